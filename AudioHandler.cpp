@@ -52,9 +52,25 @@
 void wavTrigger::start(void) {
 
 uint8_t txbuf[5];
+int i;
 
   versionRcvd = false;
   sysinfoRcvd = false;
+  totalBytesSent = 0;
+  bytesSentWindowStart = millis();
+  bytesSentThisWindow = 0;
+  bytesPerSecond = 0;
+  droppedCommands = 0;
+  mergedCommands = 0;
+  maxQueueWait = 0;
+  boardVoiceSteals = 0;
+  for (i = 0; i < WAV_TRIGGER_GAIN_CACHE_SIZE; i++) {
+    gainCacheTrack[i] = WAV_TRIGGER_GAIN_CACHE_EMPTY;
+  }
+  for (i = 0; i < WAV_TRIGGER_TX_NUM_PRIORITIES; i++) {
+    txQueueFirst[i] = 0;
+    txQueueLast[i] = 0;
+  }
   WTSerial.begin(57600);
   flush();
 
@@ -64,7 +80,7 @@ uint8_t txbuf[5];
   txbuf[2] = 0x05;
   txbuf[3] = CMD_GET_VERSION;
   txbuf[4] = EOM;
-  WTSerial.write(txbuf, 5);
+  sendFrames(txbuf, 5);
 
   // Request system info
   txbuf[0] = SOM1;
@@ -72,7 +88,7 @@ uint8_t txbuf[5];
   txbuf[2] = 0x05;
   txbuf[3] = CMD_GET_SYS_INFO;
   txbuf[4] = EOM;
-  WTSerial.write(txbuf, 5);
+  sendFrames(txbuf, 5);
 }
 
 // **************************************************************
@@ -87,6 +103,13 @@ int i;
   for (i = 0; i < MAX_NUM_VOICES; i++) {
     voiceTable[i] = 0xffff;
   }
+  for (i = 0; i < (WAV_TRIGGER_MAX_TRACKS/8); i++) {
+    trackPlayingBits[i] = 0;
+  }
+  numVoicesPlaying = 0;
+  peakVoicesPlaying = 0;
+  voiceStartsInFlight = 0;
+  voiceStopsInFlight = 0;
   while(WTSerial.available())
     /*dat = */WTSerial.read();
 }
@@ -99,6 +122,17 @@ int i;
 uint8_t dat;
 uint8_t voice;
 uint16_t track;
+unsigned long now;
+
+  now = millis();
+  if ((now - bytesSentWindowStart) >= 1000) {
+    bytesPerSecond = bytesSentThisWindow;
+    bytesSentThisWindow = 0;
+    bytesSentWindowStart = now;
+  }
+
+  // Move whatever queued commands now fit into the UART
+  drainTxQueue();
 
   rxMsgReady = false;
   while (WTSerial.available() > 0) {
@@ -148,14 +182,7 @@ uint16_t track;
           track = rxMessage[2];
           track = (track << 8) + rxMessage[1] + 1;
           voice = rxMessage[3];
-          if (voice < MAX_NUM_VOICES) {
-            if (rxMessage[4] == 0) {
-              if (track == voiceTable[voice])
-                voiceTable[voice] = 0xffff;
-            }
-            else
-              voiceTable[voice] = track;
-          }
+          handleTrackReport(track, voice, (rxMessage[4] != 0));
           // ==========================
           //Serial.print("Track ");
           //Serial.print(track);
@@ -199,18 +226,167 @@ uint16_t track;
 }
 
 // **************************************************************
-bool wavTrigger::isTrackPlaying(int trk) {
+// Keeps the voice table, the per-track bits and the voice count in
+// step with a track report, and passes on every start and the end of
+// the track's last voice (a track can be playing on more than one
+// voice, and a play on top of one that's still going is a start too)
+void wavTrigger::handleTrackReport(uint16_t track, uint8_t voice, bool playing) {
+
+uint16_t oldTrack;
+bool wasPlaying;
+
+  if (voice >= MAX_NUM_VOICES) return;
+
+  oldTrack = voiceTable[voice];
+  if (!playing) {
+    if (oldTrack != track) return;
+    voiceTable[voice] = 0xffff;
+    if (numVoicesPlaying) numVoicesPlaying -= 1;
+    if (voiceStopsInFlight) voiceStopsInFlight -= 1;
+  } else {
+    if (oldTrack == track) return;
+    voiceTable[voice] = track;
+    if (voiceStartsInFlight) voiceStartsInFlight -= 1;
+    if (oldTrack == 0xffff) {
+      numVoicesPlaying += 1;
+      if (numVoicesPlaying > peakVoicesPlaying) peakVoicesPlaying = numVoicesPlaying;
+    } else if (!isTrackOnAnyVoice(oldTrack)) {
+      // The voice was taken over without an "off" for the old track
+      // (the board stole it)
+      boardVoiceSteals += 1;
+      if (oldTrack < WAV_TRIGGER_MAX_TRACKS) trackPlayingBits[oldTrack / 8] &= ~(1 << (oldTrack % 8));
+      if (trackReportCallback) trackReportCallback(trackReportContext, oldTrack, false);
+    }
+  }
+
+  if (track >= WAV_TRIGGER_MAX_TRACKS) {
+    if (trackReportCallback && (playing || !isTrackOnAnyVoice(track))) trackReportCallback(trackReportContext, track, playing);
+    return;
+  }
+
+  wasPlaying = (trackPlayingBits[track / 8] & (1 << (track % 8))) ? true : false;
+  if (playing) trackPlayingBits[track / 8] |= (1 << (track % 8));
+  else if (!isTrackOnAnyVoice(track)) trackPlayingBits[track / 8] &= ~(1 << (track % 8));
+  else return;
+
+  if (trackReportCallback && (playing || wasPlaying)) trackReportCallback(trackReportContext, track, playing);
+}
+
+// **************************************************************
+bool wavTrigger::isTrackOnAnyVoice(uint16_t trk) {
 
 int i;
-bool fResult = false;
 
-  update();
   for (i = 0; i < MAX_NUM_VOICES; i++) {
-    if (voiceTable[i] == ((uint16_t)trk))
-      fResult = true;
+    if (voiceTable[i] == trk) return true;
   }
-  
-  return fResult;
+  return false;
+}
+
+// **************************************************************
+// Answers from the state mirrored by update() (which the owner calls
+// every loop), so this doesn't touch the serial port
+bool wavTrigger::isTrackPlaying(int trk) {
+
+  if (((uint16_t)trk) >= WAV_TRIGGER_MAX_TRACKS) return isTrackOnAnyVoice((uint16_t)trk);
+  return (trackPlayingBits[((uint16_t)trk) / 8] & (1 << (((uint16_t)trk) % 8))) ? true : false;
+}
+
+// **************************************************************
+uint8_t wavTrigger::getNumVoicesPlaying(void) {
+
+  return numVoicesPlaying;
+}
+
+// **************************************************************
+// The reported voices, plus the plays and less the stops still queued
+// or on their way, so several sounds started in one pass don't all see
+// the same count
+uint8_t wavTrigger::getNumVoicesInUse(void) {
+
+int count;
+uint8_t priority;
+uint8_t index;
+
+  expireVoiceChanges();
+  count = (int)numVoicesPlaying + voiceStartsInFlight - voiceStopsInFlight;
+  for (priority = 0; priority < WAV_TRIGGER_TX_NUM_PRIORITIES; priority++) {
+    for (index = txQueueFirst[priority]; index != txQueueLast[priority]; index = (index + 1) % WAV_TRIGGER_TX_QUEUE_SIZE) {
+      if (txQueue[priority][index].len) count += frameVoiceChange(txQueue[priority][index].data);
+    }
+  }
+  if (count < 0) return 0;
+  if (count > MAX_NUM_VOICES) return MAX_NUM_VOICES;
+  return (uint8_t)count;
+}
+
+// **************************************************************
+// +1 for a frame that takes a voice, -1 for one that frees a voice
+// that's playing (a fade that stops the track frees it later)
+int8_t wavTrigger::frameVoiceChange(const uint8_t *frame) {
+
+uint16_t trk;
+
+  if (frame[3] != CMD_TRACK_CONTROL && frame[3] != CMD_TRACK_CONTROL_EX) return 0;
+  if (frame[4] == TRK_PLAY_SOLO || frame[4] == TRK_PLAY_POLY || frame[4] == TRK_LOAD) return 1;
+  trk = (uint16_t)frame[5] | ((uint16_t)frame[6] << 8);
+  if (frame[4] == TRK_STOP && isTrackPlaying(trk)) return -1;
+  return 0;
+}
+
+// **************************************************************
+void wavTrigger::expireVoiceChanges(void) {
+
+  if ((uint16_t)((uint16_t)millis() - voiceChangeSentTime) > WAV_TRIGGER_REPORT_TIMEOUT) {
+    voiceStartsInFlight = 0;
+    voiceStopsInFlight = 0;
+  }
+}
+
+// **************************************************************
+uint8_t wavTrigger::getPeakVoicesPlaying(void) {
+
+  return peakVoicesPlaying;
+}
+
+// **************************************************************
+uint16_t wavTrigger::getVoiceTrack(uint8_t voice) {
+
+  if (voice >= MAX_NUM_VOICES) return 0xffff;
+  return voiceTable[voice];
+}
+
+// **************************************************************
+void wavTrigger::setTrackReportCallback(WavTriggerTrackReportCallback callback, void *context) {
+
+  trackReportContext = context;
+  trackReportCallback = callback;
+}
+
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+// **************************************************************
+void wavTrigger::setFrameSentCallback(WavTriggerFrameSentCallback callback, void *context) {
+
+  frameSentContext = context;
+  frameSentCallback = callback;
+}
+
+// **************************************************************
+// The next track control queued (by the very next command only) carries
+// the switch stamp to the UART. If that frame is merged into one that's
+// already pending, or dropped, the sample is lost.
+void wavTrigger::markNextTrackControl(uint32_t switchTime, uint8_t tag) {
+
+  pendingSwitchTime = switchTime;
+  pendingLatencyTag = tag;
+}
+#endif
+
+// **************************************************************
+uint8_t wavTrigger::getNumVoices(void) {
+
+  if (!sysinfoRcvd || numVoices == 0 || numVoices > MAX_NUM_VOICES) return MAX_NUM_VOICES;
+  return numVoices;
 }
 
 // **************************************************************
@@ -227,7 +403,7 @@ unsigned short vol;
   txbuf[4] = (uint8_t)vol;
   txbuf[5] = (uint8_t)(vol >> 8);
   txbuf[6] = EOM;
-  WTSerial.write(txbuf, 7);
+  sendFrames(txbuf, 7);
 }
 
 // **************************************************************
@@ -241,7 +417,7 @@ uint8_t txbuf[6];
     txbuf[3] = CMD_AMP_POWER;
     txbuf[4] = enable;
     txbuf[5] = EOM;
-    WTSerial.write(txbuf, 6);
+    sendFrames(txbuf, 6);
 }
 
 // **************************************************************
@@ -255,7 +431,7 @@ uint8_t txbuf[6];
   txbuf[3] = CMD_SET_REPORTING;
   txbuf[4] = enable;
   txbuf[5] = EOM;
-  WTSerial.write(txbuf, 6);
+  sendFrames(txbuf, 6);
 }
 
 // **************************************************************
@@ -308,21 +484,29 @@ void wavTrigger::trackPlayPoly(int trk, bool lock) {
 }
 
 // **************************************************************
-void wavTrigger::trackLoad(int trk) {
+void wavTrigger::trackLoad(int trk, uint8_t txPriority) {
   
-  trackControl(trk, TRK_LOAD);
+  trackControl(trk, TRK_LOAD, txPriority);
 }
 
 // **************************************************************
-void wavTrigger::trackLoad(int trk, bool lock) {
+void wavTrigger::trackLoad(int trk, bool lock, uint8_t txPriority) {
   
-  trackControl(trk, TRK_LOAD, lock);
+  trackControl(trk, TRK_LOAD, lock, txPriority);
 }
 
 // **************************************************************
 void wavTrigger::trackStop(int trk) {
 
-  trackControl(trk, TRK_STOP);
+  trackStop(trk, WAV_TRIGGER_TX_PRIORITY_SFX);
+}
+
+// **************************************************************
+// Anything still queued for this track is moot once it's stopped
+void wavTrigger::trackStop(int trk, uint8_t txPriority) {
+
+  cancelQueuedTrackCommands((uint16_t)trk);
+  trackControl(trk, TRK_STOP, txPriority);
 }
 
 // **************************************************************
@@ -337,6 +521,12 @@ void wavTrigger::trackResume(int trk) {
   trackControl(trk, TRK_RESUME);
 }
 
+// **************************************************************
+void wavTrigger::trackResume(int trk, uint8_t txPriority) {
+
+  trackControl(trk, TRK_RESUME, txPriority);
+}
+
 // **************************************************************
 void wavTrigger::trackLoop(int trk, bool enable) {
  
@@ -347,36 +537,39 @@ void wavTrigger::trackLoop(int trk, bool enable) {
 }
 
 // **************************************************************
-void wavTrigger::trackControl(int trk, int code) {
+void wavTrigger::trackControl(int trk, int code, uint8_t txPriority) {
   
 uint8_t txbuf[8];
 
-  txbuf[0] = SOM1;
-  txbuf[1] = SOM2;
-  txbuf[2] = 0x08;
-  txbuf[3] = CMD_TRACK_CONTROL;
-  txbuf[4] = (uint8_t)code;
-  txbuf[5] = (uint8_t)trk;
-  txbuf[6] = (uint8_t)(trk >> 8);
-  txbuf[7] = EOM;
-  WTSerial.write(txbuf, 8);
+  sendFrames(txbuf, buildTrackControl(txbuf, trk, code, false, false), txPriority);
 }
 
 // **************************************************************
-void wavTrigger::trackControl(int trk, int code, bool lock) {
+void wavTrigger::trackControl(int trk, int code, bool lock, uint8_t txPriority) {
   
 uint8_t txbuf[9];
 
+  sendFrames(txbuf, buildTrackControl(txbuf, trk, code, true, lock), txPriority);
+}
+
+// **************************************************************
+uint8_t wavTrigger::buildTrackControl(uint8_t *txbuf, int trk, int code, bool useEx, bool lock) {
+
   txbuf[0] = SOM1;
   txbuf[1] = SOM2;
-  txbuf[2] = 0x09;
-  txbuf[3] = CMD_TRACK_CONTROL_EX;
+  txbuf[3] = (useEx) ? CMD_TRACK_CONTROL_EX : CMD_TRACK_CONTROL;
   txbuf[4] = (uint8_t)code;
   txbuf[5] = (uint8_t)trk;
   txbuf[6] = (uint8_t)(trk >> 8);
+  if (!useEx) {
+    txbuf[2] = 0x08;
+    txbuf[7] = EOM;
+    return 8;
+  }
+  txbuf[2] = 0x09;
   txbuf[7] = lock;
   txbuf[8] = EOM;
-  WTSerial.write(txbuf, 9);
+  return 9;
 }
 
 // **************************************************************
@@ -389,7 +582,9 @@ uint8_t txbuf[5];
   txbuf[2] = 0x05;
   txbuf[3] = CMD_STOP_ALL;
   txbuf[4] = EOM;
-  WTSerial.write(txbuf, 5);
+  // Nothing that's still waiting to go out should play after this
+  clearTxQueue();
+  sendFrames(txbuf, 5);
 }
 
 // **************************************************************
@@ -402,13 +597,21 @@ uint8_t txbuf[5];
   txbuf[2] = 0x05;
   txbuf[3] = CMD_RESUME_ALL_SYNC;
   txbuf[4] = EOM;
-  WTSerial.write(txbuf, 5);
+  sendFrames(txbuf, 5);
 }
 
 // **************************************************************
-void wavTrigger::trackGain(int trk, int gain) {
+void wavTrigger::trackGain(int trk, int gain, uint8_t txPriority) {
 
 uint8_t txbuf[9];
+
+  setCachedGain(trk, gain);
+  sendFrames(txbuf, buildTrackGain(txbuf, trk, gain), txPriority);
+}
+
+// **************************************************************
+uint8_t wavTrigger::buildTrackGain(uint8_t *txbuf, int trk, int gain) {
+
 unsigned short vol;
 
   txbuf[0] = SOM1;
@@ -421,11 +624,51 @@ unsigned short vol;
   txbuf[6] = (uint8_t)vol;
   txbuf[7] = (uint8_t)(vol >> 8);
   txbuf[8] = EOM;
-  WTSerial.write(txbuf, 9);
+  return 9;
+}
+
+// **************************************************************
+// Plays a track with the given gain (and optionally loops it) using
+// as few frames as the protocol allows. The gain is only sent if it's 
+// different from the last gain sent for this track (the WAV Trigger 
+// keeps track gain between plays), and it's sent ahead of the play 
+// so the track doesn't start at the old level. All frames go out
+// in order from the same priority class.
+void wavTrigger::trackPlayPolyWithGain(int trk, int gain, bool lock, bool loop, uint8_t txPriority) {
+
+uint8_t txbuf[26];
+uint8_t len = 0;
+
+  if (gainChanged(trk, gain)) {
+    setCachedGain(trk, gain);
+    len += buildTrackGain(txbuf + len, trk, gain);
+  }
+  // The plain (8-byte) track control is used unless we need the lock
+  len += buildTrackControl(txbuf + len, trk, TRK_PLAY_POLY, lock, lock);
+  if (loop) len += buildTrackControl(txbuf + len, trk, TRK_LOOP_ON, false, false);
+  sendFrames(txbuf, len, txPriority);
+}
+
+// **************************************************************
+bool wavTrigger::gainChanged(int trk, int gain) {
+
+uint8_t slot = ((uint16_t)trk) % WAV_TRIGGER_GAIN_CACHE_SIZE;
+
+  if (gainCacheTrack[slot] != ((uint16_t)trk)) return true;
+  return (gainCacheValue[slot] != (int8_t)gain);
+}
+
+// **************************************************************
+void wavTrigger::setCachedGain(int trk, int gain) {
+
+uint8_t slot = ((uint16_t)trk) % WAV_TRIGGER_GAIN_CACHE_SIZE;
+
+  gainCacheTrack[slot] = (uint16_t)trk;
+  gainCacheValue[slot] = (int8_t)gain;
 }
 
 // **************************************************************
-void wavTrigger::trackFade(int trk, int gain, int time, bool stopFlag) {
+void wavTrigger::trackFade(int trk, int gain, int time, bool stopFlag, uint8_t txPriority) {
 
 uint8_t txbuf[12];
 unsigned short vol;
@@ -443,7 +686,10 @@ unsigned short vol;
   txbuf[9] = (uint8_t)(time >> 8);
   txbuf[10] = stopFlag;
   txbuf[11] = EOM;
-  WTSerial.write(txbuf, 12);
+  // The track will end up at the fade gain, so remember that (before
+  // queueing, so a dropped frame can forget it again)
+  setCachedGain(trk, gain);
+  sendFrames(txbuf, 12, txPriority);
 }
 
 // **************************************************************
@@ -460,7 +706,7 @@ unsigned short off;
   txbuf[4] = (uint8_t)off;
   txbuf[5] = (uint8_t)(off >> 8);
   txbuf[6] = EOM;
-  WTSerial.write(txbuf, 7);
+  sendFrames(txbuf, 7);
 }
 
 // **************************************************************
@@ -474,7 +720,234 @@ uint8_t txbuf[6];
   txbuf[3] = CMD_SET_TRIGGER_BANK;
   txbuf[4] = (uint8_t)bank;
   txbuf[5] = EOM;
-  WTSerial.write(txbuf, 6);
+  sendFrames(txbuf, 6);
+}
+
+// **************************************************************
+// Splits the buffer into frames (using each frame's length byte) and
+// queues them in the given priority class. A frame that only restates
+// or supersedes the one still pending for the same track is merged
+// instead of queued. If the class is full the frame is dropped rather
+// than waiting on the UART.
+void wavTrigger::sendFrames(uint8_t *txbuf, uint8_t len, uint8_t txPriority) {
+
+uint8_t *frame;
+uint8_t frameLen;
+uint8_t nextLast;
+WavTriggerFrame *txFrame;
+
+  if (txPriority >= WAV_TRIGGER_TX_NUM_PRIORITIES) txPriority = WAV_TRIGGER_TX_PRIORITY_CONTROL;
+
+  while (len >= 5) {
+    frame = txbuf;
+    frameLen = frame[2];
+    if (frameLen < 5 || frameLen > len || frameLen > WAV_TRIGGER_MAX_FRAME_LEN) break;
+    txbuf += frameLen;
+    len -= frameLen;
+
+    if (mergeFrame(frame, frameLen, txPriority)) {
+      mergedCommands += 1;
+      continue;
+    }
+
+    nextLast = (txQueueLast[txPriority] + 1) % WAV_TRIGGER_TX_QUEUE_SIZE;
+    if (nextLast == txQueueFirst[txPriority]) {
+      // We don't know if the WAV Trigger will ever see this gain
+      if (frame[3] == CMD_TRACK_VOLUME || frame[3] == CMD_TRACK_FADE) {
+        gainCacheTrack[((uint16_t)frame[4] | ((uint16_t)frame[5] << 8)) % WAV_TRIGGER_GAIN_CACHE_SIZE] = WAV_TRIGGER_GAIN_CACHE_EMPTY;
+      }
+      droppedCommands += 1;
+      continue;
+    }
+    txFrame = &txQueue[txPriority][txQueueLast[txPriority]];
+    memcpy(txFrame->data, frame, frameLen);
+    txFrame->len = frameLen;
+    txFrame->queuedTime = (uint16_t)millis();
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+    txFrame->switchTime = 0;
+    if (pendingSwitchTime && (frame[3] == CMD_TRACK_CONTROL || frame[3] == CMD_TRACK_CONTROL_EX)) {
+      txFrame->switchTime = pendingSwitchTime;
+      txFrame->latencyTag = pendingLatencyTag;
+      pendingSwitchTime = 0;
+    }
+#endif
+    txQueueLast[txPriority] = nextLast;
+  }
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  pendingSwitchTime = 0;
+#endif
+
+  drainTxQueue();
+}
+
+// **************************************************************
+// Looks back through the class for the newest pending frame on the
+// same track. A new gain (or fade) replaces a pending one of the same
+// kind, and a track control identical to the pending one is redundant.
+// Nothing is merged past a different command for the track, so the
+// order the WAV Trigger sees is unchanged.
+bool wavTrigger::mergeFrame(uint8_t *frame, uint8_t len, uint8_t txPriority) {
+
+uint8_t index;
+uint16_t trk;
+uint8_t trkOffset;
+WavTriggerFrame *txFrame;
+
+  if (frame[3] == CMD_TRACK_VOLUME || frame[3] == CMD_TRACK_FADE) trkOffset = 4;
+  else if (frame[3] == CMD_TRACK_CONTROL || frame[3] == CMD_TRACK_CONTROL_EX) trkOffset = 5;
+  else return false;
+  trk = (uint16_t)frame[trkOffset] | ((uint16_t)frame[trkOffset + 1] << 8);
+
+  index = txQueueLast[txPriority];
+  while (index != txQueueFirst[txPriority]) {
+    index = (index + WAV_TRIGGER_TX_QUEUE_SIZE - 1) % WAV_TRIGGER_TX_QUEUE_SIZE;
+    txFrame = &txQueue[txPriority][index];
+    if (txFrame->len == 0) continue;
+
+    if (txFrame->data[3] == CMD_TRACK_VOLUME || txFrame->data[3] == CMD_TRACK_FADE) {
+      if (((uint16_t)txFrame->data[4] | ((uint16_t)txFrame->data[5] << 8)) != trk) continue;
+    } else if (txFrame->data[3] == CMD_TRACK_CONTROL || txFrame->data[3] == CMD_TRACK_CONTROL_EX) {
+      if (((uint16_t)txFrame->data[5] | ((uint16_t)txFrame->data[6] << 8)) != trk) continue;
+    } else {
+      continue;
+    }
+
+    // This is the newest frame for the track
+    if (txFrame->len != len || txFrame->data[3] != frame[3]) return false;
+    if (trkOffset == 4) {
+      memcpy(txFrame->data, frame, len);
+      return true;
+    }
+    return (memcmp(txFrame->data, frame, len) == 0);
+  }
+  return false;
+}
+
+// **************************************************************
+void wavTrigger::cancelFrame(WavTriggerFrame *txFrame) {
+
+  if (txFrame->len == 0) return;
+  if (txFrame->data[3] == CMD_TRACK_VOLUME || txFrame->data[3] == CMD_TRACK_FADE) {
+    gainCacheTrack[((uint16_t)txFrame->data[4] | ((uint16_t)txFrame->data[5] << 8)) % WAV_TRIGGER_GAIN_CACHE_SIZE] = WAV_TRIGGER_GAIN_CACHE_EMPTY;
+  }
+  txFrame->len = 0;
+}
+
+// **************************************************************
+void wavTrigger::cancelQueuedTrackCommands(uint16_t trk) {
+
+uint8_t priority;
+uint8_t index;
+WavTriggerFrame *txFrame;
+
+  for (priority = 0; priority < WAV_TRIGGER_TX_NUM_PRIORITIES; priority++) {
+    for (index = txQueueFirst[priority]; index != txQueueLast[priority]; index = (index + 1) % WAV_TRIGGER_TX_QUEUE_SIZE) {
+      txFrame = &txQueue[priority][index];
+      if (txFrame->len == 0) continue;
+      if (txFrame->data[3] == CMD_TRACK_VOLUME || txFrame->data[3] == CMD_TRACK_FADE) {
+        if (((uint16_t)txFrame->data[4] | ((uint16_t)txFrame->data[5] << 8)) == trk) cancelFrame(txFrame);
+      } else if (txFrame->data[3] == CMD_TRACK_CONTROL || txFrame->data[3] == CMD_TRACK_CONTROL_EX) {
+        if (((uint16_t)txFrame->data[5] | ((uint16_t)txFrame->data[6] << 8)) == trk) cancelFrame(txFrame);
+      }
+    }
+  }
+}
+
+// **************************************************************
+void wavTrigger::clearTxQueue(void) {
+
+uint8_t priority;
+
+  for (priority = 0; priority < WAV_TRIGGER_TX_NUM_PRIORITIES; priority++) {
+    while (txQueueFirst[priority] != txQueueLast[priority]) {
+      cancelFrame(&txQueue[priority][txQueueFirst[priority]]);
+      txQueueFirst[priority] = (txQueueFirst[priority] + 1) % WAV_TRIGGER_TX_QUEUE_SIZE;
+    }
+  }
+}
+
+// **************************************************************
+// Writes whole frames, highest class first, only while the UART's
+// transmit buffer has room for them, so this never blocks. If the
+// next frame doesn't fit, lower classes wait too (otherwise a steady
+// stream of small frames could starve a larger, more important one).
+void wavTrigger::drainTxQueue(void) {
+
+int priority;
+WavTriggerFrame *txFrame;
+int8_t voiceChange;
+
+  for (priority = (WAV_TRIGGER_TX_NUM_PRIORITIES - 1); priority >= 0; priority--) {
+    while (txQueueFirst[priority] != txQueueLast[priority]) {
+      txFrame = &txQueue[priority][txQueueFirst[priority]];
+      if (txFrame->len) {
+        if (WTSerial.availableForWrite() < txFrame->len) return;
+        if ((uint16_t)((uint16_t)millis() - txFrame->queuedTime) > maxQueueWait) maxQueueWait = (uint16_t)millis() - txFrame->queuedTime;
+        voiceChange = frameVoiceChange(txFrame->data);
+        writeFrame(txFrame->data, txFrame->len);
+        if (voiceChange) {
+          expireVoiceChanges();
+          if (voiceChange > 0 && voiceStartsInFlight < MAX_NUM_VOICES) voiceStartsInFlight += 1;
+          if (voiceChange < 0 && voiceStopsInFlight < MAX_NUM_VOICES) voiceStopsInFlight += 1;
+          voiceChangeSentTime = (uint16_t)millis();
+        }
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+        if (txFrame->switchTime && frameSentCallback) {
+          // The frame is behind whatever was already in the UART's buffer
+          frameSentCallback(frameSentContext, txFrame->latencyTag, txFrame->switchTime,
+                            micros() + (uint32_t)((SERIAL_TX_BUFFER_SIZE - 1) - WTSerial.availableForWrite()) * WAV_TRIGGER_BYTE_MICROS);
+        }
+#endif
+        txFrame->len = 0;
+      }
+      txQueueFirst[priority] = (txQueueFirst[priority] + 1) % WAV_TRIGGER_TX_QUEUE_SIZE;
+    }
+  }
+}
+
+// **************************************************************
+void wavTrigger::writeFrame(uint8_t *frame, uint8_t len) {
+
+  WTSerial.write(frame, len);
+  totalBytesSent += len;
+  bytesSentThisWindow += len;
+}
+
+// **************************************************************
+unsigned short wavTrigger::getBytesPerSecond(void) {
+
+  return bytesPerSecond;
+}
+
+// **************************************************************
+unsigned long wavTrigger::getTotalBytesSent(void) {
+
+  return totalBytesSent;
+}
+
+// **************************************************************
+unsigned short wavTrigger::getDroppedCommands(void) {
+
+  return droppedCommands;
+}
+
+// **************************************************************
+unsigned short wavTrigger::getMergedCommands(void) {
+
+  return mergedCommands;
+}
+
+// **************************************************************
+// Longest time (ms) a frame has waited in the queue for room in the UART
+unsigned short wavTrigger::getMaxQueueWait(void) {
+
+  return maxQueueWait;
+}
+
+// **************************************************************
+unsigned short wavTrigger::getBoardVoiceSteals(void) {
+
+  return boardVoiceSteals;
 }
 
 #endif
@@ -487,6 +960,7 @@ AudioHandler::AudioHandler() {
   soundFXGain = 0;
   notificationsGain = 0;
   musicGain = 0;
+  soundQueueOverflows = 0;
   ClearSoundQueue();
   ClearSoundCardQueue();
   ClearNotificationStack();
@@ -496,13 +970,42 @@ AudioHandler::AudioHandler() {
   backgroundSongEndTime = 0;
   nextVoiceNotificationPlayTime = 0;
   
-  voiceNotificationStackFirst = 0;
-  voiceNotificationStackLast = 0;
+  voiceNotificationsDropped = 0;
   currentNotificationPriority = 0;
   currentNotificationPlaying = INVALID_SOUND_INDEX;
-  ducking = 20;
+  currentNotificationStarted = false;
+  currentNotificationEnded = false;
+  backgroundTrackStarted = false;
+  backgroundTrackEnded = false;
+  for (int count=0; count<MUSIC_DUCK_PRIORITY_LEVELS; count++) duckingByPriority[count] = 20;
+  musicGainSent = 0;
+  musicDuckReleaseTime = 0;
+  sfxRetriggersSkipped = 0;
+  sfxVoicesStolen = 0;
+  for (int count=0; count<MAX_NUM_VOICES; count++) activeVoices[count].voiceClass = AUDIO_VOICE_CLASS_NONE;
+  for (int count=0; count<AUDIO_PRELOAD_SLOTS; count++) {
+    preloadedTracks[count] = INVALID_SOUND_INDEX;
+    preloadedOnVoice[count] = false;
+  }
+  latencyTrack = INVALID_SOUND_INDEX;
+  for (int count=0; count<2; count++) {
+    triggerLatency[count] = 0;
+    maxTriggerLatency[count] = 0;
+  }
+#if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
+  wTrig.setTrackReportCallback(TrackReportCallback, this);
+#endif
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  ClearSwitchLatencyStats();
+  queuedSoundSwitchTime = 0;
+#if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
+  wTrig.setFrameSentCallback(FrameSentCallback, this);
+#endif
+#endif
 
-  for (int count=0; count<NUMBER_OF_SONGS_REMEMBERED; count++) lastSongsPlayed[count] = BACKGROUND_TRACK_NONE;
+  curSoundtrackWeights = NULL;
+  soundtrackWeightsScaled = false;
+  ResetSoundtrackBag();
 
   InitSoundEffectQueue();
 }
@@ -560,7 +1063,12 @@ void AudioHandler::SetMusicVolume(byte s_volume) {
 }
 
 void AudioHandler::SetMusicDuckingGain(byte s_ducking) {
-  ducking = s_ducking;
+  for (int count=0; count<MUSIC_DUCK_PRIORITY_LEVELS; count++) duckingByPriority[count] = s_ducking;
+}
+
+void AudioHandler::SetMusicDuckingGain(byte s_ducking, byte priority) {
+  if (priority>=MUSIC_DUCK_PRIORITY_LEVELS) priority = MUSIC_DUCK_PRIORITY_LEVELS-1;
+  duckingByPriority[priority] = s_ducking;
 }
 
 
@@ -568,6 +1076,7 @@ void AudioHandler::SetMusicDuckingGain(byte s_ducking) {
 boolean AudioHandler::StopSound(unsigned short soundIndex) {
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
   wTrig.trackStop(soundIndex);
+  RemoveActiveVoice(soundIndex);
 #else
   (void)soundIndex;
 #endif
@@ -577,7 +1086,8 @@ boolean AudioHandler::StopSound(unsigned short soundIndex) {
 boolean AudioHandler::StopAllMusic() {
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
   if (currentBackgroundTrack!=BACKGROUND_TRACK_NONE) {
-    wTrig.trackStop(currentBackgroundTrack);
+    wTrig.trackStop(currentBackgroundTrack, WAV_TRIGGER_TX_PRIORITY_MUSIC);
+    RemoveActiveVoice(currentBackgroundTrack);
     currentBackgroundTrack = BACKGROUND_TRACK_NONE;
     return true;
   }
@@ -590,25 +1100,20 @@ boolean AudioHandler::StopAllMusic() {
 
 void AudioHandler::ClearNotificationStack(byte priority) {
   if (priority==10) {
-    voiceNotificationStackFirst = 0;
-    voiceNotificationStackLast = 0;
-    for (byte count=0; count<VOICE_NOTIFICATION_STACK_SIZE; count++) {
-      voiceNotificationNumStack[count] = VOICE_NOTIFICATION_STACK_EMPTY;
-      voiceNotificationDuration[count] = 0;
-      voiceNotificationPriorityStack[count] = 0;
+    numVoiceNotificationsQueued = 0;
+    return;
+  }
 
+  // Keep the entries above this priority and re-heap them
+  byte numKept = 0;
+  for (byte count=0; count<numVoiceNotificationsQueued; count++) {
+    if (voiceNotificationStack[count].priority>priority) {
+      voiceNotificationStack[numKept] = voiceNotificationStack[count];
+      numKept += 1;
     }
-  } else {
-    byte tempFirst = voiceNotificationStackFirst;
-    byte tempLast = voiceNotificationStackLast;
-    while (tempFirst != tempLast) {
-      if (voiceNotificationPriorityStack[tempFirst]<=priority) {
-        voiceNotificationNumStack[tempFirst] = INVALID_SOUND_INDEX;
-      }
-      tempFirst += 1;
-      if (tempFirst >= VOICE_NOTIFICATION_STACK_SIZE) tempFirst = 0;
-    }    
   }
+  numVoiceNotificationsQueued = numKept;
+  for (byte count=numKept/2; count>0; count--) SiftDownNotification(count-1);
 }
 
 
@@ -617,7 +1122,7 @@ boolean AudioHandler::StopCurrentNotification(byte priority) {
 
   if (currentNotificationPlaying!=INVALID_SOUND_INDEX && currentNotificationPriority<=priority) {
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
-    wTrig.trackStop(currentNotificationPlaying);
+    wTrig.trackStop(currentNotificationPlaying, WAV_TRIGGER_TX_PRIORITY_VOICE);
 #endif
 //    currentNotificationPlaying = INVALID_SOUND_INDEX;
     nextVoiceNotificationPlayTime = 1;
@@ -629,49 +1134,99 @@ boolean AudioHandler::StopCurrentNotification(byte priority) {
 
 
 int AudioHandler::SpaceLeftOnNotificationStack() {
-  if (voiceNotificationStackFirst>=VOICE_NOTIFICATION_STACK_SIZE || voiceNotificationStackLast>=VOICE_NOTIFICATION_STACK_SIZE) return 0;
-  if (voiceNotificationStackLast>=voiceNotificationStackFirst) return ((VOICE_NOTIFICATION_STACK_SIZE-1) - (voiceNotificationStackLast-voiceNotificationStackFirst));
-  return (voiceNotificationStackFirst - voiceNotificationStackLast) - 1;
+  return VOICE_NOTIFICATION_STACK_SIZE - numVoiceNotificationsQueued;
 }
 
 
-void AudioHandler::PushToNotificationStack(unsigned int notification, unsigned int duration, byte priority) {
-  // If the switch stack last index is out of range, then it's an error - return
-  if (SpaceLeftOnNotificationStack() == 0) return;
+// Higher priority goes first, and then whichever was queued first
+boolean AudioHandler::NotificationGoesFirst(VoiceNotificationEntry *entry1, VoiceNotificationEntry *entry2) {
+  if (entry1->priority!=entry2->priority) return (entry1->priority>entry2->priority);
+  return ((long)(entry1->queueTime-entry2->queueTime)<0);
+}
 
-  voiceNotificationNumStack[voiceNotificationStackLast] = notification;
-  voiceNotificationDuration[voiceNotificationStackLast] = duration;
-  voiceNotificationPriorityStack[voiceNotificationStackLast] = priority;
 
-  voiceNotificationStackLast += 1;
-  if (voiceNotificationStackLast >= VOICE_NOTIFICATION_STACK_SIZE) {
-    // If the end index is off the end, then wrap
-    voiceNotificationStackLast = 0;
+void AudioHandler::SiftUpNotification(byte index) {
+  VoiceNotificationEntry entry = voiceNotificationStack[index];
+  while (index>0) {
+    byte parent = (index-1)/2;
+    if (!NotificationGoesFirst(&entry, &voiceNotificationStack[parent])) break;
+    voiceNotificationStack[index] = voiceNotificationStack[parent];
+    index = parent;
   }
+  voiceNotificationStack[index] = entry;
 }
 
 
+void AudioHandler::SiftDownNotification(byte index) {
+  VoiceNotificationEntry entry = voiceNotificationStack[index];
+  while (1) {
+    byte child = index*2 + 1;
+    if (child>=numVoiceNotificationsQueued) break;
+    if ((child+1)<numVoiceNotificationsQueued && NotificationGoesFirst(&voiceNotificationStack[child+1], &voiceNotificationStack[child])) child += 1;
+    if (!NotificationGoesFirst(&voiceNotificationStack[child], &entry)) break;
+    voiceNotificationStack[index] = voiceNotificationStack[child];
+    index = child;
+  }
+  voiceNotificationStack[index] = entry;
+}
+
+
+void AudioHandler::PushToNotificationStack(unsigned int notification, unsigned int duration, byte priority, unsigned long currentTime, unsigned short expiry) {
+  VoiceNotificationEntry newEntry;
+  newEntry.soundIndex = notification;
+  newEntry.duration = duration;
+  newEntry.priority = priority;
+  newEntry.queueTime = currentTime;
+  newEntry.expireTime = expiry ? (currentTime + expiry) : 0;
+  if (newEntry.expireTime==0 && expiry) newEntry.expireTime = 1;
+
+  // If it's already waiting, the pending one takes the higher priority
+  // and the later expiry (but keeps its place in line)
+  for (byte count=0; count<numVoiceNotificationsQueued; count++) {
+    VoiceNotificationEntry *pending = &voiceNotificationStack[count];
+    if (pending->soundIndex!=notification) continue;
+    if (pending->expireTime!=0 && (newEntry.expireTime==0 || (long)(newEntry.expireTime-pending->expireTime)>0)) pending->expireTime = newEntry.expireTime;
+    if (priority>pending->priority) {
+      pending->priority = priority;
+      SiftUpNotification(count);
+    }
+    return;
+  }
 
-byte AudioHandler::GetTopNotificationPriority() {
-  byte startStack = voiceNotificationStackFirst;
-  byte endStack = voiceNotificationStackLast;
-  if (startStack==endStack) return 0;
-
-  byte topPriorityFound = 0;
+  if (numVoiceNotificationsQueued<VOICE_NOTIFICATION_STACK_SIZE) {
+    voiceNotificationStack[numVoiceNotificationsQueued] = newEntry;
+    numVoiceNotificationsQueued += 1;
+    SiftUpNotification(numVoiceNotificationsQueued-1);
+    return;
+  }
 
-  while (startStack!=endStack) {
-    if (voiceNotificationPriorityStack[startStack]>topPriorityFound) topPriorityFound = voiceNotificationPriorityStack[startStack];
-    startStack += 1;
-    if (startStack >= VOICE_NOTIFICATION_STACK_SIZE) startStack = 0;
+  // Full -- the last in line (which is one of the leaves) makes way
+  // if the new one outranks it, otherwise the new one is dropped
+  voiceNotificationsDropped += 1;
+  byte last = numVoiceNotificationsQueued/2;
+  for (byte count=last+1; count<numVoiceNotificationsQueued; count++) {
+    if (NotificationGoesFirst(&voiceNotificationStack[last], &voiceNotificationStack[count])) last = count;
   }
+  if (!NotificationGoesFirst(&newEntry, &voiceNotificationStack[last])) return;
+  voiceNotificationStack[last] = newEntry;
+  SiftUpNotification(last);
+}
+
 
-  return topPriorityFound;
+byte AudioHandler::GetTopNotificationPriority() {
+  if (numVoiceNotificationsQueued==0) return 0;
+  return voiceNotificationStack[0].priority;
+}
+
+
+unsigned short AudioHandler::GetNotificationsDropped() {
+  return voiceNotificationsDropped;
 }
 
 
 
 
-boolean AudioHandler::QueuePrioritizedNotification(unsigned short notificationIndex, unsigned short notificationLength, byte priority, unsigned long currentTime) {
+boolean AudioHandler::QueuePrioritizedNotification(unsigned short notificationIndex, unsigned short notificationLength, byte priority, unsigned long currentTime, unsigned short expiry) {
 #if defined (RPU_OS_USE_WAV_TRIGGER) || defined (RPU_OS_USE_WAV_TRIGGER_1p3)
   // if everything on the queue has a lower priority, kill all those
   byte topQueuePriority = GetTopNotificationPriority();
@@ -681,20 +1236,25 @@ boolean AudioHandler::QueuePrioritizedNotification(unsigned short notificationIn
 
   // If there's nothing playing, we can play it now
   if (currentNotificationPlaying == INVALID_SOUND_INDEX) {
-    if (currentBackgroundTrack != BACKGROUND_TRACK_NONE) {
-      wTrig.trackFade(currentBackgroundTrack, musicGain - ducking, 500, 0);
-    }
     if (notificationLength) nextVoiceNotificationPlayTime = currentTime + (unsigned long)(notificationLength);
     else nextVoiceNotificationPlayTime = 0;
 
-    wTrig.trackPlayPoly(notificationIndex);
-    wTrig.trackGain(notificationIndex, notificationsGain);
+    if (!ResumePreloadedTrack(notificationIndex, WAV_TRIGGER_TX_PRIORITY_VOICE)) {
+      wTrig.trackPlayPolyWithGain(notificationIndex, notificationsGain, false, false, WAV_TRIGGER_TX_PRIORITY_VOICE);
+      StartTriggerLatency(notificationIndex, false);
+    }
+    AddActiveVoice(notificationIndex, AUDIO_VOICE_CLASS_CALLOUT, priority);
     currentNotificationStartTime = currentTime;
+    currentNotificationStarted = false;
+    currentNotificationEnded = false;
+    // A preloaded callout may have been reported when it was loaded
+    if (wTrig.isTrackPlaying(notificationIndex)) currentNotificationStarted = true;
     
     currentNotificationPlaying = notificationIndex;
     currentNotificationPriority = priority;
+    ServiceMusicDucking(currentTime);
   } else {
-    PushToNotificationStack(notificationIndex, notificationLength, priority);
+    PushToNotificationStack(notificationIndex, notificationLength, priority, currentTime, expiry);
   }
 #else
   // Phony stuff to get rid of warnings
@@ -702,6 +1262,7 @@ boolean AudioHandler::QueuePrioritizedNotification(unsigned short notificationIn
   (void)notificationLength;
   (void)priority;
   (void)currentTime;
+  (void)expiry;
 #endif
 
   return true;
@@ -717,10 +1278,12 @@ void AudioHandler::OutputTracksPlaying() {
   Serial.write("Version: ");
   Serial.write(buf);
   Serial.write("\n");
-  for (i=0; i<1000; i++) {
-  
-    if (wTrig.isTrackPlaying(i)) {
-      sprintf(buf, "Track %d playing\n", i);
+  sprintf(buf, "%d voices playing (peak %d)\n", wTrig.getNumVoicesPlaying(), wTrig.getPeakVoicesPlaying());
+  Serial.write(buf);
+  // Only the voices can be playing something
+  for (i=0; i<MAX_NUM_VOICES; i++) {
+    if (wTrig.getVoiceTrack(i)!=0xffff) {
+      sprintf(buf, "Track %u playing on voice %d\n", wTrig.getVoiceTrack(i), i);
       Serial.write(buf);
     }
   }
@@ -728,6 +1291,176 @@ void AudioHandler::OutputTracksPlaying() {
 }
 
 
+void AudioHandler::OutputAudioStats() {
+  char buf[128];
+#if defined (RPU_OS_USE_WAV_TRIGGER) || defined (RPU_OS_USE_WAV_TRIGGER_1p3)
+  // At 57600 baud (8N1) each byte takes ~174us on the wire
+  sprintf(buf, "WAV Trigger: %lu bytes sent, %u bytes/s (wire time %lu ms)\n", wTrig.getTotalBytesSent(), wTrig.getBytesPerSecond(), (wTrig.getTotalBytesSent()*100)/576);
+  Serial.write(buf);
+  sprintf(buf, "  commands: %u merged, %u dropped, max queue wait %u ms\n", wTrig.getMergedCommands(), wTrig.getDroppedCommands(), wTrig.getMaxQueueWait());
+  Serial.write(buf);
+  sprintf(buf, "  voices: %d playing, peak %d, board steals %u, our steals %u\n", wTrig.getNumVoicesPlaying(), wTrig.getPeakVoicesPlaying(), wTrig.getBoardVoiceSteals(), sfxVoicesStolen);
+  Serial.write(buf);
+  sprintf(buf, "  trigger latency: cold %u ms (max %u), preloaded %u ms (max %u)\n", triggerLatency[0], maxTriggerLatency[0], triggerLatency[1], maxTriggerLatency[1]);
+  Serial.write(buf);
+#endif
+  sprintf(buf, "  SFX retriggers skipped %u, sound queue overflows %u, callouts dropped %u\n", sfxRetriggersSkipped, soundQueueOverflows, voiceNotificationsDropped);
+  Serial.write(buf);
+  if (soundtrackWeightsScaled) {
+    sprintf(buf, "  soundtrack weights scaled down to fit the %d-song bag (SOUNDTRACK_BAG_SIZE)\n", SOUNDTRACK_BAG_SIZE);
+    Serial.write(buf);
+  }
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  OutputSwitchLatencyStats();
+#endif
+}
+
+
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+void AudioHandler::OutputSwitchLatencyStats() {
+  char buf[128];
+  Serial.write("Switch to sound latency (us):\n");
+  for (byte count=0; count<numSwitchLatencySlots; count++) {
+    sprintf(buf, "  %s %u: n=%u p50<%lu p90<%lu p99<%lu max %lu\n", (switchLatency[count].audioType==AUDIO_PLAY_TYPE_WAV_TRIGGER)?"WAV":"SB",
+      switchLatency[count].soundIndex, switchLatency[count].numSamples, GetSwitchLatencyPercentile(count, 50),
+      GetSwitchLatencyPercentile(count, 90), GetSwitchLatencyPercentile(count, 99), switchLatency[count].maxLatency);
+    Serial.write(buf);
+  }
+}
+
+
+void AudioHandler::ClearSwitchLatencyStats() {
+  numSwitchLatencySlots = 0;
+}
+
+
+void AudioHandler::FrameSentCallback(void *context, uint8_t tag, uint32_t switchTime, uint32_t sentTime) {
+  ((AudioHandler *)context)->RecordSwitchLatency(tag, sentTime - switchTime);
+}
+
+
+// A sound started straight from a switch handler uses the stamp of the
+// switch being handled. One that went through the sound queue carries
+// the stamp it had when it was queued.
+unsigned long AudioHandler::GetSwitchTimeForSound() {
+  if (queuedSoundSwitchTime) return queuedSoundSwitchTime;
+  return RPU_GetCurrentSwitchTime();
+}
+
+
+// Effects get a slot the first time they're heard after a switch, and
+// once the slots are used up any other effects aren't measured
+byte AudioHandler::GetSwitchLatencySlot(unsigned short soundIndex, byte audioType) {
+  for (byte count=0; count<numSwitchLatencySlots; count++) {
+    if (switchLatency[count].soundIndex==soundIndex && switchLatency[count].audioType==audioType) return count;
+  }
+  if (numSwitchLatencySlots>=AUDIO_LATENCY_EFFECT_SLOTS) return AUDIO_LATENCY_NO_SLOT;
+
+  AudioLatencyHistogram *histogram = &switchLatency[numSwitchLatencySlots];
+  histogram->soundIndex = soundIndex;
+  histogram->audioType = audioType;
+  histogram->numSamples = 0;
+  histogram->maxLatency = 0;
+  for (byte count=0; count<AUDIO_LATENCY_BINS; count++) histogram->bins[count] = 0;
+  numSwitchLatencySlots += 1;
+  return numSwitchLatencySlots-1;
+}
+
+
+// Bins 0 & 1 are [0,128) and [128,256), then each doubling is split in
+// two: [256,384), [384,512), [512,768), [768,1024) and so on. The last
+// bin holds everything past its lower edge.
+void AudioHandler::RecordSwitchLatency(byte slot, unsigned long latency) {
+  if (slot>=numSwitchLatencySlots) return;
+  AudioLatencyHistogram *histogram = &switchLatency[slot];
+
+  unsigned long units = latency>>7;
+  byte bin = (byte)units;
+  if (units>=2) {
+    bin = 2;
+    while (units>=4) {
+      units = units>>1;
+      bin += 2;
+    }
+    bin += (byte)(units-2);
+  }
+  if (bin>=AUDIO_LATENCY_BINS) bin = AUDIO_LATENCY_BINS-1;
+
+  if (histogram->numSamples==0xFFFF) return;
+  histogram->numSamples += 1;
+  histogram->bins[bin] += 1;
+  if (latency>histogram->maxLatency) histogram->maxLatency = latency;
+}
+
+
+// Returns the upper edge of the bin the percentile falls in (or the
+// max seen if it's in the last bin)
+unsigned long AudioHandler::GetSwitchLatencyPercentile(byte slot, byte percentile) {
+  if (slot>=numSwitchLatencySlots) return 0;
+  AudioLatencyHistogram *histogram = &switchLatency[slot];
+  if (histogram->numSamples==0) return 0;
+
+  unsigned long rank = ((unsigned long)histogram->numSamples*percentile + 99)/100;
+  unsigned long samplesSeen = 0;
+  for (byte bin=0; bin<(AUDIO_LATENCY_BINS-1); bin++) {
+    samplesSeen += histogram->bins[bin];
+    if (samplesSeen>=rank) {
+      unsigned long upperEdge;
+      if (bin<2) upperEdge = (unsigned long)(bin+1);
+      else if (bin&1) upperEdge = 1UL<<(bin/2 + 1);
+      else upperEdge = 3UL<<(bin/2 - 1);
+      upperEdge = upperEdge<<7;
+      if (upperEdge>histogram->maxLatency) upperEdge = histogram->maxLatency;
+      return upperEdge;
+    }
+  }
+  return histogram->maxLatency;
+}
+#endif
+
+
+void AudioHandler::TrackReportCallback(void *context, uint16_t trk, bool playing) {
+  ((AudioHandler *)context)->HandleTrackReport(trk, playing);
+}
+
+
+// Track reports arrive from inside wTrig.update(), so this only notes
+// what happened and the service functions act on it
+void AudioHandler::HandleTrackReport(unsigned short trk, boolean playing) {
+  if (trk==currentNotificationPlaying) {
+    if (playing) currentNotificationStarted = true;
+    else currentNotificationEnded = true;
+  }
+  if (trk==currentBackgroundTrack) {
+    if (playing) backgroundTrackStarted = true;
+    else backgroundTrackEnded = true;
+  }
+  if (!playing) RemoveActiveVoice(trk);
+  for (byte count=0; count<AUDIO_PRELOAD_SLOTS; count++) {
+    if (preloadedTracks[count]!=trk) continue;
+    // A preload that stops (or has its voice stolen) is gone
+    if (playing) preloadedOnVoice[count] = true;
+    else preloadedTracks[count] = INVALID_SOUND_INDEX;
+  }
+  if (playing && trk==latencyTrack) {
+    unsigned long latency = millis() - latencyStartTime;
+    if (latency>0xFFFF) latency = 0xFFFF;
+    triggerLatency[latencyPreloaded?1:0] = (unsigned short)latency;
+    if (latency>maxTriggerLatency[latencyPreloaded?1:0]) maxTriggerLatency[latencyPreloaded?1:0] = (unsigned short)latency;
+    latencyTrack = INVALID_SOUND_INDEX;
+  }
+}
+
+
+byte AudioHandler::GetWAVTriggerVoicesPlaying() {
+#if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
+  return wTrig.getNumVoicesPlaying();
+#else
+  return 0;
+#endif
+}
+
+
 boolean AudioHandler::ServiceNotificationQueue(unsigned long currentTime) {
   boolean queueStillHasEntries = true;
 #if defined (RPU_OS_USE_WAV_TRIGGER) || defined (RPU_OS_USE_WAV_TRIGGER_1p3)
@@ -737,10 +1470,12 @@ boolean AudioHandler::ServiceNotificationQueue(unsigned long currentTime) {
     if (currentTime > nextVoiceNotificationPlayTime) {
       playNextNotification = true;
     }
-  } else {
-    if (currentNotificationPlaying!=INVALID_SOUND_INDEX && !wTrig.isTrackPlaying(currentNotificationPlaying)) { 
-      if (currentTime>(currentNotificationStartTime+100)) playNextNotification = true;
-    }
+  } else if (currentNotificationPlaying!=INVALID_SOUND_INDEX) {
+    // The WAV Trigger tells us when the callout is over. If it never
+    // reported it starting (reporting off, or a missing track) then
+    // don't wait for it.
+    if (currentNotificationEnded) playNextNotification = true;
+    else if (!currentNotificationStarted && (currentTime-currentNotificationStartTime)>VOICE_NOTIFICATION_REPORT_TIMEOUT) playNextNotification = true;
   }
   
   if (playNextNotification) {
@@ -748,34 +1483,46 @@ boolean AudioHandler::ServiceNotificationQueue(unsigned long currentTime) {
     unsigned int nextNotification = VOICE_NOTIFICATION_STACK_EMPTY;
     unsigned int nextDuration = 0;
 
-    // Current notification done, see if there's another
-    if (voiceNotificationStackLast>=VOICE_NOTIFICATION_STACK_SIZE) voiceNotificationStackLast = (VOICE_NOTIFICATION_STACK_SIZE-1);
-    while (voiceNotificationStackFirst != voiceNotificationStackLast) {
-      nextPriority = voiceNotificationPriorityStack[voiceNotificationStackFirst];
-      nextNotification = voiceNotificationNumStack[voiceNotificationStackFirst];
-      nextDuration = voiceNotificationDuration[voiceNotificationStackFirst];
+    // Current notification done, see if there's another (one that's
+    // waited past its expiry isn't worth playing now)
+    while (numVoiceNotificationsQueued) {
+      VoiceNotificationEntry *top = &voiceNotificationStack[0];
+      boolean expired = (top->expireTime!=0 && (long)(currentTime-top->expireTime)>0);
+      if (!expired) {
+        nextPriority = top->priority;
+        nextNotification = top->soundIndex;
+        nextDuration = top->duration;
+      } else {
+        voiceNotificationsDropped += 1;
+      }
 
-      voiceNotificationStackFirst += 1;
-      if (voiceNotificationStackFirst >= VOICE_NOTIFICATION_STACK_SIZE) voiceNotificationStackFirst = 0;
-      if (nextNotification!=INVALID_SOUND_INDEX) break;
+      numVoiceNotificationsQueued -= 1;
+      if (numVoiceNotificationsQueued) {
+        voiceNotificationStack[0] = voiceNotificationStack[numVoiceNotificationsQueued];
+        SiftDownNotification(0);
+      }
+      if (!expired) break;
     }
 
     if (nextNotification != VOICE_NOTIFICATION_STACK_EMPTY) {
-      if (currentBackgroundTrack != BACKGROUND_TRACK_NONE) {
-        wTrig.trackFade(currentBackgroundTrack, musicGain - ducking, 500, 0);
-      }
       if (nextDuration!=0) nextVoiceNotificationPlayTime = currentTime + (unsigned long)(nextDuration);
       else nextVoiceNotificationPlayTime = 0;
-      wTrig.trackPlayPoly(nextNotification);
-      wTrig.trackGain(nextNotification, notificationsGain);
+      if (!ResumePreloadedTrack(nextNotification, WAV_TRIGGER_TX_PRIORITY_VOICE)) {
+        wTrig.trackPlayPolyWithGain(nextNotification, notificationsGain, false, false, WAV_TRIGGER_TX_PRIORITY_VOICE);
+        StartTriggerLatency(nextNotification, false);
+      }
+      AddActiveVoice(nextNotification, AUDIO_VOICE_CLASS_CALLOUT, nextPriority);
       currentNotificationStartTime = currentTime;
+      currentNotificationStarted = false;
+      currentNotificationEnded = false;
+      // A preloaded callout may have been reported when it was loaded,
+      // and one still sounding from an earlier play is audible already
+      if (wTrig.isTrackPlaying(nextNotification)) currentNotificationStarted = true;
       currentNotificationPlaying = nextNotification;
       currentNotificationPriority = nextPriority;
     } else {
-      // No more notifications -- set the volume back up and clear the variable
-      if (currentBackgroundTrack != BACKGROUND_TRACK_NONE) {
-        wTrig.trackFade(currentBackgroundTrack, musicGain, 1500, 0);
-      }
+      // No more notifications -- clear the variable (the music
+      // comes back up in ServiceMusicDucking)
       nextVoiceNotificationPlayTime = 0;
       currentNotificationPlaying = INVALID_SOUND_INDEX;
       currentNotificationPriority = 0;
@@ -792,6 +1539,33 @@ boolean AudioHandler::ServiceNotificationQueue(unsigned long currentTime) {
 
 
 
+// The music target is the ducked gain while a callout plays (attack),
+// stays there for MUSIC_DUCK_HOLD_MS after it ends (hold) and then goes
+// back to musicGain (release). Chained callouts, or a volume change,
+// only cost a fade when the target actually moves.
+void AudioHandler::ServiceMusicDucking(unsigned long currentTime) {
+#if defined (RPU_OS_USE_WAV_TRIGGER) || defined (RPU_OS_USE_WAV_TRIGGER_1p3)
+  if (currentBackgroundTrack==BACKGROUND_TRACK_NONE) return;
+
+  int targetGain = musicGain;
+  if (currentNotificationPlaying!=INVALID_SOUND_INDEX) {
+    byte priority = currentNotificationPriority;
+    if (priority>=MUSIC_DUCK_PRIORITY_LEVELS) priority = MUSIC_DUCK_PRIORITY_LEVELS-1;
+    targetGain = musicGain - duckingByPriority[priority];
+    musicDuckReleaseTime = currentTime + MUSIC_DUCK_HOLD_MS;
+  } else if (musicGainSent<musicGain && (long)(currentTime-musicDuckReleaseTime)<0) {
+    return;
+  }
+
+  if (targetGain==musicGainSent) return;
+  wTrig.trackFade(currentBackgroundTrack, targetGain, (targetGain<musicGainSent) ? MUSIC_DUCK_ATTACK_MS : MUSIC_DUCK_RELEASE_MS, 0, WAV_TRIGGER_TX_PRIORITY_MUSIC);
+  musicGainSent = targetGain;
+#else
+  (void)currentTime;
+#endif
+}
+
+
 boolean AudioHandler::StopAllNotifications(byte priority) {
   ClearNotificationStack(priority);
   return StopCurrentNotification(priority);
@@ -801,6 +1575,8 @@ boolean AudioHandler::StopAllSoundFX() {
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
   wTrig.stopAllTracks();
 #endif
+  for (int count=0; count<MAX_NUM_VOICES; count++) activeVoices[count].voiceClass = AUDIO_VOICE_CLASS_NONE;
+  for (int count=0; count<AUDIO_PRELOAD_SLOTS; count++) preloadedTracks[count] = INVALID_SOUND_INDEX;
   ClearSoundCardQueue();
   ClearSoundQueue();
   return false;
@@ -848,13 +1624,203 @@ void AudioHandler::ClearSoundCardQueue() {
 
 
 void AudioHandler::ClearSoundQueue() {
-  for (int count=0; count<SOUND_QUEUE_SIZE; count++) {
-    soundQueue[count].playTime = 0;
+  numSoundsQueued = 0;
+  currentSequence = NULL;
+}
+
+
+void AudioHandler::AddActiveVoice(unsigned short trackIndex, byte voiceClass, byte priority) {
+  byte slot = MAX_NUM_VOICES;
+  byte oldestSFX = MAX_NUM_VOICES;
+
+  for (byte count=0; count<MAX_NUM_VOICES; count++) {
+    if (activeVoices[count].voiceClass==AUDIO_VOICE_CLASS_NONE) {
+      slot = count;
+      break;
+    }
+    if (activeVoices[count].voiceClass==AUDIO_VOICE_CLASS_SFX) {
+      if (oldestSFX==MAX_NUM_VOICES || (long)(activeVoices[count].startTime-activeVoices[oldestSFX].startTime)<0) oldestSFX = count;
+    }
+  }
+  // Without track reports entries are never freed, so reuse the oldest SFX
+  if (slot==MAX_NUM_VOICES) slot = oldestSFX;
+  if (slot==MAX_NUM_VOICES) return;
+
+  activeVoices[slot].trackIndex = trackIndex;
+  activeVoices[slot].voiceClass = voiceClass;
+  activeVoices[slot].priority = priority;
+  activeVoices[slot].startTime = millis();
+}
+
+
+void AudioHandler::RemoveActiveVoice(unsigned short trackIndex) {
+  for (byte count=0; count<MAX_NUM_VOICES; count++) {
+    if (activeVoices[count].trackIndex==trackIndex) activeVoices[count].voiceClass = AUDIO_VOICE_CLASS_NONE;
+  }
+}
+
+
+// If all of the WAV Trigger's voices are in use (reported, or about to
+// be), stop the oldest of the lowest-priority SFX to make room. Music
+// and callouts are never stolen, and neither is an SFX more important
+// than the new one (in those cases the new SFX isn't played).
+boolean AudioHandler::MakeRoomForSFX(byte priority) {
+#if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
+  if (wTrig.getNumVoicesInUse() < wTrig.getNumVoices()) return true;
+
+  byte victim = MAX_NUM_VOICES;
+  for (byte count=0; count<MAX_NUM_VOICES; count++) {
+    if (activeVoices[count].voiceClass!=AUDIO_VOICE_CLASS_SFX) continue;
+    if (!wTrig.isTrackPlaying(activeVoices[count].trackIndex)) continue;
+    if (victim==MAX_NUM_VOICES || activeVoices[count].priority<activeVoices[victim].priority) {
+      victim = count;
+    } else if (activeVoices[count].priority==activeVoices[victim].priority && (long)(activeVoices[count].startTime-activeVoices[victim].startTime)<0) {
+      victim = count;
+    }
+  }
+
+  if (victim==MAX_NUM_VOICES || activeVoices[victim].priority>priority) return false;
+
+  // (ahead of anything queued, so the voice is free before the new
+  // SFX goes out, and without taking up room in the SFX class)
+  wTrig.trackStop(activeVoices[victim].trackIndex, WAV_TRIGGER_TX_PRIORITY_CONTROL);
+  RemoveActiveVoice(activeVoices[victim].trackIndex);
+  sfxVoicesStolen += 1;
+#else
+  (void)priority;
+#endif
+  return true;
+}
+
+
+// Loads the track onto a voice, paused, so that a later PlaySound()
+// or callout of the same track only has to resume it. If all the slots
+// are in use the oldest preload is dropped.
+boolean AudioHandler::PreloadSound(unsigned short soundIndex, boolean isCallout) {
+#if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
+  byte slot = AUDIO_PRELOAD_SLOTS;
+  for (byte count=0; count<AUDIO_PRELOAD_SLOTS; count++) {
+    if (preloadedTracks[count]==soundIndex) return true;
+    if (preloadedTracks[count]==INVALID_SOUND_INDEX && slot==AUDIO_PRELOAD_SLOTS) slot = count;
+  }
+
+  if (slot==AUDIO_PRELOAD_SLOTS) {
+    slot = 0;
+    for (byte count=1; count<AUDIO_PRELOAD_SLOTS; count++) {
+      if ((long)(preloadedTime[count]-preloadedTime[slot])<0) slot = count;
+    }
+    wTrig.trackStop(preloadedTracks[slot]);
+  }
+
+  // The gain, the load and the later resume all go in the same class,
+  // so they reach the board in that order
+  byte txPriority = isCallout ? WAV_TRIGGER_TX_PRIORITY_VOICE : WAV_TRIGGER_TX_PRIORITY_SFX;
+  wTrig.trackGain(soundIndex, isCallout ? notificationsGain : soundFXGain, txPriority);
+#ifdef RPU_OS_USE_WAV_TRIGGER_1p3
+  wTrig.trackLoad(soundIndex, false, txPriority);
+#else
+  wTrig.trackLoad(soundIndex, txPriority);
+#endif
+  preloadedTracks[slot] = soundIndex;
+  preloadedTime[slot] = millis();
+  preloadedOnVoice[slot] = false;
+  return true;
+#else
+  (void)soundIndex;
+  (void)isCallout;
+  return false;
+#endif
+}
+
+
+// Resumes the track if it's preloaded and still on a voice (or was
+// loaded so recently that the report may not be back yet). A preload
+// the board never reported is stopped, and false tells the caller to
+// play the track the normal way rather than resume nothing.
+boolean AudioHandler::ResumePreloadedTrack(unsigned short trackIndex, byte txPriority) {
+#if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
+  for (byte count=0; count<AUDIO_PRELOAD_SLOTS; count++) {
+    if (preloadedTracks[count]==trackIndex) {
+      preloadedTracks[count] = INVALID_SOUND_INDEX;
+      if (!preloadedOnVoice[count] && (millis()-preloadedTime[count])>VOICE_NOTIFICATION_REPORT_TIMEOUT) {
+        wTrig.trackStop(trackIndex, txPriority);
+        return false;
+      }
+      wTrig.trackResume(trackIndex, txPriority);
+      // (a board that reported the load won't report the resume)
+      if (!preloadedOnVoice[count]) StartTriggerLatency(trackIndex, true);
+      return true;
+    }
+  }
+#else
+  (void)trackIndex;
+  (void)txPriority;
+#endif
+  return false;
+}
+
+
+// Starts every preloaded track at once (sample-synchronized on the
+// WAV Trigger), e.g. a stinger along with its music bed
+boolean AudioHandler::PlayAllPreloadedSounds() {
+  boolean anyPreloaded = false;
+  for (byte count=0; count<AUDIO_PRELOAD_SLOTS; count++) {
+    if (preloadedTracks[count]!=INVALID_SOUND_INDEX) {
+      AddActiveVoice(preloadedTracks[count], AUDIO_VOICE_CLASS_SFX, 0);
+      preloadedTracks[count] = INVALID_SOUND_INDEX;
+      anyPreloaded = true;
+    }
+  }
+#if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
+  if (anyPreloaded) wTrig.resumeAllInSync();
+#endif
+  return anyPreloaded;
+}
+
+
+void AudioHandler::CancelPreloadedSounds() {
+  for (byte count=0; count<AUDIO_PRELOAD_SLOTS; count++) {
+    if (preloadedTracks[count]!=INVALID_SOUND_INDEX) {
+#if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
+      wTrig.trackStop(preloadedTracks[count]);
+#endif
+      preloadedTracks[count] = INVALID_SOUND_INDEX;
+    }
   }
 }
 
 
-boolean AudioHandler::PlaySound(unsigned short soundIndex, byte audioType, byte overrideVolume) {
+// Only one trigger is timed at a time, from the call to the board's
+// report that the track started
+void AudioHandler::StartTriggerLatency(unsigned short trackIndex, boolean preloaded) {
+  if (latencyTrack!=INVALID_SOUND_INDEX && (millis()-latencyStartTime)<1000) return;
+  latencyTrack = trackIndex;
+  latencyPreloaded = preloaded;
+  latencyStartTime = millis();
+}
+
+
+unsigned short AudioHandler::GetTriggerLatency(boolean preloaded) {
+  return triggerLatency[preloaded?1:0];
+}
+
+
+unsigned short AudioHandler::GetMaxTriggerLatency(boolean preloaded) {
+  return maxTriggerLatency[preloaded?1:0];
+}
+
+
+unsigned short AudioHandler::GetSFXRetriggersSkipped() {
+  return sfxRetriggersSkipped;
+}
+
+
+unsigned short AudioHandler::GetSFXVoicesStolen() {
+  return sfxVoicesStolen;
+}
+
+
+boolean AudioHandler::PlaySound(unsigned short soundIndex, byte audioType, byte overrideVolume, byte priority) {
 
   boolean soundPlayed = false;
   int gain = soundFXGain;
@@ -877,20 +1843,57 @@ boolean AudioHandler::PlaySound(unsigned short soundIndex, byte audioType, byte
 #ifdef RPU_OS_USE_SB100
     RPU_PlaySB100((byte)soundIndex);
     soundPlayed = true;
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+    unsigned long switchTime = GetSwitchTimeForSound();
+    if (switchTime) RecordSwitchLatency(GetSwitchLatencySlot(soundIndex, audioType), micros() - switchTime);
+#endif
 #endif
   } else if (audioType==AUDIO_PLAY_TYPE_WAV_TRIGGER) {
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
-#ifdef RPU_OS_USE_WAV_TRIGGER
-    wTrig.trackStop(soundIndex);
+    // Ignore a retrigger of an effect that only just started
+    unsigned long currentTime = millis();
+    for (byte count=0; count<MAX_NUM_VOICES; count++) {
+      if (activeVoices[count].voiceClass==AUDIO_VOICE_CLASS_SFX && activeVoices[count].trackIndex==soundIndex) {
+        if ((currentTime-activeVoices[count].startTime) < SFX_RETRIGGER_WINDOW) {
+          sfxRetriggersSkipped += 1;
+          return false;
+        }
+      }
+    }
+
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+    // The resume or play carries the stamp out to the UART
+    unsigned long switchTime = GetSwitchTimeForSound();
+    byte latencySlot = AUDIO_LATENCY_NO_SLOT;
+    if (switchTime) latencySlot = GetSwitchLatencySlot(soundIndex, audioType);
+    if (latencySlot!=AUDIO_LATENCY_NO_SLOT) wTrig.markNextTrackControl(switchTime, latencySlot);
 #endif
 
-    wTrig.trackPlayPoly(soundIndex);
-    wTrig.trackGain(soundIndex, gain);
+    if (ResumePreloadedTrack(soundIndex, WAV_TRIGGER_TX_PRIORITY_SFX)) {
+      // A preloaded track already has its voice
+    } else {
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+      // Nothing was resumed, so the stamp waits for the play
+      wTrig.markNextTrackControl(0, 0);
+#endif
+#ifdef RPU_OS_USE_WAV_TRIGGER
+      wTrig.trackStop(soundIndex);
+      RemoveActiveVoice(soundIndex);
+#endif
+      if (!MakeRoomForSFX(priority)) return false;
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+      if (latencySlot!=AUDIO_LATENCY_NO_SLOT) wTrig.markNextTrackControl(switchTime, latencySlot);
+#endif
+      wTrig.trackPlayPolyWithGain(soundIndex, gain, false, false);
+      StartTriggerLatency(soundIndex, false);
+    }
+    AddActiveVoice(soundIndex, AUDIO_VOICE_CLASS_SFX, priority);
     soundPlayed = true;
 #endif
   }
   (void)gain;
   (void)soundIndex;
+  (void)priority;
 
   return soundPlayed;  
 }
@@ -912,17 +1915,57 @@ boolean AudioHandler::FadeSound(unsigned short soundIndex, int fadeGain, int num
 
 
 boolean AudioHandler::QueueSound(unsigned short soundIndex, byte audioType, unsigned long timeToPlay, byte overrideVolume) {
-  for (int count=0; count<SOUND_QUEUE_SIZE; count++) {
-    if (soundQueue[count].playTime==0) {
-      soundQueue[count].soundIndex = soundIndex;
-      soundQueue[count].audioType = audioType;
-      soundQueue[count].playTime = timeToPlay;
-      soundQueue[count].overrideVolume = overrideVolume;
-      return true;
-    }
+  if (numSoundsQueued>=SOUND_QUEUE_SIZE) {
+    soundQueueOverflows += 1;
+    return false;
+  }
+
+  // Sift the new entry up from the bottom of the heap (times are
+  // compared as a difference so this still works when millis() wraps)
+  unsigned short child = numSoundsQueued;
+  numSoundsQueued += 1;
+  while (child>0) {
+    unsigned short parent = (child-1)/2;
+    if ((long)(timeToPlay - soundQueue[parent].playTime) >= 0) break;
+    soundQueue[child] = soundQueue[parent];
+    child = parent;
   }
+  soundQueue[child].soundIndex = soundIndex;
+  soundQueue[child].audioType = audioType;
+  soundQueue[child].playTime = timeToPlay;
+  soundQueue[child].overrideVolume = overrideVolume;
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  // Sounds deliberately scheduled for later aren't switch latency
+  soundQueue[child].switchTime = 0;
+  if ((long)(timeToPlay - millis()) <= 0) soundQueue[child].switchTime = GetSwitchTimeForSound();
+#endif
   
-  return false;
+  return true;
+}
+
+
+void AudioHandler::RemoveFirstFromSoundQueue() {
+  if (numSoundsQueued==0) return;
+  numSoundsQueued -= 1;
+  if (numSoundsQueued==0) return;
+
+  // Sift the last entry down from the top
+  SoundEntry last = soundQueue[numSoundsQueued];
+  unsigned short parent = 0;
+  while (1) {
+    unsigned short child = parent*2 + 1;
+    if (child>=numSoundsQueued) break;
+    if ((child+1)<numSoundsQueued && (long)(soundQueue[child+1].playTime - soundQueue[child].playTime) < 0) child += 1;
+    if ((long)(soundQueue[child].playTime - last.playTime) >= 0) break;
+    soundQueue[parent] = soundQueue[child];
+    parent = child;
+  }
+  soundQueue[parent] = last;
+}
+
+
+unsigned short AudioHandler::GetSoundQueueOverflows() {
+  return soundQueueOverflows;
 }
 
 
@@ -992,14 +2035,56 @@ boolean AudioHandler::PlaySoundCardWhenPossible(unsigned short soundEffectNum, u
 
 
 
+boolean AudioHandler::PlaySoundSequence(const AudioSequenceStep *sequenceSteps, byte numSteps, byte repeatCount, byte audioType, unsigned long currentTime) {
+  if (sequenceSteps==NULL || numSteps==0 || repeatCount==0) return false;
+
+  currentSequence = sequenceSteps;
+  currentSequenceNumSteps = numSteps;
+  currentSequenceStep = 0;
+  currentSequenceRepeatsLeft = repeatCount;
+  currentSequenceAudioType = audioType;
+  nextSequenceStepTime = currentTime;
+
+  // The first step plays right away
+  ServiceSoundSequence(currentTime);
+  return true;
+}
+
+
+boolean AudioHandler::ServiceSoundSequence(unsigned long currentTime) {
+  if (currentSequence==NULL) return false;
+  if ((long)(currentTime - nextSequenceStepTime) < 0) return false;
+
+  byte soundIndex = pgm_read_byte(&currentSequence[currentSequenceStep].soundIndex);
+  nextSequenceStepTime += pgm_read_byte(&currentSequence[currentSequenceStep].msToNextStep);
+
+  currentSequenceStep += 1;
+  if (currentSequenceStep>=currentSequenceNumSteps) {
+    currentSequenceStep = 0;
+    currentSequenceRepeatsLeft -= 1;
+    if (currentSequenceRepeatsLeft==0) currentSequence = NULL;
+  }
+
+  PlaySound(soundIndex, currentSequenceAudioType);
+  return true;
+}
+
+
 boolean AudioHandler::ServiceSoundQueue(unsigned long currentTime) {
   boolean soundCommandSent = false;
-  for (int count=0; count<SOUND_QUEUE_SIZE; count++) {
-    if (soundQueue[count].playTime!=0 && soundQueue[count].playTime<currentTime) {
-      PlaySound(soundQueue[count].soundIndex, soundQueue[count].audioType, soundQueue[count].overrideVolume);
-      soundQueue[count].playTime = 0;
-      soundCommandSent = true;
-    }
+
+  // Only the top of the heap needs to be checked
+  while (numSoundsQueued && (long)(currentTime - soundQueue[0].playTime) > 0) {
+    SoundEntry due = soundQueue[0];
+    RemoveFirstFromSoundQueue();
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+    queuedSoundSwitchTime = due.switchTime;
+#endif
+    PlaySound(due.soundIndex, due.audioType, due.overrideVolume);
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+    queuedSoundSwitchTime = 0;
+#endif
+    soundCommandSent = true;
   }
 
   return soundCommandSent;
@@ -1076,13 +2161,16 @@ boolean AudioHandler::ServiceSoundCardQueue(unsigned long currentTime) {
 }
 
 
-boolean AudioHandler::PlayBackgroundSoundtrack(AudioSoundtrack *soundtrackArray, unsigned short numSoundtrackEntries, unsigned long currentTime, boolean randomOrder) {
+boolean AudioHandler::PlayBackgroundSoundtrack(AudioSoundtrack *soundtrackArray, unsigned short numSoundtrackEntries, unsigned long currentTime, boolean randomOrder, const byte *songWeights) {
   StopAllMusic();
   if (soundtrackArray==NULL) return false;
 
   curSoundtrack = soundtrackArray;
   curSoundtrackEntries = numSoundtrackEntries; 
+  curSoundtrackWeights = songWeights;
   soundtrackRandomOrder = randomOrder;
+  ResetSoundtrackBag();
+  backgroundTrackStarted = false;
   if (currentTime!=0) backgroundSongEndTime = currentTime-1;
   else backgroundSongEndTime = 0;
   
@@ -1095,16 +2183,17 @@ boolean AudioHandler::PlayBackgroundSong(unsigned short trackIndex, boolean loop
 
   if (trackIndex!=BACKGROUND_TRACK_NONE) {
     currentBackgroundTrack = trackIndex;        
+    backgroundTrackStarted = false;
+    backgroundTrackEnded = false;
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
 #ifdef RPU_OS_USE_WAV_TRIGGER_1p3
-    wTrig.trackPlayPoly(trackIndex, true);
-    trackPlayed = true;
+    wTrig.trackPlayPolyWithGain(trackIndex, musicGain, true, loopTrack, WAV_TRIGGER_TX_PRIORITY_MUSIC);
 #else
-    wTrig.trackPlayPoly(trackIndex);
-    trackPlayed = true;
+    wTrig.trackPlayPolyWithGain(trackIndex, musicGain, false, loopTrack, WAV_TRIGGER_TX_PRIORITY_MUSIC);
 #endif
-    if (loopTrack) wTrig.trackLoop(trackIndex, true);
-    wTrig.trackGain(trackIndex, musicGain);
+    AddActiveVoice(trackIndex, AUDIO_VOICE_CLASS_MUSIC, 0);
+    musicGainSent = musicGain;
+    trackPlayed = true;
 #endif
   }
   (void)loopTrack;
@@ -1113,45 +2202,132 @@ boolean AudioHandler::PlayBackgroundSong(unsigned short trackIndex, boolean loop
 }
 
 
-void AudioHandler::StartNextSoundtrackSong(unsigned long currentTime) {
+// Starts a new bag (and forgets what was played) for a new soundtrack
+void AudioHandler::ResetSoundtrackBag() {
+  soundtrackBagSize = 0;
+  soundtrackBagPosition = 0;
+  soundtrackBagFirstSong = 0;
+  soundtrackNextSongToBag = 0;
+  for (byte count=0; count<NUMBER_OF_SONGS_REMEMBERED; count++) lastSongsPlayed[count] = BACKGROUND_TRACK_NONE;
+  lastSongsPlayedNext = 0;
+}
 
-  unsigned int retSong = (currentTime%curSoundtrackEntries);
-  boolean songRecentlyPlayed = false;
 
-  unsigned int songCount = 0;
-  for (songCount=0; songCount<curSoundtrackEntries; songCount++) {
-    for (byte count=0; count<NUMBER_OF_SONGS_REMEMBERED; count++) {
-      if (lastSongsPlayed[count]==curSoundtrack[retSong].TrackIndex) {
-        songRecentlyPlayed = true;        
-        break;
-      }
+unsigned short AudioHandler::GetSoundtrackBagSong(byte bagEntry) {
+  unsigned short song = soundtrackBagFirstSong + bagEntry;
+  if (song>=curSoundtrackEntries) song -= curSoundtrackEntries;
+  return song;
+}
+
+
+// Whether the song is among the last (window) played
+boolean AudioHandler::SoundtrackSongPlayedRecently(unsigned short song, byte window) {
+  byte index = lastSongsPlayedNext;
+  for (byte count=0; count<window; count++) {
+    index = (index==0) ? (NUMBER_OF_SONGS_REMEMBERED-1) : (index-1);
+    if (lastSongsPlayed[index]==song) return true;
+  }
+  return false;
+}
+
+
+// A song's share of the bag: its weight, scaled down if all the weights
+// don't fit (but never below one entry unless the weight is 0)
+byte AudioHandler::GetSoundtrackSongWeight(unsigned short song, unsigned long totalWeight) {
+  if (curSoundtrackWeights==NULL) return 1;
+  byte weight = curSoundtrackWeights[song];
+  if (weight==0 || totalWeight<=SOUNDTRACK_BAG_SIZE) return weight;
+  soundtrackWeightsScaled = true;
+  unsigned long scaled = (((unsigned long)weight) * SOUNDTRACK_BAG_SIZE) / totalWeight;
+  return (scaled==0) ? 1 : (byte)scaled;
+}
+
+
+// Refills the bag with the songs (weighted) that fit, starting after the
+// last song put in the previous bag, and shuffles it. Usually that's the
+// whole soundtrack; if not, the next bag carries on from there.
+void AudioHandler::RefillSoundtrackBag() {
+  unsigned long totalWeight = 0;
+  for (unsigned short song=0; song<curSoundtrackEntries; song++) {
+    totalWeight += (curSoundtrackWeights!=NULL) ? curSoundtrackWeights[song] : 1;
+  }
+
+  byte bagSize = 0;
+  byte songsBagged = 0;
+  if (soundtrackNextSongToBag>=curSoundtrackEntries) soundtrackNextSongToBag = 0;
+  soundtrackBagFirstSong = soundtrackNextSongToBag;
+  // (entries are byte offsets, so a bagful spans at most 256 songs)
+  for (unsigned short count=0; count<curSoundtrackEntries && count<256; count++) {
+    byte weight = GetSoundtrackSongWeight(soundtrackNextSongToBag, totalWeight);
+    // a song's copies all go in the same bag
+    if ((bagSize + weight)>SOUNDTRACK_BAG_SIZE) break;
+    for (byte copy=0; copy<weight; copy++) {
+      soundtrackBag[bagSize] = (byte)count;
+      bagSize += 1;
+    }
+    if (weight) songsBagged += 1;
+    soundtrackNextSongToBag += 1;
+    if (soundtrackNextSongToBag>=curSoundtrackEntries) soundtrackNextSongToBag = 0;
+  }
+  soundtrackBagSize = bagSize;
+  soundtrackBagPosition = 0;
+  if (!soundtrackRandomOrder || bagSize<2) return;
+
+  for (byte count=(bagSize-1); count>0; count--) {
+    byte swapIndex = random(count+1);
+    byte temp = soundtrackBag[count];
+    soundtrackBag[count] = soundtrackBag[swapIndex];
+    soundtrackBag[swapIndex] = temp;
+  }
+
+  // The song at position n is played n+1 songs after the last bag's
+  // last, so it mustn't be one of the last (window-n) played. Anything
+  // that is gets swapped with a later entry that isn't.
+  byte window = (songsBagged>NUMBER_OF_SONGS_REMEMBERED) ? NUMBER_OF_SONGS_REMEMBERED : (songsBagged-1);
+  for (byte position=0; position<window && position<bagSize; position++) {
+    if (!SoundtrackSongPlayedRecently(GetSoundtrackBagSong(soundtrackBag[position]), window-position)) continue;
+    for (byte swapIndex=(position+1); swapIndex<bagSize; swapIndex++) {
+      if (SoundtrackSongPlayedRecently(GetSoundtrackBagSong(soundtrackBag[swapIndex]), window-position)) continue;
+      byte temp = soundtrackBag[position];
+      soundtrackBag[position] = soundtrackBag[swapIndex];
+      soundtrackBag[swapIndex] = temp;
+      break;
     }
-    if (!songRecentlyPlayed) break;
-    retSong = (retSong+1);
-    songRecentlyPlayed = false;
-    if (retSong>=curSoundtrackEntries) retSong = 0;
   }
+}
+
+
+void AudioHandler::StartNextSoundtrackSong(unsigned long currentTime) {
 
-  // Record this song in the array
-  for (byte count=(NUMBER_OF_SONGS_REMEMBERED-1); count>0; count--) lastSongsPlayed[count] = lastSongsPlayed[count-1];
-  lastSongsPlayed[0] = curSoundtrack[retSong].TrackIndex;
+  if (soundtrackBagPosition>=soundtrackBagSize) RefillSoundtrackBag();
+  if (soundtrackBagSize==0) return;
 
-  backgroundSongEndTime = (((unsigned long)curSoundtrack[retSong].TrackLength) * 1000) + currentTime;
+  unsigned short retSong = GetSoundtrackBagSong(soundtrackBag[soundtrackBagPosition++]);
+  lastSongsPlayed[lastSongsPlayedNext] = retSong;
+  lastSongsPlayedNext += 1;
+  if (lastSongsPlayedNext>=NUMBER_OF_SONGS_REMEMBERED) lastSongsPlayedNext = 0;
+
+  // (0 when the length isn't known, so only the report ends it)
+  if (curSoundtrack[retSong].TrackLength) backgroundSongEndTime = (((unsigned long)curSoundtrack[retSong].TrackLength) * 1000) + currentTime;
+  else backgroundSongEndTime = 0;
   
   if (currentBackgroundTrack!=BACKGROUND_TRACK_NONE) {
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
-    wTrig.trackFade(currentBackgroundTrack, -80, 2000, 1);
+    wTrig.trackFade(currentBackgroundTrack, -80, 2000, 1, WAV_TRIGGER_TX_PRIORITY_MUSIC);
 #endif
   }
   currentBackgroundTrack = curSoundtrack[retSong].TrackIndex;
+  backgroundTrackStarted = false;
+  backgroundTrackEnded = false;
 
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
 #ifdef RPU_OS_USE_WAV_TRIGGER_1p3
-  wTrig.trackPlayPoly(currentBackgroundTrack, true);
+  wTrig.trackPlayPolyWithGain(currentBackgroundTrack, musicGain, true, false, WAV_TRIGGER_TX_PRIORITY_MUSIC);
 #else
-  wTrig.trackPlayPoly(currentBackgroundTrack);
+  wTrig.trackPlayPolyWithGain(currentBackgroundTrack, musicGain, false, false, WAV_TRIGGER_TX_PRIORITY_MUSIC);
 #endif
-  wTrig.trackGain(currentBackgroundTrack, musicGain);
+  AddActiveVoice(currentBackgroundTrack, AUDIO_VOICE_CLASS_MUSIC, 0);
+  musicGainSent = musicGain;
 #endif
 
 }
@@ -1162,20 +2338,36 @@ void AudioHandler::StartNextSoundtrackSong(unsigned long currentTime) {
 void AudioHandler::ManageBackgroundSong(unsigned long currentTime) {
   if (curSoundtrack==NULL) return; 
 
-  if (backgroundSongEndTime!=0) {
-    if (currentTime>=backgroundSongEndTime) {
-      StartNextSoundtrackSong(currentTime);
-    }
-  } else {
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
-    if (!wTrig.isTrackPlaying(currentBackgroundTrack)) {
-      StartNextSoundtrackSong(currentTime);
-    }
+  // Once the song has been reported playing, the report of it ending
+  // moves the soundtrack on (the length is a backstop for a voice taken
+  // without a report)
+  if (backgroundTrackEnded) {
+    StartNextSoundtrackSong(currentTime);
+    return;
+  }
+  if (backgroundTrackStarted) {
+    if (backgroundSongEndTime!=0 && currentTime>=(backgroundSongEndTime+SOUNDTRACK_END_REPORT_GRACE)) StartNextSoundtrackSong(currentTime);
+    return;
+  }
 #endif
+
+  // No reports, so go by the length
+  if (backgroundSongEndTime!=0 && currentTime>=backgroundSongEndTime) {
+    StartNextSoundtrackSong(currentTime);
   }
 }
 
 
+unsigned short AudioHandler::GetWAVTriggerBytesPerSecond() {
+#if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
+  return wTrig.getBytesPerSecond();
+#else
+  return 0;
+#endif
+}
+
+
 boolean AudioHandler::Update(unsigned long currentTime) {
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
   wTrig.update();
@@ -1183,7 +2375,9 @@ boolean AudioHandler::Update(unsigned long currentTime) {
   boolean queueHasEntries = false;
   ManageBackgroundSong(currentTime);
   ServiceSoundQueue(currentTime);
+  ServiceSoundSequence(currentTime);
   ServiceSoundCardQueue(currentTime);
   if (ServiceNotificationQueue(currentTime)) queueHasEntries = true;
+  ServiceMusicDucking(currentTime);
   return queueHasEntries;
 }
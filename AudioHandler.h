@@ -9,13 +9,90 @@
 #define AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS   2
 #define AUDIO_PLAY_TYPE_WAV_TRIGGER       4
 
+// Soundtrack songs are drawn in turn from a shuffled "bag" (a song with
+// weight n is in the bag n times). When the weights add up to more than
+// the bag holds they're scaled down (every song keeps at least one
+// entry, and OutputAudioStats() says so), and a soundtrack with more
+// songs than that is bagged a bagful at a time; entries are byte offsets
+// from the bagful's first song.
+#ifndef SOUNDTRACK_BAG_SIZE
+#define SOUNDTRACK_BAG_SIZE           32
+#endif
+// A new bag's first few songs are swapped away from the ones that ended
+// the last, so none of the last 10 played (or all but one, for a short
+// soundtrack) comes round again across the boundary
 #define NUMBER_OF_SONGS_REMEMBERED    10
 
+// Pending callouts are kept as a heap ordered on priority and then on
+// the order they were queued. A callout that's already pending isn't
+// queued twice. Callouts never expire unless the caller passes an
+// expiry (ms); one that has waited longer than that is dropped rather
+// than played late.
+#ifndef VOICE_NOTIFICATION_STACK_SIZE
 #define VOICE_NOTIFICATION_STACK_SIZE   5
+#endif
 #define VOICE_NOTIFICATION_STACK_EMPTY  0xFFFF
+#ifndef VOICE_NOTIFICATION_DEFAULT_EXPIRY
+#define VOICE_NOTIFICATION_DEFAULT_EXPIRY 0
+#endif
+// If the WAV Trigger hasn't reported a callout starting by now,
+// it isn't going to report it ending either
+#define VOICE_NOTIFICATION_REPORT_TIMEOUT 250
+// A soundtrack song that has been reported playing moves on when it's
+// reported ending; its length (if known) plus this is only a backstop
+#define SOUNDTRACK_END_REPORT_GRACE     2000
 
 #define BACKGROUND_TRACK_NONE           0xFFFF
 
+// The AudioHandler keeps its own table of what it has started on the
+// WAV Trigger so that, when the board runs out of voices, it chooses
+// which SFX to give up instead of letting the board steal one at random
+// (possibly a callout or the music)
+#define AUDIO_VOICE_CLASS_NONE          0
+#define AUDIO_VOICE_CLASS_SFX           1
+#define AUDIO_VOICE_CLASS_MUSIC         2
+#define AUDIO_VOICE_CLASS_CALLOUT       3
+
+// A sound effect retriggered within this many ms of its last start is
+// ignored (spinners, pops)
+#ifndef SFX_RETRIGGER_WINDOW
+#define SFX_RETRIGGER_WINDOW            40
+#endif
+
+// Music ducking for callouts: the music fades down to (musicGain - depth)
+// when a callout starts, where the depth depends on the callout's
+// priority, holds there for a moment after the callout ends in case
+// another one follows, then fades back up. A fade is only sent when
+// the target gain changes.
+#define MUSIC_DUCK_PRIORITY_LEVELS      11
+#define MUSIC_DUCK_ATTACK_MS            500
+#define MUSIC_DUCK_HOLD_MS              400
+#define MUSIC_DUCK_RELEASE_MS           1500
+
+// Tracks that are likely to be needed next can be loaded (paused) onto
+// a voice ahead of time so that playing them is a single resume with
+// no SD card seek. Each one holds a voice until it's played, replaced
+// or cancelled. One the board hasn't reported loading by the time it's
+// needed (or has reported losing) is played the normal way instead.
+#ifndef AUDIO_PRELOAD_SLOTS
+#define AUDIO_PRELOAD_SLOTS             2
+#endif
+
+struct AudioVoice {
+  unsigned short trackIndex;
+  byte voiceClass;
+  byte priority;
+  unsigned long startTime;
+};
+
+
+struct VoiceNotificationEntry {
+  unsigned short soundIndex;
+  unsigned short duration;
+  byte priority;
+  unsigned long queueTime;
+  unsigned long expireTime; // 0 for never
+};
 
 struct AudioSoundtrack {
   unsigned short TrackIndex;
@@ -35,14 +112,50 @@ struct SoundCardCommandEntry {
   unsigned long playTime;
 };
 
+// Queued sounds are kept as a min-heap on play time (soundQueue[0]
+// is always the next one due). Can be overridden for bigger sequences.
+#ifndef SOUND_QUEUE_SIZE
 #define SOUND_QUEUE_SIZE 30
+#endif
+
+// A sequence is a PROGMEM array of steps (sound, then how long until
+// the next step) that's played through, repeatCount times, by a single
+// cursor in the AudioHandler. Starting a sequence replaces the one
+// that's playing, which suits one-sound-at-a-time boards like the SB-100.
+struct AudioSequenceStep {
+  byte soundIndex;
+  byte msToNextStep;
+};
 
 struct SoundEntry {
   unsigned short soundIndex;
   byte audioType;
   byte overrideVolume;
   unsigned long playTime;  
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  unsigned long switchTime;
+#endif
+};
+
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+// Time from a switch closure (stamped in the ISR) to its sound going
+// out (the last byte leaving the UART for the WAV Trigger, or the PIA
+// write for the SB-100) is kept per effect. Bins start 128us wide and
+// there are two per doubling, so percentiles are good to within 50%.
+#ifndef AUDIO_LATENCY_EFFECT_SLOTS
+#define AUDIO_LATENCY_EFFECT_SLOTS  12
+#endif
+#define AUDIO_LATENCY_BINS          20
+#define AUDIO_LATENCY_NO_SLOT       0xFF
+
+struct AudioLatencyHistogram {
+  unsigned short soundIndex;
+  byte audioType;
+  unsigned short numSamples;
+  unsigned long maxLatency; // us
+  unsigned short bins[AUDIO_LATENCY_BINS];
 };
+#endif
 
 // These SoundEFfectEntry & Queue functions parcel out FX to the
 // built-in sound card because it can only handle one sound
@@ -93,6 +206,58 @@ struct SoundEffectEntry {
 #define SOM2  0xaa
 #define EOM   0x55
 
+// Outbound commands are queued by priority class and drained into the
+// UART only when there's room in its transmit buffer, so a burst of
+// audio never blocks the main loop. Higher classes drain first.
+#define WAV_TRIGGER_TX_PRIORITY_SFX       0
+#define WAV_TRIGGER_TX_PRIORITY_MUSIC     1
+#define WAV_TRIGGER_TX_PRIORITY_VOICE     2
+#define WAV_TRIGGER_TX_PRIORITY_CONTROL   3
+#define WAV_TRIGGER_TX_NUM_PRIORITIES     4
+#ifndef WAV_TRIGGER_TX_QUEUE_SIZE
+#define WAV_TRIGGER_TX_QUEUE_SIZE         8
+#endif
+#define WAV_TRIGGER_MAX_FRAME_LEN         12
+// Plays and stops count towards the voices in use from when they're
+// queued until the board reports them (or, if it hasn't by this many
+// ms after the last went out, it isn't going to)
+#define WAV_TRIGGER_REPORT_TIMEOUT        250
+
+struct WavTriggerFrame {
+  uint8_t len; // 0 means the frame was cancelled or merged
+  uint16_t queuedTime; // low 16 bits of millis()
+  uint8_t data[WAV_TRIGGER_MAX_FRAME_LEN];
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  uint32_t switchTime; // micros() of the switch behind this frame (0 if none)
+  uint8_t latencyTag;
+#endif
+};
+
+// Last gain sent is remembered for this many tracks (direct-mapped
+// on track number) so that unchanged gains aren't resent on every play
+#define WAV_TRIGGER_GAIN_CACHE_SIZE   32
+#define WAV_TRIGGER_GAIN_CACHE_EMPTY  0xFFFF
+
+// Track reports from the WAV Trigger are mirrored into one bit per
+// track (tracks at or above this number fall back to the voice table)
+#ifndef WAV_TRIGGER_MAX_TRACKS
+#define WAV_TRIGGER_MAX_TRACKS        2048
+#endif
+
+// Called from update() when a track starts, or when it's no longer
+// playing on any voice
+typedef void (*WavTriggerTrackReportCallback)(void *context, uint16_t trk, bool playing);
+
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+// Called when a marked frame is handed to the UART, with the time its
+// last byte should be on the wire (57600 baud, 10 bits a byte)
+#define WAV_TRIGGER_BYTE_MICROS       174
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE         64
+#endif
+typedef void (*WavTriggerFrameSentCallback)(void *context, uint8_t tag, uint32_t switchTime, uint32_t sentTime);
+#endif
+
 
 #if defined(RPU_OS_USE_WAV_TRIGGER) || defined(RPU_OS_USE_WAV_TRIGGER_1p3)
 
@@ -102,7 +267,11 @@ struct SoundEffectEntry {
 class wavTrigger
 {
 public:
-  wavTrigger() {;}
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  wavTrigger() {trackReportCallback = NULL; trackReportContext = NULL; frameSentCallback = NULL; frameSentContext = NULL; pendingSwitchTime = 0;}
+#else
+  wavTrigger() {trackReportCallback = NULL; trackReportContext = NULL;}
+#endif
   ~wavTrigger() {;}
   void start(void);
   void update(void);
@@ -112,6 +281,16 @@ public:
   bool getVersion(char *pDst, int len);
   int getNumTracks(void);
   bool isTrackPlaying(int trk);
+  uint8_t getNumVoices(void);
+  uint8_t getNumVoicesPlaying(void);
+  uint8_t getNumVoicesInUse(void);
+  uint8_t getPeakVoicesPlaying(void);
+  uint16_t getVoiceTrack(uint8_t voice);
+  void setTrackReportCallback(WavTriggerTrackReportCallback callback, void *context);
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  void setFrameSentCallback(WavTriggerFrameSentCallback callback, void *context);
+  void markNextTrackControl(uint32_t switchTime, uint8_t tag);
+#endif
   void masterGain(int gain);
   void stopAllTracks(void);
   void resumeAllInSync(void);
@@ -119,22 +298,61 @@ public:
   void trackPlaySolo(int trk, bool lock);
   void trackPlayPoly(int trk);
   void trackPlayPoly(int trk, bool lock);
-  void trackLoad(int trk);
-  void trackLoad(int trk, bool lock);
+  void trackLoad(int trk, uint8_t txPriority = WAV_TRIGGER_TX_PRIORITY_SFX);
+  void trackLoad(int trk, bool lock, uint8_t txPriority = WAV_TRIGGER_TX_PRIORITY_SFX);
   void trackStop(int trk);
+  void trackStop(int trk, uint8_t txPriority);
   void trackPause(int trk);
   void trackResume(int trk);
+  void trackResume(int trk, uint8_t txPriority);
   void trackLoop(int trk, bool enable);
-  void trackGain(int trk, int gain);
-  void trackFade(int trk, int gain, int time, bool stopFlag);
+  void trackPlayPolyWithGain(int trk, int gain, bool lock, bool loop, uint8_t txPriority = WAV_TRIGGER_TX_PRIORITY_SFX);
+  void trackGain(int trk, int gain, uint8_t txPriority = WAV_TRIGGER_TX_PRIORITY_SFX);
+  void trackFade(int trk, int gain, int time, bool stopFlag, uint8_t txPriority = WAV_TRIGGER_TX_PRIORITY_SFX);
   void samplerateOffset(int offset);
   void setTriggerBank(int bank);
+  unsigned short getBytesPerSecond(void);
+  unsigned long getTotalBytesSent(void);
+  unsigned short getDroppedCommands(void);
+  unsigned short getMergedCommands(void);
+  unsigned short getMaxQueueWait(void);
+  unsigned short getBoardVoiceSteals(void);
 
 private:
-  void trackControl(int trk, int code);
-  void trackControl(int trk, int code, bool lock);
+  void trackControl(int trk, int code, uint8_t txPriority = WAV_TRIGGER_TX_PRIORITY_SFX);
+  void trackControl(int trk, int code, bool lock, uint8_t txPriority = WAV_TRIGGER_TX_PRIORITY_SFX);
+  uint8_t buildTrackControl(uint8_t *txbuf, int trk, int code, bool useEx, bool lock);
+  uint8_t buildTrackGain(uint8_t *txbuf, int trk, int gain);
+  bool gainChanged(int trk, int gain);
+  void setCachedGain(int trk, int gain);
+  void sendFrames(uint8_t *txbuf, uint8_t len, uint8_t txPriority = WAV_TRIGGER_TX_PRIORITY_CONTROL);
+  bool mergeFrame(uint8_t *frame, uint8_t len, uint8_t txPriority);
+  void cancelFrame(WavTriggerFrame *txFrame);
+  void cancelQueuedTrackCommands(uint16_t trk);
+  void clearTxQueue(void);
+  void drainTxQueue(void);
+  void writeFrame(uint8_t *frame, uint8_t len);
+  void handleTrackReport(uint16_t track, uint8_t voice, bool playing);
+  bool isTrackOnAnyVoice(uint16_t trk);
+  int8_t frameVoiceChange(const uint8_t *frame);
+  void expireVoiceChanges(void);
 
   uint16_t voiceTable[MAX_NUM_VOICES];
+  uint8_t trackPlayingBits[WAV_TRIGGER_MAX_TRACKS/8];
+  uint8_t numVoicesPlaying;
+  uint8_t peakVoicesPlaying;
+  // Plays and stops sent that haven't been reported yet
+  uint8_t voiceStartsInFlight;
+  uint8_t voiceStopsInFlight;
+  uint16_t voiceChangeSentTime;
+  WavTriggerTrackReportCallback trackReportCallback;
+  void *trackReportContext;
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  WavTriggerFrameSentCallback frameSentCallback;
+  void *frameSentContext;
+  uint32_t pendingSwitchTime;
+  uint8_t pendingLatencyTag;
+#endif
   uint8_t rxMessage[MAX_MESSAGE_LEN];
   char version[VERSION_STRING_LEN];
   uint16_t numTracks;
@@ -144,6 +362,19 @@ private:
   bool rxMsgReady;
   bool versionRcvd;
   bool sysinfoRcvd;
+  uint16_t gainCacheTrack[WAV_TRIGGER_GAIN_CACHE_SIZE];
+  int8_t gainCacheValue[WAV_TRIGGER_GAIN_CACHE_SIZE];
+  unsigned long totalBytesSent;
+  unsigned long bytesSentWindowStart;
+  unsigned short bytesSentThisWindow;
+  unsigned short bytesPerSecond;
+  unsigned short droppedCommands;
+  unsigned short mergedCommands;
+  unsigned short maxQueueWait;
+  unsigned short boardVoiceSteals;
+  WavTriggerFrame txQueue[WAV_TRIGGER_TX_NUM_PRIORITIES][WAV_TRIGGER_TX_QUEUE_SIZE];
+  uint8_t txQueueFirst[WAV_TRIGGER_TX_NUM_PRIORITIES];
+  uint8_t txQueueLast[WAV_TRIGGER_TX_NUM_PRIORITIES];
 };
 
 #endif
@@ -159,24 +390,43 @@ class AudioHandler
     boolean InitDevices(byte audioType);
 
     void OutputTracksPlaying();
+    void OutputAudioStats();
 
     void SetSoundFXVolume(byte s_volume);
     void SetNotificationsVolume(byte s_volume);
     void SetMusicVolume(byte s_volume);
     void SetMusicDuckingGain(byte s_ducking);
+    void SetMusicDuckingGain(byte s_ducking, byte priority);
 
-    boolean PlayBackgroundSoundtrack(AudioSoundtrack *soundtrackArray, unsigned short numSoundtrackEntries, unsigned long currentTime, boolean randomOrder=true);
+    boolean PlayBackgroundSoundtrack(AudioSoundtrack *soundtrackArray, unsigned short numSoundtrackEntries, unsigned long currentTime, boolean randomOrder=true, const byte *songWeights=NULL);
     boolean PlayBackgroundSong(unsigned short trackIndex, boolean loopTrack=true);
 
-    boolean PlaySound(unsigned short soundIndex, byte audioType, byte overrideVolume=0xFF);
+    boolean PlaySound(unsigned short soundIndex, byte audioType, byte overrideVolume=0xFF, byte priority=0);
     boolean FadeSound(unsigned short soundIndex, int fadeGain, int numMilliseconds, boolean stopTrack);
     boolean QueueSound(unsigned short soundIndex, byte audioType, unsigned long timeToPlay, byte overrideVolume=0xFF);
+    boolean PlaySoundSequence(const AudioSequenceStep *sequenceSteps, byte numSteps, byte repeatCount, byte audioType, unsigned long currentTime);
     boolean QueueSoundCardCommand(byte scFunction, byte scRegister, byte scData, unsigned long startTime);
     boolean PlaySoundCardWhenPossible(unsigned short soundEffectNum, unsigned long currentTime, unsigned long requestedPlayTime = 0, unsigned long playUntil = 50, byte priority = 10);
     
-    boolean QueuePrioritizedNotification(unsigned short notificationIndex, unsigned short notificationLength, byte priority, unsigned long currentTime);
+    boolean PreloadSound(unsigned short soundIndex, boolean isCallout=false);
+    boolean PlayAllPreloadedSounds();
+    void CancelPreloadedSounds();
+    unsigned short GetTriggerLatency(boolean preloaded);
+    unsigned short GetMaxTriggerLatency(boolean preloaded);
+
+    boolean QueuePrioritizedNotification(unsigned short notificationIndex, unsigned short notificationLength, byte priority, unsigned long currentTime, unsigned short expiry=VOICE_NOTIFICATION_DEFAULT_EXPIRY);
+    unsigned short GetNotificationsDropped();
     
     boolean Update(unsigned long currentTime);
+    unsigned short GetWAVTriggerBytesPerSecond();
+    unsigned short GetSoundQueueOverflows();
+    byte GetWAVTriggerVoicesPlaying();
+    unsigned short GetSFXRetriggersSkipped();
+    unsigned short GetSFXVoicesStolen();
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+    void OutputSwitchLatencyStats();
+    void ClearSwitchLatencyStats();
+#endif
 
     boolean StopSound(unsigned short soundIndex);
     boolean StopCurrentNotification(byte priority = 10);
@@ -191,22 +441,38 @@ class AudioHandler
     int soundFXGain;
     int notificationsGain;
     int musicGain;    
-    int ducking;
-    byte voiceNotificationStackFirst;
-    byte voiceNotificationStackLast;
-    byte voiceNotificationPriorityStack[VOICE_NOTIFICATION_STACK_SIZE];
+    byte duckingByPriority[MUSIC_DUCK_PRIORITY_LEVELS];
+    int musicGainSent;
+    unsigned long musicDuckReleaseTime;
+    byte numVoiceNotificationsQueued;
+    VoiceNotificationEntry voiceNotificationStack[VOICE_NOTIFICATION_STACK_SIZE];
+    unsigned short voiceNotificationsDropped;
     byte currentNotificationPriority;
     boolean soundtrackRandomOrder;
     unsigned int currentNotificationPlaying;
-    unsigned int voiceNotificationNumStack[VOICE_NOTIFICATION_STACK_SIZE];
-    unsigned int voiceNotificationDuration[VOICE_NOTIFICATION_STACK_SIZE];
-    unsigned int lastSongsPlayed[NUMBER_OF_SONGS_REMEMBERED];
+    const byte *curSoundtrackWeights;
+    byte soundtrackBag[SOUNDTRACK_BAG_SIZE];
+    byte soundtrackBagSize;
+    byte soundtrackBagPosition;
+    unsigned short soundtrackBagFirstSong;
+    unsigned short soundtrackNextSongToBag;
+    boolean soundtrackWeightsScaled;
+    unsigned short lastSongsPlayed[NUMBER_OF_SONGS_REMEMBERED];
+    byte lastSongsPlayedNext;
     unsigned long currentNotificationStartTime;
     unsigned long nextSoundtrackPlayTime;    
     unsigned short curSoundtrackEntries;
     unsigned short currentBackgroundTrack;
 
     SoundEntry soundQueue[SOUND_QUEUE_SIZE];
+    unsigned short numSoundsQueued;
+    const AudioSequenceStep *currentSequence;
+    byte currentSequenceNumSteps;
+    byte currentSequenceStep;
+    byte currentSequenceRepeatsLeft;
+    byte currentSequenceAudioType;
+    unsigned long nextSequenceStepTime;
+    unsigned short soundQueueOverflows;
 
 #if defined(RPU_OS_USE_WTYPE_1_SOUND) || defined(RPU_OS_USE_WTYPE_2_SOUND)
     SoundEffectEntry CurrentSoundPlaying;
@@ -228,16 +494,67 @@ class AudioHandler
 
     int SpaceLeftOnNotificationStack();
     void ClearSoundQueue();
+    void RemoveFirstFromSoundQueue();
     void ClearSoundCardQueue();
     void ClearNotificationStack(byte priority = 10);
     void InitSoundEffectQueue();
     void StartNextSoundtrackSong(unsigned long currentTime);
+    void RefillSoundtrackBag();
+    unsigned short GetSoundtrackBagSong(byte bagEntry);
+    boolean SoundtrackSongPlayedRecently(unsigned short song, byte window);
+    byte GetSoundtrackSongWeight(unsigned short song, unsigned long totalWeight);
+    void ResetSoundtrackBag();
     void ManageBackgroundSong(unsigned long currentTime);
     boolean ServiceNotificationQueue(unsigned long currentTime);
-    void PushToNotificationStack(unsigned int notification, unsigned int duration, byte priority);
+    void PushToNotificationStack(unsigned int notification, unsigned int duration, byte priority, unsigned long currentTime, unsigned short expiry);
+    boolean NotificationGoesFirst(VoiceNotificationEntry *entry1, VoiceNotificationEntry *entry2);
+    void SiftUpNotification(byte index);
+    void SiftDownNotification(byte index);
     byte GetTopNotificationPriority();
     boolean ServiceSoundCardQueue(unsigned long currentTime);
     boolean ServiceSoundQueue(unsigned long currentTime);
+    boolean ServiceSoundSequence(unsigned long currentTime);
+    void ServiceMusicDucking(unsigned long currentTime);
+    static void TrackReportCallback(void *context, uint16_t trk, bool playing);
+    void HandleTrackReport(unsigned short trk, boolean playing);
+
+    void AddActiveVoice(unsigned short trackIndex, byte voiceClass, byte priority);
+    void RemoveActiveVoice(unsigned short trackIndex);
+    boolean MakeRoomForSFX(byte priority);
+
+    AudioVoice activeVoices[MAX_NUM_VOICES];
+    unsigned short preloadedTracks[AUDIO_PRELOAD_SLOTS];
+    unsigned long preloadedTime[AUDIO_PRELOAD_SLOTS];
+    boolean preloadedOnVoice[AUDIO_PRELOAD_SLOTS]; // the board reported it loaded
+    boolean ResumePreloadedTrack(unsigned short trackIndex, byte txPriority);
+    void StartTriggerLatency(unsigned short trackIndex, boolean preloaded);
+
+    // Time from sending a play (or resume) to the WAV Trigger reporting
+    // the track started, in ms
+    unsigned short latencyTrack;
+    boolean latencyPreloaded;
+    unsigned long latencyStartTime;
+    unsigned short triggerLatency[2];
+    unsigned short maxTriggerLatency[2];
+    unsigned short sfxRetriggersSkipped;
+    unsigned short sfxVoicesStolen;
+
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+    static void FrameSentCallback(void *context, uint8_t tag, uint32_t switchTime, uint32_t sentTime);
+    unsigned long GetSwitchTimeForSound();
+    byte GetSwitchLatencySlot(unsigned short soundIndex, byte audioType);
+    void RecordSwitchLatency(byte slot, unsigned long latency);
+    unsigned long GetSwitchLatencyPercentile(byte slot, byte percentile);
+    AudioLatencyHistogram switchLatency[AUDIO_LATENCY_EFFECT_SLOTS];
+    byte numSwitchLatencySlots;
+    unsigned long queuedSoundSwitchTime;
+#endif
+
+    // Set from WAV Trigger track reports
+    boolean currentNotificationStarted;
+    boolean currentNotificationEnded;
+    boolean backgroundTrackStarted;
+    boolean backgroundTrackEnded;
 
     unsigned long nextVoiceNotificationPlayTime;
     unsigned long backgroundSongEndTime;
@@ -59,12 +59,14 @@ boolean UsesM6800Processor = false;
 #if (RPU_MPU_ARCHITECTURE<10) 
 
 #ifdef RPU_USE_EXTENDED_SWITCHES_ON_PB4
+#define RPU_NUM_SOLENOIDS               15
 #define NUM_SWITCH_BYTES                6
 #define NUM_SWITCH_BYTES_ON_U10_PORT_A  5
 #define MAX_NUM_SWITCHES                48
 #define DEFAULT_SOLENOID_STATE          0x8F
 #define ST5_CONTINUOUS_SOLENOID_BIT     0x10
 #elif defined(RPU_USE_EXTENDED_SWITCHES_ON_PB7)
+#define RPU_NUM_SOLENOIDS               15
 #define NUM_SWITCH_BYTES                6
 #define NUM_SWITCH_BYTES_ON_U10_PORT_A  5
 #define MAX_NUM_SWITCHES                48
@@ -124,6 +126,29 @@ volatile byte SwitchesMinus2[NUM_SWITCH_BYTES];
 volatile byte SwitchesMinus1[NUM_SWITCH_BYTES];
 volatile byte SwitchesNow[NUM_SWITCH_BYTES];
 byte SwitchInverter[NUM_SWITCH_BYTES] = {0x00};
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+// Each switch has a 3-bit vertical counter (bit n of every switch in a
+// byte is in DebounceCountn) of how many scans in a row it has read
+// differently from its debounced state. It changes state when the count
+// reaches its depth for that direction. The depths are sliced the same
+// way and kept XORed with the defaults, so zeroed tables give the old
+// off, on, on closure. Every byte costs the same however deep it's set.
+#define DEBOUNCE_DEFAULT_CLOSE_SCANS  2
+#define DEBOUNCE_DEFAULT_OPEN_SCANS   1
+#define DEBOUNCE_MAX_SCANS            7
+#define DEBOUNCE_SLICE(scans, n)      ((((scans)>>(n))&0x01) ? 0xFF : 0x00)
+byte SwitchesDebounced[NUM_SWITCH_BYTES];
+byte SwitchChanges[NUM_SWITCH_BYTES];
+byte DebounceCount0[NUM_SWITCH_BYTES];
+byte DebounceCount1[NUM_SWITCH_BYTES];
+byte DebounceCount2[NUM_SWITCH_BYTES];
+byte CloseDepth0[NUM_SWITCH_BYTES];
+byte CloseDepth1[NUM_SWITCH_BYTES];
+byte CloseDepth2[NUM_SWITCH_BYTES];
+byte OpenDepth0[NUM_SWITCH_BYTES];
+byte OpenDepth1[NUM_SWITCH_BYTES];
+byte OpenDepth2[NUM_SWITCH_BYTES];
+#endif
 
 #ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
 #define MAX_IMMEDIATE_STREAMLINED_SOLENOIDS     10
@@ -170,6 +195,93 @@ volatile byte SwitchStack[SWITCH_STACK_SIZE];
 volatile boolean MaxSwitchesPerCycleHit = false;
 #endif
 
+#ifdef RPU_OS_COUNTED_SWITCHES
+// Closures of counted switches. SwitchCounts is only written by the ISR and
+// SwitchCountsPulled only by RPU_PullSwitchCount(), so the difference can be
+// read without turning interrupts off.
+byte CountedSwitchMask[NUM_SWITCH_BYTES] = {0x00};
+volatile byte SwitchCounts[MAX_NUM_SWITCHES];
+byte SwitchCountsPulled[MAX_NUM_SWITCHES];
+#endif
+
+#ifdef RPU_OS_TIMED_SWITCHES
+// Edges of switches marked with RPU_SetSwitchTimed(), with the millis() of
+// the scan that validated them. The top bit of switchNum marks an opening.
+#define TIMED_SWITCH_QUEUE_SIZE   16
+struct TimedSwitchEntry {
+  byte switchNum;
+  unsigned long time;
+};
+byte TimedSwitchMask[NUM_SWITCH_BYTES] = {0x00};
+volatile TimedSwitchEntry TimedSwitchQueue[TIMED_SWITCH_QUEUE_SIZE];
+volatile byte TimedSwitchQueueFirst = 0;
+volatile byte TimedSwitchQueueLast = 0;
+#ifdef RPU_OS_COUNTED_SWITCHES
+// A switch that is both counted and timed only queues the first closure
+// of each batch (its openings aren't queued at all)
+volatile byte TimedCountPending[NUM_SWITCH_BYTES];
+#endif
+#endif
+
+#ifdef RPU_OS_SWITCH_HEALTH
+// Kept by the ISR. Closures are timed in 10ms ticks, and only if the scan
+// saw them start (switches read closed at boot aren't timed until they
+// open and close again).
+#define SWITCH_HEALTH_STUCK_TICKS   60000
+volatile unsigned long SwitchClosures[MAX_NUM_SWITCHES];
+volatile unsigned short SwitchUnstableSamples[MAX_NUM_SWITCHES];
+volatile unsigned short SwitchLongestClosure[MAX_NUM_SWITCHES];
+volatile unsigned short SwitchClosedSince[MAX_NUM_SWITCHES];
+volatile byte SwitchClosureTimed[NUM_SWITCH_BYTES];
+// Ignored switches still read as they are (so the switch test and
+// RPU_ReadSingleSwitchState() see them), but are masked out of what
+// goes to the debounce, the immediate solenoids and the stack
+volatile byte SwitchesIgnored[NUM_SWITCH_BYTES];
+// Only switches ignored by hand are saved. A switch ignored for
+// chattering is ignored until the next boot, so one bad window (a ball
+// rattling on a switch) can't take a switch out for good.
+byte SwitchesIgnoredSaved[NUM_SWITCH_BYTES];
+// Switches the game expects to sit closed or to close fast (trough,
+// drop targets, spinners) are never marked stuck or ignored
+byte SwitchHealthExempt[NUM_SWITCH_BYTES] = {0x00};
+// Low byte of each switch's closures when the chatter window started
+byte SwitchChatterBase[MAX_NUM_SWITCHES];
+unsigned long SwitchChatterWindowStart = 0;
+void LoadSwitchHealth();
+#define SWITCHES_NOT_IGNORED(switchByte)  ((byte)~SwitchesIgnored[switchByte])
+#else
+#define SWITCHES_NOT_IGNORED(switchByte)  0xFF
+#endif
+
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+// micros() when each switch on the stack was pushed, and the stamp
+// of the switch most recently pulled (0 once the stack runs dry)
+volatile unsigned long SwitchStackTime[SWITCH_STACK_SIZE];
+unsigned long CurrentSwitchTime = 0;
+#endif
+
+#ifdef RPU_OS_SWITCH_RECORDER
+// Switch edges seen by the ISR, waiting for RPU_Update() to send them.
+// The top bit of switchNum marks an opening.
+#define SWITCH_RECORD_SIZE          32
+#define SWITCH_RECORD_OPEN          0x80
+// Lead bytes of the serial records (a closure is 0x80 | switch number)
+#define SWITCH_RECORD_SNAPSHOT      0xFC
+#define SWITCH_RECORD_OPENING       0xFD
+#define SWITCH_RECORD_LOST          0xFE
+struct SwitchRecordEntry {
+  byte switchNum;
+  unsigned long time;
+};
+volatile SwitchRecordEntry SwitchRecord[SWITCH_RECORD_SIZE];
+volatile byte SwitchRecordFirst = 0;
+volatile byte SwitchRecordLast = 0;
+volatile byte SwitchRecordsLost = 0;
+// Edges are only recorded after the starting snapshot has gone out
+volatile boolean SwitchRecorderOn = false;
+unsigned long SwitchRecordLastSent = 0;
+#endif
+
 // The WTYPE1 and WTYPE2 sound cards can only play one sound at a time,
 // so these structures allow the app to send in as many calls as they
 // want, but with a priority and requested amount of time to let 
@@ -1355,10 +1467,137 @@ int SpaceLeftOnSwitchStack() {
   return (SwitchStackFirst - SwitchStackLast) - 1;
 }
 
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+// Called by the ISR with each switch byte's new reading. Returns the
+// switches that have just closed (SwitchChanges has both edges).
+byte DebounceSwitchByte(byte switchByte) {
+  byte debounced = SwitchesDebounced[switchByte];
+  byte differs = (SwitchesNow[switchByte] & SWITCHES_NOT_IGNORED(switchByte)) ^ debounced;
+
+  // Count the scans that disagree, and start over on one that doesn't
+  byte count0 = DebounceCount0[switchByte];
+  byte count1 = DebounceCount1[switchByte];
+  byte count2 = (DebounceCount2[switchByte] ^ (count1 & count0)) & differs;
+  count1 = (count1 ^ count0) & differs;
+  count0 = ~count0 & differs;
+
+  // Closed switches are counting toward their open depth, open ones
+  // toward their close depth
+  byte depth0 = (debounced & (OpenDepth0[switchByte] ^ DEBOUNCE_SLICE(DEBOUNCE_DEFAULT_OPEN_SCANS, 0))) |
+                (~debounced & (CloseDepth0[switchByte] ^ DEBOUNCE_SLICE(DEBOUNCE_DEFAULT_CLOSE_SCANS, 0)));
+  byte depth1 = (debounced & (OpenDepth1[switchByte] ^ DEBOUNCE_SLICE(DEBOUNCE_DEFAULT_OPEN_SCANS, 1))) |
+                (~debounced & (CloseDepth1[switchByte] ^ DEBOUNCE_SLICE(DEBOUNCE_DEFAULT_CLOSE_SCANS, 1)));
+  byte depth2 = (debounced & (OpenDepth2[switchByte] ^ DEBOUNCE_SLICE(DEBOUNCE_DEFAULT_OPEN_SCANS, 2))) |
+                (~debounced & (CloseDepth2[switchByte] ^ DEBOUNCE_SLICE(DEBOUNCE_DEFAULT_CLOSE_SCANS, 2)));
+  byte changes = differs & ~((count0^depth0) | (count1^depth1) | (count2^depth2));
+
+  DebounceCount0[switchByte] = count0 & ~changes;
+  DebounceCount1[switchByte] = count1 & ~changes;
+  DebounceCount2[switchByte] = count2 & ~changes;
+  SwitchesDebounced[switchByte] = debounced ^ changes;
+  SwitchChanges[switchByte] = changes;
+  return changes & ~debounced;
+}
+#endif
+
+#ifdef RPU_OS_TIMED_SWITCHES
+boolean QueueTimedSwitchEvent(byte switchNum, unsigned long eventTime) {
+  byte nextLast = TimedSwitchQueueLast + 1;
+  if (nextLast>=TIMED_SWITCH_QUEUE_SIZE) nextLast = 0;
+  if (nextLast==TimedSwitchQueueFirst) return false;
+  TimedSwitchQueue[TimedSwitchQueueLast].switchNum = switchNum;
+  TimedSwitchQueue[TimedSwitchQueueLast].time = eventTime;
+  TimedSwitchQueueLast = nextLast;
+  return true;
+}
+
+// Called by the ISR for each switch byte once its history has been
+// shifted (closures come through PushToSwitchStack)
+void QueueTimedSwitchOpenings(byte switchByte) {
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+  byte openings = SwitchChanges[switchByte] & ~SwitchesDebounced[switchByte];
+#else
+  byte openings = ~(SwitchesNow[switchByte] | SwitchesMinus1[switchByte]) & SwitchesMinus2[switchByte] & SWITCHES_NOT_IGNORED(switchByte);
+#endif
+  openings &= TimedSwitchMask[switchByte];
+#ifdef RPU_OS_COUNTED_SWITCHES
+  openings &= ~CountedSwitchMask[switchByte];
+#endif
+  if (openings==0) return;
+
+  unsigned long edgeTime = millis();
+  byte switchNum = switchByte*8;
+  for (byte switchBit=0x01; switchBit; switchBit<<=1) {
+    if (openings & switchBit) QueueTimedSwitchEvent(switchNum | SWITCH_EVENT_OPENED, edgeTime);
+    switchNum += 1;
+  }
+}
+#endif
+
+#ifdef RPU_OS_SWITCH_HEALTH
+// Called by the ISR for each switch byte once its history has been
+// shifted. A scan that disagrees with the scans on both sides of it is
+// unstable whether or not the debounce let it through.
+void UpdateSwitchHealth(byte switchByte) {
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+  byte closures = SwitchChanges[switchByte] & SwitchesDebounced[switchByte];
+  byte openings = SwitchChanges[switchByte] & ~SwitchesDebounced[switchByte];
+#else
+  byte closures = (SwitchesNow[switchByte] & SwitchesMinus1[switchByte]) & ~SwitchesMinus2[switchByte];
+  byte openings = ~(SwitchesNow[switchByte] | SwitchesMinus1[switchByte]) & SwitchesMinus2[switchByte];
+#endif
+  byte unstable = (SwitchesNow[switchByte] ^ SwitchesMinus1[switchByte]) & (SwitchesMinus1[switchByte] ^ SwitchesMinus2[switchByte]);
+  if ((closures|openings|unstable)==0) return;
+
+  unsigned short edgeTick = 0;
+  if (closures|openings) edgeTick = (unsigned short)(millis()/10);
+  byte timed = SwitchClosureTimed[switchByte];
+  byte switchNum = switchByte*8;
+  for (byte switchBit=0x01; switchBit; switchBit<<=1) {
+    if ((unstable & switchBit) && SwitchUnstableSamples[switchNum]!=0xFFFF) SwitchUnstableSamples[switchNum] += 1;
+    if (closures & switchBit) {
+      SwitchClosures[switchNum] += 1;
+      SwitchClosedSince[switchNum] = edgeTick;
+    } else if (openings & timed & switchBit) {
+      unsigned short closedFor = edgeTick - SwitchClosedSince[switchNum];
+      if (closedFor>SwitchLongestClosure[switchNum]) SwitchLongestClosure[switchNum] = closedFor;
+    }
+    switchNum += 1;
+  }
+  // Exempt switches are expected to sit closed, so they aren't timed
+  SwitchClosureTimed[switchByte] = (timed | (closures & ~SwitchHealthExempt[switchByte])) & ~openings;
+}
+#endif
+
 void PushToSwitchStack(byte switchNumber) {
   //if ((switchNumber>=MAX_NUM_SWITCHES && switchNumber!=SW_SELF_TEST_SWITCH)) return;
   if (switchNumber==SWITCH_STACK_EMPTY) return;
 
+#if defined(RPU_OS_COUNTED_SWITCHES) || defined(RPU_OS_TIMED_SWITCHES)
+  // Counted and timed switches never take up room on the stack
+  if (switchNumber<MAX_NUM_SWITCHES) {
+    byte switchByte = switchNumber/8;
+    byte switchBit = 0x01<<(switchNumber%8);
+#ifdef RPU_OS_COUNTED_SWITCHES
+    if (CountedSwitchMask[switchByte] & switchBit) {
+      SwitchCounts[switchNumber] += 1;
+#ifdef RPU_OS_TIMED_SWITCHES
+      if ((TimedSwitchMask[switchByte] & ~TimedCountPending[switchByte]) & switchBit) {
+        if (QueueTimedSwitchEvent(switchNumber, millis())) TimedCountPending[switchByte] |= switchBit;
+      }
+#endif
+      return;
+    }
+#endif
+#ifdef RPU_OS_TIMED_SWITCHES
+    if (TimedSwitchMask[switchByte] & switchBit) {
+      QueueTimedSwitchEvent(switchNumber, millis());
+      return;
+    }
+#endif
+  }
+#endif
+
   // If the switch stack last index is out of range, then it's an error - return
   if (SpaceLeftOnSwitchStack()==0) return;
 
@@ -1369,6 +1608,10 @@ void PushToSwitchStack(byte switchNumber) {
   }
 
   SwitchStack[SwitchStackLast] = switchNumber;
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  SwitchStackTime[SwitchStackLast] = micros();
+  if (SwitchStackTime[SwitchStackLast]==0) SwitchStackTime[SwitchStackLast] = 1;
+#endif
   
   SwitchStackLast += 1;
   if (SwitchStackLast==SWITCH_STACK_SIZE) {
@@ -1387,11 +1630,68 @@ boolean RPU_MaxSwitchesPerCycleHit() {
 }
 #endif
 
+#ifdef RPU_OS_COUNTED_SWITCHES
+boolean RPU_SetSwitchCounted(byte switchNum, boolean counted) {
+  if (switchNum>=MAX_NUM_SWITCHES) return false;
+  if (counted) CountedSwitchMask[switchNum/8] |= (0x01 << (switchNum%8));
+  else CountedSwitchMask[switchNum/8] &= ~(0x01 << (switchNum%8));
+  // Start from zero either way
+  SwitchCountsPulled[switchNum] = SwitchCounts[switchNum];
+  return true;
+}
+
+byte RPU_PullSwitchCount(byte switchNum) {
+  if (switchNum>=MAX_NUM_SWITCHES) return 0;
+  byte count = SwitchCounts[switchNum];
+  byte retVal = count - SwitchCountsPulled[switchNum];
+  SwitchCountsPulled[switchNum] = count;
+  return retVal;
+}
+#endif
+
+#ifdef RPU_OS_TIMED_SWITCHES
+boolean RPU_SetSwitchTimed(byte switchNum, boolean timed) {
+  if (switchNum>=MAX_NUM_SWITCHES) return false;
+  if (timed) TimedSwitchMask[switchNum/8] |= (0x01 << (switchNum%8));
+  else TimedSwitchMask[switchNum/8] &= ~(0x01 << (switchNum%8));
+  return true;
+}
+
+byte RPU_PullTimedSwitchEvent(unsigned long *eventTime) {
+  if (TimedSwitchQueueFirst==TimedSwitchQueueLast) return SWITCH_STACK_EMPTY;
+
+  byte retVal = TimedSwitchQueue[TimedSwitchQueueFirst].switchNum;
+  if (eventTime) *eventTime = TimedSwitchQueue[TimedSwitchQueueFirst].time;
+  byte nextFirst = TimedSwitchQueueFirst + 1;
+  if (nextFirst>=TIMED_SWITCH_QUEUE_SIZE) nextFirst = 0;
+  TimedSwitchQueueFirst = nextFirst;
+
+#ifdef RPU_OS_COUNTED_SWITCHES
+  // The next closure of a counted switch starts a new batch
+  if (retVal<MAX_NUM_SWITCHES && (CountedSwitchMask[retVal/8] & (0x01<<(retVal%8)))) {
+    noInterrupts();
+    TimedCountPending[retVal/8] &= ~(0x01<<(retVal%8));
+    interrupts();
+  }
+#endif
+
+  return retVal;
+}
+#endif
+
 byte RPU_PullFirstFromSwitchStack() {
   // If first and last are equal, there's nothing on the stack
-  if (SwitchStackFirst==SwitchStackLast) return SWITCH_STACK_EMPTY;
+  if (SwitchStackFirst==SwitchStackLast) {
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+    CurrentSwitchTime = 0;
+#endif
+    return SWITCH_STACK_EMPTY;
+  }
 
   byte retVal = SwitchStack[SwitchStackFirst];
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  CurrentSwitchTime = SwitchStackTime[SwitchStackFirst];
+#endif
 
   SwitchStackFirst += 1;
   if (SwitchStackFirst>=SWITCH_STACK_SIZE) SwitchStackFirst = 0;
@@ -1399,6 +1699,114 @@ byte RPU_PullFirstFromSwitchStack() {
   return retVal;
 }
 
+#ifdef RPU_OS_SWITCH_RECORDER
+void RecordSwitchEdge(byte switchNum, unsigned long edgeTime) {
+  byte nextLast = SwitchRecordLast + 1;
+  if (nextLast>=SWITCH_RECORD_SIZE) nextLast = 0;
+  if (nextLast==SwitchRecordFirst) {
+    if (SwitchRecordsLost<255) SwitchRecordsLost += 1;
+    return;
+  }
+  SwitchRecord[SwitchRecordLast].switchNum = switchNum;
+  SwitchRecord[SwitchRecordLast].time = edgeTime;
+  SwitchRecordLast = nextLast;
+}
+
+// Called by the ISR for each switch byte once its history has been
+// shifted: records validated closures (off, on, on) and openings (on, off, off)
+// (or, with debounce depths, the byte's debounced changes)
+void RecordSwitchEdges(byte switchByte) {
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+  byte closures = SwitchChanges[switchByte] & SwitchesDebounced[switchByte];
+  byte openings = SwitchChanges[switchByte] & ~SwitchesDebounced[switchByte];
+#else
+  byte closures = (SwitchesNow[switchByte] & SwitchesMinus1[switchByte]) & ~SwitchesMinus2[switchByte];
+  byte openings = ~(SwitchesNow[switchByte] | SwitchesMinus1[switchByte]) & SwitchesMinus2[switchByte];
+#endif
+  if ((closures|openings)==0) return;
+
+  unsigned long edgeTime = millis();
+  byte switchNum = switchByte*8;
+  for (byte switchBit=0x01; switchBit; switchBit<<=1) {
+    if (closures & switchBit) RecordSwitchEdge(switchNum, edgeTime);
+    else if (openings & switchBit) RecordSwitchEdge(switchNum | SWITCH_RECORD_OPEN, edgeTime);
+    switchNum += 1;
+  }
+}
+
+// Writes the record's time as a delta from the last record sent:
+// 7 bits per byte, low bits first, top bit set if more bytes follow
+byte AppendSwitchRecordTime(byte *buf, unsigned long recordTime) {
+  unsigned long delta = recordTime - SwitchRecordLastSent;
+  SwitchRecordLastSent = recordTime;
+  byte len = 0;
+  while (delta>=0x80) {
+    buf[len++] = (delta & 0x7F) | 0x80;
+    delta = delta>>7;
+  }
+  buf[len++] = (byte)delta;
+  return len;
+}
+
+// Sends what the ISR has recorded, as long as it fits in the Serial
+// transmit buffer (so the loop never waits on the UART). The first
+// call sends the switch states it starts from, and so does the first
+// call after the ISR had to drop edges.
+void SendSwitchRecords(unsigned long currentTime) {
+  byte buf[4+NUM_SWITCH_BYTES+5];
+  byte len;
+
+  if (!SwitchRecorderOn || SwitchRecordsLost) {
+    if (Serial.availableForWrite()<(int)sizeof(buf)) return;
+    len = 0;
+    noInterrupts();
+    byte numLost = SwitchRecordsLost;
+    SwitchRecordsLost = 0;
+    SwitchRecordFirst = SwitchRecordLast;
+    for (byte count=0; count<NUM_SWITCH_BYTES; count++) buf[len+2+count] = SwitchesNow[count];
+    SwitchRecorderOn = true;
+    interrupts();
+    if (numLost) {
+      buf[0] = SWITCH_RECORD_LOST;
+      buf[1] = numLost;
+      Serial.write(buf, 2);
+    }
+    buf[0] = SWITCH_RECORD_SNAPSHOT;
+    buf[1] = NUM_SWITCH_BYTES;
+    len = 2 + NUM_SWITCH_BYTES;
+    len += AppendSwitchRecordTime(buf+len, currentTime);
+    Serial.write(buf, len);
+  }
+
+  while (SwitchRecordFirst!=SwitchRecordLast && Serial.availableForWrite()>=7) {
+    byte switchNum = SwitchRecord[SwitchRecordFirst].switchNum;
+    unsigned long edgeTime = SwitchRecord[SwitchRecordFirst].time;
+    if (switchNum & SWITCH_RECORD_OPEN) {
+      buf[0] = SWITCH_RECORD_OPENING;
+      buf[1] = switchNum & ~SWITCH_RECORD_OPEN;
+      len = 2;
+    } else {
+      buf[0] = 0x80 | switchNum;
+      len = 1;
+    }
+    len += AppendSwitchRecordTime(buf+len, edgeTime);
+    Serial.write(buf, len);
+
+    byte nextFirst = SwitchRecordFirst + 1;
+    if (nextFirst>=SWITCH_RECORD_SIZE) nextFirst = 0;
+    SwitchRecordFirst = nextFirst;
+  }
+}
+#endif
+
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+// Anything the game does between pulling a switch and asking for the
+// next one can be traced back to that closure with this stamp
+unsigned long RPU_GetCurrentSwitchTime() {
+  return CurrentSwitchTime;
+}
+#endif
+
 
 boolean RPU_ReadSingleSwitchState(byte switchNum) {
   if (switchNum>=MAX_NUM_SWITCHES) return false;
@@ -1417,6 +1825,151 @@ boolean RPU_SetSwitchInversion(byte switchNum) {
   return true;
 }
 
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+void SetDebounceSlices(byte *slice0, byte *slice1, byte *slice2, byte switchNum, byte scans) {
+  byte switchByte = switchNum/8;
+  byte switchBit = 0x01 << (switchNum%8);
+  if (scans & 0x01) slice0[switchByte] |= switchBit;
+  else slice0[switchByte] &= ~switchBit;
+  if (scans & 0x02) slice1[switchByte] |= switchBit;
+  else slice1[switchByte] &= ~switchBit;
+  if (scans & 0x04) slice2[switchByte] |= switchBit;
+  else slice2[switchByte] &= ~switchBit;
+}
+
+boolean RPU_SetSwitchDebounce(byte switchNum, byte closeScans, byte openScans) {
+  if (switchNum>=MAX_NUM_SWITCHES) return false;
+  if (closeScans<1 || closeScans>DEBOUNCE_MAX_SCANS || openScans<1 || openScans>DEBOUNCE_MAX_SCANS) return false;
+  SetDebounceSlices(CloseDepth0, CloseDepth1, CloseDepth2, switchNum, closeScans ^ DEBOUNCE_DEFAULT_CLOSE_SCANS);
+  SetDebounceSlices(OpenDepth0, OpenDepth1, OpenDepth2, switchNum, openScans ^ DEBOUNCE_DEFAULT_OPEN_SCANS);
+  return true;
+}
+#endif
+
+#ifdef RPU_OS_SWITCH_HEALTH
+boolean SwitchHealthSaveDue = false;
+
+byte RPU_GetNumSwitches() {
+  return MAX_NUM_SWITCHES;
+}
+
+unsigned long RPU_GetSwitchClosures(byte switchNum) {
+  if (switchNum>=MAX_NUM_SWITCHES) return 0;
+  noInterrupts();
+  unsigned long closures = SwitchClosures[switchNum];
+  interrupts();
+  return closures;
+}
+
+unsigned short RPU_GetSwitchUnstableSamples(byte switchNum) {
+  if (switchNum>=MAX_NUM_SWITCHES) return 0;
+  noInterrupts();
+  unsigned short unstableSamples = SwitchUnstableSamples[switchNum];
+  interrupts();
+  return unstableSamples;
+}
+
+unsigned long RPU_GetSwitchLongestClosure(byte switchNum) {
+  if (switchNum>=MAX_NUM_SWITCHES) return 0;
+  unsigned short nowTick = (unsigned short)(millis()/10);
+  noInterrupts();
+  unsigned short longest = SwitchLongestClosure[switchNum];
+  if (SwitchClosureTimed[switchNum/8] & (0x01<<(switchNum%8))) {
+    unsigned short closedFor = nowTick - SwitchClosedSince[switchNum];
+    if (closedFor>longest) longest = closedFor;
+  }
+  interrupts();
+  return ((unsigned long)longest)*10;
+}
+
+void RPU_ClearSwitchHealth(byte switchNum) {
+  if (switchNum>=MAX_NUM_SWITCHES) return;
+  noInterrupts();
+  SwitchClosures[switchNum] = 0;
+  SwitchUnstableSamples[switchNum] = 0;
+  SwitchLongestClosure[switchNum] = 0;
+  SwitchClosureTimed[switchNum/8] &= ~(0x01<<(switchNum%8));
+  SwitchesIgnored[switchNum/8] &= ~(0x01<<(switchNum%8));
+  interrupts();
+  SwitchesIgnoredSaved[switchNum/8] &= ~(0x01<<(switchNum%8));
+  SwitchChatterBase[switchNum] = 0;
+  SwitchHealthSaveDue = true;
+}
+
+boolean RPU_SetSwitchIgnored(byte switchNum, boolean ignored) {
+  if (switchNum>=MAX_NUM_SWITCHES) return false;
+  byte switchBit = 0x01<<(switchNum%8);
+  noInterrupts();
+  if (ignored) SwitchesIgnored[switchNum/8] |= switchBit;
+  else SwitchesIgnored[switchNum/8] &= ~switchBit;
+  interrupts();
+  byte oldSaved = SwitchesIgnoredSaved[switchNum/8];
+  if (ignored) SwitchesIgnoredSaved[switchNum/8] = oldSaved | switchBit;
+  else SwitchesIgnoredSaved[switchNum/8] = oldSaved & ~switchBit;
+  // Save right away, so a reboot doesn't bring a bad switch back
+  if (oldSaved!=SwitchesIgnoredSaved[switchNum/8]) SwitchHealthSaveDue = true;
+  return true;
+}
+
+boolean RPU_GetSwitchIgnored(byte switchNum) {
+  if (switchNum>=MAX_NUM_SWITCHES) return false;
+  return (SwitchesIgnored[switchNum/8] & (0x01<<(switchNum%8))) ? true : false;
+}
+
+boolean RPU_SetSwitchHealthExempt(byte switchNum, boolean exempt) {
+  if (switchNum>=MAX_NUM_SWITCHES) return false;
+  byte switchBit = 0x01<<(switchNum%8);
+  noInterrupts();
+  if (exempt) {
+    SwitchHealthExempt[switchNum/8] |= switchBit;
+    SwitchClosureTimed[switchNum/8] &= ~switchBit;
+  } else {
+    SwitchHealthExempt[switchNum/8] &= ~switchBit;
+  }
+  interrupts();
+  return true;
+}
+
+// Counted switches (spinners) are meant to close fast and never reach
+// the stack, so they're left alone, and so are exempt switches. A switch
+// that has been closed long enough to run out of ticks is marked as stuck
+// at the longest time that fits.
+byte RPU_UpdateSwitchHealth(unsigned long currentTime) {
+  if ((currentTime-SwitchChatterWindowStart)<RPU_OS_SWITCH_CHATTER_WINDOW) return SWITCH_STACK_EMPTY;
+  SwitchChatterWindowStart = currentTime;
+
+  byte chatteringSwitch = SWITCH_STACK_EMPTY;
+  unsigned short nowTick = (unsigned short)(millis()/10);
+  for (byte switchNum=0; switchNum<MAX_NUM_SWITCHES; switchNum++) {
+    byte switchByte = switchNum/8;
+    byte switchBit = 0x01<<(switchNum%8);
+    // The low byte is all that's needed, and it's read in one go
+    byte closures = (byte)SwitchClosures[switchNum];
+    byte windowClosures = closures - SwitchChatterBase[switchNum];
+    SwitchChatterBase[switchNum] = closures;
+
+    noInterrupts();
+    if ((SwitchClosureTimed[switchByte] & switchBit) && ((unsigned short)(nowTick-SwitchClosedSince[switchNum]))>=SWITCH_HEALTH_STUCK_TICKS) {
+      SwitchLongestClosure[switchNum] = 0xFFFF;
+      SwitchClosureTimed[switchByte] &= ~switchBit;
+    }
+    interrupts();
+
+    if (windowClosures<RPU_OS_SWITCH_CHATTER_CLOSURES || ((SwitchesIgnored[switchByte] | SwitchHealthExempt[switchByte]) & switchBit)) continue;
+#ifdef RPU_OS_COUNTED_SWITCHES
+    if (CountedSwitchMask[switchByte] & switchBit) continue;
+#endif
+    // Not saved (see SwitchesIgnoredSaved)
+    noInterrupts();
+    SwitchesIgnored[switchByte] |= switchBit;
+    interrupts();
+    chatteringSwitch = switchNum;
+  }
+
+  return chatteringSwitch;
+}
+#endif
+
 
 byte RPU_GetDipSwitches(byte index) {
 #ifdef RPU_OS_USE_DIP_SWITCHES
@@ -2165,10 +2718,20 @@ void RPU_ClearVariables() {
     SwitchesMinus1[switchCount] = 0xFF;
     SwitchesNow[switchCount] = 0xFF;
     SwitchInverter[switchCount] = 0x00;
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+    SwitchesDebounced[switchCount] = 0xFF;
+    SwitchChanges[switchCount] = 0x00;
+    DebounceCount0[switchCount] = 0x00;
+    DebounceCount1[switchCount] = 0x00;
+    DebounceCount2[switchCount] = 0x00;
+#endif
 #ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS    
     ImmediateSolenoidSwitchMask[switchCount] = 0x00;
 #endif    
   }
+#ifdef RPU_OS_SWITCH_HEALTH
+  LoadSwitchHealth();
+#endif
 
 #ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS    
   for (byte count=0; count<MAX_IMMEDIATE_STREAMLINED_SOLENOIDS; count++) {
@@ -2486,18 +3049,429 @@ void RPU_PlayW11Music(byte songNum) {
  *   EEPROM Helper Functions
  */
 
-void RPU_WriteByteToEEProm(unsigned short startByte, byte value) {
-  EEPROM.write(startByte, value);
+#ifdef RPU_OS_AUDIT_LOG_START_BYTE
+unsigned short FlushAuditLog();
+byte AuditLogDirty = 0;
+#endif
+#ifdef RPU_OS_SWITCH_HEALTH
+unsigned short FlushSwitchHealth();
+#endif
+
+#if defined(RPU_OS_EEPROM_SHADOW_SIZE) && defined(RPU_OS_CREDITS_RING_START_BYTE)
+// Rewriting the credits byte in place on every coin and every start
+// would wear it out first of all the cells (in under a year at 200
+// games a day), so each new value goes into the next record of a ring:
+//
+//    byte 0     lap (0-15, 0xFF when never written)
+//    byte 1     credits
+//
+// The lap is written after the credits, so a record cut off part way
+// still has the last lap's number and the record before it is the
+// newest. As in the audit log, the head is the first record whose lap
+// differs from the first record's. Each change writes 2 cells, and
+// each cell once a lap, so 64 records last 64 times as long as the
+// old byte. A ring that has never been written starts from the old
+// byte, which is then no longer written.
+byte CreditsRingHead = 0;
+byte CreditsRingLap = 0;
+
+byte LoadCreditsRing(byte oldCredits) {
+  byte firstLap = EEPROM.read(RPU_OS_CREDITS_RING_START_BYTE);
+  CreditsRingHead = 0;
+  CreditsRingLap = 0;
+  if (firstLap==0xFF) return oldCredits;
+
+  CreditsRingLap = (firstLap+1) & 0x0F;
+  for (byte recordNum=1; recordNum<RPU_OS_CREDITS_RING_NUM_RECORDS; recordNum++) {
+    if (EEPROM.read(RPU_OS_CREDITS_RING_START_BYTE + ((unsigned short)recordNum)*2)!=firstLap) {
+      CreditsRingHead = recordNum;
+      CreditsRingLap = firstLap;
+      break;
+    }
+  }
+  byte newest = (CreditsRingHead==0) ? (RPU_OS_CREDITS_RING_NUM_RECORDS-1) : (CreditsRingHead-1);
+  return EEPROM.read(RPU_OS_CREDITS_RING_START_BYTE + ((unsigned short)newest)*2 + 1);
+}
+
+void WriteCreditsRing(byte credits) {
+  unsigned short address = RPU_OS_CREDITS_RING_START_BYTE + ((unsigned short)CreditsRingHead)*2;
+  EEPROM.write(address+1, credits);
+  EEPROM.write(address, CreditsRingLap);
+  CreditsRingHead += 1;
+  if (CreditsRingHead>=RPU_OS_CREDITS_RING_NUM_RECORDS) {
+    CreditsRingHead = 0;
+    CreditsRingLap = (CreditsRingLap+1) & 0x0F;
+  }
+}
+#endif
+
+#ifdef RPU_OS_EEPROM_SHADOW_SIZE
+// Settings and audits live in a RAM copy of the bottom of the EEPROM.
+// Writes only change the copy (and mark the byte dirty) and the EEPROM
+// isn't touched until RPU_FlushEEProm(), which the game calls at safe
+// points and which only writes bytes that really changed. Each EEPROM
+// write blocks for ~3.3ms.
+//
+// Credits are money the player has already paid, so they're always
+// written through (to the credits ring, if there is one). The coin audit that goes with a credit
+// waits for the next flush, so a power loss in between leaves the
+// audits short rather than the player. Flushes go in address order,
+// which (because longs are stored low byte first) means a counter cut
+// off part way through reads low rather than high.
+byte EEPromShadow[RPU_OS_EEPROM_SHADOW_SIZE];
+byte EEPromShadowDirty[(RPU_OS_EEPROM_SHADOW_SIZE+7)/8];
+boolean EEPromShadowLoaded = false;
+
+void LoadEEPromShadow() {
+  for (unsigned short count=0; count<RPU_OS_EEPROM_SHADOW_SIZE; count++) {
+    EEPromShadow[count] = EEPROM.read(count);
+  }
+  for (unsigned short count=0; count<((RPU_OS_EEPROM_SHADOW_SIZE+7)/8); count++) {
+    EEPromShadowDirty[count] = 0;
+  }
+#ifdef RPU_OS_CREDITS_RING_START_BYTE
+  EEPromShadow[RPU_CREDITS_EEPROM_BYTE] = LoadCreditsRing(EEPromShadow[RPU_CREDITS_EEPROM_BYTE]);
+#endif
+  EEPromShadowLoaded = true;
 }
 
-byte RPU_ReadByteFromEEProm(unsigned short startByte) {
-  byte value = EEPROM.read(startByte);
+byte ReadEEPromByte(unsigned short address) {
+  if (address>=RPU_OS_EEPROM_SHADOW_SIZE) return EEPROM.read(address);
+  if (!EEPromShadowLoaded) LoadEEPromShadow();
+  return EEPromShadow[address];
+}
+
+void WriteEEPromByte(unsigned short address, byte value) {
+  if (address>=RPU_OS_EEPROM_SHADOW_SIZE) {
+    EEPROM.write(address, value);
+    return;
+  }
+  if (!EEPromShadowLoaded) LoadEEPromShadow();
+  if (EEPromShadow[address]==value) return;
+  EEPromShadow[address] = value;
+#ifdef RPU_OS_CREDITS_RING_START_BYTE
+  if (address==RPU_CREDITS_EEPROM_BYTE) WriteCreditsRing(value);
+#else
+  if (address==RPU_CREDITS_EEPROM_BYTE) EEPROM.write(address, value);
+#endif
+  else EEPromShadowDirty[address/8] |= (1<<(address%8));
+}
+
+unsigned short RPU_FlushEEProm() {
+  unsigned short bytesWritten = 0;
+
+  for (unsigned short count=0; EEPromShadowLoaded && count<((RPU_OS_EEPROM_SHADOW_SIZE+7)/8); count++) {
+    if (EEPromShadowDirty[count]==0) continue;
+    for (byte bitCount=0; bitCount<8; bitCount++) {
+      if ((EEPromShadowDirty[count] & (1<<bitCount))==0) continue;
+      unsigned short address = count*8 + bitCount;
+      // A byte that was changed and then changed back doesn't need writing
+      if (EEPROM.read(address)!=EEPromShadow[address]) {
+        EEPROM.write(address, EEPromShadow[address]);
+        bytesWritten += 1;
+      }
+    }
+    EEPromShadowDirty[count] = 0;
+  }
+#ifdef RPU_OS_AUDIT_LOG_START_BYTE
+  bytesWritten += FlushAuditLog();
+#endif
+#ifdef RPU_OS_SWITCH_HEALTH
+  bytesWritten += FlushSwitchHealth();
+#endif
+  return bytesWritten;
+}
 
-  // If this value is unset, set it
-  if (value==0xFF) {
-    value = 0;
-    RPU_WriteByteToEEProm(startByte, value);
+boolean RPU_EEPromNeedsFlush() {
+#ifdef RPU_OS_AUDIT_LOG_START_BYTE
+  if (AuditLogDirty) return true;
+#endif
+  if (!EEPromShadowLoaded) return false;
+  for (unsigned short count=0; count<((RPU_OS_EEPROM_SHADOW_SIZE+7)/8); count++) {
+    if (EEPromShadowDirty[count]) return true;
   }
+  return false;
+}
+#else
+#define ReadEEPromByte(address)         EEPROM.read(address)
+#define WriteEEPromByte(address, value) EEPROM.write(address, value)
+
+unsigned short RPU_FlushEEProm() {
+#ifdef RPU_OS_SWITCH_HEALTH
+  return FlushSwitchHealth();
+#else
+  return 0;
+#endif
+}
+
+boolean RPU_EEPromNeedsFlush() {
+  return false;
+}
+#endif
+
+#ifdef RPU_OS_AUDIT_LOG_START_BYTE
+// The counters that go up with every game or coin would wear out their
+// cells long before the rest of the EEPROM if they were rewritten in
+// place, so instead each new value is appended as a record to a ring
+// that rotates through the whole span:
+//
+//    byte 0     lap (high nibble) & counter number (low nibble)
+//    bytes 1-4  value, low byte first
+//    byte 5     checksum
+//
+// The lap goes up each time the ring wraps, so at boot the write head
+// is the first record whose lap differs from the first record's lap.
+// Each counter's value is its newest record with a good checksum. The
+// header is written last, and before a record is overwritten any counter
+// whose newest record it holds is carried forward, so no counter ever
+// depends on a record that's being written.
+//
+// Each append writes 6 cells once, and every cell is written once per
+// lap. With 120 records and 6 counters that's at least 114 appends a lap,
+// and only counters that changed since the last flush are appended. At
+// 100,000 writes a cell, 200 games a day with ~3 counters changing a game
+// the span lasts about 100,000*114/600 = ~52 years. The total plays byte
+// rewritten in place would be worn out in about 100,000/200 = 500 days.
+#define AUDIT_LOG_RECORD_SIZE     6
+#define AUDIT_LOG_NO_COUNTER      0x0F
+#define AUDIT_LOG_NO_RECORD       0xFF
+
+unsigned short AuditLogCounterAddress[] = {RPU_TOTAL_PLAYS_EEPROM_START_BYTE, RPU_TOTAL_REPLAYS_EEPROM_START_BYTE, RPU_TOTAL_HISCORE_BEATEN_START_BYTE,
+                                           RPU_CHUTE_1_COINS_START_BYTE, RPU_CHUTE_2_COINS_START_BYTE, RPU_CHUTE_3_COINS_START_BYTE};
+#define AUDIT_LOG_NUM_COUNTERS    (sizeof(AuditLogCounterAddress)/sizeof(unsigned short))
+
+unsigned long AuditLogValue[AUDIT_LOG_NUM_COUNTERS];
+byte AuditLogNewestRecord[AUDIT_LOG_NUM_COUNTERS];
+byte AuditLogHead;
+byte AuditLogLap;
+boolean AuditLogLoaded = false;
+
+byte AuditLogCounterNum(unsigned short startByte) {
+  for (byte count=0; count<AUDIT_LOG_NUM_COUNTERS; count++) {
+    if (AuditLogCounterAddress[count]==startByte) return count;
+  }
+  return AUDIT_LOG_NO_COUNTER;
+}
+
+byte AuditLogChecksum(byte *record) {
+  byte checksum = 0xA5;
+  for (byte count=0; count<(AUDIT_LOG_RECORD_SIZE-1); count++) checksum += record[count];
+  return checksum;
+}
+
+// Returns the record's counter number, or AUDIT_LOG_NO_COUNTER if it
+// was never written or is corrupt
+byte ReadAuditLogRecord(byte recordNum, unsigned long *value) {
+  byte record[AUDIT_LOG_RECORD_SIZE];
+  unsigned short address = RPU_OS_AUDIT_LOG_START_BYTE + ((unsigned short)recordNum)*AUDIT_LOG_RECORD_SIZE;
+  for (byte count=0; count<AUDIT_LOG_RECORD_SIZE; count++) record[count] = EEPROM.read(address+count);
+
+  byte counterNum = record[0] & 0x0F;
+  if (counterNum>=AUDIT_LOG_NUM_COUNTERS) return AUDIT_LOG_NO_COUNTER;
+  if (record[AUDIT_LOG_RECORD_SIZE-1]!=AuditLogChecksum(record)) return AUDIT_LOG_NO_COUNTER;
+  *value = ((unsigned long)record[4]<<24) | ((unsigned long)record[3]<<16) | ((unsigned long)record[2]<<8) | (unsigned long)record[1];
+  return counterNum;
+}
+
+void LoadAuditLog() {
+  unsigned long value;
+
+  // Find the write head
+  byte firstLap = EEPROM.read(RPU_OS_AUDIT_LOG_START_BYTE)>>4;
+  AuditLogHead = 0;
+  AuditLogLap = (firstLap+1) & 0x0F;
+  if (EEPROM.read(RPU_OS_AUDIT_LOG_START_BYTE)==0xFF) {
+    // Nothing has been logged yet
+    AuditLogLap = 0;
+  } else {
+    for (byte recordNum=1; recordNum<RPU_OS_AUDIT_LOG_NUM_RECORDS; recordNum++) {
+      if ((EEPROM.read(RPU_OS_AUDIT_LOG_START_BYTE + ((unsigned short)recordNum)*AUDIT_LOG_RECORD_SIZE)>>4)!=firstLap) {
+        AuditLogHead = recordNum;
+        AuditLogLap = firstLap;
+        break;
+      }
+    }
+  }
+
+  // Walk back from the head to find each counter's newest value
+  for (byte count=0; count<AUDIT_LOG_NUM_COUNTERS; count++) AuditLogNewestRecord[count] = AUDIT_LOG_NO_RECORD;
+  byte recordNum = AuditLogHead;
+  for (byte count=0; count<RPU_OS_AUDIT_LOG_NUM_RECORDS; count++) {
+    recordNum = (recordNum==0) ? (RPU_OS_AUDIT_LOG_NUM_RECORDS-1) : (recordNum-1);
+    byte counterNum = ReadAuditLogRecord(recordNum, &value);
+    if (counterNum==AUDIT_LOG_NO_COUNTER || AuditLogNewestRecord[counterNum]!=AUDIT_LOG_NO_RECORD) continue;
+    AuditLogNewestRecord[counterNum] = recordNum;
+    AuditLogValue[counterNum] = value;
+  }
+
+  // Counters that have never been logged start from their old
+  // in-place value
+  for (byte count=0; count<AUDIT_LOG_NUM_COUNTERS; count++) {
+    if (AuditLogNewestRecord[count]!=AUDIT_LOG_NO_RECORD) continue;
+    unsigned short startByte = AuditLogCounterAddress[count];
+    AuditLogValue[count] = (((unsigned long)ReadEEPromByte(startByte+3))<<24) | 
+                           ((unsigned long)(ReadEEPromByte(startByte+2))<<16) | 
+                           ((unsigned long)(ReadEEPromByte(startByte+1))<<8) | 
+                           ((unsigned long)(ReadEEPromByte(startByte)));
+  }
+  AuditLogDirty = 0;
+  AuditLogLoaded = true;
+}
+
+void WriteAuditLogRecord(byte counterNum) {
+  byte record[AUDIT_LOG_RECORD_SIZE];
+  unsigned short address = RPU_OS_AUDIT_LOG_START_BYTE + ((unsigned short)AuditLogHead)*AUDIT_LOG_RECORD_SIZE;
+
+  record[0] = (AuditLogLap<<4) | counterNum;
+  record[1] = (byte)(AuditLogValue[counterNum] & 0x000000FF);
+  record[2] = (byte)((AuditLogValue[counterNum]>>8) & 0x000000FF);
+  record[3] = (byte)((AuditLogValue[counterNum]>>16) & 0x000000FF);
+  record[4] = (byte)(AuditLogValue[counterNum]>>24);
+  record[5] = AuditLogChecksum(record);
+  for (byte count=1; count<AUDIT_LOG_RECORD_SIZE; count++) EEPROM.write(address+count, record[count]);
+  EEPROM.write(address, record[0]);
+
+  AuditLogNewestRecord[counterNum] = AuditLogHead;
+  AuditLogHead += 1;
+  if (AuditLogHead>=RPU_OS_AUDIT_LOG_NUM_RECORDS) {
+    AuditLogHead = 0;
+    AuditLogLap = (AuditLogLap+1) & 0x0F;
+  }
+}
+
+// Returns the number of bytes written
+unsigned short AppendToAuditLog(byte counterNum) {
+  unsigned short bytesWritten = 0;
+  boolean carriedForward = true;
+
+  while (carriedForward) {
+    carriedForward = false;
+    for (byte count=0; count<AUDIT_LOG_NUM_COUNTERS; count++) {
+      if (count!=counterNum && AuditLogNewestRecord[count]==AuditLogHead) {
+        WriteAuditLogRecord(count);
+        bytesWritten += AUDIT_LOG_RECORD_SIZE;
+        carriedForward = true;
+      }
+    }
+  }
+  WriteAuditLogRecord(counterNum);
+  return bytesWritten + AUDIT_LOG_RECORD_SIZE;
+}
+
+unsigned short FlushAuditLog() {
+  unsigned short bytesWritten = 0;
+  for (byte count=0; count<AUDIT_LOG_NUM_COUNTERS; count++) {
+    if (AuditLogDirty & (1<<count)) bytesWritten += AppendToAuditLog(count);
+  }
+  AuditLogDirty = 0;
+  return bytesWritten;
+}
+#endif
+
+#ifdef RPU_OS_SWITCH_HEALTH
+// The switch statistics go up all through a game, so they're saved
+// lazily: a pass starts at most every RPU_OS_SWITCH_HEALTH_SAVE_MINUTES
+// (or right away after the ignored switches or a switch's statistics
+// were changed by hand), and each flush does a few switches of it, so
+// no single flush blocks for long. Only bytes that changed are written.
+// A busy switch's closure count rewrites its low byte at most once an
+// hour, so its cell lasts over ten years of a machine that's never off.
+//
+//    byte 0               signature (written at the end of a pass)
+//    bytes 1-8            switches ignored by hand
+//    bytes 16 + 8n        switch n: closures (4 bytes, low byte first),
+//                         unstable samples (2), longest closure in 10ms (2)
+#define SWITCH_HEALTH_SIGNATURE         (0xA0 | NUM_SWITCH_BYTES)
+#define SWITCH_HEALTH_RECORD_START      (RPU_OS_SWITCH_HEALTH_START_BYTE + 16)
+#define SWITCH_HEALTH_RECORD_SIZE       8
+#define SWITCH_HEALTH_RECORDS_PER_FLUSH 8
+#define SWITCH_HEALTH_NOT_SAVING        0xFF
+
+unsigned long LastSwitchHealthSave = 0;
+byte SwitchHealthSaveNext = SWITCH_HEALTH_NOT_SAVING;
+
+void LoadSwitchHealth() {
+  boolean saved = (EEPROM.read(RPU_OS_SWITCH_HEALTH_START_BYTE)==SWITCH_HEALTH_SIGNATURE);
+  byte record[SWITCH_HEALTH_RECORD_SIZE];
+
+  for (byte switchNum=0; switchNum<MAX_NUM_SWITCHES; switchNum++) {
+    unsigned short address = SWITCH_HEALTH_RECORD_START + ((unsigned short)switchNum)*SWITCH_HEALTH_RECORD_SIZE;
+    for (byte count=0; count<SWITCH_HEALTH_RECORD_SIZE; count++) record[count] = saved ? EEPROM.read(address+count) : 0;
+    SwitchClosures[switchNum] = ((unsigned long)record[3]<<24) | ((unsigned long)record[2]<<16) | ((unsigned long)record[1]<<8) | record[0];
+    SwitchUnstableSamples[switchNum] = ((unsigned short)record[5]<<8) | record[4];
+    SwitchLongestClosure[switchNum] = ((unsigned short)record[7]<<8) | record[6];
+    SwitchChatterBase[switchNum] = record[0];
+  }
+  for (byte count=0; count<NUM_SWITCH_BYTES; count++) {
+    SwitchesIgnoredSaved[count] = saved ? EEPROM.read(RPU_OS_SWITCH_HEALTH_START_BYTE+1+count) : 0x00;
+    SwitchesIgnored[count] = SwitchesIgnoredSaved[count];
+    SwitchClosureTimed[count] = 0x00;
+  }
+
+  LastSwitchHealthSave = millis();
+  SwitchHealthSaveNext = SWITCH_HEALTH_NOT_SAVING;
+  SwitchHealthSaveDue = false;
+}
+
+byte UpdateEEPromByte(unsigned short address, byte value) {
+  if (EEPROM.read(address)==value) return 0;
+  EEPROM.write(address, value);
+  return 1;
+}
+
+unsigned short FlushSwitchHealth() {
+  unsigned short bytesWritten = 0;
+
+  if (SwitchHealthSaveNext==SWITCH_HEALTH_NOT_SAVING) {
+    if (!SwitchHealthSaveDue && (millis()-LastSwitchHealthSave)<(RPU_OS_SWITCH_HEALTH_SAVE_MINUTES*60000UL)) return 0;
+    SwitchHealthSaveDue = false;
+    LastSwitchHealthSave = millis();
+    SwitchHealthSaveNext = 0;
+    for (byte count=0; count<NUM_SWITCH_BYTES; count++) {
+      bytesWritten += UpdateEEPromByte(RPU_OS_SWITCH_HEALTH_START_BYTE+1+count, SwitchesIgnoredSaved[count]);
+    }
+  }
+
+  byte record[SWITCH_HEALTH_RECORD_SIZE];
+  for (byte count=0; count<SWITCH_HEALTH_RECORDS_PER_FLUSH && SwitchHealthSaveNext<MAX_NUM_SWITCHES; count++) {
+    byte switchNum = SwitchHealthSaveNext;
+    noInterrupts();
+    unsigned long closures = SwitchClosures[switchNum];
+    unsigned short unstableSamples = SwitchUnstableSamples[switchNum];
+    unsigned short longest = SwitchLongestClosure[switchNum];
+    interrupts();
+    record[0] = (byte)closures;
+    record[1] = (byte)(closures>>8);
+    record[2] = (byte)(closures>>16);
+    record[3] = (byte)(closures>>24);
+    record[4] = (byte)unstableSamples;
+    record[5] = (byte)(unstableSamples>>8);
+    record[6] = (byte)longest;
+    record[7] = (byte)(longest>>8);
+    unsigned short address = SWITCH_HEALTH_RECORD_START + ((unsigned short)switchNum)*SWITCH_HEALTH_RECORD_SIZE;
+    for (byte byteNum=0; byteNum<SWITCH_HEALTH_RECORD_SIZE; byteNum++) bytesWritten += UpdateEEPromByte(address+byteNum, record[byteNum]);
+    SwitchHealthSaveNext += 1;
+  }
+
+  if (SwitchHealthSaveNext>=MAX_NUM_SWITCHES) {
+    bytesWritten += UpdateEEPromByte(RPU_OS_SWITCH_HEALTH_START_BYTE, SWITCH_HEALTH_SIGNATURE);
+    SwitchHealthSaveNext = SWITCH_HEALTH_NOT_SAVING;
+  }
+  return bytesWritten;
+}
+#endif
+
+void RPU_WriteByteToEEProm(unsigned short startByte, byte value) {
+  WriteEEPromByte(startByte, value);
+}
+
+byte RPU_ReadByteFromEEProm(unsigned short startByte, byte defaultValue) {
+  byte value = ReadEEPromByte(startByte);
+
+  // An unset value reads as its default. It isn't written back, so a
+  // new EEPROM boots without any writes and the byte is only written
+  // when the value really changes.
+  if (value==0xFF) value = defaultValue;
   return value;
 }
 
@@ -2505,24 +3479,43 @@ byte RPU_ReadByteFromEEProm(unsigned short startByte) {
 unsigned long RPU_ReadULFromEEProm(unsigned short startByte, unsigned long defaultValue) {
   unsigned long value;
 
-  value = (((unsigned long)EEPROM.read(startByte+3))<<24) | 
-          ((unsigned long)(EEPROM.read(startByte+2))<<16) | 
-          ((unsigned long)(EEPROM.read(startByte+1))<<8) | 
-          ((unsigned long)(EEPROM.read(startByte)));
+#ifdef RPU_OS_AUDIT_LOG_START_BYTE
+  byte counterNum = AuditLogCounterNum(startByte);
+  if (counterNum!=AUDIT_LOG_NO_COUNTER) {
+    if (!AuditLogLoaded) LoadAuditLog();
+    value = AuditLogValue[counterNum];
+  } else
+#endif
+  value = (((unsigned long)ReadEEPromByte(startByte+3))<<24) | 
+          ((unsigned long)(ReadEEPromByte(startByte+2))<<16) | 
+          ((unsigned long)(ReadEEPromByte(startByte+1))<<8) | 
+          ((unsigned long)(ReadEEPromByte(startByte)));
 
-  if (value==0xFFFFFFFF) {
-    value = defaultValue; 
-    RPU_WriteULToEEProm(startByte, value);
-  }
+  // Unset reads as the default, without writing it back
+  if (value==0xFFFFFFFF) value = defaultValue;
   return value;
 }
 
 
 void RPU_WriteULToEEProm(unsigned short startByte, unsigned long value) {
-  EEPROM.write(startByte+3, (byte)(value>>24));
-  EEPROM.write(startByte+2, (byte)((value>>16) & 0x000000FF));
-  EEPROM.write(startByte+1, (byte)((value>>8) & 0x000000FF));
-  EEPROM.write(startByte, (byte)(value & 0x000000FF));
+#ifdef RPU_OS_AUDIT_LOG_START_BYTE
+  byte counterNum = AuditLogCounterNum(startByte);
+  if (counterNum!=AUDIT_LOG_NO_COUNTER) {
+    if (!AuditLogLoaded) LoadAuditLog();
+    if (AuditLogValue[counterNum]==value) return;
+    AuditLogValue[counterNum] = value;
+#ifdef RPU_OS_EEPROM_SHADOW_SIZE
+    AuditLogDirty |= (1<<counterNum);
+#else
+    AppendToAuditLog(counterNum);
+#endif
+    return;
+  }
+#endif
+  WriteEEPromByte(startByte+3, (byte)(value>>24));
+  WriteEEPromByte(startByte+2, (byte)((value>>16) & 0x000000FF));
+  WriteEEPromByte(startByte+1, (byte)((value>>8) & 0x000000FF));
+  WriteEEPromByte(startByte, (byte)(value & 0x000000FF));
 }
 
 
@@ -2756,7 +3749,12 @@ void InterruptService3() {
   byte u10AControl = RPU_DataRead(ADDRESS_U10_A_CONTROL);
   if (u10AControl & 0x80) {
     // self test switch
-    if (RPU_DataRead(ADDRESS_U10_A_CONTROL) & 0x80) PushToSwitchStack(SW_SELF_TEST_SWITCH);
+    if (RPU_DataRead(ADDRESS_U10_A_CONTROL) & 0x80) {
+      PushToSwitchStack(SW_SELF_TEST_SWITCH);
+#ifdef RPU_OS_SWITCH_RECORDER
+      if (SwitchRecorderOn) RecordSwitchEdge(SW_SELF_TEST_SWITCH, millis());
+#endif
+    }
     RPU_DataRead(ADDRESS_U10_A);
   }
 
@@ -2842,7 +3840,7 @@ void InterruptService3() {
 #ifndef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
 
       // Some switches need to trigger immediate closures (bumpers & slings)
-      startingClosures = (SwitchesNow[switchCount]) & (~SwitchesMinus1[switchCount]);
+      startingClosures = (SwitchesNow[switchCount]) & (~SwitchesMinus1[switchCount]) & SWITCHES_NOT_IGNORED(switchCount);
       boolean immediateSolenoidFired = false;
       // If one of the switches is starting to close (off, on)
       if (startingClosures) {
@@ -2866,7 +3864,11 @@ void InterruptService3() {
       }
 
       immediateSolenoidFired = false;
-      validClosures = (SwitchesNow[switchCount] & SwitchesMinus1[switchCount]) & ~SwitchesMinus2[switchCount];
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+      validClosures = DebounceSwitchByte(switchCount);
+#else
+      validClosures = (SwitchesNow[switchCount] & SwitchesMinus1[switchCount]) & ~SwitchesMinus2[switchCount] & SWITCHES_NOT_IGNORED(switchCount);
+#endif
       // If there is a valid switch closure (off, on, on)
       if (validClosures) {
         // Loop on bits of switch byte
@@ -2902,7 +3904,7 @@ void InterruptService3() {
       // Streamlined version of solenoid handling
       boolean immediateSolenoidFired = false;
       // Some switches need to trigger immediate closures (bumpers & slings)
-      startingClosures = (SwitchesNow[switchCount]) & (~SwitchesMinus1[switchCount]);
+      startingClosures = (SwitchesNow[switchCount]) & (~SwitchesMinus1[switchCount]) & SWITCHES_NOT_IGNORED(switchCount);
       if (startingClosures & ImmediateSolenoidSwitchMask[switchCount]) {
         // This switch requires an immediate solenoid response
         for (byte immediateTrigger=0; immediateTrigger<NumGamePrioritySwitches; immediateTrigger++) {
@@ -2915,7 +3917,11 @@ void InterruptService3() {
       }
 
       immediateSolenoidFired = false;
-      validClosures = (SwitchesNow[switchCount] & SwitchesMinus1[switchCount]) & ~SwitchesMinus2[switchCount];
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+      validClosures = DebounceSwitchByte(switchCount);
+#else
+      validClosures = (SwitchesNow[switchCount] & SwitchesMinus1[switchCount]) & ~SwitchesMinus2[switchCount] & SWITCHES_NOT_IGNORED(switchCount);
+#endif
       // If there is a valid switch closure (off, on, on)
       if (validClosures) {
 
@@ -2949,6 +3955,15 @@ void InterruptService3() {
 
 #endif
 
+#ifdef RPU_OS_SWITCH_RECORDER
+      if (SwitchRecorderOn) RecordSwitchEdges(switchCount);
+#endif
+#ifdef RPU_OS_TIMED_SWITCHES
+      QueueTimedSwitchOpenings(switchCount);
+#endif
+#ifdef RPU_OS_SWITCH_HEALTH
+      UpdateSwitchHealth(switchCount);
+#endif
 
       // There are no port reads or writes for the rest of the loop, 
       // so we can allow the display interrupt to fire
@@ -3614,7 +4629,12 @@ ISR(TIMER1_COMPA_vect) {    //This is the interrupt request (running at 965.3 Hz
     byte displayControlPortA = RPU_DataRead(PIA_DISPLAY_CONTROL_A);
     if (displayControlPortA & 0x80) {
       // If the diagnostic switch isn't on the stack already, put it there
-      if (!CheckSwitchStack(SW_SELF_TEST_SWITCH)) PushToSwitchStack(SW_SELF_TEST_SWITCH);
+      if (!CheckSwitchStack(SW_SELF_TEST_SWITCH)) {
+        PushToSwitchStack(SW_SELF_TEST_SWITCH);
+#ifdef RPU_OS_SWITCH_RECORDER
+        if (SwitchRecorderOn) RecordSwitchEdge(SW_SELF_TEST_SWITCH, millis());
+#endif
+      }
       // Clear the interrupt
       RPU_DataRead(PIA_DISPLAY_PORT_A);
     }
@@ -3637,7 +4657,20 @@ ISR(TIMER1_COMPA_vect) {    //This is the interrupt request (running at 965.3 Hz
     
     // If there are any closures, add them to the switch stack
     for (byte switchCol=0; switchCol<NUM_SWITCH_BYTES; switchCol++) {
-      byte validClosures = (SwitchesNow[switchCol] & SwitchesMinus1[switchCol]) & ~SwitchesMinus2[switchCol];
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+      byte validClosures = DebounceSwitchByte(switchCol);
+#else
+      byte validClosures = (SwitchesNow[switchCol] & SwitchesMinus1[switchCol]) & ~SwitchesMinus2[switchCol] & SWITCHES_NOT_IGNORED(switchCol);
+#endif
+#ifdef RPU_OS_SWITCH_RECORDER
+      if (SwitchRecorderOn) RecordSwitchEdges(switchCol);
+#endif
+#ifdef RPU_OS_TIMED_SWITCHES
+      QueueTimedSwitchOpenings(switchCol);
+#endif
+#ifdef RPU_OS_SWITCH_HEALTH
+      UpdateSwitchHealth(switchCol);
+#endif
       // If there is a valid switch closure (off, on, on)
       if (validClosures) {
         // Loop on bits of switch byte
@@ -3950,6 +4983,14 @@ void RPU_Update(unsigned long currentTime) {
 #if (RPU_MPU_ARCHITECTURE>=10) && (defined(RPU_OS_USE_WTYPE_1_SOUND) || defined(RPU_OS_USE_WTYPE_2_SOUND))
   RPU_UpdateTimedSoundStack(currentTime);
 #endif
+#ifdef RPU_OS_SWITCH_RECORDER
+  SendSwitchRecords(currentTime);
+#endif
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+  // The game is done with switches for this loop (even if it didn't
+  // pull until the stack was empty)
+  CurrentSwitchTime = 0;
+#endif
 
 }
 
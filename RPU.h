@@ -80,6 +80,11 @@ byte RPU_GetDipSwitches(byte index);
 //   Swtiches
 byte RPU_PullFirstFromSwitchStack();
 boolean RPU_SetSwitchInversion(byte switchNum);
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+// Scans in a row (1-7) a switch has to read closed before it closes, and
+// open before it opens. Every switch starts at 2 and 1.
+boolean RPU_SetSwitchDebounce(byte switchNum, byte closeScans, byte openScans = 1);
+#endif
 boolean RPU_ReadSingleSwitchState(byte switchNum);
 void RPU_PushToSwitchStack(byte switchNumber);
 boolean RPU_GetUpDownSwitchState(); // This always returns true for RPU_MPU_ARCHITECTURE==1 (no up/down switch)
@@ -87,6 +92,40 @@ void RPU_ClearUpDownSwitchState();
 #ifdef RPU_OS_DEBUG_SWITCHES
 boolean RPU_MaxSwitchesPerCycleHit();
 #endif
+#ifdef RPU_OS_COUNTED_SWITCHES
+boolean RPU_SetSwitchCounted(byte switchNum, boolean counted = true);
+byte RPU_PullSwitchCount(byte switchNum); // closures since the last pull (wraps at 256)
+#endif
+#ifdef RPU_OS_TIMED_SWITCHES
+#define SWITCH_EVENT_OPENED 0x80
+boolean RPU_SetSwitchTimed(byte switchNum, boolean timed = true);
+// Returns the switch number (| SWITCH_EVENT_OPENED for an opening) or SWITCH_STACK_EMPTY,
+// and the millis() of the switch scan that saw the edge
+byte RPU_PullTimedSwitchEvent(unsigned long *eventTime);
+#endif
+#ifdef RPU_OS_SWITCH_HEALTH
+// Kept by the switch scan for every switch, and saved by RPU_FlushEEProm()
+// at most every RPU_OS_SWITCH_HEALTH_SAVE_MINUTES
+byte RPU_GetNumSwitches();
+unsigned long RPU_GetSwitchClosures(byte switchNum);
+unsigned short RPU_GetSwitchUnstableSamples(byte switchNum); // scans that disagreed with the scans on both sides
+unsigned long RPU_GetSwitchLongestClosure(byte switchNum); // ms, including a closure that's still going
+void RPU_ClearSwitchHealth(byte switchNum); // also stops ignoring the switch
+// An ignored switch still reads as it is, but its closures never reach
+// the debounce, the immediate solenoids or the stack. Switches ignored
+// here are saved; ones ignored for chattering last until the next boot.
+boolean RPU_SetSwitchIgnored(byte switchNum, boolean ignored = true);
+boolean RPU_GetSwitchIgnored(byte switchNum);
+// For switches that sit closed by design (trough, drop targets) or close
+// fast (spinners): they're never timed as stuck or ignored for chattering
+boolean RPU_SetSwitchHealthExempt(byte switchNum, boolean exempt = true);
+// Call every loop. Ignores a switch that closes RPU_OS_SWITCH_CHATTER_CLOSURES
+// times in one window (until the next boot), and returns it (or SWITCH_STACK_EMPTY)
+byte RPU_UpdateSwitchHealth(unsigned long currentTime);
+#endif
+#ifdef RPU_OS_SWITCH_LATENCY_STATS
+unsigned long RPU_GetCurrentSwitchTime(); // micros() of the closure being handled, 0 if none
+#endif
 
 //   Solenoids
 void RPU_PushToSolenoidStack(byte solenoidNumber, byte numPushes, boolean disableOverride = false);
@@ -173,10 +212,12 @@ void RPU_SetBoardLEDs(boolean LED1, boolean LED2, byte BCDValue = 0xFF);
 #endif
 
 // EEProm Helper Functions
-byte RPU_ReadByteFromEEProm(unsigned short startByte);
+byte RPU_ReadByteFromEEProm(unsigned short startByte, byte defaultValue=0);
 void RPU_WriteByteToEEProm(unsigned short startByte, byte value);
 unsigned long RPU_ReadULFromEEProm(unsigned short startByte, unsigned long defaultValue=0);
 void RPU_WriteULToEEProm(unsigned short startByte, unsigned long value);
+unsigned short RPU_FlushEEProm(); // Writes changed settings & audits, returns bytes written
+boolean RPU_EEPromNeedsFlush();
 
 
 #ifdef RPU_CPP_FILE
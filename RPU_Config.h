@@ -33,7 +33,10 @@
 // Hardware Rev 100 (different order of magnitude because it's a different approach) plugs into the CPU socket
 // Hardware Rev 101 - first RPU CPU interposer release board
 // Hardware Rev 102 - second RPU (with display and WIFI socket)
+// (the rev can be set from the command line, e.g. by the host ISR timing builds)
+#ifndef RPU_OS_HARDWARE_REV
 #define RPU_OS_HARDWARE_REV   101
+#endif
 
 // Available Architectures (0-9 is for B/S Boards, 10-19 is for W)
 //  RPU_MPU_ARCHITECTURE 1 = -17, -35, 100, 200, or compatible
@@ -68,6 +71,30 @@
 //#define RPU_OS_USE_W11_SOUND
 #define RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
 #define RPU_OS_DEBUG_SWITCHES
+// RAM below is for 40 switches (5 switch bytes). `make isr-report` shows
+// the handler time of the two options that are off next to the baseline.
+// Switches marked with RPU_SetSwitchCounted() (spinners) are counted by the
+// ISR instead of being pushed onto the switch stack - see RPU_PullSwitchCount()
+// (2 bytes of RAM a switch + 5)
+#define RPU_OS_COUNTED_SWITCHES
+// Switches marked with RPU_SetSwitchTimed() report their closures and
+// openings with the millis() of the switch scan - see RPU_PullTimedSwitchEvent()
+// (87 bytes of RAM, 92 with counted switches)
+#define RPU_OS_TIMED_SWITCHES
+// Per-switch debounce depths (RPU_SetSwitchDebounce()) instead of the
+// fixed off, on, on closure (11 bytes of RAM a switch byte: 55)
+//#define RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+// Closures, unstable scans and longest closure for every switch (shown on
+// the self-test page after the switch test), and switches that chatter
+// are ignored - see RPU_UpdateSwitchHealth(). Costs 11 bytes of RAM a
+// switch + 30 (470), and a millis()/10 in the ISR for each switch byte
+// with an edge.
+//#define RPU_OS_SWITCH_HEALTH
+//#define RPU_OS_SWITCH_LATENCY_STATS
+// Streams debounced switch edges with millis() stamps out of Serial as
+// binary records (see host/SwitchTrace.h) so a game can be replayed on the
+// host build. The game has to open Serial.
+//#define RPU_OS_SWITCH_RECORDER
 
 
 
@@ -170,5 +197,29 @@
 #define RPU_CPC_CHUTE_2_SELECTION_BYTE            51
 #define RPU_CPC_CHUTE_3_SELECTION_BYTE            52
 
+// EEPROM bytes below this are cached in RAM and written by RPU_FlushEEProm()
+// (comment this out to write straight through). The game keeps its own
+// settings block at byte 100.
+#define RPU_OS_EEPROM_SHADOW_SIZE                 64
+
+// Play, replay, high score and coin audits are kept in a wear-leveled
+// log of 6-byte records here instead of at their own addresses
+#define RPU_OS_AUDIT_LOG_START_BYTE               256
+#define RPU_OS_AUDIT_LOG_NUM_RECORDS              120
+
+// Switch health statistics (16 bytes + 8 a switch). Bytes that changed
+// are rewritten at most this often, a few switches per flush.
+#define RPU_OS_SWITCH_HEALTH_START_BYTE           1024
+#define RPU_OS_SWITCH_HEALTH_SAVE_MINUTES         60
+// A switch that closes this many times in one window (ms) is chattering
+// (at the default debounce a switch can close at most 40 times a second)
+#define RPU_OS_SWITCH_CHATTER_CLOSURES            40
+#define RPU_OS_SWITCH_CHATTER_WINDOW              2000
+
+// Credits change with every coin and start, so (with the shadow above)
+// they're written to a ring of 2-byte records here instead of in place
+#define RPU_OS_CREDITS_RING_START_BYTE            1600
+#define RPU_OS_CREDITS_RING_NUM_RECORDS           64
+
 #define RPU_CONFIG_H
 #endif
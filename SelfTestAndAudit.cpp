@@ -280,6 +280,52 @@ int RunBaseSelfTest(int curState, boolean curStateChanged, unsigned long Current
       }
     }
 
+#ifdef RPU_OS_SWITCH_HEALTH
+  } else if (curState==MACHINE_STATE_TEST_SWITCH_HEALTH) {
+    // Shows closures, unstable samples, longest closure (ms) and the
+    // switch number (flashing if the switch is being ignored). The reset
+    // button steps through the switches, closing a switch shows it, and
+    // a double click clears the switch and stops ignoring it.
+    byte numSwitches = RPU_GetNumSwitches();
+    if (curStateChanged) {
+      RPU_TurnOffAllLamps();
+      RPU_DisableSolenoidStack();
+      RPU_SetDisableFlippers(true);
+
+      // Start on an ignored switch, or else the least stable one
+      unsigned short mostUnstable = 0;
+      CurValue = 0;
+      for (byte switchNum=0; switchNum<numSwitches; switchNum++) {
+        if (RPU_GetSwitchIgnored(switchNum)) {
+          CurValue = switchNum;
+          break;
+        }
+        if (RPU_GetSwitchUnstableSamples(switchNum)>mostUnstable) {
+          mostUnstable = RPU_GetSwitchUnstableSamples(switchNum);
+          CurValue = switchNum;
+        }
+      }
+    }
+
+    if (curSwitch==resetSwitch || resetDoubleClick) {
+      // The first click of a double click has already stepped off the
+      // switch, so step back to it
+      boolean stepUp = RPU_GetUpDownSwitchState();
+      if (resetDoubleClick) stepUp = !stepUp;
+      if (stepUp) CurValue = (CurValue+1<numSwitches) ? CurValue+1 : 0;
+      else CurValue = (CurValue>0) ? CurValue-1 : numSwitches-1;
+      if (resetDoubleClick) RPU_ClearSwitchHealth(CurValue);
+    } else if (curSwitch<numSwitches) {
+      CurValue = curSwitch;
+    }
+
+    RPU_SetDisplay(0, RPU_GetSwitchClosures(CurValue), true);
+    RPU_SetDisplay(1, RPU_GetSwitchUnstableSamples(CurValue), true);
+    RPU_SetDisplay(2, RPU_GetSwitchLongestClosure(CurValue), true);
+    if (RPU_GetSwitchIgnored(CurValue)) RPU_SetDisplayFlash(3, CurValue, CurrentTime, 250);
+    else RPU_SetDisplay(3, CurValue, true);
+#endif
+
   } else if (curState==MACHINE_STATE_TEST_SOUNDS) {
 #ifdef RPU_OS_USE_SB100    
     byte soundToPlay = 0x01 << (((CurrentTime-LastSelfTestChange)/750)%8);
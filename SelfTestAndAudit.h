@@ -22,52 +22,65 @@
 #ifndef SELF_TEST_H
 #define SELF_TEST_H
 
+// The state numbers depend on the architecture and options
+#include "RPU_Config.h"
+
+// The switch health page (RPU_OS_SWITCH_HEALTH) goes right after the
+// switch test, and every page after it moves down one
+#ifdef RPU_OS_SWITCH_HEALTH
+#define MACHINE_STATE_TEST_HEALTH_PAGES   1
+#else
+#define MACHINE_STATE_TEST_HEALTH_PAGES   0
+#endif
+
 #if (RPU_MPU_ARCHITECTURE<10)
 #define MACHINE_STATE_TEST_LAMPS          -1
 #define MACHINE_STATE_TEST_DISPLAYS       -2
 #define MACHINE_STATE_TEST_SOLENOIDS      -3
 #define MACHINE_STATE_TEST_SWITCHES       -4
-#define MACHINE_STATE_TEST_SOUNDS         -5
-#define MACHINE_STATE_TEST_SCORE_LEVEL_1  -6
-#define MACHINE_STATE_TEST_SCORE_LEVEL_2  -7
-#define MACHINE_STATE_TEST_SCORE_LEVEL_3  -8
-#define MACHINE_STATE_TEST_HISCR          -9
-#define MACHINE_STATE_TEST_CREDITS        -10
-#define MACHINE_STATE_TEST_TOTAL_PLAYS    -11
-#define MACHINE_STATE_TEST_TOTAL_REPLAYS  -12
-#define MACHINE_STATE_TEST_HISCR_BEAT     -13
-#define MACHINE_STATE_TEST_CHUTE_2_COINS  -14
-#define MACHINE_STATE_TEST_CHUTE_1_COINS  -15
-#define MACHINE_STATE_TEST_CHUTE_3_COINS  -16
-#define MACHINE_STATE_TEST_BOOT           -17
+#define MACHINE_STATE_TEST_SWITCH_HEALTH  -5
+#define MACHINE_STATE_TEST_SOUNDS         (-5-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_SCORE_LEVEL_1  (-6-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_SCORE_LEVEL_2  (-7-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_SCORE_LEVEL_3  (-8-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_HISCR          (-9-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_CREDITS        (-10-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_TOTAL_PLAYS    (-11-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_TOTAL_REPLAYS  (-12-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_HISCR_BEAT     (-13-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_CHUTE_2_COINS  (-14-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_CHUTE_1_COINS  (-15-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_CHUTE_3_COINS  (-16-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_BOOT           (-17-MACHINE_STATE_TEST_HEALTH_PAGES)
 #else
 #define MACHINE_STATE_TEST_SWITCHES       -1
-#define MACHINE_STATE_TEST_SOLENOIDS      -2
-#define MACHINE_STATE_TEST_SOUNDS         -3
-#define MACHINE_STATE_TEST_LAMPS          -4
-#define MACHINE_STATE_TEST_DISPLAYS       -5
-#define MACHINE_STATE_TEST_BOOT           -6
-#define MACHINE_STATE_TEST_HISCR          -7
-#define MACHINE_STATE_TEST_SCORE_LEVEL_1  -8
-#define MACHINE_STATE_TEST_SCORE_LEVEL_2  -9
-#define MACHINE_STATE_TEST_SCORE_LEVEL_3  -10
-#define MACHINE_STATE_TEST_CREDITS        -11
-#define MACHINE_STATE_TEST_TOTAL_PLAYS    -12
-#define MACHINE_STATE_TEST_TOTAL_REPLAYS  -13
-#define MACHINE_STATE_TEST_HISCR_BEAT     -14
-#define MACHINE_STATE_TEST_CHUTE_2_COINS  -15
-#define MACHINE_STATE_TEST_CHUTE_1_COINS  -16
-#define MACHINE_STATE_TEST_CHUTE_3_COINS  -17
+#define MACHINE_STATE_TEST_SWITCH_HEALTH  -2
+#define MACHINE_STATE_TEST_SOLENOIDS      (-2-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_SOUNDS         (-3-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_LAMPS          (-4-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_DISPLAYS       (-5-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_BOOT           (-6-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_HISCR          (-7-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_SCORE_LEVEL_1  (-8-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_SCORE_LEVEL_2  (-9-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_SCORE_LEVEL_3  (-10-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_CREDITS        (-11-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_TOTAL_PLAYS    (-12-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_TOTAL_REPLAYS  (-13-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_HISCR_BEAT     (-14-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_CHUTE_2_COINS  (-15-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_CHUTE_1_COINS  (-16-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_TEST_CHUTE_3_COINS  (-17-MACHINE_STATE_TEST_HEALTH_PAGES)
 #endif 
 
 #ifndef RPU_OS_DISABLE_CPC_FOR_SPACE  
-#define MACHINE_STATE_ADJUST_CPC_CHUTE_1        -18
-#define MACHINE_STATE_ADJUST_CPC_CHUTE_2        -19 
-#define MACHINE_STATE_ADJUST_CPC_CHUTE_3        -20
+#define MACHINE_STATE_ADJUST_CPC_CHUTE_1        (-18-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_ADJUST_CPC_CHUTE_2        (-19-MACHINE_STATE_TEST_HEALTH_PAGES)
+#define MACHINE_STATE_ADJUST_CPC_CHUTE_3        (-20-MACHINE_STATE_TEST_HEALTH_PAGES)
 // This define is set to the last test, so the extended settings will know when to take over
-#define MACHINE_STATE_TEST_DONE           -20
+#define MACHINE_STATE_TEST_DONE           (-20-MACHINE_STATE_TEST_HEALTH_PAGES)
 #else
-#define MACHINE_STATE_TEST_DONE           -17
+#define MACHINE_STATE_TEST_DONE           (-17-MACHINE_STATE_TEST_HEALTH_PAGES)
 #endif
 
 unsigned long GetLastSelfTestChangedTime();
@@ -115,6 +115,34 @@ boolean MachineStateChanged = true;
 #define EEPROM_EXTRA_BALL_SCORE_BYTE    140
 #define EEPROM_SPECIAL_SCORE_BYTE       144
 
+// The settings above are loaded and saved as one block, laid out at the
+// same addresses, with a version and a CRC-16 after them
+#define EEPROM_SETTINGS_START_BYTE      100
+#define EEPROM_SETTINGS_VERSION         1
+struct GameSettings {
+  byte ballSave;                // 100
+  byte freePlay;                // 101
+  byte soundSelector;           // 102
+  byte skillShot;               // 103
+  byte tiltWarnings;            // 104
+  byte awardOverride;           // 105
+  byte ballsOverride;           // 106
+  byte tournamentScoring;       // 107
+  byte musicVolume;             // 108
+  byte sfxVolume;               // 109
+  byte scrollingScores;         // 110
+  byte calloutsVolume;          // 111
+  byte unused112;
+  byte dimLevel;                // 113
+  byte unused114[26];
+  uint32_t extraBallScore;      // 140
+  uint32_t specialScore;        // 144
+  byte version;                 // 148
+  byte unused149;
+  uint16_t crc;                 // 150 (covers 100-149)
+};
+GameSettings Settings;
+
 #define SOUND_EFFECT_NONE                     0
 #define SOUND_EFFECT_DT_SKILL_SHOT            1
 #define SOUND_EFFECT_ROLLOVER_SKILL_SHOT      2
@@ -256,17 +284,29 @@ byte VoiceNotificationDurations[NUM_VOICE_NOTIFICATIONS] = {
 #define OUTHOLE_EJECT_FORCE     2
 #define SAUCER_DISPLAY_DURATION         1000
 #define MODE_START_DISPLAY_DURATION     5000
+// Callouts about the ball in front of the player (jackpot, ball saved)
+// are dropped if they can't be played within this many ms
+#define CALLOUT_STALE_TIME              3000
 #define DROP_TARGET_CLEAR_DURATION      1000
 #define STANDUP_HIT_DISPLAY_DURATION    5000
 #define MAX_DROP_TARGET_CLEAR_DEADLINE  5000
 #define ROLLOVER_FLASH_DURATION         2000
 #define RESCUE_FROM_THE_DEEP_TIME       6000
 #define FEEDING_FRENZY_ALTERNATE_TIME   30000
+// (the mode timings can be set from the command line, e.g. by the host simulator)
+#ifndef MODE_QUALIFY_TIME
 #define MODE_QUALIFY_TIME               45000
+#endif
 #define SHARP_SHOOTER_TARGET_TIME       5000
+#ifndef MINI_GAME_SINGLE_DURATION
 #define MINI_GAME_SINGLE_DURATION       40000
+#endif
+#ifndef MINI_GAME_DOUBLE_DURATION
 #define MINI_GAME_DOUBLE_DURATION       66000
+#endif
+#ifndef MINI_GAME_TRIPLE_DURATION
 #define MINI_GAME_TRIPLE_DURATION       107000
+#endif
 #define WIZARD_MODE_DURATION            110000
 
 
@@ -370,6 +410,9 @@ unsigned long BallFirstSwitchHitTime = 0;
 unsigned long BallTimeInTrough = 0;
 unsigned long AutoPlungeTime = 0;
 unsigned long LastSpinnerHitTime = 0;
+#ifdef RPU_OS_TIMED_SWITCHES
+unsigned long OutholeClosedTime = 0;
+#endif
 unsigned long GameModeStartTime = 0;
 unsigned long GameModeEndTime = 0;
 unsigned long LastTiltWarningTime = 0;
@@ -395,61 +438,137 @@ unsigned short NumPopBumperHits[4];
 AudioHandler Audio;
 
 #define BALL_SAVE_GRACE_PERIOD  2000
+#define BALL_IN_TROUGH_SETTLE_TIME  750
 
 
+unsigned short CalculateCRC16(byte *data, unsigned short length) {
+  // CRC-16/CCITT-FALSE
+  unsigned short crc = 0xFFFF;
+  for (unsigned short count = 0; count < length; count++) {
+    crc ^= ((unsigned short)data[count]) << 8;
+    for (byte bitCount = 0; bitCount < 8; bitCount++) {
+      if (crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+      else crc = crc << 1;
+    }
+  }
+  return crc;
+}
+
+unsigned short GetSettingsCRC() {
+  return CalculateCRC16((byte *)&Settings, sizeof(GameSettings) - sizeof(Settings.crc));
+}
+
+void SaveSettings() {
+  Settings.version = EEPROM_SETTINGS_VERSION;
+  Settings.crc = GetSettingsCRC();
+  // put() only writes the bytes that changed
+  EEPROM.put(EEPROM_SETTINGS_START_BYTE, Settings);
+}
+
+void DefaultSetting(byte *setting, byte defaultValue) {
+  if (*setting == 0xFF) *setting = defaultValue;
+}
+
+// Returns true if the block had to be repaired and written back
+boolean LoadSettings() {
+  EEPROM.get(EEPROM_SETTINGS_START_BYTE, Settings);
+  if (Settings.version == EEPROM_SETTINGS_VERSION && Settings.crc == GetSettingsCRC()) return false;
+
+  // A new EEPROM has nothing to keep, so the defaults stay in RAM
+  // and the block is first written when an adjustment is saved
+  boolean blockErased = true;
+  for (byte count = 0; count < sizeof(GameSettings); count++) {
+    if (((byte *)&Settings)[count] != 0xFF) blockErased = false;
+  }
+
+  // Either the EEPROM is new or the settings were saved a byte at a
+  // time by older code, so keep anything that was set and default the rest
+  DefaultSetting(&Settings.ballSave, 15);
+  DefaultSetting(&Settings.freePlay, 0);
+  DefaultSetting(&Settings.soundSelector, 5);
+  DefaultSetting(&Settings.tiltWarnings, 2);
+  DefaultSetting(&Settings.awardOverride, 99);
+  DefaultSetting(&Settings.ballsOverride, 99);
+  DefaultSetting(&Settings.tournamentScoring, 0);
+  DefaultSetting(&Settings.musicVolume, 10);
+  DefaultSetting(&Settings.sfxVolume, 10);
+  DefaultSetting(&Settings.scrollingScores, 1);
+  DefaultSetting(&Settings.calloutsVolume, 10);
+  DefaultSetting(&Settings.dimLevel, 2);
+  if (Settings.extraBallScore == 0xFFFFFFFF) Settings.extraBallScore = 0;
+  if (Settings.specialScore == 0xFFFFFFFF) Settings.specialScore = 0;
+  if (blockErased) return false;
+  SaveSettings();
+  return true;
+}
+
+// Adjustments address settings by their EEPROM byte (which is also
+// their offset into the block)
+void WriteSetting(byte setting, byte value) {
+  ((byte *)&Settings)[setting - EEPROM_SETTINGS_START_BYTE] = value;
+  SaveSettings();
+}
+
+void WriteSettingUL(byte setting, unsigned long value) {
+  uint32_t settingValue = value;
+  memcpy(((byte *)&Settings) + (setting - EEPROM_SETTINGS_START_BYTE), &settingValue, sizeof(settingValue));
+  SaveSettings();
+}
+
 void ReadStoredParameters() {
   HighScore = RPU_ReadULFromEEProm(RPU_HIGHSCORE_EEPROM_START_BYTE, 10000);
   Credits = RPU_ReadByteFromEEProm(RPU_CREDITS_EEPROM_BYTE);
   if (Credits > MaximumCredits) Credits = MaximumCredits;
 
-  ReadSetting(EEPROM_FREE_PLAY_BYTE, 0);
-  FreePlayMode = (EEPROM.read(EEPROM_FREE_PLAY_BYTE)) ? true : false;
+  if (LoadSettings() && DEBUG_MESSAGES) Serial.write("Settings block repaired\n");
+
+  FreePlayMode = (Settings.freePlay) ? true : false;
 
-  BallSaveNumSeconds = ReadSetting(EEPROM_BALL_SAVE_BYTE, 15);
+  BallSaveNumSeconds = Settings.ballSave;
   if (BallSaveNumSeconds > 20) BallSaveNumSeconds = 20;
 
-  SoundSelector = ReadSetting(EEPROM_SOUND_SELECTOR_BYTE, 5);
+  SoundSelector = Settings.soundSelector;
   if (SoundSelector > 5) SoundSelector = 5;
 
-  MusicVolume = ReadSetting(EEPROM_MUSIC_VOLUME_BYTE, 10);
+  MusicVolume = Settings.musicVolume;
   if (MusicVolume > 10) MusicVolume = 10;
 
-  SoundEffectsVolume = ReadSetting(EEPROM_SFX_VOLUME_BYTE, 10);
+  SoundEffectsVolume = Settings.sfxVolume;
   if (SoundEffectsVolume > 10) SoundEffectsVolume = 10;
 
-  CalloutsVolume = ReadSetting(EEPROM_CALLOUTS_VOLUME_BYTE, 10);
+  CalloutsVolume = Settings.calloutsVolume;
   if (CalloutsVolume > 10) CalloutsVolume = 10;
 
   Audio.SetMusicVolume(MusicVolume);
   Audio.SetSoundFXVolume(SoundEffectsVolume);
   Audio.SetNotificationsVolume(CalloutsVolume);
 
-  TournamentScoring = (ReadSetting(EEPROM_TOURNAMENT_SCORING_BYTE, 0)) ? true : false;
+  TournamentScoring = (Settings.tournamentScoring) ? true : false;
 
-  MaxTiltWarnings = ReadSetting(EEPROM_TILT_WARNING_BYTE, 2);
+  MaxTiltWarnings = Settings.tiltWarnings;
   if (MaxTiltWarnings > 2) MaxTiltWarnings = 2;
 
-  byte awardOverride = ReadSetting(EEPROM_AWARD_OVERRIDE_BYTE, 99);
+  byte awardOverride = Settings.awardOverride;
   if (awardOverride != 99) {
     ScoreAwardReplay = awardOverride;
   }
 
-  byte ballsOverride = ReadSetting(EEPROM_BALLS_OVERRIDE_BYTE, 99);
+  byte ballsOverride = Settings.ballsOverride;
   if (ballsOverride == 3 || ballsOverride == 5) {
     BallsPerGame = ballsOverride;
   } else {
-    if (ballsOverride != 99) EEPROM.write(EEPROM_BALLS_OVERRIDE_BYTE, 99);
+    if (ballsOverride != 99) WriteSetting(EEPROM_BALLS_OVERRIDE_BYTE, 99);
   }
 
-  ScrollingScores = (ReadSetting(EEPROM_SCROLLING_SCORES_BYTE, 1)) ? true : false;
+  ScrollingScores = (Settings.scrollingScores) ? true : false;
 
-  ExtraBallValue = RPU_ReadULFromEEProm(EEPROM_EXTRA_BALL_SCORE_BYTE);
+  ExtraBallValue = Settings.extraBallScore;
   if (ExtraBallValue % 1000 || ExtraBallValue > 100000) ExtraBallValue = 20000;
 
-  SpecialValue = RPU_ReadULFromEEProm(EEPROM_SPECIAL_SCORE_BYTE);
+  SpecialValue = Settings.specialScore;
   if (SpecialValue % 1000 || SpecialValue > 100000) SpecialValue = 40000;
 
-  DimLevel = ReadSetting(EEPROM_DIM_LEVEL_BYTE, 2);
+  DimLevel = Settings.dimLevel;
   if (DimLevel < 2 || DimLevel > 3) DimLevel = 2;
   RPU_SetDimDivisor(1, DimLevel);
 
@@ -487,6 +606,36 @@ void setup() {
   // that will trigger them:  
   RPU_SetupGameSwitches(NUM_SWITCHES_WITH_TRIGGERS, NUM_PRIORITY_SWITCHES_WITH_TRIGGERS, SolenoidAssociatedSwitches);
 #endif
+#ifdef RPU_OS_COUNTED_SWITCHES
+  // A fast spin can close a spinner every switch scan, so the OS
+  // counts them instead of filling the switch stack
+  RPU_SetSwitchCounted(SW_LEFT_SPINNER);
+  RPU_SetSwitchCounted(SW_RIGHT_SPINNER);
+#endif
+#ifdef RPU_OS_TIMED_SWITCHES
+  // These come back with the time the ISR saw them, for the combo,
+  // alternating spinner and ball save timing
+#ifdef RPU_OS_COUNTED_SWITCHES
+  // (only a counted spinner is timed - otherwise it comes off the stack)
+  RPU_SetSwitchTimed(SW_LEFT_SPINNER);
+  RPU_SetSwitchTimed(SW_RIGHT_SPINNER);
+#endif
+  RPU_SetSwitchTimed(SW_OUTHOLE);
+#endif
+#ifdef RPU_OS_SWITCH_HEALTH
+  // These sit closed by design (or spin fast), so they're never
+  // reported stuck or ignored for chattering
+  byte healthExemptSwitches[] = {SW_OUTHOLE, SW_BALL_1, SW_BALL_2, SW_BALL_3, SW_SHOOTER_LANE, SW_SAUCER,
+                                 SW_DROP_TARGET_1, SW_DROP_TARGET_2, SW_DROP_TARGET_3, SW_DROP_TARGET_4, SW_DROP_TARGET_5,
+                                 SW_LEFT_SPINNER, SW_RIGHT_SPINNER};
+  for (byte count=0; count<sizeof(healthExemptSwitches); count++) RPU_SetSwitchHealthExempt(healthExemptSwitches[count]);
+#endif
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+  // The ball rattles into the shooter lane and the outhole, so those
+  // wait for it to settle (the slings and pops keep the fast default)
+  RPU_SetSwitchDebounce(SW_SHOOTER_LANE, 4);
+  RPU_SetSwitchDebounce(SW_OUTHOLE, 4, 2);
+#endif
 
   // Set up the chips and interrupts
   unsigned long initResult = 0;
@@ -523,7 +672,13 @@ void setup() {
 
 
   // Read parameters from EEProm
+  unsigned long settingsLoadTime = micros();
   ReadStoredParameters();
+  if (DEBUG_MESSAGES) {
+    char buf[128];
+    sprintf(buf, "Settings loaded in %lu us\n", micros() - settingsLoadTime);
+    Serial.write(buf);
+  }
 
   CurrentScores[0] = TRIDENT2022_MAJOR_VERSION;
   CurrentScores[1] = TRIDENT2022_MINOR_VERSION;
@@ -543,16 +698,11 @@ void setup() {
   Audio.QueueSound(SOUND_EFFECT_TRIDENT_INTRO, AUDIO_PLAY_TYPE_WAV_TRIGGER, CurrentTime+5000);
 }
 
-byte ReadSetting(byte setting, byte defaultValue) {
-  byte value = EEPROM.read(setting);
-  if (value == 0xFF) {
-    EEPROM.write(setting, defaultValue);
-    return defaultValue;
-  }
-  return value;
-}
-
 void SetGameMode(byte newGameMode) {
+  // A preloaded callout holds a voice, so it's let go when the mode that
+  // wanted it ends (a qualified mode timing out, the wizard mode ending).
+  // Starting the qualified mode uses its preloaded start callout.
+  if (newGameMode!=GAME_MODE_MINI_GAME_ENGAGED) Audio.CancelPreloadedSounds();
   GameMode = newGameMode;
   GameModeStartTime = 0;
   GameModeEndTime = 0;
@@ -1347,7 +1497,11 @@ byte TempValue = 0;
 
 
 byte SelfTestStateToCalloutMap[] = {
-  136, 137, 135, 134, 133, 140, 141, 142, 139, 143, 144, 145, 146, 147, 148, 149, 138, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159, 160, 161, 162, 163, 164, 165, 171, 0
+  136, 137, 135, 134,
+#ifdef RPU_OS_SWITCH_HEALTH
+  134, // switch health has no callout of its own
+#endif
+  133, 140, 141, 142, 139, 143, 144, 145, 146, 147, 148, 149, 138, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159, 160, 161, 162, 163, 164, 165, 171, 0
 };
 
 byte SoundSelectorToCalloutsMap[] {
@@ -1359,6 +1513,9 @@ int RunSelfTest(int curState, boolean curStateChanged) {
   int returnState = curState;
   CurrentNumPlayers = 0;
 
+  // Nothing's being played, so adjustments are saved as they're made
+  RPU_FlushEEProm();
+
   if (curStateChanged) {
     // Send a stop-all command and reset the sample-rate offset, in case we have
     //  reset while the WAV Trigger was already playing.
@@ -1529,7 +1686,7 @@ int RunSelfTest(int curState, boolean curStateChanged) {
           }
         }
         *CurrentAdjustmentByte = curVal;
-        if (CurrentAdjustmentStorageByte) EEPROM.write(CurrentAdjustmentStorageByte, curVal);
+        if (CurrentAdjustmentStorageByte) WriteSetting(CurrentAdjustmentStorageByte, curVal);
 
         if (curState==MACHINE_STATE_ADJUST_SFX_AND_SOUNDTRACK) {
           Audio.StopAllAudio();
@@ -1559,14 +1716,14 @@ int RunSelfTest(int curState, boolean curStateChanged) {
           if (curVal == AdjustmentValues[valCount]) newIndex = valCount + 1;
         }
         *CurrentAdjustmentByte = AdjustmentValues[newIndex];
-        if (CurrentAdjustmentStorageByte) EEPROM.write(CurrentAdjustmentStorageByte, AdjustmentValues[newIndex]);
+        if (CurrentAdjustmentStorageByte) WriteSetting(CurrentAdjustmentStorageByte, AdjustmentValues[newIndex]);
       } else if (CurrentAdjustmentUL && (AdjustmentType == ADJ_TYPE_SCORE_WITH_DEFAULT || AdjustmentType == ADJ_TYPE_SCORE_NO_DEFAULT)) {
         unsigned long curVal = *CurrentAdjustmentUL;
         curVal += 5000;
         if (curVal > 100000) curVal = 0;
         if (AdjustmentType == ADJ_TYPE_SCORE_NO_DEFAULT && curVal == 0) curVal = 5000;
         *CurrentAdjustmentUL = curVal;
-        if (CurrentAdjustmentStorageByte) RPU_WriteULToEEProm(CurrentAdjustmentStorageByte, curVal);
+        if (CurrentAdjustmentStorageByte) WriteSettingUL(CurrentAdjustmentStorageByte, curVal);
       }
 
       if (curState == MACHINE_STATE_ADJUST_DIM_LEVEL) {
@@ -1614,12 +1771,23 @@ int RunSelfTest(int curState, boolean curStateChanged) {
 //
 ////////////////////////////////////////////////////////////////////////////
 
-void QueueNotification(unsigned int soundEffectNum, byte priority) {
+void QueueNotification(unsigned int soundEffectNum, byte priority, unsigned short expiry = 0) {
   if (CalloutsVolume==0) return;
   if (SoundSelector<4) return;   
   if (soundEffectNum < SOUND_EFFECT_VP_VOICE_NOTIFICATIONS_START || soundEffectNum >= (SOUND_EFFECT_VP_VOICE_NOTIFICATIONS_START + NUM_VOICE_NOTIFICATIONS)) return;
 
-  Audio.QueuePrioritizedNotification(soundEffectNum, 0, priority, CurrentTime);
+  Audio.QueuePrioritizedNotification(soundEffectNum, 0, priority, CurrentTime, expiry);
+}
+
+
+// Callouts that are likely to be needed soon (jackpot lit, mode
+// qualified) are loaded ahead of time so they start without a delay
+void PreloadNotification(unsigned int soundEffectNum) {
+  if (CalloutsVolume==0) return;
+  if (SoundSelector<4) return;   
+  if (soundEffectNum < SOUND_EFFECT_VP_VOICE_NOTIFICATIONS_START || soundEffectNum >= (SOUND_EFFECT_VP_VOICE_NOTIFICATIONS_START + NUM_VOICE_NOTIFICATIONS)) return;
+
+  Audio.PreloadSound(soundEffectNum, true);
 }
 
 
@@ -1630,6 +1798,93 @@ void PlayBackgroundSong(unsigned short songNum) {
 
 unsigned long NextSoundEffectTime = 0;
 
+// SB-100 (Sound Selector 1) versions of the sound effects. Each one is
+// a short sequence of sound bytes; most are a single blip repeated.
+const AudioSequenceStep SB100Blip01[] PROGMEM = {{0x01, 75}, {0x00, 125}};
+const AudioSequenceStep SB100Blip02[] PROGMEM = {{0x02, 75}, {0x00, 125}};
+const AudioSequenceStep SB100Blip04[] PROGMEM = {{0x04, 75}, {0x00, 125}};
+const AudioSequenceStep SB100Blip08[] PROGMEM = {{0x08, 75}, {0x00, 125}};
+const AudioSequenceStep SB100Blip10[] PROGMEM = {{0x10, 75}, {0x00, 125}};
+const AudioSequenceStep SB100Blip20[] PROGMEM = {{0x20, 75}, {0x00, 125}};
+const AudioSequenceStep SB100TwoTone[] PROGMEM = {{0x08, 75}, {0x04, 100}, {0x00, 0}};
+const AudioSequenceStep SB100RightInlane[] PROGMEM = {
+  {0x04, 75}, {0x00, 125}, {0x04, 75}, {0x00, 125}, {0x04, 75}, {0x00, 125},
+  {0x10, 75}, {0x00, 125}, {0x10, 75}, {0x00, 125}, {0x10, 75}, {0x00, 125}
+};
+const AudioSequenceStep SB100Descending[] PROGMEM = {
+  {0x08, 75}, {0x04, 75}, {0x02, 75}, {0x01, 100},
+  {0x08, 75}, {0x04, 75}, {0x02, 75}, {0x01, 100}, {0x00, 0}
+};
+const AudioSequenceStep SB100Ascending[] PROGMEM = {
+  {0x01, 75}, {0x02, 75}, {0x04, 75}, {0x08, 100},
+  {0x01, 75}, {0x02, 75}, {0x04, 75}, {0x08, 100}, {0x00, 0}
+};
+
+#define SB100_SEQUENCE(steps, repeats)  steps, (sizeof(steps)/sizeof(AudioSequenceStep)), repeats
+
+struct SB100SoundEffect {
+  unsigned short soundEffectNum;
+  const AudioSequenceStep *sequenceSteps;
+  byte numSteps;
+  byte repeatCount;
+};
+
+const SB100SoundEffect SB100SoundEffects[] PROGMEM = {
+  {SOUND_EFFECT_ROLLOVER,               SB100_SEQUENCE(SB100Blip02, 1)},
+  {SOUND_EFFECT_DT_SKILL_SHOT,          SB100_SEQUENCE(SB100Blip02, 1)},
+  {SOUND_EFFECT_ROLLOVER_SKILL_SHOT,    SB100_SEQUENCE(SB100Blip02, 1)},
+  {SOUND_EFFECT_SU_SKILL_SHOT,          SB100_SEQUENCE(SB100Blip02, 1)},
+  {SOUND_EFFECT_LEFT_SPINNER,           SB100_SEQUENCE(SB100Blip02, 1)},
+  {SOUND_EFFECT_RIGHT_SPINNER,          SB100_SEQUENCE(SB100Blip02, 1)},
+  {SOUND_EFFECT_DROP_TARGET,            SB100_SEQUENCE(SB100Blip02, 1)},
+  {SOUND_EFFECT_BALL_OVER,              SB100_SEQUENCE(SB100Blip02, 1)},
+  {SOUND_EFFECT_LEFT_INLANE,            SB100_SEQUENCE(SB100Blip04, 0)}, // repeats RolloverValue times
+  {SOUND_EFFECT_RIGHT_INLANE,           SB100_SEQUENCE(SB100RightInlane, 1)},
+  {SOUND_EFFECT_SAUCER_HIT_5K,          SB100_SEQUENCE(SB100Blip04, 5)},
+  {SOUND_EFFECT_SAUCER_HIT_30K,         SB100_SEQUENCE(SB100Blip08, 3)},
+  {SOUND_EFFECT_SAUCER_HIT_20K,         SB100_SEQUENCE(SB100Blip08, 2)},
+  {SOUND_EFFECT_SAUCER_HIT_10K,         SB100_SEQUENCE(SB100Blip08, 1)},
+  {SOUND_EFFECT_RIGHT_OUTLANE,          SB100_SEQUENCE(SB100Blip04, 5)},
+  {SOUND_EFFECT_TOP_BUMPER_HIT,         SB100_SEQUENCE(SB100Blip20, 1)},
+  {SOUND_EFFECT_BOTTOM_BUMPER_HIT,      SB100_SEQUENCE(SB100Blip20, 1)},
+  {SOUND_EFFECT_VP_SHOOT_AGAIN,         SB100_SEQUENCE(SB100TwoTone, 1)},
+  {SOUND_EFFECT_PLAYER_1_UP,            SB100_SEQUENCE(SB100TwoTone, 1)},
+  {SOUND_EFFECT_PLAYER_2_UP,            SB100_SEQUENCE(SB100TwoTone, 1)},
+  {SOUND_EFFECT_PLAYER_3_UP,            SB100_SEQUENCE(SB100TwoTone, 1)},
+  {SOUND_EFFECT_PLAYER_4_UP,            SB100_SEQUENCE(SB100TwoTone, 1)},
+  {SOUND_EFFECT_BONUS_COUNT,            SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_2X_BONUS_COUNT,         SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_3X_BONUS_COUNT,         SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_4X_BONUS_COUNT,         SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_5X_BONUS_COUNT,         SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_UPPER_SLING,            SB100_SEQUENCE(SB100Blip10, 1)},
+  {SOUND_EFFECT_VP_EXTRA_BALL,          SB100_SEQUENCE(SB100Blip10, 1)},
+  {SOUND_EFFECT_TILT_WARNING,           SB100_SEQUENCE(SB100Blip10, 1)},
+  {SOUND_EFFECT_10PT_SWITCH,            SB100_SEQUENCE(SB100Blip01, 1)},
+  {SOUND_EFFECT_MATCH_SPIN,             SB100_SEQUENCE(SB100Blip01, 1)},
+  {SOUND_EFFECT_LOWER_SLING,            SB100_SEQUENCE(SB100Blip01, 1)},
+  {SOUND_EFFECT_DROP_TARGET_CLEAR_1,    SB100_SEQUENCE(SB100Blip08, 1)},
+  {SOUND_EFFECT_DROP_TARGET_CLEAR_2,    SB100_SEQUENCE(SB100Blip08, 1)},
+  {SOUND_EFFECT_DROP_TARGET_CLEAR_3,    SB100_SEQUENCE(SB100Blip08, 1)},
+  {SOUND_EFFECT_DROP_TARGET_CLEAR_4,    SB100_SEQUENCE(SB100Blip08, 1)},
+  {SOUND_EFFECT_DROP_TARGET_CLEAR_5,    SB100_SEQUENCE(SB100Blip08, 1)},
+  {SOUND_EFFECT_FIRST_SU_SWITCH_HIT,    SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_SECOND_SU_SWITCH_HIT,   SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_THIRD_SU_SWITCH_HIT,    SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_FOURTH_SU_SWITCH_HIT,   SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_FIFTH_SU_SWITCH_HIT,    SB100_SEQUENCE(SB100Blip04, 1)},
+  {SOUND_EFFECT_ADD_CREDIT,             SB100_SEQUENCE(SB100Descending, 1)},
+  {SOUND_EFFECT_GAME_OVER,              SB100_SEQUENCE(SB100Descending, 1)},
+  {SOUND_EFFECT_ADD_PLAYER_1,           SB100_SEQUENCE(SB100Ascending, 1)},
+  {SOUND_EFFECT_ADD_PLAYER_2,           SB100_SEQUENCE(SB100Ascending, 1)},
+  {SOUND_EFFECT_ADD_PLAYER_3,           SB100_SEQUENCE(SB100Ascending, 1)},
+  {SOUND_EFFECT_ADD_PLAYER_4,           SB100_SEQUENCE(SB100Ascending, 1)},
+  {SOUND_EFFECT_VP_RESCUE_FROM_THE_DEEP, SB100_SEQUENCE(SB100Ascending, 1)},
+  {SOUND_EFFECT_TRIDENT_INTRO,          SB100_SEQUENCE(SB100Ascending, 1)}
+};
+
+#define NUM_SB100_SOUND_EFFECTS (sizeof(SB100SoundEffects)/sizeof(SB100SoundEffect))
+
 void PlaySoundEffect(unsigned short soundEffectNum) {
 
   if (SoundSelector == 0) return;
@@ -1637,143 +1892,16 @@ void PlaySoundEffect(unsigned short soundEffectNum) {
   if (SoundSelector>1) Audio.PlaySound(soundEffectNum, AUDIO_PLAY_TYPE_WAV_TRIGGER);
 
   if (SoundSelector==1) {
-  
-    switch(soundEffectNum) {
-      case SOUND_EFFECT_ROLLOVER:
-      case SOUND_EFFECT_DT_SKILL_SHOT:
-      case SOUND_EFFECT_ROLLOVER_SKILL_SHOT:
-      case SOUND_EFFECT_SU_SKILL_SHOT:
-      case SOUND_EFFECT_LEFT_SPINNER: 
-      case SOUND_EFFECT_RIGHT_SPINNER:
-      case SOUND_EFFECT_DROP_TARGET:  
-      case SOUND_EFFECT_BALL_OVER:    
-        Audio.QueueSound(0x02, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);      
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 75);
-      break;
-      case SOUND_EFFECT_LEFT_INLANE:  
-        for (int count=0; count<RolloverValue; count++) {
-          Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 200*count);      
-          Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 75 + (200*count));
-        }
-      break;
-      case SOUND_EFFECT_RIGHT_INLANE: 
-        for (int count=0; count<6; count++) {
-          Audio.QueueSound((count<3)?0x04:0x10, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 200*count);      
-          Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 75 + (200*count));
-        }
-      break;
-      case SOUND_EFFECT_SAUCER_HIT_5K:
-        for (int count=0; count<5; count++) {
-          Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 200*count);      
-          Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 75 + (200*count));
-        }
-      break;
-      case SOUND_EFFECT_SAUCER_HIT_30K: 
-        for (int count=0; count<3; count++) {
-          Audio.QueueSound(0x08, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 200*count);      
-          Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 75 + (200*count));
-        }
-      break;
-      case SOUND_EFFECT_SAUCER_HIT_20K:     
-        for (int count=0; count<2; count++) {
-          Audio.QueueSound(0x08, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 200*count);      
-          Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 75 + (200*count));
-        }
-      break;
-      case SOUND_EFFECT_SAUCER_HIT_10K:    
-        for (int count=0; count<1; count++) {
-          Audio.QueueSound(0x08, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 200*count);      
-          Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 75 + (200*count));
-        }
-      break;
-      case SOUND_EFFECT_RIGHT_OUTLANE:
-        for (int count=0; count<5; count++) {
-          Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 200*count);      
-          Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime + 75 + (200*count));
-        }
-      break;
-      case SOUND_EFFECT_TOP_BUMPER_HIT:     
-      case SOUND_EFFECT_BOTTOM_BUMPER_HIT: 
-        Audio.QueueSound(0x20, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);      
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+75);      
-      break;     
-      case SOUND_EFFECT_VP_SHOOT_AGAIN:  
-      case SOUND_EFFECT_PLAYER_1_UP:  
-      case SOUND_EFFECT_PLAYER_2_UP:  
-      case SOUND_EFFECT_PLAYER_3_UP:  
-      case SOUND_EFFECT_PLAYER_4_UP:  
-        Audio.QueueSound(0x08, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);      
-        Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+75);      
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+175);      
-      break;
-      case SOUND_EFFECT_BONUS_COUNT:  
-      case SOUND_EFFECT_2X_BONUS_COUNT:     
-      case SOUND_EFFECT_3X_BONUS_COUNT:     
-      case SOUND_EFFECT_4X_BONUS_COUNT:     
-      case SOUND_EFFECT_5X_BONUS_COUNT:
-        Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);      
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+75);      
-      break;     
-      case SOUND_EFFECT_UPPER_SLING:  
-      case SOUND_EFFECT_VP_EXTRA_BALL:   
-      case SOUND_EFFECT_TILT_WARNING: 
-        Audio.QueueSound(0x10, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);      
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+75);      
-      break;
-      case SOUND_EFFECT_10PT_SWITCH:  
-      case SOUND_EFFECT_MATCH_SPIN:   
-      case SOUND_EFFECT_LOWER_SLING:  
-        Audio.QueueSound(0x01, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);      
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+75);      
-      break;
-      case SOUND_EFFECT_DROP_TARGET_CLEAR_1:
-      case SOUND_EFFECT_DROP_TARGET_CLEAR_2:
-      case SOUND_EFFECT_DROP_TARGET_CLEAR_3:
-      case SOUND_EFFECT_DROP_TARGET_CLEAR_4:
-      case SOUND_EFFECT_DROP_TARGET_CLEAR_5:
-        Audio.QueueSound(0x08, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);      
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+75);      
-      break;
-      case SOUND_EFFECT_FIRST_SU_SWITCH_HIT:
-      case SOUND_EFFECT_SECOND_SU_SWITCH_HIT:
-      case SOUND_EFFECT_THIRD_SU_SWITCH_HIT:
-      case SOUND_EFFECT_FOURTH_SU_SWITCH_HIT: 
-      case SOUND_EFFECT_FIFTH_SU_SWITCH_HIT:
-        Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);      
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+75);      
-      break;
-      case SOUND_EFFECT_ADD_CREDIT:
-      case SOUND_EFFECT_GAME_OVER:
-        Audio.QueueSound(0x08, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);
-        Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+75);
-        Audio.QueueSound(0x02, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+150);
-        Audio.QueueSound(0x01, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+225);
-        Audio.QueueSound(0x08, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+325);
-        Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+400);
-        Audio.QueueSound(0x02, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+475);
-        Audio.QueueSound(0x01, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+550);
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+650);
-      break;
-      case SOUND_EFFECT_ADD_PLAYER_1:
-      case SOUND_EFFECT_ADD_PLAYER_2: 
-      case SOUND_EFFECT_ADD_PLAYER_3: 
-      case SOUND_EFFECT_ADD_PLAYER_4: 
-      case SOUND_EFFECT_VP_RESCUE_FROM_THE_DEEP:
-      case SOUND_EFFECT_TRIDENT_INTRO:
-        Audio.QueueSound(0x01, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);
-        Audio.QueueSound(0x02, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+75);
-        Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+150);
-        Audio.QueueSound(0x08, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+225);
-        Audio.QueueSound(0x01, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+325);
-        Audio.QueueSound(0x02, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+400);
-        Audio.QueueSound(0x04, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+475);
-        Audio.QueueSound(0x08, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+550);
-        Audio.QueueSound(0x00, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime+650);
+    SB100SoundEffect effect;
+    for (byte count=0; count<NUM_SB100_SOUND_EFFECTS; count++) {
+      memcpy_P(&effect, &SB100SoundEffects[count], sizeof(SB100SoundEffect));
+      if (effect.soundEffectNum!=soundEffectNum) continue;
+      if (soundEffectNum==SOUND_EFFECT_LEFT_INLANE) effect.repeatCount = RolloverValue;
+      Audio.PlaySoundSequence(effect.sequenceSteps, effect.numSteps, effect.repeatCount, AUDIO_PLAY_TYPE_ORIGINAL_SOUNDS, CurrentTime);
       break;
     }
   }
 
-
 }
 
 
@@ -1801,8 +1929,13 @@ int RunAttractMode(int curState, boolean curStateChanged) {
     RPU_DisableSolenoidStack();
     RPU_TurnOffAllLamps();
     RPU_SetDisableFlippers(true);
+    unsigned short eepromBytesWritten = RPU_FlushEEProm();
     if (DEBUG_MESSAGES) {
+      char buf[128];
       Serial.write("Entering Attract Mode\n\r");
+      sprintf(buf, "Flushed %d EEPROM bytes\n\r", eepromBytesWritten);
+      Serial.write(buf);
+      Audio.OutputAudioStats();
     }
 
     AttractLastHeadMode = 0;
@@ -1913,6 +2046,20 @@ byte CountBits(byte byteToBeCounted) {
 }
 
 
+unsigned short GetMiniGameStartSound(byte miniGames) {
+  switch (miniGames) {
+    case MINI_GAME_SHARP_SHOOTER_FLAG: return SOUND_EFFECT_VP_SHARP_SHOOTER_START;
+    case MINI_GAME_EXPLORE_THE_DEPTHS_FLAG: return SOUND_EFFECT_VP_EXPLORE_THE_DEPTHS_START;
+    case MINI_GAME_FEEDING_FRENZY_FLAG: return SOUND_EFFECT_VP_FEEDING_FRENZY_START;
+    case (MINI_GAME_SHARP_SHOOTER_FLAG|MINI_GAME_FEEDING_FRENZY_FLAG): return SOUND_EFFECT_VP_SS_AND_FF_START;
+    case (MINI_GAME_SHARP_SHOOTER_FLAG|MINI_GAME_EXPLORE_THE_DEPTHS_FLAG): return SOUND_EFFECT_VP_SS_AND_ETD_START;
+    case (MINI_GAME_FEEDING_FRENZY_FLAG|MINI_GAME_EXPLORE_THE_DEPTHS_FLAG): return SOUND_EFFECT_VP_FF_AND_ETD_START;
+    case (MINI_GAME_SHARP_SHOOTER_FLAG|MINI_GAME_FEEDING_FRENZY_FLAG|MINI_GAME_EXPLORE_THE_DEPTHS_FLAG): return SOUND_EFFECT_VP_MEGA_STACK_START;
+  }
+  return SOUND_EFFECT_VP_FEEDING_FRENZY_START;
+}
+
+
 
 void ResetDropTargets() {
   RPU_PushToTimedSolenoidStack(SOL_DROP_TARGET_RESET, 12, CurrentTime + 400);  
@@ -2072,6 +2219,78 @@ void HandleStandupHit(byte switchHit) {
 }
 
 
+// With RPU_OS_COUNTED_SWITCHES the spinners are counted by the OS rather
+// than stacked (see RPU_SetSwitchCounted in setup), so each of these
+// scores a whole batch of spins at once. Without it every closure comes
+// off the switch stack as a batch of one. spinTime is when the batch
+// started.
+void HandleLeftSpinner(byte spins, unsigned long spinTime) {
+  if (GameMode==GAME_MODE_SKILL_SHOT) {
+    CurrentScores[CurrentPlayer] += (unsigned long)spins * 10000 * PlayfieldMultiplier;
+    PlaySoundEffect(SOUND_EFFECT_LEFT_SPINNER);
+  } else if ((MiniGamesRunning & MINI_GAME_FEEDING_FRENZY_FLAG)) {
+    CurrentScores[CurrentPlayer] += (unsigned long)spins * 5000 * PlayfieldMultiplier;
+    PlaySoundEffect(SOUND_EFFECT_FEEDING_FRENZY);
+    if (spins > (255-CurrentFeedingFrenzy)) CurrentFeedingFrenzy = 255;
+    else CurrentFeedingFrenzy += spins;
+  } else {
+    unsigned long scoreAddition = 0;
+    if (LastStandupTargetHit&STANDUP_AMBER_MASK) scoreAddition += 400;
+    if (LastStandupTargetHit&STANDUP_WHITE_MASK) scoreAddition += 400;
+    if (LastStandupTargetHit&STANDUP_PURPLE_MASK && PurpleShotSide==0) scoreAddition += 1000;
+    if (CurrentStandupsHit&STANDUP_AMBER_MASK) scoreAddition += 400;
+    if (CurrentStandupsHit&STANDUP_WHITE_MASK) scoreAddition += 400;
+    if (CurrentStandupsHit&STANDUP_PURPLE_MASK && PurpleShotSide==0) scoreAddition += 1000;
+    CurrentScores[CurrentPlayer] += (unsigned long)spins * (200 + scoreAddition) * PlayfieldMultiplier;
+    // Only the first spin of a batch can alternate sides
+    if (LastSpinnerHitTime!=0 && LastSpinnerSide==2) {
+      NextSpinnerChangeTime = 0;
+      AlternatingSpinnerCount += 1;
+      if (CurrentFeedingFrenzyAlternateTime>15000) CurrentFeedingFrenzyAlternateTime -= 2000;
+    }
+    LastSpinnerHitTime = spinTime;
+    LastSpinnerSide = 1;
+    PlaySoundEffect(SOUND_EFFECT_LEFT_SPINNER);
+    if (ComboMultiballStage==0) {
+      ComboMultiballStart = spinTime;
+      ComboMultiballStage = 1;
+      if (DEBUG_MESSAGES) Serial.write("Combo multi start #1\n");
+    } else {
+      ComboMultiballStart = spinTime;
+    }
+  }
+  if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
+}
+
+
+void HandleRightSpinner(byte spins, unsigned long spinTime) {
+  if ((MiniGamesRunning & MINI_GAME_FEEDING_FRENZY_FLAG)) {
+    CurrentScores[CurrentPlayer] += (unsigned long)spins * 5000 * PlayfieldMultiplier;
+    PlaySoundEffect(SOUND_EFFECT_FEEDING_FRENZY);
+    if (spins > (255-CurrentFeedingFrenzy)) CurrentFeedingFrenzy = 255;
+    else CurrentFeedingFrenzy += spins;
+  } else if (GameMode!=GAME_MODE_SKILL_SHOT) {
+    unsigned long scoreAddition = 0;
+    if (LastStandupTargetHit&STANDUP_YELLOW_MASK) scoreAddition += 400;
+    if (LastStandupTargetHit&STANDUP_GREEN_MASK) scoreAddition += 400;
+    if (LastStandupTargetHit&STANDUP_PURPLE_MASK && PurpleShotSide==1) scoreAddition += 1000;
+    if (CurrentStandupsHit&STANDUP_YELLOW_MASK) scoreAddition += 400;
+    if (CurrentStandupsHit&STANDUP_GREEN_MASK) scoreAddition += 400;
+    if (CurrentStandupsHit&STANDUP_PURPLE_MASK && PurpleShotSide==1) scoreAddition += 1000;
+    CurrentScores[CurrentPlayer] += (unsigned long)spins * (200 + scoreAddition) * PlayfieldMultiplier;
+    PlaySoundEffect(SOUND_EFFECT_RIGHT_SPINNER);
+    if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
+    if (LastSpinnerHitTime!=0 && LastSpinnerSide==1) {
+      NextSpinnerChangeTime = 0;
+      AlternatingSpinnerCount += 1;
+      if (CurrentFeedingFrenzyAlternateTime>15000) CurrentFeedingFrenzyAlternateTime -= 2000;
+    }
+    LastSpinnerHitTime = spinTime;
+    LastSpinnerSide = 2;
+  }
+}
+
+
 int InitGamePlay() {
 
   if (DEBUG_MESSAGES) {
@@ -2118,6 +2337,16 @@ int InitGamePlay() {
 
   if (RPU_ReadSingleSwitchState(SW_SAUCER)) RPU_PushToSolenoidStack(SOL_SAUCER, 5);
 
+  // Throw away any spins and switch events from attract mode
+#ifdef RPU_OS_COUNTED_SWITCHES
+  RPU_PullSwitchCount(SW_LEFT_SPINNER);
+  RPU_PullSwitchCount(SW_RIGHT_SPINNER);
+#endif
+#ifdef RPU_OS_TIMED_SWITCHES
+  while (RPU_PullTimedSwitchEvent(NULL) != SWITCH_STACK_EMPTY);
+  OutholeClosedTime = 0;
+#endif
+
   return MACHINE_STATE_INIT_NEW_BALL;
 }
 
@@ -2326,7 +2555,8 @@ int ManageGameMode() {
     }
   }
 
-  if (CurrentTime>(RescueFromTheDeepEndTime+BALL_SAVE_GRACE_PERIOD)) RescueFromTheDeepEndTime = 0;
+  // (a ball that drained in time keeps its save while it settles)
+  if (BallTimeInTrough==0 && CurrentTime>(RescueFromTheDeepEndTime+BALL_SAVE_GRACE_PERIOD)) RescueFromTheDeepEndTime = 0;
   if (LastTroughSwitchCheck==0) LastTroughSwitchCheck = CurrentTime;
 
   if (CurrentTime>(LastTroughSwitchCheck+3000)) {
@@ -2425,6 +2655,7 @@ int ManageGameMode() {
         GameModeStartTime = CurrentTime;
         GameModeEndTime = CurrentTime + MODE_QUALIFY_TIME;
         // Play sound to direct player to saucer        
+        PreloadNotification(GetMiniGameStartSound(MiniGamesFlagsQualified));
       }
       CheckForFeedingFrenzyQualify();
 
@@ -2450,17 +2681,7 @@ int ManageGameMode() {
           NumAlternatingSpinnersRequired[CurrentPlayer] += 1;
         }
         
-        unsigned short modeStartSound = SOUND_EFFECT_VP_FEEDING_FRENZY_START;        
-        switch (MiniGamesRunning) {
-          case MINI_GAME_SHARP_SHOOTER_FLAG: modeStartSound = SOUND_EFFECT_VP_SHARP_SHOOTER_START; break;
-          case MINI_GAME_EXPLORE_THE_DEPTHS_FLAG: modeStartSound = SOUND_EFFECT_VP_EXPLORE_THE_DEPTHS_START; break;
-          case MINI_GAME_FEEDING_FRENZY_FLAG: modeStartSound = SOUND_EFFECT_VP_FEEDING_FRENZY_START; break;
-          case (MINI_GAME_SHARP_SHOOTER_FLAG|MINI_GAME_FEEDING_FRENZY_FLAG): modeStartSound = SOUND_EFFECT_VP_SS_AND_FF_START; break;
-          case (MINI_GAME_SHARP_SHOOTER_FLAG|MINI_GAME_EXPLORE_THE_DEPTHS_FLAG): modeStartSound = SOUND_EFFECT_VP_SS_AND_ETD_START; break;
-          case (MINI_GAME_FEEDING_FRENZY_FLAG|MINI_GAME_EXPLORE_THE_DEPTHS_FLAG): modeStartSound = SOUND_EFFECT_VP_FF_AND_ETD_START; break;
-          case (MINI_GAME_SHARP_SHOOTER_FLAG|MINI_GAME_FEEDING_FRENZY_FLAG|MINI_GAME_EXPLORE_THE_DEPTHS_FLAG): modeStartSound = SOUND_EFFECT_VP_MEGA_STACK_START; break;
-        }
-        QueueNotification(modeStartSound, 9);
+        QueueNotification(GetMiniGameStartSound(MiniGamesRunning), 9);
 
         byte numMiniGames = CountBits(MiniGamesRunning);
         if (numMiniGames==1) {
@@ -2560,6 +2781,7 @@ int ManageGameMode() {
         PlayBackgroundSong(SOUND_EFFECT_BACKGROUND_WIZ);
         QueueNotification(SOUND_EFFECT_VP_DEEP_BLUE_SEA_MODE, 9);
         JackpotLit = true;
+        PreloadNotification(SOUND_EFFECT_VP_JACKPOT);
         LastModeStepTime = CurrentTime + 1000;
         LastModeStep = 0;
       }
@@ -2573,6 +2795,7 @@ int ManageGameMode() {
       if (!JackpotLit) {
         if (CurrentFeedingFrenzy && CurrentSharpShooter && CurrentExploreTheDepths) {
           JackpotLit = true;
+          PreloadNotification(SOUND_EFFECT_VP_JACKPOT);
         }
       }
 
@@ -2664,11 +2887,21 @@ int ManageGameMode() {
       // If this is the first time we're seeing too many balls in the trough, we'll wait to make sure 
       // everything is settled
       BallTimeInTrough = CurrentTime;
+#ifdef RPU_OS_TIMED_SWITCHES
+      // If it's the outhole that just closed, go by when the ISR saw it
+      if (OutholeClosedTime && (CurrentTime-OutholeClosedTime)<BALL_IN_TROUGH_SETTLE_TIME) BallTimeInTrough = OutholeClosedTime;
+#endif
     } else {
       
       // Make sure the ball stays on the sensor for at least
       // 0.5 seconds to be sure that it's not bouncing or passing through
-      if ((CurrentTime - BallTimeInTrough) > 750) {
+      if ((CurrentTime - BallTimeInTrough) > BALL_IN_TROUGH_SETTLE_TIME) {
+#ifdef RPU_OS_TIMED_SWITCHES
+        // The saves below go by when the ball settled, not by how late this loop is
+        unsigned long ballSettledTime = BallTimeInTrough + BALL_IN_TROUGH_SETTLE_TIME;
+#else
+        unsigned long ballSettledTime = CurrentTime;
+#endif
 
         if (DEBUG_MESSAGES) {
           Serial.write("Balls in trough for more than 750ms\n");
@@ -2682,7 +2915,7 @@ int ManageGameMode() {
           returnState = MACHINE_STATE_NORMAL_GAMEPLAY;
         } else {
           // if we haven't used the ball save, and we're under the time limit, then save the ball
-          if (BallSaveEndTime && CurrentTime<(BallSaveEndTime+BALL_SAVE_GRACE_PERIOD)) {
+          if (BallSaveEndTime && ballSettledTime<(BallSaveEndTime+BALL_SAVE_GRACE_PERIOD)) {
             RPU_PushToTimedSolenoidStack(SOL_OUTHOLE, OUTHOLE_EJECT_FORCE, CurrentTime + 100);
             AutoPlungeTime = CurrentTime + 100;
             LastTroughSwitchCheck = AutoPlungeTime;
@@ -2696,13 +2929,13 @@ int ManageGameMode() {
               BallSaveEndTime = CurrentTime + 1000;
               if (LastSwimAgainNotification==0 || CurrentTime>(LastSwimAgainNotification+5000)) {
                 LastSwimAgainNotification = 0;
-                QueueNotification(SOUND_EFFECT_VP_SWIM_AGAIN, 4);
+                QueueNotification(SOUND_EFFECT_VP_SWIM_AGAIN, 4, CALLOUT_STALE_TIME);
               }
             } else {
               if (CurrentTime>BallSaveEndTime) BallSaveEndTime += 1000;
               PlaySoundEffect(SOUND_EFFECT_AUTO_PLUNGE);
             }
-          } else if ( RescueFromTheDeepEndTime!=0 && CurrentTime<(RescueFromTheDeepEndTime+BALL_SAVE_GRACE_PERIOD) ) {
+          } else if ( RescueFromTheDeepEndTime!=0 && ballSettledTime<(RescueFromTheDeepEndTime+BALL_SAVE_GRACE_PERIOD) ) {
             RPU_PushToTimedSolenoidStack(SOL_OUTHOLE, OUTHOLE_EJECT_FORCE, CurrentTime + 100);
             AutoPlungeTime = CurrentTime + 100;
             LastTroughSwitchCheck = AutoPlungeTime;
@@ -2743,6 +2976,8 @@ int CountdownBonus(boolean curStateChanged) {
   // If this is the first time through the countdown loop
   if (curStateChanged) {
     RPU_SetLampState(BALL_IN_PLAY, 1, 0, 250);
+    // Nothing that was preloaded for this ball will be played now
+    Audio.CancelPreloadedSounds();
 
     CountdownStartTime = CurrentTime;
     ShowBonusOnTree(Bonus);
@@ -2916,6 +3151,8 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
     ShowPlayerScores(CurrentPlayer, (BallFirstSwitchHitTime==0)?true:false, (BallFirstSwitchHitTime>0 && ((CurrentTime-LastTimeScoreChanged)>2000))?true:false);
   } else if (curState == MACHINE_STATE_BALL_OVER) {
     StandupsHit[ CurrentPlayer] = CurrentStandupsHit;
+    // The ball is dead, so this is a safe time to block on the EEPROM
+    RPU_FlushEEProm();
     if (SamePlayerShootsAgain) {
       returnState = MACHINE_STATE_INIT_NEW_BALL;
     } else {
@@ -2947,6 +3184,33 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
   byte switchHit;
   unsigned long lastBallFirstSwitchHitTime = BallFirstSwitchHitTime;
 
+#ifdef RPU_OS_COUNTED_SWITCHES
+  unsigned long leftSpinTime = 0, rightSpinTime = 0;
+#endif
+#ifdef RPU_OS_TIMED_SWITCHES
+  unsigned long switchTime;
+  while ( (switchHit = RPU_PullTimedSwitchEvent(&switchTime)) != SWITCH_STACK_EMPTY ) {
+    // The scan can be later than the start of this loop
+    if (switchTime > CurrentTime) switchTime = CurrentTime;
+    switch (switchHit) {
+#ifdef RPU_OS_COUNTED_SWITCHES
+      case SW_LEFT_SPINNER:
+        leftSpinTime = switchTime;
+        break;
+      case SW_RIGHT_SPINNER:
+        rightSpinTime = switchTime;
+        break;
+#endif
+      case SW_OUTHOLE:
+        OutholeClosedTime = switchTime;
+        break;
+      case (SW_OUTHOLE | SWITCH_EVENT_OPENED):
+        OutholeClosedTime = 0;
+        break;
+    }
+  }
+#endif
+
   if (NumTiltWarnings <= MaxTiltWarnings) {
     while ( (switchHit = RPU_PullFirstFromSwitchStack()) != SWITCH_STACK_EMPTY ) {
 
@@ -3038,66 +3302,14 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
           CurrentScores[CurrentPlayer] += 10 * PlayfieldMultiplier;
           PlaySoundEffect(SOUND_EFFECT_10PT_SWITCH);
           break;
+#ifndef RPU_OS_COUNTED_SWITCHES
         case SW_LEFT_SPINNER:
-          if (GameMode==GAME_MODE_SKILL_SHOT) {
-            CurrentScores[CurrentPlayer] += 10000 * PlayfieldMultiplier;
-            PlaySoundEffect(SOUND_EFFECT_LEFT_SPINNER);
-          } else if ((MiniGamesRunning & MINI_GAME_FEEDING_FRENZY_FLAG)) {
-            CurrentScores[CurrentPlayer] += (unsigned long)5000 * PlayfieldMultiplier;
-            PlaySoundEffect(SOUND_EFFECT_FEEDING_FRENZY);
-            if (CurrentFeedingFrenzy<255) CurrentFeedingFrenzy += 1;
-          } else {
-            unsigned long scoreAddition = 0;
-            if (LastStandupTargetHit&STANDUP_AMBER_MASK) scoreAddition += 400;
-            if (LastStandupTargetHit&STANDUP_WHITE_MASK) scoreAddition += 400;
-            if (LastStandupTargetHit&STANDUP_PURPLE_MASK && PurpleShotSide==0) scoreAddition += 1000;
-            if (CurrentStandupsHit&STANDUP_AMBER_MASK) scoreAddition += 400;
-            if (CurrentStandupsHit&STANDUP_WHITE_MASK) scoreAddition += 400;
-            if (CurrentStandupsHit&STANDUP_PURPLE_MASK && PurpleShotSide==0) scoreAddition += 1000;
-            CurrentScores[CurrentPlayer] += (200 + (unsigned long)scoreAddition) * PlayfieldMultiplier;
-            if (LastSpinnerHitTime!=0 && LastSpinnerSide==2) {
-              NextSpinnerChangeTime = 0;
-              AlternatingSpinnerCount += 1;
-              if (CurrentFeedingFrenzyAlternateTime>15000) CurrentFeedingFrenzyAlternateTime -= 2000;
-            }
-            LastSpinnerHitTime = CurrentTime;
-            LastSpinnerSide = 1;
-            PlaySoundEffect(SOUND_EFFECT_LEFT_SPINNER);
-            if (ComboMultiballStage==0) {
-              ComboMultiballStart = CurrentTime;
-              ComboMultiballStage = 1;
-              if (DEBUG_MESSAGES) Serial.write("Combo multi start #1\n");
-            } else {
-              ComboMultiballStart = CurrentTime;
-            }
-          }
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
+          HandleLeftSpinner(1, CurrentTime);
           break;
         case SW_RIGHT_SPINNER:
-          if ((MiniGamesRunning & MINI_GAME_FEEDING_FRENZY_FLAG)) {
-            CurrentScores[CurrentPlayer] += (unsigned long)5000 * PlayfieldMultiplier;
-            PlaySoundEffect(SOUND_EFFECT_FEEDING_FRENZY);
-            if (CurrentFeedingFrenzy<255) CurrentFeedingFrenzy += 1;
-          } else if (GameMode!=GAME_MODE_SKILL_SHOT) {
-            unsigned long scoreAddition = 0;
-            if (LastStandupTargetHit&STANDUP_YELLOW_MASK) scoreAddition += 400;
-            if (LastStandupTargetHit&STANDUP_GREEN_MASK) scoreAddition += 400;
-            if (LastStandupTargetHit&STANDUP_PURPLE_MASK && PurpleShotSide==1) scoreAddition += 1000;
-            if (CurrentStandupsHit&STANDUP_YELLOW_MASK) scoreAddition += 400;
-            if (CurrentStandupsHit&STANDUP_GREEN_MASK) scoreAddition += 400;
-            if (CurrentStandupsHit&STANDUP_PURPLE_MASK && PurpleShotSide==1) scoreAddition += 1000;
-            CurrentScores[CurrentPlayer] += (200 + (unsigned long)scoreAddition) * PlayfieldMultiplier;
-            PlaySoundEffect(SOUND_EFFECT_RIGHT_SPINNER);
-            if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-            if (LastSpinnerHitTime!=0 && LastSpinnerSide==1) {
-              NextSpinnerChangeTime = 0;              
-              AlternatingSpinnerCount += 1;
-              if (CurrentFeedingFrenzyAlternateTime>15000) CurrentFeedingFrenzyAlternateTime -= 2000;
-            }
-            LastSpinnerHitTime = CurrentTime;
-            LastSpinnerSide = 2;
-          }
+          HandleRightSpinner(1, CurrentTime);
           break;
+#endif
         case SW_SAUCER:
           // We only count a saucer hit if it hasn't happened in the last 500ms
           // (software debounce)
@@ -3112,7 +3324,7 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
               CurrentFeedingFrenzy = 0;
               CurrentExploreTheDepths = 0;
               CurrentSharpShooter = 0;
-              QueueNotification(SOUND_EFFECT_VP_JACKPOT, 3);
+              QueueNotification(SOUND_EFFECT_VP_JACKPOT, 3, CALLOUT_STALE_TIME);
               unsigned long jackpotValue = ((unsigned long)FeedingFrenzySpins[CurrentPlayer])*((unsigned long)1000);
               jackpotValue += ((unsigned long)ExploreTheDepthsHits[CurrentPlayer])*((unsigned long)10000);
               jackpotValue += ((unsigned long)SharpShooterHits[CurrentPlayer])*((unsigned long)10000);
@@ -3195,8 +3407,10 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
           RolloverFlashEndTime = CurrentTime + ROLLOVER_FLASH_DURATION;
           if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
           break;
+#ifndef RPU_OS_TIMED_SWITCHES
         case SW_OUTHOLE:
           break;
+#endif
         case SW_DROP_TARGET_1:
         case SW_DROP_TARGET_2:
         case SW_DROP_TARGET_3:
@@ -3277,8 +3491,21 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
           break;
         }
       }
+
+#ifdef RPU_OS_COUNTED_SWITCHES
+      // A spin that came in after its batch was timed has been counted
+      // already, so a missing time just means now
+      byte spins = RPU_PullSwitchCount(SW_LEFT_SPINNER);
+      if (spins) HandleLeftSpinner(spins, leftSpinTime ? leftSpinTime : CurrentTime);
+      spins = RPU_PullSwitchCount(SW_RIGHT_SPINNER);
+      if (spins) HandleRightSpinner(spins, rightSpinTime ? rightSpinTime : CurrentTime);
+#endif
     } else {
       // We're tilted, so just wait for outhole
+#ifdef RPU_OS_COUNTED_SWITCHES
+      RPU_PullSwitchCount(SW_LEFT_SPINNER);
+      RPU_PullSwitchCount(SW_RIGHT_SPINNER);
+#endif
       while ( (switchHit = RPU_PullFirstFromSwitchStack()) != SWITCH_STACK_EMPTY ) {
         switch (switchHit) {
           case SW_SELF_TEST_SWITCH:
@@ -3305,7 +3532,7 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
   if (lastBallFirstSwitchHitTime==0 && BallFirstSwitchHitTime!=0) {
     BallSaveEndTime = BallFirstSwitchHitTime + ((unsigned long)BallSaveNumSeconds)*1000;
   }
-  if (CurrentTime>(BallSaveEndTime+BALL_SAVE_GRACE_PERIOD)) {
+  if (BallTimeInTrough==0 && CurrentTime>(BallSaveEndTime+BALL_SAVE_GRACE_PERIOD)) {
     BallSaveEndTime = 0;
   }
 
@@ -3361,4 +3588,13 @@ void loop() {
   RPU_Update(CurrentTime);
   Audio.Update(CurrentTime);
 
+#ifdef RPU_OS_SWITCH_HEALTH
+  byte chatteringSwitch = RPU_UpdateSwitchHealth(CurrentTime);
+  if (chatteringSwitch!=SWITCH_STACK_EMPTY && DEBUG_MESSAGES) {
+    char buf[128];
+    sprintf(buf, "Ignoring chattering switch %d\n", chatteringSwitch);
+    Serial.write(buf);
+  }
+#endif
+
 }
@@ -0,0 +1,436 @@
+// Microbenchmarks for the RPU primitives and the game's display helpers
+//
+// Each benchmark calls one function (or a push/pull pair) over and over
+// with varying arguments, after setup() has run on the idle bus with the
+// interrupts off, so nothing else runs in between. For each it reports
+//   host_ns      nanoseconds per call on this machine (best of -r runs)
+//   port_reads, port_writes per call
+// There's no count of Mega cycles: the shim only charges for port
+// accesses, bus waits and the like, and these are computation. Real AVR
+// cycle counts would need an avr-gcc build of these run under an AVR
+// instruction-set simulator (simavr or the like), which isn't done here.
+//
+// -j writes the results as JSON; -c compares against an earlier JSON
+// file and exits with 2 if any benchmark got slower: host_ns up by more
+// than -t percent.
+//
+// usage: trident_bench [-f filter] [-r runs] [-m minMs] [-j out.json]
+//                      [-c baseline.json [-t percent]] [-l]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+// (the STL comes ahead of Arduino's min/max)
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "RPU_Config.h"
+#include "RPU.h"
+#include "AudioHandler.h"
+
+void setup();
+void loop();
+
+// From Trident2023.ino
+extern unsigned long CurrentTime;
+extern unsigned long CurrentScores[4];
+extern byte CurrentNumPlayers, CurrentPlayer;
+extern AudioHandler Audio;
+byte MagnitudeOfScore(unsigned long score);
+void ShowAnimatedValue(byte displayNum, unsigned long displayScore, byte animationType);
+void ShowPlayerScores(byte displayToUpdate, boolean flashCurrent, boolean dashCurrent, unsigned long allScoresShowValue);
+// From RPU.cpp
+byte PullFirstFromSolenoidStack();
+
+#define BENCH_DEFAULT_RUNS          5
+#define BENCH_DEFAULT_MIN_MS        50
+#define BENCH_DEFAULT_THRESHOLD     10.0
+#define BENCH_NUM_LAMPS             48
+#define BENCH_NUM_FLASHING_LAMPS    20
+#define BENCH_FIRST_SOUND           100
+
+class HostNullDevice : public HostSerialDevice {
+public:
+  void transmitted(uint8_t, uint64_t) {}
+};
+
+// Scores of every length, so the digit loops don't always take the
+// same path
+static const unsigned long BenchScores[16] = {
+  0, 7, 42, 310, 5000, 12340, 99990, 250000,
+  1234560, 9999999, 20, 805, 4100, 76540, 310020, 8675309
+};
+
+// Keeps results from being optimized away
+static volatile unsigned long Sink;
+static unsigned long BenchTime = 0;
+
+
+/*********************************************************************
+    Benchmarks
+*********************************************************************/
+static void BenchMagnitudeOfScore(uint32_t iterations) {
+  unsigned long total = 0;
+  for (uint32_t count=0; count<iterations; count++) total += MagnitudeOfScore(BenchScores[count&15]);
+  Sink = total;
+}
+
+static void BenchSetDisplay(uint32_t iterations) {
+  for (uint32_t count=0; count<iterations; count++) RPU_SetDisplay(count&3, BenchScores[count&15], true, 2);
+}
+
+static void BenchSetLampState(uint32_t iterations) {
+  for (uint32_t count=0; count<iterations; count++) {
+    RPU_SetLampState(count%BENCH_NUM_LAMPS, count&1, 0, (count&4) ? 250 : 0);
+  }
+}
+
+static void PrepareFlashingLamps() {
+  RPU_TurnOffAllLamps();
+  for (int lampNum=0; lampNum<BENCH_NUM_FLASHING_LAMPS; lampNum++) RPU_SetLampState(lampNum*2, 1, 0, 100 + 25*lampNum);
+}
+
+static void BenchApplyFlashToLamps(uint32_t iterations) {
+  for (uint32_t count=0; count<iterations; count++) {
+    BenchTime += 7;
+    RPU_ApplyFlashToLamps(BenchTime);
+  }
+}
+
+static void BenchTurnOffAllLamps(uint32_t iterations) {
+  for (uint32_t count=0; count<iterations; count++) RPU_TurnOffAllLamps();
+}
+
+static void BenchSwitchStack(uint32_t iterations) {
+  unsigned long total = 0;
+  for (uint32_t count=0; count<iterations; count++) {
+    RPU_PushToSwitchStack(count%40);
+    total += RPU_PullFirstFromSwitchStack();
+  }
+  Sink = total;
+}
+
+static void BenchSolenoidStack(uint32_t iterations) {
+  unsigned long total = 0;
+  for (uint32_t count=0; count<iterations; count++) {
+    RPU_PushToSolenoidStack(count%15, 1);
+    total += PullFirstFromSolenoidStack();
+  }
+  Sink = total;
+}
+
+static void BenchTimedSolenoidStack(uint32_t iterations) {
+  unsigned long total = 0;
+  for (uint32_t count=0; count<iterations; count++) {
+    BenchTime += 1;
+    RPU_PushToTimedSolenoidStack(count%15, 1, BenchTime);
+    RPU_UpdateTimedSolenoidStack(BenchTime);
+    total += PullFirstFromSolenoidStack();
+  }
+  Sink = total;
+}
+
+static void PrepareScores() {
+  CurrentNumPlayers = 4;
+  CurrentPlayer = 0;
+  for (int count=0; count<4; count++) CurrentScores[count] = BenchScores[12 + count];
+}
+
+static void BenchShowPlayerScores(uint32_t iterations) {
+  for (uint32_t count=0; count<iterations; count++) {
+    CurrentTime += 3;
+    CurrentScores[count&3] += 10;
+    ShowPlayerScores(0xFF, (count&8) ? true : false, false, 0);
+  }
+}
+
+static void BenchShowAnimatedValue(uint32_t iterations) {
+  for (uint32_t count=0; count<iterations; count++) {
+    CurrentTime += 3;
+    ShowAnimatedValue(count&3, BenchScores[count&15], 1 + ((count>>2)&3));
+  }
+}
+
+// Fills the sound queue with sounds that aren't due yet
+static void FillSoundQueue(unsigned long dueTime) {
+  for (unsigned short count=0; count<SOUND_QUEUE_SIZE; count++) {
+    Audio.QueueSound(BENCH_FIRST_SOUND + count, AUDIO_PLAY_TYPE_WAV_TRIGGER, dueTime + count);
+  }
+}
+
+static void PrepareFullSoundQueue() {
+  Audio.StopAllAudio();
+  FillSoundQueue(CurrentTime + 1000000);
+}
+
+static void BenchAudioUpdateNoneDue(uint32_t iterations) {
+  for (uint32_t count=0; count<iterations; count++) {
+    CurrentTime += 1;
+    Audio.Update(CurrentTime);
+  }
+}
+
+static void BenchAudioUpdateAllDue(uint32_t iterations) {
+  for (uint32_t count=0; count<iterations; count++) {
+    CurrentTime += 1;
+    FillSoundQueue(CurrentTime);
+    Audio.Update(CurrentTime + SOUND_QUEUE_SIZE);
+    Audio.StopAllAudio();
+  }
+}
+
+static void BenchQueueSounds(uint32_t iterations) {
+  for (uint32_t count=0; count<iterations; count++) {
+    CurrentTime += 1;
+    FillSoundQueue(CurrentTime + 1000000);
+    Audio.StopAllAudio();
+  }
+}
+
+struct Benchmark {
+  const char *name;
+  void (*prepare)();
+  void (*run)(uint32_t iterations);
+};
+
+static const Benchmark Benchmarks[] = {
+  {"MagnitudeOfScore", NULL, BenchMagnitudeOfScore},
+  {"RPU_SetDisplay", NULL, BenchSetDisplay},
+  {"RPU_SetLampState", NULL, BenchSetLampState},
+  {"RPU_ApplyFlashToLamps", PrepareFlashingLamps, BenchApplyFlashToLamps},
+  {"RPU_TurnOffAllLamps", NULL, BenchTurnOffAllLamps},
+  {"SwitchStack push+pull", NULL, BenchSwitchStack},
+  {"SolenoidStack push+pull", NULL, BenchSolenoidStack},
+  {"TimedSolenoidStack push+update+pull", NULL, BenchTimedSolenoidStack},
+  {"ShowPlayerScores 4 players", PrepareScores, BenchShowPlayerScores},
+  {"ShowAnimatedValue", NULL, BenchShowAnimatedValue},
+  {"AudioHandler::Update full queue, none due", PrepareFullSoundQueue, BenchAudioUpdateNoneDue},
+  {"AudioHandler::Update full queue, all due (with refill)", NULL, BenchAudioUpdateAllDue},
+  {"AudioHandler::QueueSound x queue size (refill only)", NULL, BenchQueueSounds},
+};
+#define NUM_BENCHMARKS (sizeof(Benchmarks)/sizeof(Benchmarks[0]))
+
+
+/*********************************************************************
+    Measuring
+*********************************************************************/
+struct BenchResult {
+  std::string name;
+  uint32_t iterations;
+  double hostNs;
+  double portReads;
+  double portWrites;
+};
+
+static double WallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static BenchResult Measure(const Benchmark &bench, int numRuns, double minSeconds) {
+  BenchResult result;
+  result.name = bench.name;
+
+  // Find an iteration count that takes at least minSeconds
+  uint32_t iterations = 16;
+  for (;;) {
+    if (bench.prepare) bench.prepare();
+    double start = WallSeconds();
+    bench.run(iterations);
+    double elapsed = WallSeconds() - start;
+    if (elapsed>=minSeconds || iterations>=(1u<<30)) break;
+    iterations = (elapsed>0.0 && minSeconds/elapsed<16.0) ? (uint32_t)(iterations * minSeconds/elapsed * 1.2) + 1 : iterations*16;
+  }
+  result.iterations = iterations;
+
+  // Best wall time of the runs; the shim's counts are the same every run
+  result.hostNs = 0.0;
+  for (int run=0; run<numRuns; run++) {
+    if (bench.prepare) bench.prepare();
+    const HostStats *stats = HostGetStats();
+    uint64_t startReads = stats->portReads, startWrites = stats->portWrites;
+    double start = WallSeconds();
+    bench.run(iterations);
+    double ns = (WallSeconds() - start) * 1e9 / iterations;
+    if (run==0 || ns<result.hostNs) result.hostNs = ns;
+    result.portReads = (double)(stats->portReads - startReads) / iterations;
+    result.portWrites = (double)(stats->portWrites - startWrites) / iterations;
+  }
+  return result;
+}
+
+
+/*********************************************************************
+    JSON
+*********************************************************************/
+static void WriteJson(FILE *out, const std::vector<BenchResult> &results) {
+  fprintf(out, "{\n  \"suite\": \"trident_bench\",\n  \"config\": {");
+  fprintf(out, "\"RPU_OS_HARDWARE_REV\": %d, \"RPU_MPU_ARCHITECTURE\": %d", RPU_OS_HARDWARE_REV, RPU_MPU_ARCHITECTURE);
+#ifdef RPU_OS_USE_7_DIGIT_DISPLAYS
+  fprintf(out, ", \"RPU_OS_USE_7_DIGIT_DISPLAYS\": true");
+#endif
+#ifdef RPU_OS_USE_AUX_LAMPS
+  fprintf(out, ", \"RPU_OS_USE_AUX_LAMPS\": true");
+#endif
+  fprintf(out, "},\n  \"benchmarks\": [\n");
+  for (size_t count=0; count<results.size(); count++) {
+    const BenchResult &result = results[count];
+    fprintf(out, "    {\"name\": \"%s\", \"iterations\": %u, \"host_ns\": %.2f, \"port_reads\": %.2f, \"port_writes\": %.2f}%s\n",
+            result.name.c_str(), result.iterations, result.hostNs, result.portReads, result.portWrites,
+            (count+1<results.size()) ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+}
+
+static double JsonNumber(const std::string &object, const char *key) {
+  std::string quoted = std::string("\"") + key + "\":";
+  size_t pos = object.find(quoted);
+  if (pos==std::string::npos) return -1.0;
+  return atof(object.c_str() + pos + quoted.size());
+}
+
+// Reads back what WriteJson wrote (one benchmark object per line is not
+// assumed, but each object is flat)
+static bool ReadJson(const char *path, std::vector<BenchResult> &results) {
+  FILE *in = fopen(path, "r");
+  if (!in) return false;
+  std::string text;
+  char buf[4096];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), in))>0) text.append(buf, len);
+  fclose(in);
+
+  size_t pos = text.find("\"benchmarks\"");
+  if (pos==std::string::npos) return false;
+  while ((pos = text.find('{', pos))!=std::string::npos) {
+    size_t end = text.find('}', pos);
+    if (end==std::string::npos) break;
+    std::string object = text.substr(pos, end - pos);
+    pos = end;
+    size_t nameStart = object.find("\"name\": \"");
+    if (nameStart==std::string::npos) continue;
+    nameStart += 9;
+    size_t nameEnd = object.find('"', nameStart);
+    BenchResult result;
+    result.name = object.substr(nameStart, nameEnd - nameStart);
+    result.iterations = (uint32_t)JsonNumber(object, "iterations");
+    result.hostNs = JsonNumber(object, "host_ns");
+    result.portReads = JsonNumber(object, "port_reads");
+    result.portWrites = JsonNumber(object, "port_writes");
+    results.push_back(result);
+  }
+  return !results.empty();
+}
+
+static double PercentChange(double before, double after) {
+  if (before<=0.0) return (after<=0.0) ? 0.0 : 100.0;
+  return 100.0 * (after - before) / before;
+}
+
+// Returns the number of regressions
+static int Compare(FILE *out, const std::vector<BenchResult> &baseline, const std::vector<BenchResult> &results, double threshold) {
+  int numRegressions = 0;
+  fprintf(out, "\n%-52s %10s %10s %8s\n", "Compared with baseline", "ns before", "ns after", "change");
+  for (size_t count=0; count<results.size(); count++) {
+    const BenchResult &result = results[count];
+    const BenchResult *before = NULL;
+    for (size_t baseCount=0; baseCount<baseline.size(); baseCount++) {
+      if (baseline[baseCount].name==result.name) before = &baseline[baseCount];
+    }
+    if (!before) {
+      fprintf(out, "%-52s %10s %10.1f %8s  (new)\n", result.name.c_str(), "-", result.hostNs, "");
+      continue;
+    }
+    double change = PercentChange(before->hostNs, result.hostNs);
+    bool slower = change>threshold;
+    if (slower) numRegressions += 1;
+    fprintf(out, "%-52s %10.1f %10.1f %+7.1f%%%s\n", result.name.c_str(), before->hostNs, result.hostNs, change,
+            slower ? "  SLOWER" : "");
+  }
+  return numRegressions;
+}
+
+
+/*********************************************************************
+    Driver
+*********************************************************************/
+static void Usage(const char *name) {
+  fprintf(stderr, "usage: %s [-f filter] [-r runs] [-m minMs] [-j out.json] [-c baseline.json [-t percent]] [-l]\n", name);
+  fprintf(stderr, "  -f  only benchmarks whose name contains this\n");
+  fprintf(stderr, "  -r  timed runs per benchmark, best one kept (default %d)\n", BENCH_DEFAULT_RUNS);
+  fprintf(stderr, "  -m  shortest run in ms (default %d)\n", BENCH_DEFAULT_MIN_MS);
+  fprintf(stderr, "  -j  write the results as JSON (- for stdout)\n");
+  fprintf(stderr, "  -c  compare with an earlier -j file; exit 2 if anything got slower\n");
+  fprintf(stderr, "  -t  host_ns increase that counts as slower, in percent (default %.0f)\n", BENCH_DEFAULT_THRESHOLD);
+  fprintf(stderr, "  -l  list the benchmarks\n");
+}
+
+int main(int argc, char **argv) {
+  const char *filter = NULL;
+  const char *jsonPath = NULL;
+  const char *baselinePath = NULL;
+  int numRuns = BENCH_DEFAULT_RUNS;
+  double minSeconds = BENCH_DEFAULT_MIN_MS / 1000.0;
+  double threshold = BENCH_DEFAULT_THRESHOLD;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:r:m:j:c:t:lh"))!=-1) {
+    switch (opt) {
+      case 'f': filter = optarg; break;
+      case 'r': numRuns = atoi(optarg); break;
+      case 'm': minSeconds = atof(optarg) / 1000.0; break;
+      case 'j': jsonPath = optarg; break;
+      case 'c': baselinePath = optarg; break;
+      case 't': threshold = atof(optarg); break;
+      case 'l':
+        for (size_t count=0; count<NUM_BENCHMARKS; count++) printf("%s\n", Benchmarks[count].name);
+        return 0;
+      default: Usage(argv[0]); return (opt=='h') ? 0 : 1;
+    }
+  }
+  if (numRuns<1) numRuns = 1;
+
+  std::vector<BenchResult> baseline;
+  if (baselinePath && !ReadJson(baselinePath, baseline)) {
+    fprintf(stderr, "No benchmark results in %s\n", baselinePath);
+    return 1;
+  }
+
+  HostNullDevice nullDevice;
+  HostSetSerialDevice(0, &nullDevice);
+  HostSetSerialDevice(1, &nullDevice);
+
+  // Boot on the idle bus and keep the interrupts out of the numbers
+  setup();
+  detachInterrupt(digitalPinToInterrupt(2));
+  TIMSK1 &= ~(1<<OCIE1A);
+  BenchTime = millis();
+
+  bool jsonToStdout = jsonPath && strcmp(jsonPath, "-")==0;
+  FILE *table = jsonToStdout ? stderr : stdout;
+  std::vector<BenchResult> results;
+  fprintf(table, "%-52s %12s %10s %8s %8s\n", "Benchmark", "iterations", "host ns", "reads", "writes");
+  for (size_t count=0; count<NUM_BENCHMARKS; count++) {
+    if (filter && !strstr(Benchmarks[count].name, filter)) continue;
+    BenchResult result = Measure(Benchmarks[count], numRuns, minSeconds);
+    fprintf(table, "%-52s %12u %10.1f %8.1f %8.1f\n", result.name.c_str(), result.iterations, result.hostNs, result.portReads, result.portWrites);
+    fflush(table);
+    results.push_back(result);
+  }
+
+  if (jsonPath) {
+    FILE *out = jsonToStdout ? stdout : fopen(jsonPath, "w");
+    if (!out) {
+      fprintf(stderr, "Can't write %s\n", jsonPath);
+      return 1;
+    }
+    WriteJson(out, results);
+    if (!jsonToStdout) fclose(out);
+  }
+
+  if (baselinePath && Compare(table, baseline, results, threshold)) return 2;
+  return 0;
+}
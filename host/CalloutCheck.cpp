@@ -0,0 +1,173 @@
+// Checks the callout queue against a burst: while one callout plays, 20
+// more are queued 10 ms apart (12 different tracks, priorities cycling
+// 0-9), with the WAV Trigger emulator answering on Serial1 and every
+// track playing for WAV_EMULATOR_DEFAULT_TRACK_MS. The burst is run once
+// with callouts that never expire and once with an expiry of -e ms, and
+// for each the callouts are printed as they play. It exits with 2 if
+//   - a callout starts before the one ahead of it has finished (the
+//     queue should wait for the board's "off" report, not time out)
+//   - once the burst is over, a callout plays ahead of a higher
+//     priority one that was waiting
+//   - a callout with an expiry plays after it
+//   - the expired callouts aren't exactly the ones the never-expiring
+//     run plays in addition
+//
+// usage: trident_callouts [-e expiryMs] [-v]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+// (the STL comes ahead of Arduino's min/max)
+#include <map>
+#include <vector>
+#include "WavTriggerEmulator.h"
+#include "Arduino.h"
+#include "AudioHandler.h"
+
+#define CALLOUT_CHECK_DEFAULT_EXPIRY  3000
+#define CALLOUT_CHECK_BURST_SIZE      20
+#define CALLOUT_CHECK_BURST_TRACKS    12
+#define CALLOUT_CHECK_BURST_SPACING   10
+#define CALLOUT_CHECK_FIRST_TRACK     500
+#define CALLOUT_CHECK_RUN_MS          30000
+// Slack for the report coming back over the wire
+#define CALLOUT_CHECK_REPORT_SLACK_MS 20
+
+struct CalloutPlay {
+  unsigned long time;
+  uint16_t track;
+  byte priority;
+};
+
+struct CalloutRun {
+  std::vector<CalloutPlay> plays;
+  unsigned short dropped;
+  int failures;
+};
+
+static bool Verbose = false;
+
+static void Fail(CalloutRun &run, const char *what, const CalloutPlay &play) {
+  printf("  FAIL at %lu ms, track %u: %s\n", play.time, play.track, what);
+  run.failures += 1;
+}
+
+// What the queue should hold is tracked alongside it: the priority each
+// waiting track has (a repeat takes the higher one, a higher priority
+// than any waiting clears them) and when it was last queued
+static void RunBurst(unsigned short expiry, CalloutRun &run) {
+  WavTriggerEmulator wavTrigger;
+  HostSetSerialDevice(1, &wavTrigger);
+  AudioHandler audio;
+  audio.InitDevices(AUDIO_PLAY_TYPE_WAV_TRIGGER);
+  audio.SetNotificationsVolume(10);
+
+  std::map<uint16_t, byte> waitingPriority;
+  std::map<uint16_t, unsigned long> lastQueued;
+  std::vector<WavTriggerCommand> commands;
+  run.failures = 0;
+
+  unsigned long startTime = millis();
+  unsigned long burstStart = startTime + 200;
+  unsigned long burstEnd = burstStart + CALLOUT_CHECK_BURST_SIZE*CALLOUT_CHECK_BURST_SPACING;
+  int nextInBurst = -1;
+
+  while ((millis()-startTime)<CALLOUT_CHECK_RUN_MS) {
+    unsigned long now = millis();
+    if (nextInBurst<0 && now>=(startTime+100)) {
+      audio.QueuePrioritizedNotification(CALLOUT_CHECK_FIRST_TRACK, 0, 5, now, expiry);
+      lastQueued[CALLOUT_CHECK_FIRST_TRACK] = now;
+      waitingPriority[CALLOUT_CHECK_FIRST_TRACK] = 5;
+      nextInBurst = 0;
+    }
+    if (nextInBurst>=0 && nextInBurst<CALLOUT_CHECK_BURST_SIZE && now>=(burstStart + nextInBurst*CALLOUT_CHECK_BURST_SPACING)) {
+      uint16_t track = CALLOUT_CHECK_FIRST_TRACK + 1 + (nextInBurst%CALLOUT_CHECK_BURST_TRACKS);
+      byte priority = nextInBurst%10;
+      byte topPriority = 0;
+      for (std::map<uint16_t, byte>::iterator it=waitingPriority.begin(); it!=waitingPriority.end(); ++it) {
+        if (it->second>topPriority) topPriority = it->second;
+      }
+      if (priority>topPriority) waitingPriority.clear();
+      if (!waitingPriority.count(track) || priority>waitingPriority[track]) waitingPriority[track] = priority;
+      lastQueued[track] = now;
+      audio.QueuePrioritizedNotification(track, 0, priority, now, expiry);
+      if (Verbose) printf("  %5lu ms  queue %u (priority %u)\n", now-startTime, track, priority);
+      nextInBurst += 1;
+    }
+
+    HostAdvanceCycles(HOST_CPU_HZ/1000);
+    wavTrigger.update(HostGetCycles());
+    audio.Update(millis());
+
+    wavTrigger.takeCommands(commands);
+    for (size_t count=0; count<commands.size(); count++) {
+      const WavTriggerCommand &command = commands[count];
+      if (command.code!=TRK_PLAY_POLY && command.code!=TRK_RESUME) continue;
+      if (command.track<CALLOUT_CHECK_FIRST_TRACK || command.track>(CALLOUT_CHECK_FIRST_TRACK+CALLOUT_CHECK_BURST_TRACKS)) continue;
+      CalloutPlay play;
+      play.time = (unsigned long)(command.cycle/(HOST_CPU_HZ/1000)) - startTime;
+      play.track = command.track;
+      play.priority = waitingPriority.count(command.track) ? waitingPriority[command.track] : 0xFF;
+      printf("  %5lu ms  play %u (priority %u, waited %lu ms)\n", play.time, play.track, play.priority, (play.time+startTime) - lastQueued[play.track]);
+
+      if (play.priority==0xFF) Fail(run, "wasn't waiting", play);
+      if (!run.plays.empty()) {
+        const CalloutPlay &previous = run.plays.back();
+        if ((play.time-previous.time+CALLOUT_CHECK_REPORT_SLACK_MS)<WAV_EMULATOR_DEFAULT_TRACK_MS) Fail(run, "started before the last one finished", play);
+        if ((play.time+startTime)>burstEnd && previous.time+startTime>burstEnd && play.priority>previous.priority) Fail(run, "was waiting behind a lower priority", play);
+      }
+      if (expiry && ((play.time+startTime)-lastQueued[play.track])>(unsigned long)(expiry+CALLOUT_CHECK_REPORT_SLACK_MS)) Fail(run, "played after its expiry", play);
+      waitingPriority.erase(play.track);
+      run.plays.push_back(play);
+    }
+  }
+
+  run.dropped = audio.GetNotificationsDropped();
+  HostSetSerialDevice(1, NULL);
+}
+
+
+static void Usage(const char *name) {
+  fprintf(stderr, "usage: %s [-e expiryMs] [-v]\n", name);
+  fprintf(stderr, "  -e  expiry for the second run (default %d ms)\n", CALLOUT_CHECK_DEFAULT_EXPIRY);
+  fprintf(stderr, "  -v  show the callouts as they're queued\n");
+}
+
+
+int main(int argc, char **argv) {
+  unsigned short expiry = CALLOUT_CHECK_DEFAULT_EXPIRY;
+  int opt;
+  while ((opt=getopt(argc, argv, "e:vh"))!=-1) {
+    switch (opt) {
+      case 'e': expiry = (unsigned short)atoi(optarg); break;
+      case 'v': Verbose = true; break;
+      default: Usage(argv[0]); return (opt=='h') ? 0 : 1;
+    }
+  }
+  if (expiry==0) {
+    fprintf(stderr, "The second run needs an expiry\n");
+    return 1;
+  }
+
+  CalloutRun neverExpire, withExpiry;
+  printf("Burst of %d callouts, never expiring:\n", CALLOUT_CHECK_BURST_SIZE);
+  RunBurst(0, neverExpire);
+  printf("  %u played, %u dropped\n", (unsigned)neverExpire.plays.size(), neverExpire.dropped);
+  printf("Burst of %d callouts, expiring after %u ms:\n", CALLOUT_CHECK_BURST_SIZE, expiry);
+  RunBurst(expiry, withExpiry);
+  printf("  %u played, %u dropped\n", (unsigned)withExpiry.plays.size(), withExpiry.dropped);
+
+  int failures = neverExpire.failures + withExpiry.failures;
+  long playedMore = (long)neverExpire.plays.size() - (long)withExpiry.plays.size();
+  long droppedMore = (long)withExpiry.dropped - (long)neverExpire.dropped;
+  if (playedMore!=droppedMore) {
+    printf("FAIL: %ld expired, but the never-expiring run played %ld more\n", droppedMore, playedMore);
+    failures += 1;
+  }
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 2;
+  }
+  printf("OK\n");
+  return 0;
+}
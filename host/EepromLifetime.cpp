@@ -0,0 +1,267 @@
+// EEPROM wear projection: plays games of the unmodified firmware on the
+// Monte Carlo playfield (PlayfieldModel.h), a coin and a start button
+// each, against a file-backed EEPROM image, counts the writes to every
+// cell and projects how long the most-written cell of each region lasts
+// at a given number of plays a day.
+//
+// The games are split over a number of power-ons. Each one is a process
+// forked from the unbooted state that loads the image, runs setup(),
+// plays its share of games and exits, so every boot reads back what the
+// previous session left in the file (the audit log's and the credits
+// ring's write heads, the switch health block), as a cabinet would
+// after being switched off.
+// The image is kept between runs: run it again to carry on wearing the
+// same EEPROM, or remove it to start from a virgin one.
+//
+// Only the cells a game (or a boot) writes are counted; a cabinet left
+// in attract mode writes nothing. The audit log spreads its writes over
+// the whole ring, so play enough games to go around it a few times (the
+// default does, about three times) or its projection comes out short.
+//
+// usage: trident_eeprom [-e image] [-n games] [-b boots] [-d playsPerDay]
+//                       [-c cycles] [-m model] [-S seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+// (the model uses the STL, so it comes ahead of Arduino's min/max)
+#include "PlayfieldModel.h"
+#include "Arduino.h"
+#include "RPU_Config.h"
+
+void setup();
+void loop();
+
+// From Trident2023.ino
+extern char MachineState;
+
+#define LIFE_MACHINE_STATE_ATTRACT    0
+#define LIFE_LOOP_CYCLES              64000     // 4 ms, as trident_sim
+#define LIFE_MAX_TIME_STEP            16000
+#define LIFE_BOOT_SECONDS             3
+#define LIFE_MAX_GAME_SECONDS         1800
+#define LIFE_DEFAULT_IMAGE            "build/eeprom_life.bin"
+#define LIFE_DEFAULT_GAMES            100
+#define LIFE_DEFAULT_BOOTS            5
+#define LIFE_DEFAULT_PLAYS_PER_DAY    200
+// Write/erase cycles the ATmega2560 datasheet gives for its EEPROM
+#define LIFE_DEFAULT_ENDURANCE        100000
+// AUDIT_LOG_RECORD_SIZE and the switch health layout in RPU.cpp
+#define LIFE_AUDIT_LOG_RECORD_SIZE    6
+// (switch health is sized for the most switches any board has, 64)
+#define LIFE_SWITCH_HEALTH_END        (RPU_OS_SWITCH_HEALTH_START_BYTE + 16 + 8*64)
+#define LIFE_CREDITS_RING_END         (RPU_OS_CREDITS_RING_START_BYTE + 2*RPU_OS_CREDITS_RING_NUM_RECORDS)
+
+struct LifeRegion {
+  const char *name;
+  unsigned short start;
+  unsigned short end;
+};
+
+static const LifeRegion Regions[] = {
+  {"OS values (RAM shadowed)", 0, RPU_OS_EEPROM_SHADOW_SIZE},
+  {"game settings", RPU_OS_EEPROM_SHADOW_SIZE, RPU_OS_AUDIT_LOG_START_BYTE},
+  {"audit log", RPU_OS_AUDIT_LOG_START_BYTE, RPU_OS_AUDIT_LOG_START_BYTE + RPU_OS_AUDIT_LOG_NUM_RECORDS*LIFE_AUDIT_LOG_RECORD_SIZE},
+  {"unused", RPU_OS_AUDIT_LOG_START_BYTE + RPU_OS_AUDIT_LOG_NUM_RECORDS*LIFE_AUDIT_LOG_RECORD_SIZE, RPU_OS_SWITCH_HEALTH_START_BYTE},
+  {"switch health", RPU_OS_SWITCH_HEALTH_START_BYTE, LIFE_SWITCH_HEALTH_END},
+  {"unused", LIFE_SWITCH_HEALTH_END, RPU_OS_CREDITS_RING_START_BYTE},
+  {"credits ring", RPU_OS_CREDITS_RING_START_BYTE, LIFE_CREDITS_RING_END},
+  {"unused", LIFE_CREDITS_RING_END, HOST_EEPROM_SIZE},
+};
+#define NUM_LIFE_REGIONS (sizeof(Regions)/sizeof(Regions[0]))
+
+// Lives in memory shared with the boot processes
+struct LifeShared {
+  uint32_t gamesPlayed;
+  uint32_t gamesStuck;
+  uint64_t cellWrites[HOST_EEPROM_SIZE];
+};
+
+class HostNullDevice : public HostSerialDevice {
+public:
+  void transmitted(uint8_t, uint64_t) {}
+};
+
+static PlayfieldSim *Sim = NULL;
+
+static void RunLoop() {
+  loop();
+  HostAdvanceCycles(LIFE_LOOP_CYCLES);
+  Sim->update(HostGetCycles());
+}
+
+static void RunFor(uint64_t cycles) {
+  uint64_t endCycle = HostGetCycles() + cycles;
+  while (HostGetCycles()<endCycle) RunLoop();
+}
+
+// One power-on: boot, play the games, count what was written
+static void RunBoot(const PlayfieldModel &model, uint32_t firstGame, uint32_t numGames, uint64_t seed, LifeShared *shared) {
+  HostNullDevice nullDevice;
+  HostSetSerialDevice(0, &nullDevice);
+  HostSetSerialDevice(1, &nullDevice);
+
+  // Boot on the idle bus, then take the interrupts' place
+  setup();
+  detachInterrupt(digitalPinToInterrupt(2));
+  TIMSK1 &= ~(1<<OCIE1A);
+  HostSetMaxTimeStep(LIFE_MAX_TIME_STEP);
+  PlayfieldSim sim(model);
+  Sim = &sim;
+  sim.reset(HostGetCycles());
+  RunFor((uint64_t)LIFE_BOOT_SECONDS * HOST_CPU_HZ);
+
+  for (uint32_t gameNum=firstGame; gameNum<(firstGame+numGames); gameNum++) {
+    SimRandom seeds;
+    seeds.seed(seed * 0x100000001B3ULL + gameNum);
+    sim.seed(seeds.next());
+    randomSeed((unsigned long)((seeds.next() & 0x7FFFFFFF) | 1));
+
+    uint64_t startCycle = HostGetCycles();
+    sim.startGame(startCycle, 1);
+    bool started = false, done = false;
+    while (!done && (HostGetCycles()-startCycle)<((uint64_t)LIFE_MAX_GAME_SECONDS * HOST_CPU_HZ)) {
+      RunLoop();
+      if (MachineState!=LIFE_MACHINE_STATE_ATTRACT) started = true;
+      else if (started) done = true;
+    }
+    if (done) shared->gamesPlayed += 1;
+    else shared->gamesStuck += 1;
+    // A moment of attract mode before the next coin
+    RunFor((uint64_t)LIFE_BOOT_SECONDS * HOST_CPU_HZ);
+  }
+
+  for (unsigned short address=0; address<HOST_EEPROM_SIZE; address++) shared->cellWrites[address] += HostGetEEPromWrites(address);
+}
+
+
+static void Report(const LifeShared *shared, uint32_t numBoots, uint32_t playsPerDay, uint32_t endurance) {
+  uint32_t numGames = shared->gamesPlayed + shared->gamesStuck;
+  printf("%u games over %u boots (%u didn't finish)\n", numGames, numBoots, shared->gamesStuck);
+  if (numGames==0) return;
+
+  uint64_t totalWrites = 0;
+  for (unsigned short address=0; address<HOST_EEPROM_SIZE; address++) totalWrites += shared->cellWrites[address];
+  printf("%llu cell writes, %.1f a game\n\n", (unsigned long long)totalWrites, (double)totalWrites / numGames);
+
+  printf("At %u plays a day and %u write cycles a cell:\n", playsPerDay, endurance);
+  printf("  %-26s %11s %8s %11s %12s %13s\n", "region", "bytes", "writes", "worst cell", "writes/game", "lasts");
+  double shortestYears = -1.0;
+  const char *shortestRegion = NULL;
+  for (size_t region=0; region<NUM_LIFE_REGIONS; region++) {
+    const LifeRegion &info = Regions[region];
+    uint64_t regionWrites = 0, worstWrites = 0;
+    unsigned short worstCell = info.start;
+    for (unsigned short address=info.start; address<info.end; address++) {
+      regionWrites += shared->cellWrites[address];
+      if (shared->cellWrites[address]>worstWrites) {
+        worstWrites = shared->cellWrites[address];
+        worstCell = address;
+      }
+    }
+    char lasts[32];
+    if (worstWrites==0) {
+      snprintf(lasts, sizeof(lasts), "-");
+    } else {
+      // days until the worst cell has taken its rated cycles
+      double writesPerDay = (double)worstWrites * playsPerDay / numGames;
+      double years = (double)endurance / writesPerDay / 365.0;
+      snprintf(lasts, sizeof(lasts), "%.1f years", years);
+      if (shortestYears<0.0 || years<shortestYears) {
+        shortestYears = years;
+        shortestRegion = info.name;
+      }
+    }
+    char worst[16];
+    if (worstWrites) snprintf(worst, sizeof(worst), "%u", worstCell);
+    else snprintf(worst, sizeof(worst), "-");
+    printf("  %-26s %5u-%-5u %8llu %11s %12.2f %13s\n", info.name, info.start, info.end-1, (unsigned long long)regionWrites, worst,
+           (double)worstWrites / numGames, lasts);
+  }
+  if (shortestRegion) printf("\nFirst cell to wear out: %s, in %.1f years\n", shortestRegion, shortestYears);
+}
+
+
+static void Usage(const char *name) {
+  fprintf(stderr, "usage: %s [-e image] [-n games] [-b boots] [-d playsPerDay] [-c cycles] [-m model] [-S seed]\n", name);
+  fprintf(stderr, "  -e  EEPROM image, carried over between runs (default %s)\n", LIFE_DEFAULT_IMAGE);
+  fprintf(stderr, "  -n  games to play (default %d)\n", LIFE_DEFAULT_GAMES);
+  fprintf(stderr, "  -b  power-ons to spread them over (default %d)\n", LIFE_DEFAULT_BOOTS);
+  fprintf(stderr, "  -d  plays a day to project for (default %d)\n", LIFE_DEFAULT_PLAYS_PER_DAY);
+  fprintf(stderr, "  -c  write cycles a cell is good for (default %d)\n", LIFE_DEFAULT_ENDURANCE);
+  fprintf(stderr, "  -m  playfield model file (see PlayfieldModel.h)\n");
+  fprintf(stderr, "  -S  seed\n");
+}
+
+int main(int argc, char **argv) {
+  const char *imagePath = LIFE_DEFAULT_IMAGE;
+  const char *modelPath = NULL;
+  uint32_t numGames = LIFE_DEFAULT_GAMES;
+  uint32_t numBoots = LIFE_DEFAULT_BOOTS;
+  uint32_t playsPerDay = LIFE_DEFAULT_PLAYS_PER_DAY;
+  uint32_t endurance = LIFE_DEFAULT_ENDURANCE;
+  uint64_t seed = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "e:n:b:d:c:m:S:h"))!=-1) {
+    switch (opt) {
+      case 'e': imagePath = optarg; break;
+      case 'n': numGames = strtoul(optarg, NULL, 0); break;
+      case 'b': numBoots = strtoul(optarg, NULL, 0); break;
+      case 'd': playsPerDay = strtoul(optarg, NULL, 0); break;
+      case 'c': endurance = strtoul(optarg, NULL, 0); break;
+      case 'm': modelPath = optarg; break;
+      case 'S': seed = strtoull(optarg, NULL, 0); break;
+      default: Usage(argv[0]); return (opt=='h') ? 0 : 1;
+    }
+  }
+  if (numGames==0 || numBoots==0 || playsPerDay==0 || endurance==0) {
+    Usage(argv[0]);
+    return 1;
+  }
+  if (numBoots>numGames) numBoots = numGames;
+
+  PlayfieldModel model;
+  char error[160];
+  if (modelPath && !model.load(modelPath, error, sizeof(error))) {
+    fprintf(stderr, "%s: %s\n", modelPath, error);
+    return 1;
+  }
+
+  void *sharedMemory = mmap(NULL, sizeof(LifeShared), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if (sharedMemory==MAP_FAILED) {
+    fprintf(stderr, "Can't map the write counts\n");
+    return 1;
+  }
+  LifeShared *shared = (LifeShared *)sharedMemory;
+  memset(shared, 0, sizeof(LifeShared));
+
+  uint32_t firstGame = 0;
+  for (uint32_t boot=0; boot<numBoots; boot++) {
+    uint32_t bootGames = numGames/numBoots + ((boot<(numGames%numBoots)) ? 1 : 0);
+    // Read back what the last boot left in the file
+    if (!HostOpenEEProm(imagePath)) {
+      fprintf(stderr, "Can't open EEPROM image %s\n", imagePath);
+      return 1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid==0) {
+      RunBoot(model, firstGame, bootGames, seed, shared);
+      _exit(0);
+    }
+    int status = 0;
+    if (pid<0 || waitpid(pid, &status, 0)!=pid || !WIFEXITED(status) || WEXITSTATUS(status)!=0) {
+      fprintf(stderr, "Boot %u crashed\n", boot+1);
+      return 1;
+    }
+    firstGame += bootGames;
+  }
+
+  Report(shared, numBoots, playsPerDay, endurance);
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <string.h>
+#include "GoldenTrace.h"
+#include "Arduino.h"
+#include "AudioHandler.h"
+
+// The game's state (Trident2023.ino)
+extern char MachineState;
+extern byte CurrentPlayer, CurrentBallInPlay, Credits;
+extern unsigned long CurrentScores[4];
+
+#define GOLDEN_MAX_REPORTED_DIFFERENCES 5
+
+
+GoldenTrace::GoldenTrace(MPUBoardArch1 &s_board, WavTriggerMonitor &s_wavTrigger) : board(s_board), wavTrigger(s_wavTrigger) {
+  out = NULL;
+  numLines = 0;
+  numDifferences = 0;
+  memset(lastPulses, 0, sizeof(lastPulses));
+  lastSoundCommand = 0;
+}
+
+GoldenTrace::~GoldenTrace() {
+  if (out) fclose(out);
+}
+
+bool GoldenTrace::open(const char *writePath, const char *comparePath) {
+  if (comparePath) {
+    FILE *in = fopen(comparePath, "r");
+    if (!in) return false;
+    char line[1024];
+    while (fgets(line, sizeof(line), in)) {
+      line[strcspn(line, "\r\n")] = 0;
+      golden.push_back(line);
+    }
+    fclose(in);
+  }
+  if (writePath) {
+    out = fopen(writePath, "w");
+    if (!out) return false;
+  }
+  return true;
+}
+
+void GoldenTrace::addLine(uint32_t timeMs, const char *what) {
+  std::string line;
+  char buf[64];
+
+  snprintf(buf, sizeof(buf), "%u %s | st %d p%d b%d c%d | sc", timeMs, what, MachineState, CurrentPlayer, CurrentBallInPlay, Credits);
+  line += buf;
+  for (int count=0; count<4; count++) {
+    snprintf(buf, sizeof(buf), " %lu", CurrentScores[count]);
+    line += buf;
+  }
+
+  line += " | lamps ";
+  for (int nibble=(MPU_NUM_LAMPS+3)/4-1; nibble>=0; nibble--) {
+    uint8_t value = 0;
+    for (int bit=3; bit>=0; bit--) value = (value<<1) | (board.getLamp(nibble*4+bit) ? 1 : 0);
+    snprintf(buf, sizeof(buf), "%X", value);
+    line += buf;
+  }
+
+  line += " | sol";
+  for (uint8_t solNum=0; solNum<MPU_NUM_SOLENOIDS; solNum++) {
+    uint32_t pulses = board.getSolenoidStats(solNum)->pulses;
+    for (; lastPulses[solNum]<pulses; lastPulses[solNum]++) {
+      snprintf(buf, sizeof(buf), " %d", solNum);
+      line += buf;
+    }
+  }
+  snprintf(buf, sizeof(buf), " cont %X | snd", board.getSolenoidByte()>>4);
+  line += buf;
+
+  std::vector<WavTriggerCommand> commands;
+  wavTrigger.takeCommands(commands);
+  for (size_t count=0; count<commands.size(); count++) {
+    const WavTriggerCommand &command = commands[count];
+    if (command.command==CMD_STOP_ALL) snprintf(buf, sizeof(buf), " stopall");
+    else if (command.code==TRK_PLAY_SOLO || command.code==TRK_PLAY_POLY) snprintf(buf, sizeof(buf), " p%u", command.track);
+    else if (command.code==TRK_STOP) snprintf(buf, sizeof(buf), " s%u", command.track);
+    else snprintf(buf, sizeof(buf), " t%u:%u", command.code, command.track);
+    line += buf;
+  }
+  // The log only holds the last MPU_SOUND_LOG_SIZE commands
+  uint32_t numSoundCommands = board.getNumSoundCommands();
+  if (numSoundCommands - lastSoundCommand > MPU_SOUND_LOG_SIZE) lastSoundCommand = numSoundCommands - MPU_SOUND_LOG_SIZE;
+  for (; lastSoundCommand<numSoundCommands; lastSoundCommand++) {
+    snprintf(buf, sizeof(buf), " sb%02X", board.getSoundCommand(lastSoundCommand));
+    line += buf;
+  }
+
+  if (out) fprintf(out, "%s\n", line.c_str());
+
+  if (!golden.empty()) {
+    if (numLines>=golden.size() || golden[numLines]!=line) {
+      if (numDifferences<GOLDEN_MAX_REPORTED_DIFFERENCES) {
+        fprintf(stderr, "Golden trace differs at line %u:\n", numLines+1);
+        fprintf(stderr, "  expected: %s\n", numLines<golden.size() ? golden[numLines].c_str() : "(end of trace)");
+        fprintf(stderr, "  got:      %s\n", line.c_str());
+      }
+      numDifferences += 1;
+    }
+  }
+  numLines += 1;
+}
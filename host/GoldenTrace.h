@@ -0,0 +1,50 @@
+// Golden traces for switch replays
+//
+// One line per replayed switch event, written when the next event comes
+// due, with what the machine did in between:
+//
+//   <ms> <event> | st <state> p<player> b<ball> c<credits> | sc <scores x4>
+//     | lamps <60 lamps, hex, lamp 0 in the low bit> | sol <pulses> cont <hi nibble>
+//     | snd <WAV Trigger track commands> <sound board commands>
+//
+// (all on one line). Lamps are the ones the board saw lit; the rest
+// comes from the game's variables, the solenoid decoder, Serial1 and the
+// sound board latch. A replay can write a trace, compare against one,
+// or both.
+
+#ifndef GOLDEN_TRACE_H
+#define GOLDEN_TRACE_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "MPUBoardArch1.h"
+#include "WavTriggerMonitor.h"
+
+class GoldenTrace {
+public:
+  GoldenTrace(MPUBoardArch1 &s_board, WavTriggerMonitor &s_wavTrigger);
+  ~GoldenTrace();
+
+  // Either path can be NULL
+  bool open(const char *writePath, const char *comparePath);
+  // Ends the window of the event described by what (stamped timeMs)
+  void addLine(uint32_t timeMs, const char *what);
+
+  uint32_t getNumLines() { return numLines; }
+  uint32_t getNumDifferences() { return numDifferences; }
+  // Lines left over in the golden trace (it ran longer than the replay)
+  uint32_t getNumMissing() { return golden.size()>numLines ? golden.size() - numLines : 0; }
+
+private:
+  MPUBoardArch1 &board;
+  WavTriggerMonitor &wavTrigger;
+  FILE *out;
+  std::vector<std::string> golden;
+  uint32_t numLines;
+  uint32_t numDifferences;
+  uint32_t lastPulses[MPU_NUM_SOLENOIDS];
+  uint32_t lastSoundCommand;
+};
+
+#endif
@@ -0,0 +1,515 @@
+// Worst-case execution time of the interrupt handlers
+//
+// The zero crossing handler (InterruptService3) turns interrupts back on
+// between switch strobes and lamp nibbles, so the display handler
+// (ISR(TIMER1_COMPA_vect)) and the board's own display IRQ can nest in
+// it, and the display handler can hold it off. This runs setup() on the
+// emulated MPU board and then drives one zero crossing at a time down
+// every path the inputs can send the handlers:
+//
+//   switches   none changing, or the first N switches (in scan order)
+//              starting to close, or becoming valid closures, for every
+//              N (RPU_OS_DEBUG_SWITCHES cuts the scan short past 8)
+//   solenoids  stack empty / a solenoid to pull
+//   revert     no continuous solenoid waiting / one reverting this tick
+//   self test  open / pressed as the handler starts
+//
+// with the display interrupt kept out of the way. Then, on the longest
+// of those paths, it moves Timer1's match across every -s step from just
+// before the zero crossing to the end of the handler, for every digit the
+// display handler can be on, so the display handler runs ahead of it,
+// nests in each interrupts() window, or is held off until the next one.
+//
+// For each handler it reports the longest run (on its own, and with what
+// nested in it), the longest stretch with interrupts off, the longest
+// zero crossing response (edge to U10's flag being cleared for the last
+// time) and the path behind each. A crossing is missed when the response
+// reaches the next crossing: U10's flag only holds one edge, and the
+// handler clears it on the way out. A display refresh is lost when
+// interrupts stay off longer than Timer1's period.
+//
+// The cycles are the shim's: bus transactions, delays and the interrupt
+// entry are charged, plain computation is not, so the real handlers run
+// somewhat longer. -m sets how much of the zero crossing period has to be
+// left over before a configuration counts as safe.
+//
+// The configuration is compiled in (`make isr-report` builds and runs
+// every combination).
+//
+// usage: trident_isr [-n name] [-z hz] [-s us] [-m percent] [-c out.csv] [-b [-H]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "Arduino.h"
+#include "RPU_Config.h"
+#include "RPU.h"
+#include "MPUBoardArch1.h"
+
+void setup();
+
+// From RPU.cpp
+extern volatile byte SwitchesMinus1[], SwitchesNow[];
+extern byte SwitchInverter[];
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+extern byte SwitchesDebounced[], DebounceCount0[], DebounceCount1[], DebounceCount2[];
+#endif
+extern volatile byte CurrentDisplayDigit;
+extern volatile byte CurrentSolenoidByte;
+extern volatile byte RevertSolenoidBit;
+extern volatile byte NumCyclesBeforeRevertingSolenoidByte;
+extern volatile int numberOfU10Interrupts;
+byte PullFirstFromSolenoidStack();
+
+// Switch bytes the zero crossing handler scans (as RPU.cpp sizes them)
+#if defined(RPU_USE_EXTENDED_SWITCHES_ON_PB4) || defined(RPU_USE_EXTENDED_SWITCHES_ON_PB7)
+#define ISR_NUM_SWITCH_BYTES      6
+#else
+#define ISR_NUM_SWITCH_BYTES      5
+#endif
+#define ISR_NUM_SWITCHES          (ISR_NUM_SWITCH_BYTES*8)
+
+#define ISR_SWITCHES_NONE         0
+#define ISR_SWITCHES_CLOSING      1
+#define ISR_SWITCHES_CLOSED       2
+
+#define ISR_DEFAULT_ZERO_CROSSING_HZ  120
+#define ISR_DEFAULT_STEP_US           8
+#define ISR_DEFAULT_HEADROOM          20.0
+// Each zero crossing is set up this long before its edge
+#define ISR_LEAD_CYCLES               (2*HOST_CPU_HZ/1000)
+// Timer1's prescaler (RPU_HookInterrupts)
+#define ISR_TIMER1_PRESCALER          1024
+#define ISR_SOLENOID_STACK_EMPTY      0xFF
+#define ISR_TEST_SOLENOID             1
+#define ISR_REVERT_BIT                0x10
+#define ISR_NO_DISPLAY                INT64_MIN
+
+class HostNullDevice : public HostSerialDevice {
+public:
+  void transmitted(uint8_t, uint64_t) {}
+};
+
+
+struct IsrPath {
+  uint8_t switches;
+  uint8_t numSwitches;
+  bool solenoid;
+  bool revert;
+  bool selfTest;
+  uint8_t digit;
+  // Timer1's match, in cycles from the zero crossing edge
+  int64_t displayOffset;
+};
+
+struct IsrRun {
+  // Outermost zero crossing handler (the call that did the zero crossing)
+  uint64_t zeroCrossingCycles;
+  uint64_t zeroCrossingOwnCycles;
+  uint64_t responseCycles;
+  uint64_t displayCycles;
+  uint64_t interruptsOffCycles;
+  uint64_t nestedDisplays;
+  bool done;
+};
+
+struct IsrWorst {
+  uint64_t cycles;
+  IsrPath path;
+};
+
+
+// The emulated board, plus an eye on the handler that does the zero
+// crossing
+class TimingBoard : public MPUBoardArch1 {
+public:
+  TimingBoard() : depth(0), armed(false) {}
+
+  void arm(uint64_t s_edgeCycle, bool s_pressSelfTest) {
+    edgeCycle = s_edgeCycle;
+    pressSelfTest = s_pressSelfTest;
+    armed = true;
+    done = false;
+  }
+  bool isDone() const { return done; }
+  uint64_t getStartCycle() const { return startCycle; }
+  uint64_t getEndCycle() const { return endCycle; }
+
+  void interruptEntered(uint8_t vector, uint64_t cycle) {
+    MPUBoardArch1::interruptEntered(vector, cycle);
+    if (vector!=0) return;
+    if (depth++) return;
+    entryCycle = cycle;
+    entryCount = numberOfU10Interrupts;
+    if (armed && pressSelfTest && cycle>=edgeCycle) {
+      setSelfTestSwitch(true);
+      pressSelfTest = false;
+    }
+  }
+
+  void interruptExited(uint8_t vector, uint64_t cycle) {
+    MPUBoardArch1::interruptExited(vector, cycle);
+    if (vector!=0 || depth==0) return;
+    if (--depth) return;
+    // (it may have come in for the display IRQ just ahead of the edge)
+    if (armed && numberOfU10Interrupts!=entryCount && cycle>=edgeCycle) {
+      startCycle = entryCycle;
+      endCycle = cycle;
+      done = true;
+      armed = false;
+    }
+  }
+
+private:
+  uint8_t depth;
+  uint64_t entryCycle;
+  int entryCount;
+  bool armed;
+  bool pressSelfTest;
+  uint64_t edgeCycle;
+  bool done;
+  uint64_t startCycle, endCycle;
+};
+
+static TimingBoard Board;
+static uint64_t ZeroCrossingPeriod;
+static FILE *RunLog = NULL;
+
+
+static void DescribePath(const IsrPath &path, char *buf, size_t size) {
+  std::string text;
+  char part[64];
+  if (path.switches==ISR_SWITCHES_NONE || path.numSwitches==0) {
+    text = "no switches";
+  } else {
+    snprintf(part, sizeof(part), "%u switch%s %s", path.numSwitches, (path.numSwitches==1) ? "" : "es",
+             (path.switches==ISR_SWITCHES_CLOSING) ? "closing" : "closed");
+    text = part;
+  }
+  if (path.solenoid) text += ", solenoid";
+  if (path.revert) text += ", revert";
+  if (path.selfTest) text += ", self test";
+  if (path.displayOffset!=ISR_NO_DISPLAY) {
+    snprintf(part, sizeof(part), ", digit %u display at %+.0f us", path.digit, (double)path.displayOffset / HOST_CYCLES_PER_MICRO);
+    text += part;
+  }
+  snprintf(buf, size, "%s", text.c_str());
+}
+
+// Sets the inputs up for one zero crossing (with interrupts off)
+static void SetUpPath(const IsrPath &path) {
+  while (RPU_PullFirstFromSwitchStack()!=SWITCH_STACK_EMPTY);
+  while (PullFirstFromSolenoidStack()!=ISR_SOLENOID_STACK_EMPTY);
+
+  for (uint8_t byteNum=0; byteNum<ISR_NUM_SWITCH_BYTES; byteNum++) {
+    uint8_t mask = 0x00;
+    if (path.switches!=ISR_SWITCHES_NONE) {
+      int bits = (int)path.numSwitches - byteNum*8;
+      if (bits>=8) mask = 0xFF;
+      else if (bits>0) mask = (uint8_t)((1<<bits) - 1);
+    }
+    // Open on the board, so the inverter decides what the handler reads.
+    // A valid closure is off, on, on; a starting one is off, on.
+    SwitchInverter[byteNum] = mask;
+    SwitchesMinus1[byteNum] = 0x00;
+    SwitchesNow[byteNum] = (path.switches==ISR_SWITCHES_CLOSED) ? mask : 0x00;
+#ifdef RPU_OS_SWITCH_DEBOUNCE_DEPTHS
+    // Open, with one closed scan counted toward the default depth of 2
+    // for a valid closure
+    SwitchesDebounced[byteNum] = 0x00;
+    DebounceCount0[byteNum] = (path.switches==ISR_SWITCHES_CLOSED) ? mask : 0x00;
+    DebounceCount1[byteNum] = 0x00;
+    DebounceCount2[byteNum] = 0x00;
+#endif
+  }
+
+  if (path.solenoid) RPU_PushToSolenoidStack(ISR_TEST_SOLENOID, 1, true);
+  if (path.revert) {
+    NumCyclesBeforeRevertingSolenoidByte = 1;
+    RevertSolenoidBit = ISR_REVERT_BIT;
+  }
+  CurrentDisplayDigit = path.digit;
+}
+
+static void TearDownPath(const IsrPath &path, uint8_t solenoidByte) {
+  for (uint8_t byteNum=0; byteNum<ISR_NUM_SWITCH_BYTES; byteNum++) SwitchInverter[byteNum] = 0x00;
+  if (path.selfTest) Board.setSelfTestSwitch(false);
+  NumCyclesBeforeRevertingSolenoidByte = 0;
+  RevertSolenoidBit = 0x00;
+  CurrentSolenoidByte = solenoidByte;
+}
+
+// Handlers that run on the way add their time on top of what the main
+// thread is charged, so time is moved in small steps
+static void AdvanceTo(uint64_t cycle) {
+  while (HostGetCycles()<cycle) {
+    uint64_t left = cycle - HostGetCycles();
+    HostAdvanceCycles((left<HOST_CYCLES_PER_MICRO) ? left : HOST_CYCLES_PER_MICRO);
+  }
+}
+
+// Runs one zero crossing down the path
+static IsrRun RunPath(const IsrPath &path) {
+  uint64_t edge = 0;
+  while (edge==0 || HostGetCycles() + ISR_LEAD_CYCLES/2>edge) {
+    uint64_t now = HostGetCycles();
+    edge = (now/ZeroCrossingPeriod + 1) * ZeroCrossingPeriod;
+    if (edge - now<ISR_LEAD_CYCLES) edge += ZeroCrossingPeriod;
+    AdvanceTo(edge - ISR_LEAD_CYCLES);
+  }
+
+  noInterrupts();
+  uint8_t solenoidByte = CurrentSolenoidByte;
+  SetUpPath(path);
+  // Without a display offset, Timer1 waits until after this crossing
+  int64_t offset = (path.displayOffset==ISR_NO_DISPLAY) ? (int64_t)ZeroCrossingPeriod : path.displayOffset;
+  HostSetTimer1NextMatch(edge + offset);
+  Board.arm(edge, path.selfTest);
+  interrupts();
+  HostResetStats();
+
+  while (!Board.isDone() && HostGetCycles()<edge + ZeroCrossingPeriod) HostAdvanceCycles(HOST_CYCLES_PER_MICRO);
+
+  IsrRun run;
+  const HostStats *stats = HostGetStats();
+  run.done = Board.isDone();
+  run.zeroCrossingCycles = run.done ? (Board.getEndCycle() - Board.getStartCycle()) : 0;
+  run.responseCycles = run.done ? (Board.getEndCycle() - edge) : 0;
+  run.zeroCrossingOwnCycles = stats->vectors[0].maxCycles;
+  run.displayCycles = stats->vectors[HOST_VECTOR_TIMER1].maxCycles;
+  run.interruptsOffCycles = stats->maxInterruptsOffCycles;
+  run.nestedDisplays = stats->vectors[HOST_VECTOR_TIMER1].nestedCalls;
+  TearDownPath(path, solenoidByte);
+
+  if (RunLog) {
+    char what[128];
+    DescribePath(path, what, sizeof(what));
+    fprintf(RunLog, "\"%s\",%d,%.1f,%.1f,%.1f,%.1f,%.1f,%u\n", what, run.done ? 1 : 0,
+            (double)run.zeroCrossingOwnCycles / HOST_CYCLES_PER_MICRO, (double)run.zeroCrossingCycles / HOST_CYCLES_PER_MICRO,
+            (double)run.displayCycles / HOST_CYCLES_PER_MICRO, (double)run.responseCycles / HOST_CYCLES_PER_MICRO,
+            (double)run.interruptsOffCycles / HOST_CYCLES_PER_MICRO, (unsigned)run.nestedDisplays);
+  }
+  return run;
+}
+
+static void Keep(IsrWorst &worst, uint64_t cycles, const IsrPath &path) {
+  if (cycles>worst.cycles) {
+    worst.cycles = cycles;
+    worst.path = path;
+  }
+}
+
+struct IsrReport {
+  uint32_t numPaths;
+  uint32_t numRuns;
+  uint32_t missedRuns;
+  IsrWorst zeroCrossingOwn;
+  IsrWorst zeroCrossing;
+  IsrWorst display;
+  IsrWorst response;
+  IsrWorst interruptsOff;
+  uint64_t maxNestedDisplays;
+};
+
+static void Record(IsrReport &report, const IsrRun &run, const IsrPath &path) {
+  report.numRuns += 1;
+  if (!run.done) {
+    report.missedRuns += 1;
+    return;
+  }
+  Keep(report.zeroCrossingOwn, run.zeroCrossingOwnCycles, path);
+  Keep(report.zeroCrossing, run.zeroCrossingCycles, path);
+  Keep(report.display, run.displayCycles, path);
+  Keep(report.response, run.responseCycles, path);
+  Keep(report.interruptsOff, run.interruptsOffCycles, path);
+  if (run.nestedDisplays>report.maxNestedDisplays) report.maxNestedDisplays = run.nestedDisplays;
+}
+
+static void Analyze(IsrReport &report, uint64_t stepCycles) {
+  memset(&report, 0, sizeof(report));
+
+  // Every input path, with the display handler out of the way
+  IsrPath path;
+  memset(&path, 0, sizeof(path));
+  path.displayOffset = ISR_NO_DISPLAY;
+  IsrWorst longest;
+  memset(&longest, 0, sizeof(longest));
+  for (uint8_t switches=ISR_SWITCHES_NONE; switches<=ISR_SWITCHES_CLOSED; switches++) {
+    int maxSwitches = (switches==ISR_SWITCHES_NONE) ? 0 : ISR_NUM_SWITCHES;
+    for (int numSwitches=(switches==ISR_SWITCHES_NONE) ? 0 : 1; numSwitches<=maxSwitches; numSwitches++) {
+      for (uint8_t flags=0; flags<8; flags++) {
+        path.switches = switches;
+        path.numSwitches = (uint8_t)numSwitches;
+        path.solenoid = (flags & 0x01) ? true : false;
+        path.revert = (flags & 0x02) ? true : false;
+        path.selfTest = (flags & 0x04) ? true : false;
+        IsrRun run = RunPath(path);
+        Record(report, run, path);
+        report.numPaths += 1;
+        if (run.done) Keep(longest, run.zeroCrossingCycles, path);
+      }
+    }
+  }
+
+  // The longest of them, with the display handler falling everywhere
+  // from just before the edge (it finishes first when it starts a whole
+  // handler's length ahead) to the end of the handler
+  path = longest.path;
+  path.displayOffset = -(int64_t)ISR_LEAD_CYCLES/2;
+  Record(report, RunPath(path), path);
+  int64_t first = -(int64_t)report.display.cycles - (int64_t)stepCycles;
+  int64_t last = (int64_t)longest.cycles + (int64_t)stepCycles;
+  for (uint8_t digit=0; digit<RPU_OS_NUM_DIGITS; digit++) {
+    for (int64_t offset=first; offset<=last; offset+=(int64_t)stepCycles) {
+      path.digit = digit;
+      path.displayOffset = offset;
+      Record(report, RunPath(path), path);
+    }
+  }
+}
+
+
+/*********************************************************************
+    Report
+*********************************************************************/
+static void DescribeConfig(char *buf, size_t size) {
+  const char *switches = "40 switches";
+#if defined(RPU_USE_EXTENDED_SWITCHES_ON_PB4)
+  switches = "48 switches (PB4)";
+#elif defined(RPU_USE_EXTENDED_SWITCHES_ON_PB7)
+  switches = "48 switches (PB7)";
+#endif
+  const char *lamps = "main lamps";
+#ifdef RPU_OS_USE_AUX_LAMPS
+  lamps = "aux lamps";
+#endif
+  snprintf(buf, size, "rev %d, %d digits, %s, %s", RPU_OS_HARDWARE_REV, RPU_OS_NUM_DIGITS, switches, lamps);
+}
+
+static double Micros(uint64_t cycles) {
+  return (double)cycles / HOST_CYCLES_PER_MICRO;
+}
+
+static void PrintWorst(const char *what, const IsrWorst &worst) {
+  char path[128];
+  DescribePath(worst.path, path, sizeof(path));
+  printf("  %-30s %9.1f us  %s\n", what, Micros(worst.cycles), path);
+}
+
+#define ISR_VERDICT_OK        0
+#define ISR_VERDICT_AT_RISK   1
+#define ISR_VERDICT_MISSES    2
+
+static int Verdict(const IsrReport &report, uint64_t displayPeriod, double headroom, const char **text) {
+  if (report.missedRuns || report.response.cycles>=ZeroCrossingPeriod) {
+    *text = "MISSES ZERO CROSSINGS";
+    return ISR_VERDICT_MISSES;
+  }
+  if (report.interruptsOff.cycles>=displayPeriod) {
+    *text = "DROPS DISPLAY INTERRUPTS";
+    return ISR_VERDICT_MISSES;
+  }
+  if (report.response.cycles>(uint64_t)(ZeroCrossingPeriod * (1.0 - headroom/100.0))) {
+    *text = "AT RISK";
+    return ISR_VERDICT_AT_RISK;
+  }
+  *text = "OK";
+  return ISR_VERDICT_OK;
+}
+
+static void Usage(const char *name) {
+  fprintf(stderr, "usage: %s [-n name] [-z hz] [-s us] [-m percent] [-c out.csv] [-b [-H]]\n", name);
+  fprintf(stderr, "  -n  name for the configuration (default: describes it)\n");
+  fprintf(stderr, "  -z  zero crossing rate (default %d, 100 for 50 Hz mains)\n", ISR_DEFAULT_ZERO_CROSSING_HZ);
+  fprintf(stderr, "  -s  display interrupt step in us (default %d)\n", ISR_DEFAULT_STEP_US);
+  fprintf(stderr, "  -m  zero crossing headroom needed, in percent (default %.0f)\n", ISR_DEFAULT_HEADROOM);
+  fprintf(stderr, "  -c  write every run as CSV\n");
+  fprintf(stderr, "  -b  one line per configuration (-H adds the heading)\n");
+}
+
+int main(int argc, char **argv) {
+  const char *name = NULL;
+  const char *csvPath = NULL;
+  unsigned int zeroCrossingHz = ISR_DEFAULT_ZERO_CROSSING_HZ;
+  double stepMicros = ISR_DEFAULT_STEP_US;
+  double headroom = ISR_DEFAULT_HEADROOM;
+  bool brief = false;
+  bool heading = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:z:s:m:c:bHh"))!=-1) {
+    switch (opt) {
+      case 'n': name = optarg; break;
+      case 'z': zeroCrossingHz = (unsigned int)atoi(optarg); break;
+      case 's': stepMicros = atof(optarg); break;
+      case 'm': headroom = atof(optarg); break;
+      case 'c': csvPath = optarg; break;
+      case 'b': brief = true; break;
+      case 'H': heading = true; break;
+      default: Usage(argv[0]); return (opt=='h') ? 0 : 1;
+    }
+  }
+  if (zeroCrossingHz==0) zeroCrossingHz = ISR_DEFAULT_ZERO_CROSSING_HZ;
+  uint64_t stepCycles = (uint64_t)(stepMicros * HOST_CYCLES_PER_MICRO);
+  if (stepCycles==0) stepCycles = 1;
+
+  if (csvPath) {
+    RunLog = fopen(csvPath, "w");
+    if (!RunLog) {
+      fprintf(stderr, "Can't write %s\n", csvPath);
+      return 1;
+    }
+    fprintf(RunLog, "path,done,zc_own_us,zc_us,display_us,response_us,interrupts_off_us,nested_displays\n");
+  }
+
+  HostNullDevice nullDevice;
+  HostSetSerialDevice(0, &nullDevice);
+  HostSetSerialDevice(1, &nullDevice);
+  Board.setZeroCrossingHz(zeroCrossingHz);
+  ZeroCrossingPeriod = HOST_CPU_HZ / zeroCrossingHz;
+  HostSetBus(&Board);
+
+  setup();
+  // Let the attract mode settle
+  HostAdvanceCycles(HOST_CPU_HZ);
+
+  IsrReport report;
+  Analyze(report, stepCycles);
+  if (RunLog) fclose(RunLog);
+
+  uint64_t displayPeriod = ((uint64_t)OCR1A + 1) * ISR_TIMER1_PRESCALER;
+  const char *verdictText;
+  int verdict = Verdict(report, displayPeriod, headroom, &verdictText);
+  char config[96];
+  DescribeConfig(config, sizeof(config));
+  if (!name) name = config;
+  double headroomLeft = 100.0 * (1.0 - (double)report.response.cycles / ZeroCrossingPeriod);
+
+  if (brief) {
+    if (heading) {
+      printf("%-28s %10s %10s %10s %10s %10s %9s  %s\n", "configuration", "zc own us", "zc us", "display us",
+             "irq off us", "response", "headroom", "verdict");
+    }
+    printf("%-28s %10.1f %10.1f %10.1f %10.1f %10.1f %8.1f%%  %s\n", name, Micros(report.zeroCrossingOwn.cycles),
+           Micros(report.zeroCrossing.cycles), Micros(report.display.cycles), Micros(report.interruptsOff.cycles),
+           Micros(report.response.cycles), headroomLeft, verdictText);
+  } else {
+    printf("%s\n", name);
+    if (name!=config) printf("  %s\n", config);
+    printf("  %u input paths, %u runs, display interrupt step %.1f us\n", report.numPaths, report.numRuns, stepMicros);
+    PrintWorst("Zero crossing (own)", report.zeroCrossingOwn);
+    PrintWorst("Zero crossing (with nested)", report.zeroCrossing);
+    PrintWorst("Display (Timer1)", report.display);
+    PrintWorst("Interrupts off", report.interruptsOff);
+    PrintWorst("Zero crossing response", report.response);
+    printf("  %-30s %9llu\n", "Nested display interrupts", (unsigned long long)report.maxNestedDisplays);
+    printf("  %-30s %9.1f us  (%u Hz)\n", "Zero crossing period", Micros(ZeroCrossingPeriod), zeroCrossingHz);
+    printf("  %-30s %9.1f us\n", "Display interrupt period", Micros(displayPeriod));
+    if (report.missedRuns) printf("  %u runs never finished the zero crossing\n", report.missedRuns);
+    printf("  %.1f%% of the zero crossing period left: %s\n", headroomLeft, verdictText);
+  }
+
+  return (verdict==ISR_VERDICT_MISSES) ? 2 : 0;
+}
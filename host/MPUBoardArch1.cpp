@@ -0,0 +1,454 @@
+#include <string.h>
+#include "Arduino.h"
+#include "RPU_Config.h"
+#include "MPUBoardArch1.h"
+
+// The firmware's own view of the outputs (RPU.cpp)
+extern volatile byte LampStates[RPU_NUM_LAMP_BANKS], LampDim1[RPU_NUM_LAMP_BANKS], LampDim2[RPU_NUM_LAMP_BANKS];
+extern volatile byte DisplayDigits[5][RPU_OS_NUM_DIGITS];
+extern volatile byte DisplayDigitEnable[5];
+extern volatile byte CurrentSolenoidByte;
+
+#define MPU_ADDRESS_U10           0x88
+#define MPU_ADDRESS_U11           0x90
+#define MPU_ADDRESS_SB100         0xA0
+#define MPU_ADDRESS_SB100_CHIMES  0xC0
+
+#define MPU_VMA_BIT               0x02    // PG1
+#define MPU_PHI2_BIT              0x04    // PG2
+#define MPU_RW_BIT                0x20    // PE5
+#define MPU_IRQ_BIT               0x10    // PE4
+
+#define MPU_LAMP_PARK_ADDRESS     0x0F
+#define MPU_ZERO_CROSSING_HZ      120
+#define MPU_ZERO_CROSSING_WIDTH   (HOST_CPU_HZ/2000)    // 500 us
+#define MPU_DISPLAY_INTERRUPT_HZ  320
+#define MPU_DISPLAY_INTERRUPT_WIDTH (HOST_CPU_HZ/10000) // 100 us
+#define MPU_MAX_REPORTED_MISMATCHES 10
+
+#ifdef RPU_OS_USE_7_DIGIT_DISPLAYS
+#define MPU_FIRST_DIGIT_ENABLE_BIT  0x02
+#else
+#define MPU_FIRST_DIGIT_ENABLE_BIT  0x04
+#endif
+
+
+MPUBoardArch1::MPUBoardArch1() {
+  lastCycle = 0;
+  addressCycle = 0;
+  address = 0;
+  vmaActive = false;
+  readCycle = false;
+  readDone = false;
+  readValue = 0;
+
+  memset(switches, 0, sizeof(switches));
+  memset(dipSwitches, 0, sizeof(dipSwitches));
+  zeroCrossingPeriod = HOST_CPU_HZ / MPU_ZERO_CROSSING_HZ;
+  displayInterruptPeriod = HOST_CPU_HZ / MPU_DISPLAY_INTERRUPT_HZ;
+  // The self-test switch pulls CA1 low when closed
+  u10.setC1(PIA_SIDE_A, true);
+
+  lampAddress = MPU_LAMP_PARK_ADDRESS;
+  memset(lampFired, 0, sizeof(lampFired));
+  memset(lampLit, 0, sizeof(lampLit));
+  memset(lampScanFired, 0, sizeof(lampScanFired));
+  lampScanSeen = false;
+
+  memset(displayLatch, MPU_DIGIT_BLANK, sizeof(displayLatch));
+  memset(displayShown, MPU_DIGIT_BLANK, sizeof(displayShown));
+
+  solenoidByte = 0xFF;
+  solenoidStartCycle = 0;
+  memset(solenoidStats, 0, sizeof(solenoidStats));
+  continuousChanges = 0;
+  numSoundCommands = 0;
+  lastSoundCommand = 0;
+  memset(soundLog, 0, sizeof(soundLog));
+
+  frameDepth = 0;
+  zeroCrossingDepth = 0;
+  memset(busStats, 0, sizeof(busStats));
+
+  lampChecks = lampMismatches = 0;
+  displayChecks = displayMismatches = 0;
+  solenoidChecks = solenoidMismatches = 0;
+}
+
+
+/*********************************************************************
+    Inputs
+*********************************************************************/
+void MPUBoardArch1::setSwitch(uint8_t switchNum, bool closed) {
+  if (switchNum<MPU_NUM_SWITCHES) switches[switchNum] = closed;
+}
+
+bool MPUBoardArch1::getSwitch(uint8_t switchNum) {
+  return (switchNum<MPU_NUM_SWITCHES) ? switches[switchNum] : false;
+}
+
+void MPUBoardArch1::setSelfTestSwitch(bool closed) {
+  catchUp(HostGetCycles());
+  u10.setC1(PIA_SIDE_A, !closed);
+}
+
+void MPUBoardArch1::setDipSwitches(uint8_t bank, uint8_t value) {
+  if (bank<MPU_NUM_DIP_BANKS) dipSwitches[bank] = value;
+}
+
+void MPUBoardArch1::setZeroCrossingHz(unsigned int hz) {
+  zeroCrossingPeriod = hz ? (HOST_CPU_HZ / hz) : 0;
+}
+
+void MPUBoardArch1::setDisplayInterruptHz(unsigned int hz) {
+  displayInterruptPeriod = hz ? (HOST_CPU_HZ / hz) : 0;
+}
+
+// Delivers the edges of a pulse train (high for width, every period)
+// that fall in (fromCycle, toCycle] to a PIA's C1 input
+void MPUBoardArch1::pulseEdges(uint64_t fromCycle, uint64_t toCycle, uint64_t period, uint64_t width, PIA6821 &pia, uint8_t side) {
+  if (period==0) return;
+  // Only the last couple of edges matter to the flags
+  if (toCycle - fromCycle > 2*period) fromCycle = toCycle - 2*period;
+  for (uint64_t start=(fromCycle/period)*period; start<=toCycle; start+=period) {
+    if (start>fromCycle) {
+      pia.setC1(side, true);
+      if (&pia==&u10 && side==PIA_SIDE_B) {
+        // Zero crossing: the lamp SCRs that fired stay lit for this half cycle
+        memcpy(lampLit, lampFired, sizeof(lampLit));
+        memset(lampFired, 0, sizeof(lampFired));
+      }
+    }
+    if (start + width>fromCycle && start + width<=toCycle) pia.setC1(side, false);
+  }
+}
+
+void MPUBoardArch1::catchUp(uint64_t cycle) {
+  if (cycle<=lastCycle) return;
+  pulseEdges(lastCycle, cycle, zeroCrossingPeriod, MPU_ZERO_CROSSING_WIDTH, u10, PIA_SIDE_B);
+  pulseEdges(lastCycle, cycle, displayInterruptPeriod, MPU_DISPLAY_INTERRUPT_WIDTH, u11, PIA_SIDE_A);
+  lastCycle = cycle;
+}
+
+bool MPUBoardArch1::irqAsserted() {
+  return u10.getIRQ() || u11.getIRQ();
+}
+
+uint8_t MPUBoardArch1::switchReturns() {
+  uint8_t strobes = u10.getOutput(PIA_SIDE_A);
+  uint8_t returns = 0;
+  for (uint8_t row=0; row<MPU_NUM_SWITCHES/8; row++) {
+    if (!(strobes & (0x01<<row))) continue;
+    for (uint8_t bit=0; bit<8; bit++) {
+      if (switches[row*8 + bit]) returns |= (0x01<<bit);
+    }
+  }
+  // PA5-7 and CB2 strobe the four DIP switch banks
+  for (uint8_t bank=0; bank<3; bank++) {
+    if (strobes & (0x20<<bank)) returns |= dipSwitches[bank];
+  }
+  if (u10.getC2Output(PIA_SIDE_B)) returns |= dipSwitches[3];
+  return returns;
+}
+
+
+/*********************************************************************
+    Bus
+*********************************************************************/
+uint8_t MPUBoardArch1::readPins(uint8_t port, uint64_t cycle) {
+  if (port==HOST_PORT_G) return HostBus::readPins(port, cycle);
+  if (port==HOST_PORT_E) {
+    catchUp(cycle);
+    return irqAsserted() ? 0x00 : MPU_IRQ_BIT;
+  }
+  if (port==HOST_PORT_A) {
+    if (!vmaActive || !readCycle) return 0x00;
+    if (!readDone) {
+      catchUp(cycle);
+      readValue = busRead(address);
+      readDone = true;
+    }
+    return readValue;
+  }
+  return 0x00;
+}
+
+void MPUBoardArch1::portChanged(uint8_t port, uint8_t portValue, uint8_t ddrValue, uint64_t cycle) {
+  if (port==HOST_PORT_K) {
+    // The high byte goes out last, so the address is valid from here
+    addressCycle = cycle;
+  } else if (port==HOST_PORT_G) {
+    bool vma = (portValue & ddrValue & MPU_VMA_BIT) ? true : false;
+    if (vma && !vmaActive) {
+      vmaActive = true;
+      address = (HostGetPortValue(HOST_PORT_K)<<8) | HostGetPortValue(HOST_PORT_F);
+      readCycle = (HostGetPortValue(HOST_PORT_E) & MPU_RW_BIT) ? true : false;
+      readDone = false;
+    } else if (!vma && vmaActive) {
+      endTransaction(cycle);
+      vmaActive = false;
+    }
+  }
+}
+
+void MPUBoardArch1::endTransaction(uint64_t cycle) {
+  catchUp(cycle);
+  if (readCycle) {
+    if (!readDone) busRead(address);
+  } else {
+    busWrite(address, HostGetPortValue(HOST_PORT_A));
+  }
+
+  uint64_t busCycles = cycle - addressCycle;
+  MPUBusStats &mainStats = busStats[MPU_CONTEXT_MAIN];
+  if (frameDepth) {
+    Frame &frame = frames[frameDepth-1];
+    if (readCycle) frame.reads += 1;
+    else frame.writes += 1;
+    frame.busCycles += busCycles;
+  } else {
+    if (readCycle) mainStats.reads += 1;
+    else mainStats.writes += 1;
+    mainStats.busCycles += busCycles;
+  }
+}
+
+uint8_t MPUBoardArch1::busRead(uint16_t busAddress) {
+  if ((busAddress & 0xFFFC)==MPU_ADDRESS_U10) {
+    if ((busAddress & 0x03)==0x02) u10.setInputPins(PIA_SIDE_B, switchReturns());
+    return u10.read(busAddress & 0x03);
+  }
+  if ((busAddress & 0xFFFC)==MPU_ADDRESS_U11) return u11.read(busAddress & 0x03);
+  // No RAM or ROM is modeled
+  return 0x00;
+}
+
+void MPUBoardArch1::busWrite(uint16_t busAddress, uint8_t value) {
+  if ((busAddress & 0xFFFC)==MPU_ADDRESS_U10) {
+    u10.write(busAddress & 0x03, value);
+  } else if ((busAddress & 0xFFFC)==MPU_ADDRESS_U11) {
+    u11.write(busAddress & 0x03, value);
+  } else if (busAddress==MPU_ADDRESS_SB100 || busAddress==MPU_ADDRESS_SB100_CHIMES) {
+    soundLog[numSoundCommands % MPU_SOUND_LOG_SIZE] = value;
+    numSoundCommands += 1;
+    lastSoundCommand = value;
+    return;
+  } else {
+    return;
+  }
+  updateOutputs(HostGetCycles());
+}
+
+
+/*********************************************************************
+    Outputs
+*********************************************************************/
+int MPUBoardArch1::enabledDigit() {
+  uint8_t enables = u11.getOutput(PIA_SIDE_A);
+  int digit = -1;
+  for (uint8_t count=0; count<RPU_OS_NUM_DIGITS; count++) {
+    if (enables & (MPU_FIRST_DIGIT_ENABLE_BIT<<count)) {
+      if (digit>=0) return -1;
+      digit = count;
+    }
+  }
+  return digit;
+}
+
+void MPUBoardArch1::updateOutputs(uint64_t cycle) {
+  uint8_t u10A = u10.getOutput(PIA_SIDE_A);
+  bool u10CA2 = u10.getC2Output(PIA_SIDE_A);
+  uint8_t u11A = u11.getOutput(PIA_SIDE_A);
+  uint8_t u11B = u11.getOutput(PIA_SIDE_B);
+
+  // Lamp decoders latch the address while CB2 is high; a low inhibit
+  // line then gates that lamp's SCR
+  if (u10.getC2Output(PIA_SIDE_B)) {
+    lampAddress = u10A & 0x0F;
+    if (lampAddress!=MPU_LAMP_PARK_ADDRESS) lampScanSeen = true;
+  }
+  if (lampAddress!=MPU_LAMP_PARK_ADDRESS) {
+    for (uint8_t decoder=0; decoder<4; decoder++) {
+      if (u10A & (0x10<<decoder)) continue;
+      uint8_t lampNum = lampAddress*4 + decoder;
+      lampFired[lampNum] = true;
+      lampScanFired[lampNum] = true;
+    }
+  }
+
+  // Display latches are transparent while their strobe is low (and,
+  // for the four player displays, while CA2 is low)
+  for (uint8_t displayCount=0; displayCount<4; displayCount++) {
+    if (!u10CA2 && !(u10A & (0x01<<displayCount))) displayLatch[displayCount] = u10A>>4;
+  }
+  if (!(u11A & 0x01)) displayLatch[4] = u10A>>4;
+  if (u10CA2) {
+    int digit = enabledDigit();
+    if (digit>=0) {
+      for (uint8_t displayCount=0; displayCount<MPU_NUM_DISPLAYS; displayCount++) {
+        displayShown[displayCount][digit] = displayLatch[displayCount];
+      }
+    }
+  }
+
+  // Solenoid decoder (low nibble) and continuous solenoids (high nibble)
+  if (u11B!=solenoidByte) {
+    uint8_t oldSolenoid = solenoidByte & 0x0F;
+    uint8_t newSolenoid = u11B & 0x0F;
+    if (oldSolenoid!=newSolenoid) {
+      if (oldSolenoid<MPU_NUM_SOLENOIDS) {
+        MPUSolenoidStats &stats = solenoidStats[oldSolenoid];
+        uint64_t pulseCycles = cycle - solenoidStartCycle;
+        stats.pulses += 1;
+        stats.totalCycles += pulseCycles;
+        if (pulseCycles>stats.maxCycles) stats.maxCycles = pulseCycles;
+      }
+      solenoidStartCycle = cycle;
+    }
+    if ((u11B ^ solenoidByte) & 0xF0) continuousChanges += 1;
+    solenoidByte = u11B;
+  }
+}
+
+bool MPUBoardArch1::getLamp(uint8_t lampNum) {
+  return (lampNum<MPU_NUM_LAMPS) ? lampLit[lampNum] : false;
+}
+
+uint8_t MPUBoardArch1::getDisplayDigit(uint8_t displayNum, uint8_t digitNum) {
+  if (displayNum>=MPU_NUM_DISPLAYS || digitNum>=MPU_MAX_DIGITS) return MPU_DIGIT_BLANK;
+  return displayShown[displayNum][digitNum];
+}
+
+uint8_t MPUBoardArch1::getSolenoidByte() {
+  return solenoidByte;
+}
+
+const MPUSolenoidStats *MPUBoardArch1::getSolenoidStats(uint8_t solenoidNum) {
+  return (solenoidNum<MPU_NUM_SOLENOIDS) ? &solenoidStats[solenoidNum] : NULL;
+}
+
+
+/*********************************************************************
+    Interrupt accounting & checks
+*********************************************************************/
+void MPUBoardArch1::interruptEntered(uint8_t vector, uint64_t cycle) {
+  if (frameDepth<HOST_MAX_INTERRUPT_DEPTH) {
+    Frame &frame = frames[frameDepth++];
+    frame.vector = vector;
+    frame.reads = 0;
+    frame.writes = 0;
+    frame.busCycles = 0;
+  }
+  if (vector==0) {
+    if (zeroCrossingDepth==0) {
+      lampScanSeen = false;
+      memset(lampScanFired, 0, sizeof(lampScanFired));
+    }
+    zeroCrossingDepth += 1;
+  }
+}
+
+void MPUBoardArch1::interruptExited(uint8_t vector, uint64_t cycle) {
+  if (frameDepth) {
+    Frame &frame = frames[--frameDepth];
+    MPUBusStats &stats = busStats[frame.vector];
+    stats.calls += 1;
+    stats.reads += frame.reads;
+    stats.writes += frame.writes;
+    stats.busCycles += frame.busCycles;
+    if (frame.reads>stats.maxReads) stats.maxReads = frame.reads;
+    if (frame.writes>stats.maxWrites) stats.maxWrites = frame.writes;
+    if (frame.busCycles>stats.maxBusCycles) stats.maxBusCycles = frame.busCycles;
+  }
+
+  if (vector==0 && zeroCrossingDepth) {
+    zeroCrossingDepth -= 1;
+    if (zeroCrossingDepth==0 && lampScanSeen) {
+      checkLamps(cycle);
+      checkSolenoids(cycle);
+    }
+  } else if (vector==HOST_VECTOR_TIMER1) {
+    checkDisplays(cycle);
+  }
+}
+
+// Every lamp the scan just gated should be on in LampStates (a 0 bit),
+// and the rest off. Dimmed lamps skip scans by design, so they're left out.
+void MPUBoardArch1::checkLamps(uint64_t cycle) {
+  lampChecks += 1;
+  for (uint8_t lampNum=0; lampNum<MPU_NUM_LAMPS; lampNum++) {
+    uint8_t lampBit = 0x01<<(lampNum%8);
+    if ((LampDim1[lampNum/8] | LampDim2[lampNum/8]) & lampBit) continue;
+    bool expectedOn = (LampStates[lampNum/8] & lampBit) ? false : true;
+    if (expectedOn==lampScanFired[lampNum]) continue;
+    if (getNumMismatches()<MPU_MAX_REPORTED_MISMATCHES) {
+      fprintf(stderr, "MPU %.6f s: lamp %d is %s, firmware has it %s\n", (double)cycle/HOST_CPU_HZ, lampNum,
+              lampScanFired[lampNum] ? "on" : "off", expectedOn ? "on" : "off");
+    }
+    lampMismatches += 1;
+  }
+}
+
+void MPUBoardArch1::checkDisplays(uint64_t cycle) {
+  int digit = enabledDigit();
+  if (digit<0) return;
+  displayChecks += 1;
+  for (uint8_t displayCount=0; displayCount<MPU_NUM_DISPLAYS; displayCount++) {
+    uint8_t expected = MPU_DIGIT_BLANK;
+    if (DisplayDigitEnable[displayCount] & (0x01<<digit)) expected = DisplayDigits[displayCount][digit] & 0x0F;
+    if (displayLatch[displayCount]==expected) continue;
+    if (getNumMismatches()<MPU_MAX_REPORTED_MISMATCHES) {
+      fprintf(stderr, "MPU %.6f s: display %d digit %d latched 0x%X, firmware has 0x%X\n", (double)cycle/HOST_CPU_HZ,
+              displayCount, digit, displayLatch[displayCount], expected);
+    }
+    displayMismatches += 1;
+  }
+}
+
+void MPUBoardArch1::checkSolenoids(uint64_t cycle) {
+  solenoidChecks += 1;
+  if (solenoidByte==CurrentSolenoidByte) return;
+  if (getNumMismatches()<MPU_MAX_REPORTED_MISMATCHES) {
+    fprintf(stderr, "MPU %.6f s: solenoid port is 0x%02X, firmware has 0x%02X\n", (double)cycle/HOST_CPU_HZ,
+            solenoidByte, CurrentSolenoidByte);
+  }
+  solenoidMismatches += 1;
+}
+
+void MPUBoardArch1::report(FILE *out) {
+  static const char *contextNames[MPU_NUM_CONTEXTS] = {
+    "INT0 (PIA IRQ)", "INT1", "INT2", "INT3", "INT4", "INT5", "TIMER1 (display)", "main"
+  };
+  const HostStats *hostStats = HostGetStats();
+
+  fprintf(out, "\nMPU bus (per call: avg/max)  calls    reads       writes      bus us         handler us\n");
+  for (uint8_t context=0; context<MPU_NUM_CONTEXTS; context++) {
+    const MPUBusStats &stats = busStats[context];
+    if (context==MPU_CONTEXT_MAIN) {
+      if (stats.reads + stats.writes==0) continue;
+      fprintf(out, "  %-26s %8s %11llu %11llu %14.0f\n", contextNames[context], "-",
+              (unsigned long long)stats.reads, (unsigned long long)stats.writes, (double)stats.busCycles/HOST_CYCLES_PER_MICRO);
+      continue;
+    }
+    if (stats.calls==0) continue;
+    const HostVectorStats &vectorStats = hostStats->vectors[context];
+    double calls = (double)stats.calls;
+    fprintf(out, "  %-26s %8llu %5.1f/%-5u %5.1f/%-5u %6.1f/%-7.1f %6.1f/%.1f\n", contextNames[context],
+            (unsigned long long)stats.calls, stats.reads/calls, stats.maxReads, stats.writes/calls, stats.maxWrites,
+            stats.busCycles/calls/HOST_CYCLES_PER_MICRO, (double)stats.maxBusCycles/HOST_CYCLES_PER_MICRO,
+            vectorStats.totalCycles/calls/HOST_CYCLES_PER_MICRO, (double)vectorStats.maxCycles/HOST_CYCLES_PER_MICRO);
+  }
+
+  unsigned int lampsLit = 0;
+  for (uint8_t lampNum=0; lampNum<MPU_NUM_LAMPS; lampNum++) if (lampLit[lampNum]) lampsLit += 1;
+  fprintf(out, "MPU outputs: %u lamps lit, solenoid port 0x%02X (%u continuous changes), %u sound commands (last 0x%02X)\n",
+          lampsLit, solenoidByte, continuousChanges, numSoundCommands, lastSoundCommand);
+  for (uint8_t solenoidNum=0; solenoidNum<MPU_NUM_SOLENOIDS; solenoidNum++) {
+    const MPUSolenoidStats &stats = solenoidStats[solenoidNum];
+    if (stats.pulses==0) continue;
+    fprintf(out, "  solenoid %2d: %u pulses, avg %.1f ms, max %.1f ms\n", solenoidNum, stats.pulses,
+            (double)stats.totalCycles*1000.0/stats.pulses/HOST_CPU_HZ, (double)stats.maxCycles*1000.0/HOST_CPU_HZ);
+  }
+  fprintf(out, "MPU checks: lamps %u scans (%u mismatches), displays %u refreshes (%u), solenoids %u (%u)\n",
+          lampChecks, lampMismatches, displayChecks, displayMismatches, solenoidChecks, solenoidMismatches);
+}
@@ -0,0 +1,163 @@
+// Bally -17/-35 style MPU board (RPU_MPU_ARCHITECTURE 1) for the host build
+//
+// Plugs into the shim as its HostBus: the Arduino's address, data, VMA
+// and R/W lines are decoded into reads and writes of the two 6821 PIAs
+// (U10 at 0x88, U11 at 0x90) and the sound board latch (0xA0), exactly
+// as RPU_DataRead()/RPU_DataWrite() drive them. The PIAs' IRQ outputs
+// drive pin 2.
+//
+// Around the PIAs the board models what the firmware talks to:
+//   U10 PA0-4 / PB0-7   switch strobes & returns (PA5-7 and CB2 strobe the DIPs)
+//   U10 PA0-7 / CB2     lamp decoder address latch (CB2 strobe) and inhibit lines
+//   U10 PA / CA2, U11 PA display latch strobes (NOR'd with CA2), BCD data and
+//                       digit enables
+//   U11 PB              solenoid decoder (low nibble) and continuous solenoids
+//   U10 CB1, U11 CA1    zero crossing and display interrupt generators
+//   U10 CA1             self-test switch
+//
+// It also counts bus transactions per interrupt handler and, every time
+// a handler finishes, checks the lamps, displays and solenoid lines
+// against the firmware's LampStates / DisplayDigits / CurrentSolenoidByte.
+
+#ifndef MPU_BOARD_ARCH1_H
+#define MPU_BOARD_ARCH1_H
+
+#include <stdio.h>
+#include "HostPlatform.h"
+#include "PIA6821.h"
+
+#define MPU_NUM_SWITCHES          40
+#define MPU_NUM_LAMPS             60
+#define MPU_NUM_DISPLAYS          5
+#define MPU_MAX_DIGITS            7
+#define MPU_NUM_SOLENOIDS         15
+#define MPU_NUM_DIP_BANKS         4
+#define MPU_DIGIT_BLANK           0x0F
+#define MPU_SOUND_LOG_SIZE        64
+// Bus statistics are kept per vector, plus one slot for the main loop
+#define MPU_CONTEXT_MAIN          HOST_NUM_VECTORS
+#define MPU_NUM_CONTEXTS          (HOST_NUM_VECTORS+1)
+
+
+struct MPUBusStats {
+  uint64_t calls;
+  uint64_t reads;
+  uint64_t writes;
+  // CPU cycles from address setup to the end of VMA
+  uint64_t busCycles;
+  uint32_t maxReads;
+  uint32_t maxWrites;
+  uint64_t maxBusCycles;
+};
+
+struct MPUSolenoidStats {
+  uint32_t pulses;
+  uint64_t totalCycles;
+  uint64_t maxCycles;
+};
+
+
+class MPUBoardArch1 : public HostBus {
+public:
+  MPUBoardArch1();
+
+  // HostBus
+  uint8_t readPins(uint8_t port, uint64_t cycle);
+  void portChanged(uint8_t port, uint8_t portValue, uint8_t ddrValue, uint64_t cycle);
+  void interruptEntered(uint8_t vector, uint64_t cycle);
+  void interruptExited(uint8_t vector, uint64_t cycle);
+
+  // Cabinet & playfield
+  void setSwitch(uint8_t switchNum, bool closed);
+  bool getSwitch(uint8_t switchNum);
+  void setSelfTestSwitch(bool closed);
+  void setDipSwitches(uint8_t bank, uint8_t value);
+  void setZeroCrossingHz(unsigned int hz);
+  void setDisplayInterruptHz(unsigned int hz);
+
+  // Outputs
+  bool getLamp(uint8_t lampNum);
+  uint8_t getDisplayDigit(uint8_t displayNum, uint8_t digitNum);
+  uint8_t getSolenoidByte();
+  const MPUSolenoidStats *getSolenoidStats(uint8_t solenoidNum);
+  uint32_t getNumSoundCommands() { return numSoundCommands; }
+  uint8_t getLastSoundCommand() { return lastSoundCommand; }
+  // The commandNum'th command written to the sound board (only the last
+  // MPU_SOUND_LOG_SIZE are kept)
+  uint8_t getSoundCommand(uint32_t commandNum) { return soundLog[commandNum % MPU_SOUND_LOG_SIZE]; }
+
+  const MPUBusStats *getBusStats(uint8_t context) { return &busStats[context]; }
+  uint32_t getNumMismatches() { return lampMismatches + displayMismatches + solenoidMismatches; }
+  void report(FILE *out);
+
+private:
+  PIA6821 u10;
+  PIA6821 u11;
+
+  // Bus state
+  uint64_t lastCycle;
+  uint64_t addressCycle;
+  uint16_t address;
+  bool vmaActive;
+  bool readCycle;
+  bool readDone;
+  uint8_t readValue;
+
+  // Inputs
+  bool switches[MPU_NUM_SWITCHES];
+  uint8_t dipSwitches[MPU_NUM_DIP_BANKS];
+  uint64_t zeroCrossingPeriod;
+  uint64_t displayInterruptPeriod;
+
+  // Lamps
+  uint8_t lampAddress;
+  bool lampFired[MPU_NUM_LAMPS];
+  bool lampLit[MPU_NUM_LAMPS];
+  bool lampScanFired[MPU_NUM_LAMPS];
+  bool lampScanSeen;
+
+  // Displays
+  uint8_t displayLatch[MPU_NUM_DISPLAYS];
+  uint8_t displayShown[MPU_NUM_DISPLAYS][MPU_MAX_DIGITS];
+
+  // Solenoids & sound
+  uint8_t solenoidByte;
+  uint64_t solenoidStartCycle;
+  MPUSolenoidStats solenoidStats[MPU_NUM_SOLENOIDS];
+  uint32_t continuousChanges;
+  uint32_t numSoundCommands;
+  uint8_t lastSoundCommand;
+  uint8_t soundLog[MPU_SOUND_LOG_SIZE];
+
+  // Per handler accounting
+  struct Frame {
+    uint8_t vector;
+    uint32_t reads;
+    uint32_t writes;
+    uint64_t busCycles;
+  };
+  Frame frames[HOST_MAX_INTERRUPT_DEPTH];
+  uint8_t frameDepth;
+  uint8_t zeroCrossingDepth;
+  MPUBusStats busStats[MPU_NUM_CONTEXTS];
+
+  // Checks
+  uint32_t lampChecks, lampMismatches;
+  uint32_t displayChecks, displayMismatches;
+  uint32_t solenoidChecks, solenoidMismatches;
+
+  void catchUp(uint64_t cycle);
+  void pulseEdges(uint64_t fromCycle, uint64_t toCycle, uint64_t period, uint64_t width, PIA6821 &pia, uint8_t side);
+  bool irqAsserted();
+  uint8_t switchReturns();
+  uint8_t busRead(uint16_t busAddress);
+  void busWrite(uint16_t busAddress, uint8_t value);
+  void endTransaction(uint64_t cycle);
+  void updateOutputs(uint64_t cycle);
+  int enabledDigit();
+  void checkLamps(uint64_t cycle);
+  void checkDisplays(uint64_t cycle);
+  void checkSolenoids(uint64_t cycle);
+};
+
+#endif
@@ -0,0 +1,495 @@
+// Monte Carlo game simulator: plays many games of the unmodified rules
+// against a stochastic playfield (PlayfieldModel.h) and reports the
+// score distribution, how often each mode starts and how long games
+// last, for tuning the rule constants off the cabinet.
+//
+// The firmware keeps its state in globals, so games run in processes,
+// not threads: after setup() and a few seconds of attract mode, the
+// driver forks one worker per core. Workers take game numbers from a
+// shared counter (so a worker that draws short games just takes more),
+// and play each game in a child forked from that same pristine state,
+// so game n always plays out the same way for a given seed and model.
+// Results go into shared memory.
+//
+// The board isn't emulated here. The interrupts are switched off and
+// PlayfieldSim does their job directly (switch stack, SwitchesNow, the
+// solenoid stack at 120 Hz), which is what makes it fast. A game is
+// about 100k passes through loop(); most of what's left of the time is
+// the firmware's own bus reads, which spin on phi2 as they would on the
+// board. The shim's fast spin (HostSetFastSpin()) steps over those waits
+// in one go, charging the same cycles, so games play out exactly as they
+// would without it (-B turns it off to check). A bigger -l makes for
+// fewer passes, but coarser playfield time.
+//
+// usage: trident_sim [-n games] [-j workers] [-p players] [-m model] [-M]
+//                    [-l loopCycles] [-S seed] [-T seconds] [-s name=value]
+//                    [-o games.csv] [-B]
+//
+// Rule constants in Trident2023.ino that are wrapped in #ifndef can be
+// changed per build, e.g.
+//   make BUILD=build-mq HOST_DEFINES=-DMODE_QUALIFY_TIME=60000 sim
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+// (the model uses the STL, so it comes ahead of Arduino's min/max)
+#include <new>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include "PlayfieldModel.h"
+#include "Arduino.h"
+
+void setup();
+void loop();
+
+// Game state from Trident2023.ino
+extern char MachineState;
+extern byte CurrentNumPlayers, GameMode, MiniGamesRunning, ComboMultiballStage;
+extern unsigned long CurrentScores[4];
+// Settings -s can change
+extern byte BallsPerGame, BallSaveNumSeconds, MaxTiltWarnings;
+extern byte ExploreTheDepthsStart, TargetSpecialBonus, StandupSpecialLevel;
+extern boolean TournamentScoring;
+
+#define SIM_MACHINE_STATE_ATTRACT       0
+#define SIM_MACHINE_STATE_INIT_NEW_BALL 2
+#define SIM_GAME_MODE_QUALIFIED         2
+#define SIM_GAME_MODE_WIZARD            6
+#define SIM_FEEDING_FRENZY_FLAG         0x01
+#define SIM_SHARP_SHOOTER_FLAG          0x02
+#define SIM_EXPLORE_THE_DEPTHS_FLAG     0x04
+#define SIM_COMBO_MULTIBALL_STAGE       3
+
+// A pass through loop() is charged a typical pass on the cabinet; the
+// playfield only moves between passes
+#define SIM_DEFAULT_LOOP_CYCLES   64000     // 4 ms
+#define SIM_DEFAULT_GAMES         1000
+#define SIM_DEFAULT_MAX_SECONDS   1800
+#define SIM_ATTRACT_SECONDS       3
+#define SIM_HISTOGRAM_BINS        20
+#define SIM_HISTOGRAM_BAR         40
+
+#define SIM_GAME_NOT_RUN          0
+#define SIM_GAME_DONE             1
+#define SIM_GAME_TIMED_OUT        2
+#define SIM_GAME_CRASHED          3
+
+#define SIM_MODE_QUALIFIED        0
+#define SIM_MODE_FEEDING_FRENZY   1
+#define SIM_MODE_SHARP_SHOOTER    2
+#define SIM_MODE_EXPLORE          3
+#define SIM_MODE_DOUBLE           4
+#define SIM_MODE_TRIPLE           5
+#define SIM_MODE_WIZARD           6
+#define SIM_MODE_COMBO_MULTIBALL  7
+#define SIM_NUM_MODES             8
+
+static const char *ModeNames[SIM_NUM_MODES] = {
+  "Mini-game qualified", "Feeding Frenzy", "Sharp Shooter", "Explore the Depths",
+  "Two mini-games", "Three mini-games", "Wizard", "Combo multiball"
+};
+
+struct SimResult {
+  uint8_t status;
+  uint8_t numPlayers;
+  uint16_t ballsStarted;
+  uint32_t lengthMs;
+  uint32_t numShots;
+  uint32_t scores[4];
+  uint8_t modeStarts[SIM_NUM_MODES];
+};
+
+// Lives in memory shared by every process
+struct SimShared {
+  std::atomic<uint32_t> nextGame;
+  std::atomic<uint32_t> gamesDone;
+};
+
+struct SimSetting {
+  const char *name;
+  void *value;
+  bool isBoolean;
+};
+
+static SimSetting Settings[] = {
+  {"BallsPerGame", &BallsPerGame, false},
+  {"BallSaveNumSeconds", &BallSaveNumSeconds, false},
+  {"MaxTiltWarnings", &MaxTiltWarnings, false},
+  {"ExploreTheDepthsStart", &ExploreTheDepthsStart, false},
+  {"TargetSpecialBonus", &TargetSpecialBonus, false},
+  {"StandupSpecialLevel", &StandupSpecialLevel, false},
+  {"TournamentScoring", &TournamentScoring, true},
+};
+#define NUM_SIM_SETTINGS (sizeof(Settings)/sizeof(Settings[0]))
+
+class HostNullDevice : public HostSerialDevice {
+public:
+  void transmitted(uint8_t, uint64_t) {}
+};
+
+static uint64_t LoopCycles = SIM_DEFAULT_LOOP_CYCLES;
+static uint64_t MaxGameCycles = (uint64_t)SIM_DEFAULT_MAX_SECONDS * HOST_CPU_HZ;
+static uint8_t NumPlayers = 1;
+static uint64_t BaseSeed = 1;
+static PlayfieldSim *Sim = NULL;
+
+static double WallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void RunLoop() {
+  loop();
+  HostAdvanceCycles(LoopCycles);
+  Sim->update(HostGetCycles());
+}
+
+static void PlayGame(uint32_t gameNum, SimResult &result) {
+  SimRandom seeds;
+  seeds.seed(BaseSeed * 0x100000001B3ULL + gameNum);
+  Sim->seed(seeds.next());
+  randomSeed((unsigned long)((seeds.next() & 0x7FFFFFFF) | 1));
+
+  uint64_t startCycle = HostGetCycles();
+  Sim->startGame(startCycle, NumPlayers);
+  bool started = false;
+  char lastState = MachineState;
+  byte lastGameMode = GameMode, lastRunning = MiniGamesRunning, lastCombo = ComboMultiballStage;
+
+  result.status = SIM_GAME_TIMED_OUT;
+  while (HostGetCycles() - startCycle < MaxGameCycles) {
+    RunLoop();
+    if (MachineState!=SIM_MACHINE_STATE_ATTRACT) {
+      started = true;
+    } else if (started) {
+      result.status = SIM_GAME_DONE;
+      break;
+    }
+
+    if (MachineState==SIM_MACHINE_STATE_INIT_NEW_BALL && lastState!=MachineState) result.ballsStarted += 1;
+    if (GameMode!=lastGameMode) {
+      if (GameMode==SIM_GAME_MODE_QUALIFIED) result.modeStarts[SIM_MODE_QUALIFIED] += 1;
+      if (GameMode==SIM_GAME_MODE_WIZARD) result.modeStarts[SIM_MODE_WIZARD] += 1;
+    }
+    byte newlyRunning = MiniGamesRunning & ~lastRunning;
+    if (newlyRunning & SIM_FEEDING_FRENZY_FLAG) result.modeStarts[SIM_MODE_FEEDING_FRENZY] += 1;
+    if (newlyRunning & SIM_SHARP_SHOOTER_FLAG) result.modeStarts[SIM_MODE_SHARP_SHOOTER] += 1;
+    if (newlyRunning & SIM_EXPLORE_THE_DEPTHS_FLAG) result.modeStarts[SIM_MODE_EXPLORE] += 1;
+    if (lastRunning==0 && MiniGamesRunning) {
+      int numRunning = __builtin_popcount(MiniGamesRunning & 0x07);
+      if (numRunning==2) result.modeStarts[SIM_MODE_DOUBLE] += 1;
+      if (numRunning==3) result.modeStarts[SIM_MODE_TRIPLE] += 1;
+    }
+    if (ComboMultiballStage==SIM_COMBO_MULTIBALL_STAGE && lastCombo!=SIM_COMBO_MULTIBALL_STAGE) result.modeStarts[SIM_MODE_COMBO_MULTIBALL] += 1;
+
+    lastState = MachineState;
+    lastGameMode = GameMode;
+    lastRunning = MiniGamesRunning;
+    lastCombo = ComboMultiballStage;
+  }
+
+  result.numPlayers = CurrentNumPlayers;
+  result.lengthMs = (uint32_t)((HostGetCycles() - startCycle) / (HOST_CPU_HZ/1000));
+  result.numShots = Sim->getNumShots();
+  for (int count=0; count<4; count++) result.scores[count] = (uint32_t)CurrentScores[count];
+}
+
+static void RunWorker(SimShared *shared, SimResult *results, uint32_t numGames) {
+  for (;;) {
+    uint32_t gameNum = shared->nextGame.fetch_add(1);
+    if (gameNum>=numGames) break;
+    pid_t pid = fork();
+    if (pid==0) {
+      PlayGame(gameNum, results[gameNum]);
+      _exit(0);
+    }
+    int status = 0;
+    if (pid<0 || waitpid(pid, &status, 0)!=pid || !WIFEXITED(status) || WEXITSTATUS(status)!=0) {
+      results[gameNum].status = SIM_GAME_CRASHED;
+    }
+    shared->gamesDone.fetch_add(1);
+  }
+}
+
+
+/*********************************************************************
+    Report
+*********************************************************************/
+static double Percentile(const std::vector<double> &sorted, double fraction) {
+  if (sorted.empty()) return 0.0;
+  size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+// 1, 2 or 5 times a power of ten
+static double NiceBinWidth(double span) {
+  double raw = span / SIM_HISTOGRAM_BINS;
+  if (raw<1.0) return 1.0;
+  double magnitude = pow(10.0, floor(log10(raw)));
+  if (raw<=magnitude) return magnitude;
+  if (raw<=2.0*magnitude) return 2.0*magnitude;
+  if (raw<=5.0*magnitude) return 5.0*magnitude;
+  return 10.0*magnitude;
+}
+
+// Summary numbers and a histogram up to the 99th percentile (anything
+// past that goes in the last bin)
+static void PrintDistribution(FILE *out, const char *title, std::vector<double> &values) {
+  std::sort(values.begin(), values.end());
+  fprintf(out, "\n%s (%u):\n", title, (unsigned)values.size());
+  if (values.empty()) return;
+
+  double sum = 0.0, sumSquares = 0.0;
+  for (size_t count=0; count<values.size(); count++) {
+    sum += values[count];
+    sumSquares += values[count]*values[count];
+  }
+  double mean = sum / values.size();
+  double variance = sumSquares / values.size() - mean*mean;
+  fprintf(out, "  mean %.0f  sd %.0f  min %.0f  max %.0f\n", mean, variance>0.0 ? sqrt(variance) : 0.0, values.front(), values.back());
+  fprintf(out, "  p10 %.0f  p25 %.0f  median %.0f  p75 %.0f  p90 %.0f  p99 %.0f\n",
+          Percentile(values, 0.10), Percentile(values, 0.25), Percentile(values, 0.50),
+          Percentile(values, 0.75), Percentile(values, 0.90), Percentile(values, 0.99));
+
+  double binWidth = NiceBinWidth(Percentile(values, 0.99) - values.front());
+  double firstBin = floor(values.front() / binWidth) * binWidth;
+  int numBins = (int)((Percentile(values, 0.99) - firstBin) / binWidth) + 1;
+  if (numBins>SIM_HISTOGRAM_BINS+1) numBins = SIM_HISTOGRAM_BINS+1;
+  std::vector<uint32_t> bins(numBins + 1, 0);
+  for (size_t count=0; count<values.size(); count++) {
+    int bin = (int)((values[count] - firstBin) / binWidth);
+    bins[(bin<numBins) ? bin : numBins] += 1;
+  }
+  uint32_t mostInBin = *std::max_element(bins.begin(), bins.end());
+  for (int bin=0; bin<=numBins; bin++) {
+    if (bin==numBins && bins[bin]==0) break;
+    char range[48];
+    if (bin<numBins) snprintf(range, sizeof(range), "%.0f - %.0f", firstBin + bin*binWidth, firstBin + (bin+1)*binWidth);
+    else snprintf(range, sizeof(range), "%.0f and up", firstBin + bin*binWidth);
+    int barLength = mostInBin ? (int)((uint64_t)bins[bin] * SIM_HISTOGRAM_BAR / mostInBin) : 0;
+    fprintf(out, "  %25s %8u %5.1f%%  %.*s\n", range, bins[bin], 100.0 * bins[bin] / values.size(), barLength, "########################################");
+  }
+}
+
+static void WriteCsv(FILE *out, const SimResult *results, uint32_t numGames) {
+  fprintf(out, "game,status,players,balls,length_ms,shots,score1,score2,score3,score4");
+  for (int mode=0; mode<SIM_NUM_MODES; mode++) fprintf(out, ",%s", ModeNames[mode]);
+  fprintf(out, "\n");
+  for (uint32_t gameNum=0; gameNum<numGames; gameNum++) {
+    const SimResult &result = results[gameNum];
+    fprintf(out, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u", gameNum, result.status, result.numPlayers, result.ballsStarted, result.lengthMs, result.numShots,
+            result.scores[0], result.scores[1], result.scores[2], result.scores[3]);
+    for (int mode=0; mode<SIM_NUM_MODES; mode++) fprintf(out, ",%u", result.modeStarts[mode]);
+    fprintf(out, "\n");
+  }
+}
+
+static void Report(FILE *out, const SimResult *results, uint32_t numGames) {
+  std::vector<double> scores, lengths, balls;
+  uint32_t numDone = 0, numTimedOut = 0, numCrashed = 0;
+  uint32_t gamesWithMode[SIM_NUM_MODES] = {0};
+  uint64_t modeStarts[SIM_NUM_MODES] = {0};
+  uint64_t totalShots = 0;
+  for (uint32_t gameNum=0; gameNum<numGames; gameNum++) {
+    const SimResult &result = results[gameNum];
+    if (result.status==SIM_GAME_TIMED_OUT) numTimedOut += 1;
+    if (result.status==SIM_GAME_CRASHED) numCrashed += 1;
+    if (result.status!=SIM_GAME_DONE) continue;
+    numDone += 1;
+    for (uint8_t player=0; player<result.numPlayers && player<4; player++) scores.push_back(result.scores[player]);
+    lengths.push_back(result.lengthMs / 1000.0);
+    balls.push_back(result.ballsStarted);
+    totalShots += result.numShots;
+    for (int mode=0; mode<SIM_NUM_MODES; mode++) {
+      if (result.modeStarts[mode]) gamesWithMode[mode] += 1;
+      modeStarts[mode] += result.modeStarts[mode];
+    }
+  }
+
+  fprintf(out, "Games:   %u finished, %u timed out, %u crashed\n", numDone, numTimedOut, numCrashed);
+  if (numDone==0) return;
+  fprintf(out, "Hits:    %.1f per game\n", (double)totalShots / numDone);
+  PrintDistribution(out, "Score per player", scores);
+  PrintDistribution(out, "Game length, seconds", lengths);
+  PrintDistribution(out, "Balls started per game (extra balls included)", balls);
+
+  fprintf(out, "\n%-22s %14s %14s\n", "Mode starts", "% of games", "per game");
+  for (int mode=0; mode<SIM_NUM_MODES; mode++) {
+    fprintf(out, "  %-20s %13.1f%% %14.2f\n", ModeNames[mode], 100.0 * gamesWithMode[mode] / numDone, (double)modeStarts[mode] / numDone);
+  }
+}
+
+
+/*********************************************************************
+    Driver
+*********************************************************************/
+static bool ApplySetting(const char *assignment) {
+  const char *equals = strchr(assignment, '=');
+  if (!equals) return false;
+  size_t nameLength = equals - assignment;
+  char *end;
+  unsigned long value = strtoul(equals+1, &end, 0);
+  if (*end || value>255) return false;
+  for (size_t count=0; count<NUM_SIM_SETTINGS; count++) {
+    if (strlen(Settings[count].name)!=nameLength || strncmp(Settings[count].name, assignment, nameLength)) continue;
+    if (Settings[count].isBoolean) *(boolean *)Settings[count].value = value ? true : false;
+    else *(byte *)Settings[count].value = (byte)value;
+    return true;
+  }
+  return false;
+}
+
+static void Usage(const char *name) {
+  fprintf(stderr, "usage: %s [-n games] [-j workers] [-p players] [-m model] [-M]\n", name);
+  fprintf(stderr, "       %*s [-l loopCycles] [-S seed] [-T seconds] [-s name=value] [-o games.csv] [-B]\n", (int)strlen(name), "");
+  fprintf(stderr, "  -n  games to play (default %d)\n", SIM_DEFAULT_GAMES);
+  fprintf(stderr, "  -j  worker processes (default: one per core)\n");
+  fprintf(stderr, "  -p  players per game, 1-4 (default 1)\n");
+  fprintf(stderr, "  -m  playfield model file (see PlayfieldModel.h)\n");
+  fprintf(stderr, "  -M  print the built-in model and exit\n");
+  fprintf(stderr, "  -l  CPU cycles charged per pass through loop() (default %d)\n", SIM_DEFAULT_LOOP_CYCLES);
+  fprintf(stderr, "  -S  seed (game n plays the same for the same seed and model)\n");
+  fprintf(stderr, "  -T  virtual seconds before a game counts as stuck (default %d)\n", SIM_DEFAULT_MAX_SECONDS);
+  fprintf(stderr, "  -s  change a setting after boot:");
+  for (size_t count=0; count<NUM_SIM_SETTINGS; count++) fprintf(stderr, "%s %s", count ? "," : "", Settings[count].name);
+  fprintf(stderr, "\n  -o  write one CSV line per game\n");
+  fprintf(stderr, "  -B  read the bus a spin at a time (slower, for checking the fast spin)\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t numGames = SIM_DEFAULT_GAMES;
+  long numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *modelPath = NULL;
+  const char *csvPath = NULL;
+  bool printModel = false;
+  bool fastSpin = true;
+  std::vector<const char *> settings;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:j:p:m:Ml:S:T:s:o:Bh"))!=-1) {
+    switch (opt) {
+      case 'n': numGames = strtoul(optarg, NULL, 0); break;
+      case 'j': numWorkers = strtol(optarg, NULL, 0); break;
+      case 'p': NumPlayers = (uint8_t)atoi(optarg); break;
+      case 'm': modelPath = optarg; break;
+      case 'M': printModel = true; break;
+      case 'l': LoopCycles = strtoull(optarg, NULL, 0); break;
+      case 'S': BaseSeed = strtoull(optarg, NULL, 0); break;
+      case 'T': MaxGameCycles = (uint64_t)(atof(optarg) * HOST_CPU_HZ); break;
+      case 's': settings.push_back(optarg); break;
+      case 'o': csvPath = optarg; break;
+      case 'B': fastSpin = false; break;
+      default: Usage(argv[0]); return (opt=='h') ? 0 : 1;
+    }
+  }
+  if (NumPlayers<1 || NumPlayers>4 || numGames==0 || LoopCycles==0) {
+    Usage(argv[0]);
+    return 1;
+  }
+  if (numWorkers<1) numWorkers = 1;
+  if ((uint32_t)numWorkers>numGames) numWorkers = numGames;
+
+  PlayfieldModel model;
+  char error[160];
+  if (modelPath && !model.load(modelPath, error, sizeof(error))) {
+    fprintf(stderr, "%s: %s\n", modelPath, error);
+    return 1;
+  }
+  if (printModel) {
+    model.print(stdout);
+    return 0;
+  }
+
+  HostNullDevice nullDevice;
+  HostSetSerialDevice(0, &nullDevice);
+  HostSetSerialDevice(1, &nullDevice);
+  HostSetFastSpin(fastSpin);
+
+  // Boot on the idle bus, then take the interrupts' place
+  setup();
+  detachInterrupt(digitalPinToInterrupt(2));
+  TIMSK1 &= ~(1<<OCIE1A);
+  // Nothing is left to poll, so a pass's charge can go in one step
+  HostSetMaxTimeStep(LoopCycles);
+  PlayfieldSim sim(model);
+  Sim = &sim;
+  sim.reset(HostGetCycles());
+  uint64_t attractEnd = HostGetCycles() + (uint64_t)SIM_ATTRACT_SECONDS * HOST_CPU_HZ;
+  while (HostGetCycles()<attractEnd) RunLoop();
+
+  for (size_t count=0; count<settings.size(); count++) {
+    if (!ApplySetting(settings[count])) {
+      fprintf(stderr, "Bad setting %s\n", settings[count]);
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+
+  size_t sharedSize = sizeof(SimShared) + (size_t)numGames * sizeof(SimResult);
+  void *sharedMemory = mmap(NULL, sharedSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if (sharedMemory==MAP_FAILED) {
+    fprintf(stderr, "Can't map %lu bytes for %u games\n", (unsigned long)sharedSize, numGames);
+    return 1;
+  }
+  SimShared *shared = new (sharedMemory) SimShared;
+  shared->nextGame = 0;
+  shared->gamesDone = 0;
+  SimResult *results = (SimResult *)((char *)sharedMemory + sizeof(SimShared));
+
+  fprintf(stderr, "Playing %u %d-player games on %ld workers (seed %llu, %.1f%% drain chance per hit, loop %.2f ms)\n",
+          numGames, NumPlayers, numWorkers, (unsigned long long)BaseSeed, 100.0 * model.getDrainChance(), (double)LoopCycles * 1000.0 / HOST_CPU_HZ);
+  fflush(stdout);
+  fflush(stderr);
+  double wallStart = WallSeconds();
+
+  std::vector<pid_t> workers;
+  for (long count=0; count<numWorkers; count++) {
+    pid_t pid = fork();
+    if (pid==0) {
+      RunWorker(shared, results, numGames);
+      _exit(0);
+    }
+    if (pid<0) {
+      perror("fork");
+      break;
+    }
+    workers.push_back(pid);
+  }
+  if (workers.empty()) return 1;
+
+  bool showProgress = isatty(fileno(stderr));
+  size_t numRunning = workers.size();
+  while (numRunning) {
+    pid_t pid = waitpid(-1, NULL, WNOHANG);
+    if (pid>0) {
+      numRunning -= 1;
+      continue;
+    }
+    if (showProgress) fprintf(stderr, "\r%u/%u games", shared->gamesDone.load(), numGames);
+    usleep(200000);
+  }
+  double wallSeconds = WallSeconds() - wallStart;
+  if (showProgress) fprintf(stderr, "\r%*s\r", 24, "");
+
+  Report(stdout, results, numGames);
+  fprintf(stdout, "\nWall time: %.1f s (%.1f games/s, %.3f s per game per worker)\n", wallSeconds,
+          wallSeconds>0 ? numGames / wallSeconds : 0.0, numGames ? wallSeconds * workers.size() / numGames : 0.0);
+
+  if (csvPath) {
+    FILE *csv = fopen(csvPath, "w");
+    if (!csv) {
+      fprintf(stderr, "Can't write %s\n", csvPath);
+      return 1;
+    }
+    WriteCsv(csv, results, numGames);
+    fclose(csv);
+  }
+  return 0;
+}
@@ -0,0 +1,94 @@
+#include "PIA6821.h"
+
+// Control register bits
+#define PIA_CR_C1_IRQ_ENABLE    0x01
+#define PIA_CR_C1_RISING_EDGE   0x02
+#define PIA_CR_DATA_SELECT      0x04
+#define PIA_CR_C2_IRQ_ENABLE    0x08
+#define PIA_CR_C2_RISING_EDGE   0x10
+#define PIA_CR_C2_OUTPUT        0x20
+#define PIA_CR_IRQ2_FLAG        0x40
+#define PIA_CR_IRQ1_FLAG        0x80
+
+
+PIA6821::PIA6821() {
+  reset();
+}
+
+void PIA6821::reset() {
+  for (uint8_t side=0; side<2; side++) {
+    outputRegister[side] = 0;
+    dataDirection[side] = 0;
+    control[side] = 0;
+    inputPins[side] = 0;
+    c1Level[side] = false;
+    c2Level[side] = false;
+  }
+  writeCount = 0;
+}
+
+uint8_t PIA6821::read(uint8_t registerSelect) {
+  uint8_t side = (registerSelect & 0x02) ? PIA_SIDE_B : PIA_SIDE_A;
+
+  if (registerSelect & 0x01) return control[side];
+
+  if (!(control[side] & PIA_CR_DATA_SELECT)) return dataDirection[side];
+
+  // Reading the peripheral register clears both interrupt flags
+  control[side] &= ~(PIA_CR_IRQ1_FLAG | PIA_CR_IRQ2_FLAG);
+  uint8_t ddr = dataDirection[side];
+  // (port A reads the pins, but nothing on this board loads its outputs,
+  // so both sides read back the output register for output bits)
+  return (outputRegister[side] & ddr) | (inputPins[side] & ~ddr);
+}
+
+void PIA6821::write(uint8_t registerSelect, uint8_t value) {
+  uint8_t side = (registerSelect & 0x02) ? PIA_SIDE_B : PIA_SIDE_A;
+  writeCount += 1;
+
+  if (registerSelect & 0x01) {
+    // The flags are read-only
+    control[side] = (control[side] & (PIA_CR_IRQ1_FLAG | PIA_CR_IRQ2_FLAG)) | (value & 0x3F);
+    // Flag 2 can't be set while C2 is an output
+    if (control[side] & PIA_CR_C2_OUTPUT) control[side] &= ~PIA_CR_IRQ2_FLAG;
+  } else if (control[side] & PIA_CR_DATA_SELECT) {
+    outputRegister[side] = value;
+  } else {
+    dataDirection[side] = value;
+  }
+}
+
+void PIA6821::setC1(uint8_t side, bool level) {
+  if (level==c1Level[side]) return;
+  c1Level[side] = level;
+  bool risingActive = (control[side] & PIA_CR_C1_RISING_EDGE) ? true : false;
+  if (level==risingActive) control[side] |= PIA_CR_IRQ1_FLAG;
+}
+
+void PIA6821::setC2(uint8_t side, bool level) {
+  if (level==c2Level[side]) return;
+  c2Level[side] = level;
+  if (control[side] & PIA_CR_C2_OUTPUT) return;
+  bool risingActive = (control[side] & PIA_CR_C2_RISING_EDGE) ? true : false;
+  if (level==risingActive) control[side] |= PIA_CR_IRQ2_FLAG;
+}
+
+uint8_t PIA6821::getOutput(uint8_t side) {
+  // Input bits float high (port A has pull-ups, port B is tri-state)
+  return (outputRegister[side] & dataDirection[side]) | ~dataDirection[side];
+}
+
+bool PIA6821::getC2Output(uint8_t side) {
+  uint8_t cr = control[side];
+  if (!(cr & PIA_CR_C2_OUTPUT)) return true;
+  // Manual mode follows bit 3; the strobe modes idle high
+  if (cr & PIA_CR_C2_RISING_EDGE) return (cr & PIA_CR_C2_IRQ_ENABLE) ? true : false;
+  return true;
+}
+
+bool PIA6821::getIRQ(uint8_t side) {
+  uint8_t cr = control[side];
+  if ((cr & PIA_CR_IRQ1_FLAG) && (cr & PIA_CR_C1_IRQ_ENABLE)) return true;
+  if ((cr & PIA_CR_IRQ2_FLAG) && (cr & PIA_CR_C2_IRQ_ENABLE) && !(cr & PIA_CR_C2_OUTPUT)) return true;
+  return false;
+}
@@ -0,0 +1,50 @@
+// Motorola 6821 Peripheral Interface Adapter, as seen from the bus
+//
+// Register select (RS1:RS0) picks port A data/DDR, control A, port B
+// data/DDR or control B; bit 2 of a control register decides whether
+// the port address reaches the data register or the DDR. CA1/CB1 are
+// edge-sensitive inputs that set bit 7 of their control register, CA2/CB2
+// are either inputs (setting bit 6) or outputs (set/reset by bit 3 when
+// bits 5:4 are 11). Reading a data register clears that side's flags.
+
+#ifndef PIA6821_H
+#define PIA6821_H
+
+#include <stdint.h>
+
+#define PIA_SIDE_A  0
+#define PIA_SIDE_B  1
+
+class PIA6821 {
+public:
+  PIA6821();
+  void reset();
+
+  // Bus side (registerSelect is RS1:RS0)
+  uint8_t read(uint8_t registerSelect);
+  void write(uint8_t registerSelect, uint8_t value);
+
+  // Peripheral side
+  void setInputPins(uint8_t side, uint8_t pins) { inputPins[side] = pins; }
+  void setC1(uint8_t side, bool level);
+  void setC2(uint8_t side, bool level);
+  uint8_t getOutput(uint8_t side);
+  bool getC2Output(uint8_t side);
+  uint8_t getControl(uint8_t side) { return control[side]; }
+  bool getIRQ(uint8_t side);
+  bool getIRQ() { return getIRQ(PIA_SIDE_A) || getIRQ(PIA_SIDE_B); }
+
+  // Bumped on every write, so a board can tell its outputs may have moved
+  uint32_t getWriteCount() { return writeCount; }
+
+private:
+  uint8_t outputRegister[2];
+  uint8_t dataDirection[2];
+  uint8_t control[2];
+  uint8_t inputPins[2];
+  bool c1Level[2];
+  bool c2Level[2];
+  uint32_t writeCount;
+};
+
+#endif
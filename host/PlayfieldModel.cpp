@@ -0,0 +1,546 @@
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include "PlayfieldModel.h"
+#include "Arduino.h"
+
+// The OS's switch and solenoid state (RPU.cpp)
+extern volatile byte SwitchesNow[];
+extern volatile byte CurrentSolenoidByte;
+extern volatile byte RevertSolenoidBit;
+extern volatile byte NumCyclesBeforeRevertingSolenoidByte;
+byte PullFirstFromSolenoidStack();
+void RPU_PushToSwitchStack(byte switchNumber);
+
+// Trident's wiring, from Trident2020.h (which defines data, so it can't
+// be included here)
+#define PF_NUM_SWITCHES           40
+#define PF_SW_COIN_1              1
+#define PF_SW_CREDIT_RESET        5
+#define PF_SW_SAUCER              25
+#define PF_SW_OUTHOLE             32
+#define PF_SW_SHOOTER_LANE        37
+#define PF_SOL_SAUCER             12
+#define PF_SOL_DROP_TARGET_RESET  13
+#define PF_SOL_OUTHOLE            14
+// The shooter lane kicker is a continuous solenoid
+#define PF_SHOOTER_KICKER_BIT     0x10
+#define PF_SOL_NONE               0x0F
+#define PF_SOLENOID_STACK_EMPTY   0xFF
+#define PF_NUM_DROP_TARGETS       5
+
+// SW_BALL_1-3 and SW_BALL_JAM, filled from the eject end
+static const uint8_t TroughSwitches[] = {35, 34, 33, 36};
+#define PF_TROUGH_SIZE            (sizeof(TroughSwitches)/sizeof(TroughSwitches[0]))
+static const uint8_t DropTargetSwitches[PF_NUM_DROP_TARGETS] = {31, 30, 29, 28, 27};
+static const uint8_t DropTargetSolenoids[PF_NUM_DROP_TARGETS] = {3, 4, 7, 10, 11};
+
+// How long things take, in ms
+#define PF_EJECT_TO_SHOOTER_MS    500
+#define PF_LAUNCH_MS              800
+#define PF_DRAIN_TO_OUTHOLE_MS    600
+#define PF_OUTHOLE_TO_TROUGH_MS   500
+#define PF_BUTTON_MS              80
+#define PF_SWITCH_CLOSED_MS       30
+#define PF_REPEAT_MS              250
+#define PF_SPIN_CLOSED_MS         6
+#define PF_SPIN_FIRST_GAP_MS      18
+#define PF_ZERO_CROSSINGS_PER_SEC 120
+
+#define MS_TO_CYCLES(ms)          ((uint64_t)(ms) * (HOST_CPU_HZ/1000))
+
+#define BALL_FREE                 0
+#define BALL_TO_SHOOTER           1
+#define BALL_IN_SHOOTER           2
+#define BALL_LAUNCHED             3
+#define BALL_ON_PLAYFIELD         4
+#define BALL_IN_SAUCER            5
+#define BALL_DRAINING             6
+#define BALL_ON_OUTHOLE           7
+
+static const char *ShotKindNames[] = {"switch", "spinner", "drop", "saucer", "outlane", "drain"};
+#define NUM_SHOT_KINDS            (sizeof(ShotKindNames)/sizeof(ShotKindNames[0]))
+
+static const char *DefaultModel =
+  "# Trident playfield model for trident_sim\n"
+  "shot_interval   1.2\n"
+  "plunge          0.4 2.0\n"
+  "\n"
+  "# kind   switch  weight  min max\n"
+  "switch    14     9       1   3     # top pop bumper\n"
+  "switch    15     9       1   3     # bottom pop bumper\n"
+  "switch    11     4       1   2     # upper left sling\n"
+  "switch    10     4       1   2     # upper right sling\n"
+  "switch    13     6       1   2     # lower left sling\n"
+  "switch    12     6       1   2     # lower right sling\n"
+  "switch     9     4                 # top rollover\n"
+  "switch    26     3                 # 10 point rebound\n"
+  "switch    18     4                 # left inlane\n"
+  "switch    17     4                 # right inlane\n"
+  "switch    19     3                 # purple standup\n"
+  "switch    20     3                 # yellow standup\n"
+  "switch    21     3                 # amber standup\n"
+  "switch    22     3                 # green standup\n"
+  "switch    23     3                 # white standup\n"
+  "spinner    4     5       4  25     # left spinner\n"
+  "spinner    3     5       4  25     # right spinner\n"
+  "drop      31     3                 # drop target 1\n"
+  "drop      30     3                 # drop target 2\n"
+  "drop      29     3                 # drop target 3\n"
+  "drop      28     3                 # drop target 4\n"
+  "drop      27     3                 # drop target 5\n"
+  "saucer    25     4                 # top saucer\n"
+  "outlane   16     1.5               # right outlane\n"
+  "drain     -      2                 # down the middle\n";
+
+
+/*********************************************************************
+    Model
+*********************************************************************/
+PlayfieldModel::PlayfieldModel() {
+  char error[128];
+  parse(DefaultModel, error, sizeof(error));
+}
+
+static char *TrimSpace(char *text) {
+  while (isspace((unsigned char)*text)) text++;
+  char *end = text + strlen(text);
+  while (end>text && isspace((unsigned char)end[-1])) *(--end) = '\0';
+  return text;
+}
+
+static bool IsDropTargetSwitch(uint8_t switchNum) {
+  for (int count=0; count<PF_NUM_DROP_TARGETS; count++) {
+    if (DropTargetSwitches[count]==switchNum) return true;
+  }
+  return false;
+}
+
+bool PlayfieldModel::parse(const char *text, char *error, size_t errorSize) {
+  shots.clear();
+  shotInterval = 1.0;
+  plungeMin = plungeMax = 1.0;
+  totalWeight = 0.0;
+
+  int lineNum = 0;
+  const char *lineStart = text;
+  while (*lineStart) {
+    const char *lineEnd = strchr(lineStart, '\n');
+    size_t lineLength = lineEnd ? (size_t)(lineEnd - lineStart) : strlen(lineStart);
+    char line[256];
+    if (lineLength>=sizeof(line)) lineLength = sizeof(line) - 1;
+    memcpy(line, lineStart, lineLength);
+    line[lineLength] = '\0';
+    lineStart = lineEnd ? lineEnd + 1 : lineStart + strlen(lineStart);
+    lineNum += 1;
+
+    char *comment = strchr(line, '#');
+    if (comment) *(comment++) = '\0';
+    char *words[6];
+    int numWords = 0;
+    for (char *word = strtok(line, " \t\r"); word && numWords<6; word = strtok(NULL, " \t\r")) words[numWords++] = word;
+    if (numWords==0) continue;
+
+    if (strcmp(words[0], "shot_interval")==0) {
+      if (numWords!=2 || (shotInterval = atof(words[1]))<=0.0) {
+        snprintf(error, errorSize, "line %d: shot_interval needs a number of seconds", lineNum);
+        return false;
+      }
+      continue;
+    }
+    if (strcmp(words[0], "plunge")==0) {
+      if (numWords!=3 || (plungeMin = atof(words[1]))<0.0 || (plungeMax = atof(words[2]))<plungeMin) {
+        snprintf(error, errorSize, "line %d: plunge needs the shortest and longest wait in seconds", lineNum);
+        return false;
+      }
+      continue;
+    }
+
+    ModelShot shot;
+    memset(&shot, 0, sizeof(shot));
+    size_t kind;
+    for (kind=0; kind<NUM_SHOT_KINDS; kind++) {
+      if (strcmp(words[0], ShotKindNames[kind])==0) break;
+    }
+    if (kind==NUM_SHOT_KINDS) {
+      snprintf(error, errorSize, "line %d: unknown kind \"%s\"", lineNum, words[0]);
+      return false;
+    }
+    shot.kind = (uint8_t)kind;
+    if (numWords<3) {
+      snprintf(error, errorSize, "line %d: needs a switch and a weight", lineNum);
+      return false;
+    }
+    if (strcmp(words[1], "-")==0) {
+      shot.switchNum = MODEL_NO_SWITCH;
+    } else {
+      long switchNum = strtol(words[1], NULL, 0);
+      shot.switchNum = (switchNum>=0 && switchNum<PF_NUM_SWITCHES) ? (uint8_t)switchNum : MODEL_NO_SWITCH;
+    }
+    if ((shot.switchNum==MODEL_NO_SWITCH) != (shot.kind==MODEL_SHOT_DRAIN)) {
+      snprintf(error, errorSize, "line %d: bad switch \"%s\"", lineNum, words[1]);
+      return false;
+    }
+    if ((shot.kind==MODEL_SHOT_DROP && !IsDropTargetSwitch(shot.switchNum)) || (shot.kind==MODEL_SHOT_SAUCER && shot.switchNum!=PF_SW_SAUCER)) {
+      snprintf(error, errorSize, "line %d: switch %d isn't a %s", lineNum, shot.switchNum, ShotKindNames[kind]);
+      return false;
+    }
+    shot.weight = atof(words[2]);
+    long minCount = (numWords>3) ? strtol(words[3], NULL, 0) : 1;
+    long maxCount = (numWords>4) ? strtol(words[4], NULL, 0) : minCount;
+    if (shot.weight<0.0 || minCount<1 || maxCount<minCount || maxCount>255) {
+      snprintf(error, errorSize, "line %d: bad weight or count", lineNum);
+      return false;
+    }
+    shot.minCount = (uint8_t)minCount;
+    shot.maxCount = (uint8_t)maxCount;
+    if (comment) {
+      strncpy(shot.name, TrimSpace(comment), MODEL_NAME_SIZE-1);
+    }
+    if (shot.name[0]=='\0') snprintf(shot.name, MODEL_NAME_SIZE, "%s %s", words[0], words[1]);
+    totalWeight += shot.weight;
+    shots.push_back(shot);
+  }
+
+  if (totalWeight<=0.0) {
+    snprintf(error, errorSize, "no shots");
+    return false;
+  }
+  if (getDrainChance()<=0.0) {
+    snprintf(error, errorSize, "no outlane or drain, so balls never end");
+    return false;
+  }
+  return true;
+}
+
+bool PlayfieldModel::load(const char *path, char *error, size_t errorSize) {
+  FILE *in = fopen(path, "r");
+  if (!in) {
+    snprintf(error, errorSize, "can't read %s", path);
+    return false;
+  }
+  std::vector<char> text;
+  char buf[4096];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), in))>0) text.insert(text.end(), buf, buf+len);
+  fclose(in);
+  text.push_back('\0');
+  return parse(&text[0], error, errorSize);
+}
+
+void PlayfieldModel::print(FILE *out) const {
+  fprintf(out, "shot_interval   %g\n", shotInterval);
+  fprintf(out, "plunge          %g %g\n\n", plungeMin, plungeMax);
+  fprintf(out, "# kind   switch  weight  min max\n");
+  for (size_t count=0; count<shots.size(); count++) {
+    const ModelShot &shot = shots[count];
+    char switchNum[8], counts[16] = "";
+    if (shot.switchNum==MODEL_NO_SWITCH) strcpy(switchNum, "-");
+    else snprintf(switchNum, sizeof(switchNum), "%d", shot.switchNum);
+    if (shot.maxCount>1) snprintf(counts, sizeof(counts), "%-3d %d", shot.minCount, shot.maxCount);
+    fprintf(out, "%-8s %3s     %-7g %-9s # %s\n", ShotKindNames[shot.kind], switchNum, shot.weight, counts, shot.name);
+  }
+}
+
+double PlayfieldModel::getDrainChance() const {
+  double drainWeight = 0.0;
+  for (size_t count=0; count<shots.size(); count++) {
+    if (shots[count].kind==MODEL_SHOT_OUTLANE || shots[count].kind==MODEL_SHOT_DRAIN) drainWeight += shots[count].weight;
+  }
+  return (totalWeight>0.0) ? drainWeight / totalWeight : 0.0;
+}
+
+
+/*********************************************************************
+    Random numbers
+*********************************************************************/
+void SimRandom::seed(uint64_t value) {
+  // splitmix64, so neighbouring seeds start far apart
+  uint64_t z = value + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z>>30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z>>27)) * 0x94D049BB133111EBULL;
+  state = z ^ (z>>31);
+  if (state==0) state = 1;
+}
+
+uint64_t SimRandom::next() {
+  state ^= state>>12;
+  state ^= state<<25;
+  state ^= state>>27;
+  return state * 0x2545F4914F6CDD1DULL;
+}
+
+double SimRandom::uniform() {
+  return (double)(next()>>11) / 9007199254740992.0;
+}
+
+double SimRandom::exponential(double mean) {
+  return -mean * log(1.0 - uniform());
+}
+
+int SimRandom::range(int low, int high) {
+  if (high<=low) return low;
+  return low + (int)(next() % (uint64_t)(high - low + 1));
+}
+
+
+/*********************************************************************
+    Playfield
+*********************************************************************/
+PlayfieldSim::PlayfieldSim(const PlayfieldModel &s_model) : model(s_model) {
+  rng.seed(0);
+  for (int count=0; count<SIM_MAX_BALLS; count++) balls[count].state = BALL_FREE;
+  ballsInTrough = 0;
+  tickNum = 0;
+  nextTickCycle = 0;
+  lastSolenoid = PF_SOLENOID_STACK_EMPTY;
+  kickerFiring = false;
+  numShots = 0;
+}
+
+void PlayfieldSim::reset(uint64_t cycle) {
+  for (int count=0; count<SIM_MAX_BALLS; count++) balls[count].state = BALL_FREE;
+  switchChanges.clear();
+  // Nothing closed but the trough
+  for (int switchNum=0; switchNum<PF_NUM_SWITCHES; switchNum++) SwitchesNow[switchNum/8] &= ~(1<<(switchNum%8));
+  ballsInTrough = PF_TROUGH_SIZE;
+  for (size_t count=0; count<PF_TROUGH_SIZE; count++) SwitchesNow[TroughSwitches[count]/8] |= 1<<(TroughSwitches[count]%8);
+  tickNum = cycle / (HOST_CPU_HZ/PF_ZERO_CROSSINGS_PER_SEC) + 1;
+  nextTickCycle = tickNum * HOST_CPU_HZ / PF_ZERO_CROSSINGS_PER_SEC;
+  lastSolenoid = PF_SOLENOID_STACK_EMPTY;
+  kickerFiring = false;
+  numShots = 0;
+}
+
+void PlayfieldSim::startGame(uint64_t cycle, uint8_t numPlayers) {
+  scheduleSwitch(cycle + MS_TO_CYCLES(100), PF_SW_COIN_1, true);
+  scheduleSwitch(cycle + MS_TO_CYCLES(100 + PF_BUTTON_MS), PF_SW_COIN_1, false);
+  for (uint8_t count=0; count<numPlayers; count++) {
+    uint64_t pressCycle = cycle + MS_TO_CYCLES(600 + 400*count);
+    if (count) {
+      // Each player after the first needs another credit
+      scheduleSwitch(pressCycle - MS_TO_CYCLES(200), PF_SW_COIN_1, true);
+      scheduleSwitch(pressCycle - MS_TO_CYCLES(200 - PF_BUTTON_MS), PF_SW_COIN_1, false);
+    }
+    scheduleSwitch(pressCycle, PF_SW_CREDIT_RESET, true);
+    scheduleSwitch(pressCycle + MS_TO_CYCLES(PF_BUTTON_MS), PF_SW_CREDIT_RESET, false);
+  }
+}
+
+void PlayfieldSim::update(uint64_t cycle) {
+  while (nextTickCycle<=cycle) {
+    tick(nextTickCycle);
+    tickNum += 1;
+    nextTickCycle = tickNum * HOST_CPU_HZ / PF_ZERO_CROSSINGS_PER_SEC;
+  }
+  for (int count=0; count<SIM_MAX_BALLS; count++) {
+    while (balls[count].state!=BALL_FREE && balls[count].nextCycle<=cycle) updateBall(balls[count], cycle);
+  }
+  // (kept in order, so a quick close and open can't swap)
+  size_t numDue = 0;
+  while (numDue<switchChanges.size() && switchChanges[numDue].cycle<=cycle) {
+    setSwitch(switchChanges[numDue].switchNum, switchChanges[numDue].closed);
+    numDue += 1;
+  }
+  if (numDue) switchChanges.erase(switchChanges.begin(), switchChanges.begin() + numDue);
+}
+
+uint8_t PlayfieldSim::getBallsOnPlayfield() const {
+  return countBalls(BALL_ON_PLAYFIELD) + countBalls(BALL_IN_SAUCER);
+}
+
+// What InterruptService3 does with the solenoids at a zero crossing
+void PlayfieldSim::tick(uint64_t cycle) {
+  bool kicker = NumCyclesBeforeRevertingSolenoidByte!=0 && (RevertSolenoidBit & PF_SHOOTER_KICKER_BIT);
+  if (kicker && !kickerFiring) {
+    for (int count=0; count<SIM_MAX_BALLS; count++) {
+      if (balls[count].state==BALL_IN_SHOOTER) launchBall(balls[count], cycle);
+    }
+  }
+  kickerFiring = kicker;
+
+  if (NumCyclesBeforeRevertingSolenoidByte!=0) {
+    NumCyclesBeforeRevertingSolenoidByte -= 1;
+    if (NumCyclesBeforeRevertingSolenoidByte==0) {
+      CurrentSolenoidByte |= RevertSolenoidBit;
+      RevertSolenoidBit = 0x00;
+    }
+  }
+
+  // A pulse is the same solenoid pulled on consecutive crossings
+  byte solenoidNum = PullFirstFromSolenoidStack();
+  if (solenoidNum!=PF_SOLENOID_STACK_EMPTY) {
+    if (solenoidNum!=lastSolenoid) fireSolenoid(solenoidNum, cycle);
+    CurrentSolenoidByte = (CurrentSolenoidByte&0xF0) | solenoidNum;
+  } else {
+    CurrentSolenoidByte = (CurrentSolenoidByte&0xF0) | PF_SOL_NONE;
+  }
+  lastSolenoid = solenoidNum;
+}
+
+void PlayfieldSim::fireSolenoid(uint8_t solenoidNum, uint64_t cycle) {
+  if (solenoidNum==PF_SOL_OUTHOLE) {
+    if (ballsInTrough==0) return;
+    for (int count=0; count<SIM_MAX_BALLS; count++) {
+      if (balls[count].state!=BALL_FREE) continue;
+      ballsInTrough -= 1;
+      setTroughSwitches();
+      balls[count].state = BALL_TO_SHOOTER;
+      balls[count].nextCycle = cycle + MS_TO_CYCLES(PF_EJECT_TO_SHOOTER_MS);
+      return;
+    }
+  } else if (solenoidNum==PF_SOL_SAUCER) {
+    for (int count=0; count<SIM_MAX_BALLS; count++) {
+      if (balls[count].state!=BALL_IN_SAUCER) continue;
+      balls[count].state = BALL_ON_PLAYFIELD;
+      setSwitch(PF_SW_SAUCER, false);
+      scheduleNextHit(balls[count], cycle);
+      return;
+    }
+  } else if (solenoidNum==PF_SOL_DROP_TARGET_RESET) {
+    for (int count=0; count<PF_NUM_DROP_TARGETS; count++) setSwitch(DropTargetSwitches[count], false);
+  } else {
+    for (int count=0; count<PF_NUM_DROP_TARGETS; count++) {
+      if (DropTargetSolenoids[count]==solenoidNum) setSwitch(DropTargetSwitches[count], true);
+    }
+  }
+}
+
+void PlayfieldSim::updateBall(Ball &ball, uint64_t cycle) {
+  switch (ball.state) {
+    case BALL_TO_SHOOTER:
+      ball.state = BALL_IN_SHOOTER;
+      setSwitch(PF_SW_SHOOTER_LANE, true);
+      ball.nextCycle = cycle + (uint64_t)(rng.uniform(model.getPlungeMin(), model.getPlungeMax()) * HOST_CPU_HZ);
+      break;
+    case BALL_IN_SHOOTER:
+      launchBall(ball, cycle);
+      break;
+    case BALL_LAUNCHED:
+      ball.state = BALL_ON_PLAYFIELD;
+      scheduleNextHit(ball, cycle);
+      break;
+    case BALL_ON_PLAYFIELD:
+      hitSomething(ball, cycle);
+      break;
+    case BALL_DRAINING:
+      ball.state = BALL_ON_OUTHOLE;
+      setSwitch(PF_SW_OUTHOLE, true);
+      ball.nextCycle = cycle + MS_TO_CYCLES(PF_OUTHOLE_TO_TROUGH_MS);
+      break;
+    case BALL_ON_OUTHOLE:
+      ball.state = BALL_FREE;
+      if (countBalls(BALL_ON_OUTHOLE)==0) setSwitch(PF_SW_OUTHOLE, false);
+      if (ballsInTrough<PF_TROUGH_SIZE) ballsInTrough += 1;
+      setTroughSwitches();
+      break;
+    default:
+      // Waiting on a solenoid
+      ball.nextCycle = UINT64_MAX;
+      break;
+  }
+}
+
+void PlayfieldSim::launchBall(Ball &ball, uint64_t cycle) {
+  ball.state = BALL_LAUNCHED;
+  ball.nextCycle = cycle + MS_TO_CYCLES(PF_LAUNCH_MS);
+  if (countBalls(BALL_IN_SHOOTER)==0) setSwitch(PF_SW_SHOOTER_LANE, false);
+}
+
+void PlayfieldSim::scheduleNextHit(Ball &ball, uint64_t cycle) {
+  ball.nextCycle = cycle + 1 + (uint64_t)(rng.exponential(model.getShotInterval()) * HOST_CPU_HZ);
+}
+
+void PlayfieldSim::hitSomething(Ball &ball, uint64_t cycle) {
+  numShots += 1;
+  double pick = rng.uniform() * model.getTotalWeight();
+  size_t shotNum = 0;
+  while (shotNum+1<model.getNumShots() && pick>=model.getShot(shotNum).weight) {
+    pick -= model.getShot(shotNum).weight;
+    shotNum += 1;
+  }
+  const ModelShot &shot = model.getShot(shotNum);
+  int numTimes = rng.range(shot.minCount, shot.maxCount);
+
+  switch (shot.kind) {
+    case MODEL_SHOT_SWITCH:
+      for (int count=0; count<numTimes; count++) {
+        uint64_t closeCycle = cycle + MS_TO_CYCLES(PF_REPEAT_MS*count);
+        scheduleSwitch(closeCycle, shot.switchNum, true);
+        scheduleSwitch(closeCycle + MS_TO_CYCLES(PF_SWITCH_CLOSED_MS), shot.switchNum, false);
+      }
+      break;
+    case MODEL_SHOT_SPINNER: {
+      // Each turn takes a little longer than the last
+      double gapMs = PF_SPIN_FIRST_GAP_MS, closeMs = 0.0;
+      for (int count=0; count<numTimes; count++) {
+        uint64_t closeCycle = cycle + MS_TO_CYCLES(1) * (uint64_t)closeMs;
+        scheduleSwitch(closeCycle, shot.switchNum, true);
+        scheduleSwitch(closeCycle + MS_TO_CYCLES(PF_SPIN_CLOSED_MS), shot.switchNum, false);
+        closeMs += gapMs;
+        gapMs *= 1.08;
+      }
+      break;
+    }
+    case MODEL_SHOT_DROP:
+      // Hitting a target that's already down scores nothing
+      if (!isSwitchClosed(shot.switchNum)) setSwitch(shot.switchNum, true);
+      break;
+    case MODEL_SHOT_SAUCER:
+      // Only one ball fits; another one bounces off
+      if (countBalls(BALL_IN_SAUCER)==0) {
+        ball.state = BALL_IN_SAUCER;
+        ball.nextCycle = UINT64_MAX;
+        setSwitch(shot.switchNum, true);
+        return;
+      }
+      break;
+    case MODEL_SHOT_OUTLANE:
+      scheduleSwitch(cycle, shot.switchNum, true);
+      scheduleSwitch(cycle + MS_TO_CYCLES(PF_SWITCH_CLOSED_MS), shot.switchNum, false);
+      // fall through
+    case MODEL_SHOT_DRAIN:
+      ball.state = BALL_DRAINING;
+      ball.nextCycle = cycle + MS_TO_CYCLES(PF_DRAIN_TO_OUTHOLE_MS);
+      return;
+  }
+  scheduleNextHit(ball, cycle);
+}
+
+void PlayfieldSim::scheduleSwitch(uint64_t cycle, uint8_t switchNum, bool closed) {
+  SwitchChange change = {cycle, switchNum, closed};
+  std::vector<SwitchChange>::iterator pos = switchChanges.end();
+  while (pos!=switchChanges.begin() && (pos-1)->cycle>cycle) --pos;
+  switchChanges.insert(pos, change);
+}
+
+// Stands in for the ISR's debounce: a closure goes on the switch stack
+// once, and SwitchesNow follows the contacts
+void PlayfieldSim::setSwitch(uint8_t switchNum, bool closed) {
+  byte mask = 1<<(switchNum%8);
+  if (closed) {
+    if (SwitchesNow[switchNum/8] & mask) return;
+    SwitchesNow[switchNum/8] |= mask;
+    RPU_PushToSwitchStack(switchNum);
+  } else {
+    SwitchesNow[switchNum/8] &= ~mask;
+  }
+}
+
+bool PlayfieldSim::isSwitchClosed(uint8_t switchNum) const {
+  return (SwitchesNow[switchNum/8] & (1<<(switchNum%8))) ? true : false;
+}
+
+void PlayfieldSim::setTroughSwitches() {
+  for (size_t count=0; count<PF_TROUGH_SIZE; count++) setSwitch(TroughSwitches[count], count<ballsInTrough);
+}
+
+uint8_t PlayfieldSim::countBalls(uint8_t state) const {
+  uint8_t numBalls = 0;
+  for (int count=0; count<SIM_MAX_BALLS; count++) {
+    if (balls[count].state==state) numBalls += 1;
+  }
+  return numBalls;
+}
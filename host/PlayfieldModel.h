@@ -0,0 +1,158 @@
+// Stochastic stand-in for the Trident playfield, used by trident_sim
+//
+// A PlayfieldModel is a table of the things a ball on the playfield can
+// hit, each with a weight (its share of all hits), plus how often the
+// ball hits something and how long a player takes to plunge. Models are
+// plain text, one entry per line ('#' starts a comment):
+//
+//   shot_interval  1.2        mean seconds between hits (exponential)
+//   plunge         0.4 2.0    seconds a player waits to plunge (uniform)
+//   <kind> <switch> <weight> [min [max]]
+//
+// kind is one of
+//   switch    a momentary switch, closed min-max times in a row (pops,
+//             slings, lanes, standups)
+//   spinner   min-max spins
+//   drop      knocks down a drop target (stays closed until the reset)
+//   saucer    the ball stays in the saucer until the game kicks it out
+//   outlane   the switch closes and the ball drains
+//   drain     the ball drains without touching a switch (switch is -)
+//
+// `trident_sim -M` prints the built-in model.
+//
+// A PlayfieldSim puts the balls on such a playfield, wired like a
+// Trident, and stands in for the MPU board under the unmodified game
+// logic: it writes the switch matrix straight into the OS (SwitchesNow
+// and the switch stack) and does what the zero crossing interrupt does
+// with the solenoid stack, so the driver can run the game without the
+// interrupts (or an emulated board) at all.
+
+#ifndef PLAYFIELD_MODEL_H
+#define PLAYFIELD_MODEL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#define MODEL_SHOT_SWITCH     0
+#define MODEL_SHOT_SPINNER    1
+#define MODEL_SHOT_DROP       2
+#define MODEL_SHOT_SAUCER     3
+#define MODEL_SHOT_OUTLANE    4
+#define MODEL_SHOT_DRAIN      5
+
+#define MODEL_NO_SWITCH       0xFF
+#define MODEL_NAME_SIZE       32
+
+struct ModelShot {
+  uint8_t kind;
+  uint8_t switchNum;
+  double weight;
+  uint8_t minCount;
+  uint8_t maxCount;
+  char name[MODEL_NAME_SIZE];   // from the line's comment
+};
+
+
+class PlayfieldModel {
+public:
+  // Starts out as the built-in model
+  PlayfieldModel();
+
+  // Returns false (and says why in error) if the file can't be read or
+  // has a bad line
+  bool load(const char *path, char *error, size_t errorSize);
+  void print(FILE *out) const;
+
+  size_t getNumShots() const { return shots.size(); }
+  const ModelShot &getShot(size_t index) const { return shots[index]; }
+  double getShotInterval() const { return shotInterval; }
+  double getPlungeMin() const { return plungeMin; }
+  double getPlungeMax() const { return plungeMax; }
+  double getTotalWeight() const { return totalWeight; }
+  // Chance that any one hit ends the ball
+  double getDrainChance() const;
+
+private:
+  std::vector<ModelShot> shots;
+  double shotInterval;
+  double plungeMin, plungeMax;
+  double totalWeight;
+
+  bool parse(const char *text, char *error, size_t errorSize);
+};
+
+
+// xorshift64*: small, fast and the same everywhere, so a game's seed
+// reproduces it
+class SimRandom {
+public:
+  void seed(uint64_t value);
+  uint64_t next();
+  // [0, 1)
+  double uniform();
+  double uniform(double low, double high) { return low + (high-low)*uniform(); }
+  double exponential(double mean);
+  // [low, high]
+  int range(int low, int high);
+
+private:
+  uint64_t state;
+};
+
+
+#define SIM_MAX_BALLS         5
+
+class PlayfieldSim {
+public:
+  PlayfieldSim(const PlayfieldModel &s_model);
+
+  // Empties the playfield and fills the trough, and brings the OS's
+  // switch states in line (call after setup(), before update())
+  void reset(uint64_t cycle);
+  void seed(uint64_t value) { rng.seed(value); }
+  // Drops coins and presses the start button for numPlayers
+  void startGame(uint64_t cycle, uint8_t numPlayers);
+  // Runs every zero crossing and every ball and switch change due by
+  // this cycle
+  void update(uint64_t cycle);
+
+  uint8_t getBallsOnPlayfield() const;
+  uint32_t getNumShots() const { return numShots; }
+
+private:
+  struct Ball {
+    uint8_t state;
+    uint64_t nextCycle;
+  };
+  struct SwitchChange {
+    uint64_t cycle;
+    uint8_t switchNum;
+    bool closed;
+  };
+
+  const PlayfieldModel &model;
+  SimRandom rng;
+  Ball balls[SIM_MAX_BALLS];
+  uint8_t ballsInTrough;
+  std::vector<SwitchChange> switchChanges;
+  uint64_t tickNum;
+  uint64_t nextTickCycle;
+  uint8_t lastSolenoid;
+  bool kickerFiring;
+  uint32_t numShots;
+
+  void tick(uint64_t cycle);
+  void fireSolenoid(uint8_t solenoidNum, uint64_t cycle);
+  void updateBall(Ball &ball, uint64_t cycle);
+  void hitSomething(Ball &ball, uint64_t cycle);
+  void launchBall(Ball &ball, uint64_t cycle);
+  void scheduleNextHit(Ball &ball, uint64_t cycle);
+  void scheduleSwitch(uint64_t cycle, uint8_t switchNum, bool closed);
+  void setSwitch(uint8_t switchNum, bool closed);
+  bool isSwitchClosed(uint8_t switchNum) const;
+  void setTroughSwitches();
+  uint8_t countBalls(uint8_t state) const;
+};
+
+#endif
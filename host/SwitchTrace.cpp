@@ -0,0 +1,205 @@
+#include <string.h>
+#include <algorithm>
+#include "SwitchTrace.h"
+#include "MPUBoardArch1.h"
+
+#define SWITCH_RECORD_SNAPSHOT    0xFC
+#define SWITCH_RECORD_OPENING     0xFD
+#define SWITCH_RECORD_LOST        0xFE
+
+// The ISR validates a closure on the second closed scan, which comes 1-2
+// scan periods (8.3 ms at 120 Hz) after the contacts close. Closing the
+// switch 1.5 periods early centers the replayed closure on its stamp.
+// Openings are validated the same way.
+#define SWITCH_REPLAY_LEAD_CYCLES       (HOST_CPU_HZ*3/240)
+// A closure has to last two scans to count, and a switch has to be seen
+// open for a scan before it can close again
+#define SWITCH_REPLAY_MIN_CLOSED_CYCLES (HOST_CPU_HZ*17/1000)
+#define SWITCH_REPLAY_MIN_OPEN_CYCLES   (HOST_CPU_HZ*9/1000)
+// The self-test switch interrupts on CA1 right away
+#define SWITCH_REPLAY_SELF_TEST_CYCLES  (HOST_CPU_HZ*20/1000)
+
+
+/*********************************************************************
+    Capture
+*********************************************************************/
+bool SwitchTrace::load(const char *path) {
+  events.clear();
+  numLost = 0;
+  truncated = false;
+
+  FILE *in = fopen(path, "rb");
+  if (!in) return false;
+  std::vector<uint8_t> data;
+  uint8_t buf[4096];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), in))>0) data.insert(data.end(), buf, buf+len);
+  fclose(in);
+
+  uint32_t time = 0;
+  size_t pos = 0;
+  while (pos<data.size()) {
+    uint8_t lead = data[pos++];
+    // Text from the game
+    if (lead<0x80) continue;
+
+    SwitchTraceEvent event;
+    memset(&event, 0, sizeof(event));
+    size_t needed = 0;
+    if (lead==SWITCH_RECORD_LOST) {
+      if (pos>=data.size()) break;
+      event.kind = SWITCH_TRACE_LOST;
+      event.switchNum = data[pos++];
+      event.time = time;
+      numLost += event.switchNum;
+      events.push_back(event);
+      continue;
+    } else if (lead==SWITCH_RECORD_SNAPSHOT) {
+      if (pos>=data.size()) break;
+      event.kind = SWITCH_TRACE_SNAPSHOT;
+      event.numBytes = data[pos++];
+      needed = event.numBytes;
+      if (event.numBytes>SWITCH_TRACE_MAX_BYTES || pos+needed>data.size()) break;
+      memcpy(event.states, &data[pos], needed);
+      pos += needed;
+    } else if (lead==SWITCH_RECORD_OPENING) {
+      if (pos>=data.size()) break;
+      event.kind = SWITCH_TRACE_OPENED;
+      event.switchNum = data[pos++];
+    } else {
+      event.kind = SWITCH_TRACE_CLOSED;
+      event.switchNum = lead & 0x7F;
+    }
+
+    uint32_t delta = 0;
+    uint8_t shift = 0;
+    bool complete = false;
+    while (pos<data.size() && shift<35) {
+      uint8_t timeByte = data[pos++];
+      delta |= (uint32_t)(timeByte & 0x7F) << shift;
+      shift += 7;
+      if (!(timeByte & 0x80)) {
+        complete = true;
+        break;
+      }
+    }
+    if (!complete) break;
+    time += delta;
+    event.time = time;
+    events.push_back(event);
+  }
+
+  truncated = (pos<data.size());
+  return !events.empty();
+}
+
+void SwitchTrace::print(FILE *out) const {
+  for (size_t count=0; count<events.size(); count++) {
+    const SwitchTraceEvent &event = events[count];
+    fprintf(out, "%10.3f ", event.time / 1000.0);
+    switch (event.kind) {
+      case SWITCH_TRACE_CLOSED: fprintf(out, "close %d\n", event.switchNum); break;
+      case SWITCH_TRACE_OPENED: fprintf(out, "open  %d\n", event.switchNum); break;
+      case SWITCH_TRACE_LOST: fprintf(out, "lost  %d edges\n", event.switchNum); break;
+      case SWITCH_TRACE_SNAPSHOT:
+        fprintf(out, "state");
+        for (uint8_t byteNum=0; byteNum<event.numBytes; byteNum++) fprintf(out, " %02X", event.states[byteNum]);
+        fprintf(out, "\n");
+        break;
+    }
+  }
+}
+
+
+/*********************************************************************
+    Replay
+*********************************************************************/
+SwitchReplay::SwitchReplay(const SwitchTrace &s_trace, MPUBoardArch1 &s_board) : board(s_board) {
+  nextAction = 0;
+  schedule(s_trace);
+}
+
+void SwitchReplay::schedule(const SwitchTrace &trace) {
+  bool closed[MPU_NUM_SWITCHES];
+  // Where each switch last changed in the replay
+  uint64_t changeCycle[MPU_NUM_SWITCHES];
+  memset(closed, 0, sizeof(closed));
+  memset(changeCycle, 0, sizeof(changeCycle));
+  bool started = false;
+
+  for (size_t count=0; count<trace.size(); count++) {
+    const SwitchTraceEvent &event = trace[count];
+    uint64_t eventCycle = (uint64_t)event.time * (HOST_CPU_HZ/1000);
+    uint64_t leadCycle = (eventCycle>SWITCH_REPLAY_LEAD_CYCLES) ? eventCycle - SWITCH_REPLAY_LEAD_CYCLES : 0;
+
+    if (event.kind==SWITCH_TRACE_LOST) continue;
+
+    if (event.switchNum==SWITCH_TRACE_SELF_TEST && event.kind==SWITCH_TRACE_CLOSED) {
+      Action press = {eventCycle, SWITCH_TRACE_SELF_TEST, true};
+      Action release = {eventCycle + SWITCH_REPLAY_SELF_TEST_CYCLES, SWITCH_TRACE_SELF_TEST, false};
+      actions.push_back(press);
+      actions.push_back(release);
+      continue;
+    }
+
+    if (event.kind==SWITCH_TRACE_SNAPSHOT) {
+      for (uint8_t switchNum=0; switchNum<MPU_NUM_SWITCHES && switchNum/8<event.numBytes; switchNum++) {
+        bool snapshotClosed = (event.states[switchNum/8]>>(switchNum%8)) & 0x01;
+        if (snapshotClosed==closed[switchNum]) continue;
+        // The first snapshot is how the playfield was before the game booted
+        uint64_t cycle = started ? leadCycle : 0;
+        uint64_t earliest = changeCycle[switchNum] + (closed[switchNum] ? SWITCH_REPLAY_MIN_CLOSED_CYCLES : SWITCH_REPLAY_MIN_OPEN_CYCLES);
+        if (started && cycle<earliest) cycle = earliest;
+        Action change = {cycle, switchNum, snapshotClosed};
+        actions.push_back(change);
+        closed[switchNum] = snapshotClosed;
+        changeCycle[switchNum] = cycle;
+      }
+      started = true;
+      continue;
+    }
+
+    started = true;
+    uint8_t switchNum = event.switchNum;
+    if (switchNum>=MPU_NUM_SWITCHES) continue;
+
+    if (event.kind==SWITCH_TRACE_CLOSED) {
+      if (closed[switchNum]) {
+        // The opening went missing - let it go just long enough to close again
+        uint64_t cycle = (leadCycle>SWITCH_REPLAY_MIN_OPEN_CYCLES) ? leadCycle - SWITCH_REPLAY_MIN_OPEN_CYCLES : 0;
+        if (cycle<changeCycle[switchNum] + SWITCH_REPLAY_MIN_CLOSED_CYCLES) cycle = changeCycle[switchNum] + SWITCH_REPLAY_MIN_CLOSED_CYCLES;
+        Action release = {cycle, switchNum, false};
+        actions.push_back(release);
+        changeCycle[switchNum] = cycle;
+      }
+      uint64_t cycle = leadCycle;
+      if (changeCycle[switchNum] && cycle<changeCycle[switchNum] + SWITCH_REPLAY_MIN_OPEN_CYCLES) cycle = changeCycle[switchNum] + SWITCH_REPLAY_MIN_OPEN_CYCLES;
+      Action press = {cycle, switchNum, true};
+      actions.push_back(press);
+      closed[switchNum] = true;
+      changeCycle[switchNum] = cycle;
+    } else if (closed[switchNum]) {
+      uint64_t cycle = leadCycle;
+      if (cycle<changeCycle[switchNum] + SWITCH_REPLAY_MIN_CLOSED_CYCLES) cycle = changeCycle[switchNum] + SWITCH_REPLAY_MIN_CLOSED_CYCLES;
+      Action release = {cycle, switchNum, false};
+      actions.push_back(release);
+      closed[switchNum] = false;
+      changeCycle[switchNum] = cycle;
+    }
+  }
+
+  // Each switch's changes are already in order; this interleaves them
+  std::stable_sort(actions.begin(), actions.end(), [](const Action &a, const Action &b) { return a.cycle<b.cycle; });
+}
+
+void SwitchReplay::update(uint64_t cycle) {
+  while (nextAction<actions.size() && actions[nextAction].cycle<=cycle) {
+    const Action &action = actions[nextAction++];
+    if (action.switchNum==SWITCH_TRACE_SELF_TEST) board.setSelfTestSwitch(action.closed);
+    else board.setSwitch(action.switchNum, action.closed);
+  }
+}
+
+uint64_t SwitchReplay::getEndCycle() const {
+  return actions.empty() ? 0 : actions.back().cycle;
+}
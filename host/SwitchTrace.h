@@ -0,0 +1,93 @@
+// Switch captures from RPU_OS_SWITCH_RECORDER, and their replay
+//
+// With the recorder on, the firmware interleaves binary records with
+// whatever text the game prints on Serial. Text is 7-bit, so any byte
+// with the top bit set starts a record:
+//
+//   0x80|sw  time        switch sw closed (sw 0x7F is the self-test switch)
+//   0xFD sw  time        switch sw opened
+//   0xFC n   b0..bn-1 time
+//                        switch states (SwitchesNow, 1 = closed) - sent
+//                        first, and again after edges were lost
+//   0xFE count           the ISR dropped count edges (one byte, a snapshot
+//                        follows)
+//
+// time is milliseconds since the previous record (the first one counts
+// from boot), 7 bits per byte, low bits first, top bit set on all but
+// the last byte. A capture is just the bytes that came out of the
+// Arduino's USB port, e.g. `cat /dev/ttyACM0 > game.bin`.
+//
+// Replay turns the edges back into switch closures on the emulated MPU
+// board, placed so the ISR validates each one at about the time it was
+// recorded.
+
+#ifndef SWITCH_TRACE_H
+#define SWITCH_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+class MPUBoardArch1;
+
+#define SWITCH_TRACE_CLOSED       0
+#define SWITCH_TRACE_OPENED       1
+#define SWITCH_TRACE_SNAPSHOT     2
+#define SWITCH_TRACE_LOST         3
+
+#define SWITCH_TRACE_MAX_BYTES    8
+#define SWITCH_TRACE_SELF_TEST    0x7F
+
+struct SwitchTraceEvent {
+  uint32_t time;        // ms since boot
+  uint8_t kind;
+  uint8_t switchNum;    // or the number of edges lost
+  uint8_t numBytes;     // snapshots only
+  uint8_t states[SWITCH_TRACE_MAX_BYTES];
+};
+
+
+class SwitchTrace {
+public:
+  // Returns false if the file can't be read or holds no records
+  bool load(const char *path);
+  size_t size() const { return events.size(); }
+  const SwitchTraceEvent &operator[](size_t index) const { return events[index]; }
+  uint32_t getNumLost() const { return numLost; }
+  // Where the capture ended early (a record cut off), if it did
+  bool isTruncated() const { return truncated; }
+  // One line per event
+  void print(FILE *out) const;
+
+private:
+  std::vector<SwitchTraceEvent> events;
+  uint32_t numLost;
+  bool truncated;
+};
+
+
+// Drives the board's switches from a capture
+class SwitchReplay {
+public:
+  SwitchReplay(const SwitchTrace &s_trace, MPUBoardArch1 &s_board);
+
+  // Applies every switch change due by this cycle
+  void update(uint64_t cycle);
+  bool isDone() const { return nextAction>=actions.size(); }
+  // Cycle at which the last switch change happens
+  uint64_t getEndCycle() const;
+
+private:
+  struct Action {
+    uint64_t cycle;
+    uint8_t switchNum;
+    bool closed;
+  };
+  MPUBoardArch1 &board;
+  std::vector<Action> actions;
+  size_t nextAction;
+
+  void schedule(const SwitchTrace &trace);
+};
+
+#endif
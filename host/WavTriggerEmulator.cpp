@@ -0,0 +1,314 @@
+#include <string.h>
+#include <stdlib.h>
+#include "WavTriggerEmulator.h"
+#include "Arduino.h"
+#include "AudioHandler.h"
+
+#define WAV_EMULATOR_NO_TRACK   0xFFFF
+
+// 20 characters, as the board sends them
+static const char EmulatorVersion[] = "WAV Trigger host emu";
+
+
+WavTriggerEmulator::WavTriggerEmulator(uint8_t s_serialNum) {
+  serialNum = s_serialNum;
+  mute = false;
+  reporting = false;
+  // 8N1 = 10 bits per byte
+  cyclesPerByte = (10ULL * HOST_CPU_HZ) / WAV_EMULATOR_BAUD;
+  for (int voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) voices[voice].track = WAV_EMULATOR_NO_TRACK;
+  nextReplyByteCycle = 0;
+  bytesReceived = 0;
+  bytesSent = 0;
+  numPlays = 0;
+  numResumes = 0;
+  numBlindResumes = 0;
+  numLoads = 0;
+  numVoiceSteals = 0;
+  numPlaysRefused = 0;
+  numReports = 0;
+  for (int kind=0; kind<2; kind++) {
+    totalStartCycles[kind] = 0;
+    maxStartCycles[kind] = 0;
+    numStarts[kind] = 0;
+  }
+  numVoicesBusy = 0;
+  peakVoicesBusy = 0;
+  currentCycle = 0;
+}
+
+bool WavTriggerEmulator::loadTrackLengths(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) return false;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    char *comment = strchr(line, '#');
+    if (comment) *comment = 0;
+    unsigned first, last;
+    unsigned long lengthMs;
+    if (sscanf(line, "%u %u %lu", &first, &last, &lengthMs)!=3) continue;
+    WavEmulatorTrackRange range;
+    range.first = (uint16_t)first;
+    range.last = (uint16_t)last;
+    range.lengthMs = (uint32_t)lengthMs;
+    trackLengths.push_back(range);
+  }
+  fclose(file);
+  return true;
+}
+
+uint64_t WavTriggerEmulator::trackCycles(uint16_t track) {
+  uint32_t lengthMs = WAV_EMULATOR_DEFAULT_TRACK_MS;
+  for (size_t count=0; count<trackLengths.size(); count++) {
+    if (track>=trackLengths[count].first && track<=trackLengths[count].last) lengthMs = trackLengths[count].lengthMs;
+  }
+  return (uint64_t)lengthMs * (HOST_CPU_HZ/1000);
+}
+
+void WavTriggerEmulator::frameReceived(const uint8_t *frame, uint8_t len, uint64_t cycle) {
+  bytesReceived += len;
+  if (mute) return;
+  PendingFrame pending;
+  pending.cycle = cycle;
+  pending.len = len;
+  memcpy(pending.data, frame, len);
+  received.push_back(pending);
+}
+
+void WavTriggerEmulator::update(uint64_t cycle) {
+  currentCycle = cycle;
+  while (!received.empty() && received.front().cycle<=cycle) {
+    PendingFrame frame = received.front();
+    received.pop_front();
+    advanceVoices(frame.cycle);
+    execute(frame);
+  }
+  advanceVoices(cycle);
+  deliverReplies(cycle);
+}
+
+void WavTriggerEmulator::execute(const PendingFrame &frame) {
+  const uint8_t *data = frame.data;
+  uint8_t reply[32];
+  uint64_t firstByteCycle = frame.cycle - (uint64_t)frame.len * cyclesPerByte;
+
+  switch (data[3]) {
+    case CMD_GET_VERSION:
+      reply[0] = SOM1;
+      reply[1] = SOM2;
+      reply[2] = 4 + (VERSION_STRING_LEN - 1) + 1;
+      reply[3] = RSP_VERSION_STRING;
+      memcpy(reply + 4, EmulatorVersion, VERSION_STRING_LEN - 1);
+      reply[4 + VERSION_STRING_LEN - 1] = EOM;
+      sendReply(reply, reply[2]);
+      break;
+    case CMD_GET_SYS_INFO:
+      reply[0] = SOM1;
+      reply[1] = SOM2;
+      reply[2] = 0x08;
+      reply[3] = RSP_SYSTEM_INFO;
+      reply[4] = WAV_EMULATOR_NUM_VOICES;
+      reply[5] = (uint8_t)WAV_EMULATOR_NUM_TRACKS;
+      reply[6] = (uint8_t)(WAV_EMULATOR_NUM_TRACKS >> 8);
+      reply[7] = EOM;
+      sendReply(reply, 8);
+      break;
+    case CMD_SET_REPORTING:
+      reporting = (data[4]!=0);
+      break;
+    case CMD_TRACK_CONTROL:
+      trackControl(data[4], (uint16_t)(data[5] | (data[6]<<8)), false, frame.cycle, firstByteCycle);
+      break;
+    case CMD_TRACK_CONTROL_EX:
+      trackControl(data[4], (uint16_t)(data[5] | (data[6]<<8)), data[7]!=0, frame.cycle, firstByteCycle);
+      break;
+    case CMD_STOP_ALL:
+      for (int voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) freeVoice(voice, true);
+      break;
+    case CMD_RESUME_ALL_SYNC:
+      for (int voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) {
+        WavEmulatorVoice &v = voices[voice];
+        if (v.track==WAV_EMULATOR_NO_TRACK || !v.paused) continue;
+        v.paused = false;
+        uint64_t resumeCycle = frame.cycle + (uint64_t)WAV_EMULATOR_RESUME_LATENCY_US * HOST_CYCLES_PER_MICRO;
+        if (v.startCycle<resumeCycle) v.startCycle = resumeCycle;
+        numResumes += 1;
+        addStartLatency(1, v.startCycle - firstByteCycle);
+      }
+      break;
+    case CMD_TRACK_FADE:
+      // Only a fade that stops the track matters here (gain isn't modeled)
+      if (data[10]) {
+        uint16_t track = (uint16_t)(data[4] | (data[5]<<8));
+        uint64_t stopCycle = frame.cycle + (uint64_t)(data[8] | (data[9]<<8)) * (HOST_CPU_HZ/1000);
+        for (int voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) {
+          if (voices[voice].track==track) voices[voice].stopCycle = stopCycle;
+        }
+      }
+      break;
+    default:
+      // Volume, amp power, sample rate, trigger bank - nothing to answer
+      break;
+  }
+}
+
+void WavTriggerEmulator::trackControl(uint8_t code, uint16_t track, bool lock, uint64_t cycle, uint64_t firstByteCycle) {
+  int voice;
+  bool found = false;
+
+  switch (code) {
+    case TRK_PLAY_SOLO:
+      for (voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) freeVoice(voice, true);
+      // fall through
+    case TRK_PLAY_POLY:
+    case TRK_LOAD:
+      voice = allocateVoice();
+      if (voice<0) {
+        numPlaysRefused += 1;
+        break;
+      }
+      startVoice(voice, track, code==TRK_LOAD, lock, cycle);
+      if (code==TRK_LOAD) {
+        numLoads += 1;
+      } else {
+        numPlays += 1;
+        addStartLatency(0, voices[voice].startCycle - firstByteCycle);
+      }
+      break;
+    case TRK_PAUSE:
+      for (voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) {
+        WavEmulatorVoice &v = voices[voice];
+        if (v.track!=track || v.paused) continue;
+        if (cycle>v.startCycle) v.playedCycles += cycle - v.startCycle;
+        v.paused = true;
+      }
+      break;
+    case TRK_RESUME:
+      for (voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) {
+        WavEmulatorVoice &v = voices[voice];
+        if (v.track!=track) continue;
+        found = true;
+        if (!v.paused) continue;
+        v.paused = false;
+        uint64_t resumeCycle = cycle + (uint64_t)WAV_EMULATOR_RESUME_LATENCY_US * HOST_CYCLES_PER_MICRO;
+        if (v.startCycle<resumeCycle) v.startCycle = resumeCycle;
+        addStartLatency(1, v.startCycle - firstByteCycle);
+      }
+      numResumes += 1;
+      // The board has nothing to resume, so nothing plays
+      if (!found) numBlindResumes += 1;
+      break;
+    case TRK_STOP:
+      for (voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) {
+        if (voices[voice].track==track) freeVoice(voice, true);
+      }
+      break;
+    case TRK_LOOP_ON:
+    case TRK_LOOP_OFF:
+      for (voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) {
+        if (voices[voice].track==track) voices[voice].looping = (code==TRK_LOOP_ON);
+      }
+      break;
+  }
+}
+
+// A free voice if there is one, or the oldest unlocked one (-1 if every
+// voice is locked)
+int WavTriggerEmulator::allocateVoice() {
+  int oldest = -1;
+  for (int voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) {
+    if (voices[voice].track==WAV_EMULATOR_NO_TRACK) return voice;
+    if (voices[voice].locked) continue;
+    if (oldest<0 || voices[voice].allocCycle<voices[oldest].allocCycle) oldest = voice;
+  }
+  if (oldest>=0) {
+    // Taken over without an "off" report
+    numVoiceSteals += 1;
+    voices[oldest].track = WAV_EMULATOR_NO_TRACK;
+    numVoicesBusy -= 1;
+  }
+  return oldest;
+}
+
+void WavTriggerEmulator::startVoice(int voice, uint16_t track, bool paused, bool lock, uint64_t cycle) {
+  WavEmulatorVoice &v = voices[voice];
+  v.track = track;
+  v.paused = paused;
+  v.looping = false;
+  v.locked = lock;
+  v.reported = false;
+  v.allocCycle = cycle;
+  v.startCycle = cycle + (uint64_t)WAV_EMULATOR_PLAY_LATENCY_US * HOST_CYCLES_PER_MICRO;
+  v.playedCycles = 0;
+  v.stopCycle = 0;
+  numVoicesBusy += 1;
+  if (numVoicesBusy>peakVoicesBusy) peakVoicesBusy = numVoicesBusy;
+}
+
+void WavTriggerEmulator::freeVoice(int voice, bool sendReport) {
+  WavEmulatorVoice &v = voices[voice];
+  if (v.track==WAV_EMULATOR_NO_TRACK) return;
+  if (sendReport && v.reported) sendTrackReport(v.track, (uint8_t)voice, false);
+  v.track = WAV_EMULATOR_NO_TRACK;
+  numVoicesBusy -= 1;
+}
+
+// Reports voices that have started (a loaded track reports once it's
+// loaded, paused or not) and ends the ones that have run out
+void WavTriggerEmulator::advanceVoices(uint64_t cycle) {
+  for (int voice=0; voice<WAV_EMULATOR_NUM_VOICES; voice++) {
+    WavEmulatorVoice &v = voices[voice];
+    if (v.track==WAV_EMULATOR_NO_TRACK || cycle<v.startCycle) continue;
+    if (!v.reported) {
+      v.reported = true;
+      sendTrackReport(v.track, (uint8_t)voice, true);
+    }
+    if (v.stopCycle && cycle>=v.stopCycle) {
+      freeVoice(voice, true);
+      continue;
+    }
+    if (v.paused || v.looping) continue;
+    uint64_t length = trackCycles(v.track);
+    if (v.playedCycles + (cycle - v.startCycle)>=length) freeVoice(voice, true);
+  }
+}
+
+void WavTriggerEmulator::addStartLatency(int kind, uint64_t cycles) {
+  totalStartCycles[kind] += cycles;
+  if (cycles>maxStartCycles[kind]) maxStartCycles[kind] = cycles;
+  numStarts[kind] += 1;
+}
+
+void WavTriggerEmulator::sendTrackReport(uint16_t track, uint8_t voice, bool playing) {
+  if (!reporting) return;
+  // The board numbers tracks from 0 in its reports
+  uint16_t index = track - 1;
+  uint8_t reply[9] = {SOM1, SOM2, 0x09, RSP_TRACK_REPORT, (uint8_t)index, (uint8_t)(index >> 8), voice, (uint8_t)(playing ? 1 : 0), EOM};
+  numReports += 1;
+  sendReply(reply, 9);
+}
+
+void WavTriggerEmulator::sendReply(const uint8_t *data, uint8_t len) {
+  if (replyBytes.empty() && nextReplyByteCycle<currentCycle + cyclesPerByte) nextReplyByteCycle = currentCycle + cyclesPerByte;
+  for (uint8_t count=0; count<len; count++) replyBytes.push_back(data[count]);
+}
+
+void WavTriggerEmulator::deliverReplies(uint64_t cycle) {
+  while (!replyBytes.empty() && nextReplyByteCycle<=cycle) {
+    HostSerialReceive(serialNum, replyBytes.front());
+    replyBytes.pop_front();
+    bytesSent += 1;
+    nextReplyByteCycle += cyclesPerByte;
+  }
+}
+
+void WavTriggerEmulator::report(FILE *out) {
+  fprintf(out, "WAV Trigger:       %llu bytes in (%.1f ms on the wire), %llu bytes out (%u track reports)%s\n",
+          (unsigned long long)bytesReceived, (double)bytesReceived * cyclesPerByte * 1000.0 / HOST_CPU_HZ,
+          (unsigned long long)bytesSent, numReports, mute ? ", muted" : "");
+  fprintf(out, "  tracks:          %u plays, %u loads, %u resumes (%u with nothing loaded)\n", numPlays, numLoads, numResumes, numBlindResumes);
+  fprintf(out, "  to first sample: plays %.1f ms (max %.1f), resumes %.1f ms (max %.1f)\n",
+          numStarts[0] ? (double)totalStartCycles[0] * 1000.0 / HOST_CPU_HZ / numStarts[0] : 0.0, (double)maxStartCycles[0] * 1000.0 / HOST_CPU_HZ,
+          numStarts[1] ? (double)totalStartCycles[1] * 1000.0 / HOST_CPU_HZ / numStarts[1] : 0.0, (double)maxStartCycles[1] * 1000.0 / HOST_CPU_HZ);
+  fprintf(out, "  voices:          peak %u of %d, %u steals, %u plays refused (all locked)\n", peakVoicesBusy, WAV_EMULATOR_NUM_VOICES, numVoiceSteals, numPlaysRefused);
+}
@@ -0,0 +1,116 @@
+// A WAV Trigger on the other end of Serial1: it answers the version and
+// system info requests, plays tracks on a model of the board's 14 voices
+// (stealing the oldest unlocked voice when they're all busy, without an
+// "off" report for the track it takes, as the board does) and sends
+// track reports back at 57600 baud once reporting is turned on.
+//
+// Tracks play for the length given in a track list (see
+// replay/trident_tracks.txt), or for WAV_EMULATOR_DEFAULT_TRACK_MS. A
+// play starts after an SD card seek; resuming a loaded (paused) track
+// doesn't have to seek.
+//
+// The driver calls update() between passes through loop(); commands act
+// at the cycle their last byte came off the wire.
+
+#ifndef WAV_TRIGGER_EMULATOR_H
+#define WAV_TRIGGER_EMULATOR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "WavTriggerMonitor.h"
+
+#define WAV_EMULATOR_NUM_VOICES         14
+#define WAV_EMULATOR_NUM_TRACKS         999
+#define WAV_EMULATOR_DEFAULT_TRACK_MS   1000
+// From the end of a play command to the first sample, and for a resume
+#define WAV_EMULATOR_PLAY_LATENCY_US    12000
+#define WAV_EMULATOR_RESUME_LATENCY_US  500
+#define WAV_EMULATOR_BAUD               57600
+
+struct WavEmulatorVoice {
+  uint16_t track;       // 0xFFFF when free
+  bool paused;
+  bool looping;
+  bool locked;
+  bool reported;        // an "on" report has been sent for it
+  uint64_t allocCycle;  // for picking the oldest voice to steal
+  uint64_t startCycle;  // when the audio starts (or resumes)
+  uint64_t playedCycles;  // played before the last pause
+  uint64_t stopCycle;   // a fade with the stop flag ends here (0 = none)
+};
+
+struct WavEmulatorTrackRange {
+  uint16_t first;
+  uint16_t last;
+  uint32_t lengthMs;
+};
+
+class WavTriggerEmulator : public WavTriggerMonitor {
+public:
+  WavTriggerEmulator(uint8_t s_serialNum = 1);
+
+  // Lines of "first last ms" (# starts a comment); later lines win
+  bool loadTrackLengths(const char *path);
+  // A board that hears everything but never answers (like the monitor)
+  void setMute(bool s_mute) { mute = s_mute; }
+
+  void update(uint64_t cycle);
+  void report(FILE *out);
+
+  uint32_t getNumVoiceSteals() { return numVoiceSteals; }
+
+protected:
+  void frameReceived(const uint8_t *frame, uint8_t len, uint64_t cycle);
+
+private:
+  struct PendingFrame {
+    uint64_t cycle;
+    uint8_t len;
+    uint8_t data[WAV_MONITOR_MAX_FRAME];
+  };
+
+  uint8_t serialNum;
+  bool mute;
+  bool reporting;
+  uint64_t cyclesPerByte;
+  WavEmulatorVoice voices[WAV_EMULATOR_NUM_VOICES];
+  std::vector<WavEmulatorTrackRange> trackLengths;
+  std::deque<PendingFrame> received;
+  // Reply bytes, and when the next one is due in the Arduino's buffer
+  std::deque<uint8_t> replyBytes;
+  uint64_t nextReplyByteCycle;
+
+  uint64_t bytesReceived;
+  uint64_t bytesSent;
+  uint32_t numPlays;
+  uint32_t numResumes;
+  uint32_t numBlindResumes;
+  uint32_t numLoads;
+  uint32_t numVoiceSteals;
+  uint32_t numPlaysRefused;
+  uint32_t numReports;
+  // From the first byte of a play (or resume) on the wire to the first
+  // sample out, for plays [0] and resumes [1]
+  uint64_t totalStartCycles[2];
+  uint64_t maxStartCycles[2];
+  uint32_t numStarts[2];
+  uint8_t numVoicesBusy;
+  uint8_t peakVoicesBusy;
+  uint64_t currentCycle;
+
+  void execute(const PendingFrame &frame);
+  void trackControl(uint8_t code, uint16_t track, bool lock, uint64_t cycle, uint64_t firstByteCycle);
+  void addStartLatency(int kind, uint64_t cycles);
+  int allocateVoice();
+  void startVoice(int voice, uint16_t track, bool paused, bool lock, uint64_t cycle);
+  void freeVoice(int voice, bool sendReport);
+  void advanceVoices(uint64_t cycle);
+  uint64_t trackCycles(uint16_t track);
+  void sendReply(const uint8_t *data, uint8_t len);
+  void sendTrackReport(uint16_t track, uint8_t voice, bool playing);
+  void deliverReplies(uint64_t cycle);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include "WavTriggerMonitor.h"
+#include "Arduino.h"
+#include "AudioHandler.h"
+
+
+WavTriggerMonitor::WavTriggerMonitor() {
+  frameLen = 0;
+  numFrames = 0;
+  numBadFrames = 0;
+}
+
+// Frames are SOM1 SOM2 length command data... EOM, where length counts
+// every byte of the frame
+void WavTriggerMonitor::transmitted(uint8_t data, uint64_t cycle) {
+  if (frameLen==0 && data!=SOM1) return;
+  if (frameLen==1 && data!=SOM2) {
+    frameLen = (data==SOM1) ? 1 : 0;
+    numBadFrames += 1;
+    return;
+  }
+  if (frameLen==2 && (data<5 || data>WAV_MONITOR_MAX_FRAME)) {
+    frameLen = 0;
+    numBadFrames += 1;
+    return;
+  }
+
+  frame[frameLen++] = data;
+  if (frameLen>2 && frameLen==frame[2]) {
+    frameDone(cycle);
+    frameLen = 0;
+  }
+}
+
+void WavTriggerMonitor::frameDone(uint64_t cycle) {
+  if (frame[frameLen-1]!=EOM) {
+    numBadFrames += 1;
+    return;
+  }
+  numFrames += 1;
+  frameReceived(frame, frameLen, cycle);
+
+  WavTriggerCommand command;
+  command.cycle = cycle;
+  command.command = frame[3];
+  command.code = 0;
+  command.track = 0;
+  if (frame[3]==CMD_TRACK_CONTROL || frame[3]==CMD_TRACK_CONTROL_EX) {
+    command.code = frame[4];
+    command.track = frame[5] | (frame[6]<<8);
+    pending.push_back(command);
+  } else if (frame[3]==CMD_STOP_ALL) {
+    pending.push_back(command);
+  }
+}
+
+void WavTriggerMonitor::takeCommands(std::vector<WavTriggerCommand> &commands) {
+  commands.swap(pending);
+  pending.clear();
+}
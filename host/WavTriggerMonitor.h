@@ -0,0 +1,46 @@
+// Listens to the firmware's WAV Trigger serial port (Serial1) and keeps
+// the track commands it sends, so replays can check what was played.
+// (WavTriggerEmulator.h answers them as well.)
+
+#ifndef WAV_TRIGGER_MONITOR_H
+#define WAV_TRIGGER_MONITOR_H
+
+#include <stdint.h>
+#include <vector>
+#include "HostPlatform.h"
+
+#define WAV_MONITOR_MAX_FRAME   32
+
+struct WavTriggerCommand {
+  uint64_t cycle;
+  uint8_t command;      // CMD_TRACK_CONTROL(_EX) or CMD_STOP_ALL
+  uint8_t code;         // TRK_x for track control
+  uint16_t track;
+};
+
+class WavTriggerMonitor : public HostSerialDevice {
+public:
+  WavTriggerMonitor();
+  virtual ~WavTriggerMonitor() {}
+  void transmitted(uint8_t data, uint64_t cycle);
+
+  // Track commands since the last call
+  void takeCommands(std::vector<WavTriggerCommand> &commands);
+  uint32_t getNumFrames() { return numFrames; }
+  uint32_t getNumBadFrames() { return numBadFrames; }
+
+protected:
+  // Every good frame, at the cycle its last byte came off the wire
+  virtual void frameReceived(const uint8_t *frame, uint8_t len, uint64_t cycle) {}
+
+private:
+  uint8_t frame[WAV_MONITOR_MAX_FRAME];
+  uint8_t frameLen;
+  uint32_t numFrames;
+  uint32_t numBadFrames;
+  std::vector<WavTriggerCommand> pending;
+
+  void frameDone(uint64_t cycle);
+};
+
+#endif
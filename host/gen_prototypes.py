@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# Turns a sketch (.ino) into a .cpp the way the Arduino IDE does: adds
+# prototypes for every function defined in the sketch right after its
+# last #include, and #line directives so errors point at the .ino.
+#
+# usage: gen_prototypes.py Sketch.ino > Sketch.cpp
+
+import re
+import sys
+
+FUNCTION_DEF = re.compile(r'^([A-Za-z_][\w \*&:<>]*?[\s\*&]+)([A-Za-z_]\w*)\s*\(([^;{}()]*?)\)\s*\{', re.M)
+NOT_A_TYPE = ('else', 'return', 'case', 'do')
+NOT_A_FUNCTION = ('if', 'while', 'for', 'switch')
+
+
+def main():
+    path = sys.argv[1]
+    with open(path) as f:
+        src = f.read()
+
+    prototypes = []
+    for m in FUNCTION_DEF.finditer(src):
+        ret_type, name, args = m.group(1).strip(), m.group(2), m.group(3)
+        if ret_type.split()[0] in NOT_A_TYPE or name in NOT_A_FUNCTION:
+            continue
+        # Default arguments can only be given once; the IDE leaves these
+        # to the definition as well
+        if '=' in args:
+            continue
+        if ret_type.startswith('static '):
+            continue
+        prototypes.append('%s %s(%s);' % (ret_type, name, args))
+
+    includes = [m.end() for m in re.finditer(r'^\s*#include.*$', src, re.M)]
+    split = includes[-1] if includes else 0
+    head, tail = src[:split], src[split:]
+
+    out = sys.stdout
+    out.write('#include <Arduino.h>\n')
+    out.write('#line 1 "%s"\n' % path)
+    out.write(head)
+    out.write('\n')
+    out.write('\n'.join(prototypes))
+    out.write('\n#line %d "%s"\n' % (head.count('\n') + 1, path))
+    out.write(tail)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,296 @@
+// Host driver for the firmware: runs setup() and then loop() against the
+// virtual Mega in shim/ (wired to an emulated MPU board) until the
+// requested amount of virtual time has passed, then reports how fast
+// that went, the longest pass through loop() (and how long the firmware
+// sat waiting on a full serial buffer), what the bus saw, and whether
+// the board's lamps, displays and solenoids matched what the firmware
+// meant them to be.
+//
+// A WAV Trigger emulator (WavTriggerEmulator.h) answers on Serial1.
+//
+// With -r it replays a switch capture (see SwitchTrace.h) into the board,
+// can write or check a golden trace of what the game did (GoldenTrace.h)
+// and reports the loop passes and interrupt time each switch event cost.
+//
+// usage: trident_host [-t seconds] [-e eeprom.bin] [-l loopCycles] [-q] [-i]
+//                     [-w tracks.txt] [-m]
+//                     [-r capture [-g trace.out] [-c trace.golden] [-p events.csv] [-d]]
+//
+// Exits with 2 if the board checks found mismatches, 3 if the replay
+// didn't match the golden trace.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+// (the replay classes use the STL, so they come ahead of Arduino's min/max)
+#include "SwitchTrace.h"
+#include "GoldenTrace.h"
+#include "WavTriggerEmulator.h"
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "MPUBoardArch1.h"
+#include "AudioHandler.h"
+
+void setup();
+void loop();
+extern AudioHandler Audio;
+
+// What a pass through loop() costs beyond the port accesses, time
+// reads, EEPROM and serial traffic the shim already charges for
+#define HOST_DEFAULT_LOOP_CYCLES  800
+// How long a replay runs past the last switch change, by default
+#define HOST_REPLAY_TAIL_SECONDS  5.0
+// A pass through loop() longer than this (not counting the time in
+// interrupt handlers, which is reported on its own) is a stall
+#define HOST_LOOP_STALL_US        1000
+
+class HostNullDevice : public HostSerialDevice {
+public:
+  void transmitted(uint8_t, uint64_t) {}
+};
+
+// For the firmware's own audio stats at the end of a run
+class HostStderrDevice : public HostSerialDevice {
+public:
+  void transmitted(uint8_t data, uint64_t) { fputc(data, stderr); }
+};
+
+static double WallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Total time spent in interrupt handlers so far
+static uint64_t HandlerCycles() {
+  const HostStats *stats = HostGetStats();
+  uint64_t cycles = 0;
+  for (int vector=0; vector<HOST_NUM_VECTORS; vector++) cycles += stats->vectors[vector].totalCycles;
+  return cycles;
+}
+
+static void DescribeEvent(const SwitchTraceEvent &event, char *buf, size_t bufSize) {
+  if (event.kind==SWITCH_TRACE_CLOSED) snprintf(buf, bufSize, "close %d", event.switchNum);
+  else if (event.kind==SWITCH_TRACE_OPENED) snprintf(buf, bufSize, "open %d", event.switchNum);
+  else snprintf(buf, bufSize, "state");
+}
+
+static void Usage(const char *name) {
+  fprintf(stderr, "usage: %s [-t seconds] [-e eeprom.bin] [-l loopCycles] [-q] [-i]\n", name);
+  fprintf(stderr, "       %*s [-w tracks.txt] [-m]\n", (int)strlen(name), "");
+  fprintf(stderr, "       %*s [-r capture [-g trace.out] [-c trace.golden] [-p events.csv] [-d]]\n", (int)strlen(name), "");
+  fprintf(stderr, "  -t  virtual seconds to run (default 60, or %.0f past the end of a replay)\n", HOST_REPLAY_TAIL_SECONDS);
+  fprintf(stderr, "  -e  EEPROM image file (created if missing, kept between runs)\n");
+  fprintf(stderr, "  -l  CPU cycles charged per pass through loop() (default %d)\n", HOST_DEFAULT_LOOP_CYCLES);
+  fprintf(stderr, "  -q  don't echo Serial to stdout\n");
+  fprintf(stderr, "  -i  idle bus instead of the MPU board (no PIAs, no interrupts)\n");
+  fprintf(stderr, "  -w  WAV Trigger track lengths (lines of \"first last ms\")\n");
+  fprintf(stderr, "  -m  the WAV Trigger listens but never answers\n");
+  fprintf(stderr, "  -r  replay a switch capture from RPU_OS_SWITCH_RECORDER\n");
+  fprintf(stderr, "  -g  write the replay's golden trace\n");
+  fprintf(stderr, "  -c  compare the replay against a golden trace\n");
+  fprintf(stderr, "  -p  write loop passes and handler time per replayed event (CSV)\n");
+  fprintf(stderr, "  -d  print the capture's events and exit\n");
+}
+
+int main(int argc, char **argv) {
+  double runSeconds = 60.0;
+  const char *eepromPath = NULL;
+  unsigned long loopCycles = HOST_DEFAULT_LOOP_CYCLES;
+  bool quiet = false;
+  bool idleBus = false;
+  bool runSecondsSet = false;
+  const char *capturePath = NULL;
+  const char *tracePath = NULL;
+  const char *goldenPath = NULL;
+  const char *profilePath = NULL;
+  bool dumpCapture = false;
+  const char *tracksPath = NULL;
+  bool muteWavTrigger = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:e:l:qiw:mr:g:c:p:dh"))!=-1) {
+    switch (opt) {
+      case 't': runSeconds = atof(optarg); runSecondsSet = true; break;
+      case 'e': eepromPath = optarg; break;
+      case 'l': loopCycles = strtoul(optarg, NULL, 0); break;
+      case 'q': quiet = true; break;
+      case 'i': idleBus = true; break;
+      case 'w': tracksPath = optarg; break;
+      case 'm': muteWavTrigger = true; break;
+      case 'r': capturePath = optarg; break;
+      case 'g': tracePath = optarg; break;
+      case 'c': goldenPath = optarg; break;
+      case 'p': profilePath = optarg; break;
+      case 'd': dumpCapture = true; break;
+      default: Usage(argv[0]); return (opt=='h') ? 0 : 1;
+    }
+  }
+
+  SwitchTrace capture;
+  if (capturePath) {
+    if (!capture.load(capturePath)) {
+      fprintf(stderr, "No switch records in %s\n", capturePath);
+      return 1;
+    }
+    if (dumpCapture) {
+      capture.print(stdout);
+      return 0;
+    }
+    if (idleBus) {
+      fprintf(stderr, "A replay needs the MPU board (drop -i)\n");
+      return 1;
+    }
+  }
+
+  if (eepromPath && !HostOpenEEProm(eepromPath)) {
+    fprintf(stderr, "Can't open EEPROM image %s\n", eepromPath);
+    return 1;
+  }
+
+  HostNullDevice nullDevice;
+  if (quiet) HostSetSerialDevice(0, &nullDevice);
+
+  MPUBoardArch1 board;
+  if (!idleBus) HostSetBus(&board);
+
+  WavTriggerEmulator wavTrigger;
+  if (tracksPath && !wavTrigger.loadTrackLengths(tracksPath)) {
+    fprintf(stderr, "Can't open track list %s\n", tracksPath);
+    return 1;
+  }
+  wavTrigger.setMute(muteWavTrigger);
+  HostSetSerialDevice(1, &wavTrigger);
+  GoldenTrace trace(board, wavTrigger);
+  SwitchReplay *replay = NULL;
+  FILE *profile = NULL;
+  if (capturePath) {
+    if (!trace.open(tracePath, goldenPath)) {
+      fprintf(stderr, "Can't open golden trace %s\n", goldenPath ? goldenPath : tracePath);
+      return 1;
+    }
+    if (profilePath) {
+      profile = fopen(profilePath, "w");
+      if (!profile) {
+        fprintf(stderr, "Can't write %s\n", profilePath);
+        return 1;
+      }
+      fprintf(profile, "time_ms,event,loops,handler_us,window_us\n");
+    }
+    replay = new SwitchReplay(capture, board);
+    if (!runSecondsSet) runSeconds = (double)replay->getEndCycle() / HOST_CPU_HZ + HOST_REPLAY_TAIL_SECONDS;
+    // Switches that were closed when the game booted
+    replay->update(0);
+  }
+
+  uint64_t endCycle = (uint64_t)(runSeconds * HOST_CPU_HZ);
+  unsigned long long numLoops = 0;
+  double wallStart = WallSeconds();
+
+  // Each replayed event is charged the loop passes and handler time until
+  // the next one comes due
+  int windowEvent = -1;
+  unsigned long long windowLoops = 0;
+  uint64_t windowHandlerCycles = 0, windowStartCycle = 0;
+  unsigned long long totalEventLoops = 0, maxEventLoops = 0;
+  uint64_t totalEventHandlerCycles = 0, maxEventHandlerCycles = 0;
+  uint32_t numEvents = 0;
+  auto endWindow = [&](uint64_t now) {
+    const SwitchTraceEvent &event = capture[windowEvent];
+    char what[32];
+    DescribeEvent(event, what, sizeof(what));
+    trace.addLine(event.time, what);
+    unsigned long long loops = numLoops - windowLoops;
+    uint64_t cycles = HandlerCycles() - windowHandlerCycles;
+    if (profile) fprintf(profile, "%u,%s,%llu,%.1f,%.1f\n", event.time, what, loops, (double)cycles / HOST_CYCLES_PER_MICRO, (double)(now - windowStartCycle) / HOST_CYCLES_PER_MICRO);
+    if (loops>maxEventLoops) maxEventLoops = loops;
+    if (cycles>maxEventHandlerCycles) maxEventHandlerCycles = cycles;
+    totalEventLoops += loops;
+    totalEventHandlerCycles += cycles;
+    numEvents += 1;
+  };
+
+  // Passes through loop() that took longer than HOST_LOOP_STALL_US
+  uint64_t maxLoopCycles = 0;
+  unsigned long long numLoopStalls = 0;
+
+  setup();
+  uint64_t setupCycles = HostGetCycles();
+  // Boot is over at the end of the first pass through loop(), which
+  // enters attract mode (and flushes whatever setup() deferred)
+  uint64_t bootCycles = 0;
+  uint64_t bootEEPromWrites = 0;
+  size_t nextEvent = 0;
+  while (HostGetCycles()<endCycle) {
+    wavTrigger.update(HostGetCycles());
+    if (replay) {
+      uint64_t now = HostGetCycles();
+      replay->update(now);
+      while (nextEvent<capture.size() && (uint64_t)capture[nextEvent].time * (HOST_CPU_HZ/1000)<=now) {
+        if (capture[nextEvent].kind!=SWITCH_TRACE_LOST) {
+          if (windowEvent>=0) endWindow(now);
+          windowEvent = (int)nextEvent;
+          windowLoops = numLoops;
+          windowHandlerCycles = HandlerCycles();
+          windowStartCycle = now;
+        }
+        nextEvent += 1;
+      }
+    }
+    uint64_t loopStart = HostGetCycles() - HandlerCycles();
+    loop();
+    HostAdvanceCycles(loopCycles);
+    numLoops += 1;
+    uint64_t passCycles = HostGetCycles() - HandlerCycles() - loopStart;
+    if (passCycles>maxLoopCycles) maxLoopCycles = passCycles;
+    if (passCycles>(uint64_t)HOST_LOOP_STALL_US * HOST_CYCLES_PER_MICRO) numLoopStalls += 1;
+    if (numLoops==1) {
+      bootCycles = HostGetCycles();
+      bootEEPromWrites = HostGetStats()->eepromWrites;
+    }
+  }
+  if (windowEvent>=0) endWindow(HostGetCycles());
+  if (profile) fclose(profile);
+
+  double wallSeconds = WallSeconds() - wallStart;
+  double virtualSeconds = (double)HostGetCycles() / HOST_CPU_HZ;
+  const HostStats *stats = HostGetStats();
+  HostSerialFlushAll();
+
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Virtual time:      %.3f s (setup %.3f s)\n", virtualSeconds, (double)setupCycles / HOST_CPU_HZ);
+  fprintf(stderr, "Boot:              %.1f ms to the end of the first loop() pass (%.1f ms of it after setup), %llu EEPROM writes\n",
+          (double)bootCycles * 1000.0 / HOST_CPU_HZ, (double)(bootCycles - setupCycles) * 1000.0 / HOST_CPU_HZ, (unsigned long long)bootEEPromWrites);
+  fprintf(stderr, "Wall time:         %.3f s (%.1fx real time)\n", wallSeconds, wallSeconds>0 ? virtualSeconds / wallSeconds : 0.0);
+  fprintf(stderr, "loop() passes:     %llu (%.1f us each)\n", numLoops, numLoops ? (virtualSeconds - (double)setupCycles / HOST_CPU_HZ) * 1e6 / numLoops : 0.0);
+  fprintf(stderr, "Longest loop():    %.1f us outside handlers (%llu passes over %d us)\n", (double)maxLoopCycles / HOST_CYCLES_PER_MICRO, numLoopStalls, HOST_LOOP_STALL_US);
+  fprintf(stderr, "Timer1 interrupts: %llu (%.1f Hz)\n", (unsigned long long)stats->timer1Interrupts, virtualSeconds>0 ? stats->timer1Interrupts / virtualSeconds : 0.0);
+  fprintf(stderr, "Ext. interrupts:   %llu\n", (unsigned long long)stats->externalInterrupts);
+  fprintf(stderr, "Port accesses:     %llu reads, %llu writes\n", (unsigned long long)stats->portReads, (unsigned long long)stats->portWrites);
+  fprintf(stderr, "EEPROM writes:     %llu (%.1f ms stalled)\n", (unsigned long long)stats->eepromWrites, (double)stats->eepromWriteStallCycles * 1000.0 / HOST_CPU_HZ);
+  fprintf(stderr, "Serial bytes:      %llu (Serial), %llu (Serial1)\n", (unsigned long long)HostGetSerialBytesSent(0), (unsigned long long)HostGetSerialBytesSent(1));
+  fprintf(stderr, "Serial TX stalls:  %.1f ms (Serial), %.1f ms (Serial1)\n", (double)HostGetSerialTxStallCycles(0) * 1000.0 / HOST_CPU_HZ, (double)HostGetSerialTxStallCycles(1) * 1000.0 / HOST_CPU_HZ);
+  wavTrigger.report(stderr);
+  HostStderrDevice stderrDevice;
+  HostSetSerialDevice(0, &stderrDevice);
+  Audio.OutputAudioStats();
+  if (idleBus) return 0;
+
+  board.report(stderr);
+  if (replay) {
+    fprintf(stderr, "Replay:            %u of %u events (%u edges lost in capture%s)\n", numEvents, (unsigned)capture.size(), capture.getNumLost(), capture.isTruncated() ? ", capture truncated" : "");
+    if (numEvents) {
+      fprintf(stderr, "  per event:       %.1f loop() passes (max %llu), %.1f us in handlers (max %.1f)\n",
+              (double)totalEventLoops / numEvents, maxEventLoops,
+              (double)totalEventHandlerCycles / numEvents / HOST_CYCLES_PER_MICRO, (double)maxEventHandlerCycles / HOST_CYCLES_PER_MICRO);
+    }
+    fprintf(stderr, "  sound:           %u WAV Trigger frames (%u bad), %u sound board commands\n", wavTrigger.getNumFrames(), wavTrigger.getNumBadFrames(), board.getNumSoundCommands());
+    if (goldenPath) fprintf(stderr, "  golden trace:    %u lines, %u differ, %u missing\n", trace.getNumLines(), trace.getNumDifferences(), trace.getNumMissing());
+    delete replay;
+  }
+  if (board.getNumMismatches()) return 2;
+  if (trace.getNumDifferences() || trace.getNumMissing()) return 3;
+  return 0;
+}
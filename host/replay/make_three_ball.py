@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+# Writes three_ball.cap, a synthetic capture in the recorder's format (see
+# ../SwitchTrace.h): two coins, a start, then three balls of random
+# playfield hits (spinner runs, drop targets, the saucer, lanes and
+# slings), each ending in the outhole. Text lines are sprinkled in the
+# way the game's debug output would be.
+#
+# usage: make_three_ball.py [seed] > three_ball.cap
+#
+# The committed capture is seed 1. Its golden trace is rewritten with
+#   ../build/trident_host -r three_ball.cap -w trident_tracks.txt -q -g three_ball.golden
+# whenever a change to the game is meant to change what it does.
+
+import random
+import sys
+
+random.seed(int(sys.argv[1]) if len(sys.argv) > 1 else 1)
+
+events = []   # (ms, kind, switch or states)
+events.append((1312, 'state', [0, 0, 0, 0, 0x0E]))
+
+def hit(ms, switch, hold=40):
+    events.append((ms, 'c', switch))
+    events.append((ms + hold, 'o', switch))
+
+hit(3000, 1, 60)
+hit(4000, 5, 80)
+ms = 5000
+for ball in range(3):
+    # ball leaves the trough, sits in the shooter lane, gets plunged
+    events.append((ms, 'o', 35))
+    events.append((ms + 400, 'c', 37))
+    events.append((ms + 2500, 'o', 37))
+    ms += 3000
+    end = ms + random.randint(15000, 30000)
+    while ms < end:
+        r = random.random()
+        if r < 0.2:
+            switch = random.choice([3, 4])
+            for count in range(random.randint(3, 15)):
+                hit(ms, switch, 12)
+                ms += random.randint(30, 60)
+        elif r < 0.4:
+            hit(ms, random.choice([14, 15, 10, 11, 12, 13]), 25)
+        elif r < 0.6:
+            hit(ms, random.choice([27, 28, 29, 30, 31]), 30)
+        elif r < 0.7:
+            hit(ms, 25, 1500)
+            ms += 1600
+        elif r < 0.85:
+            hit(ms, random.choice([19, 20, 21, 22, 23, 9, 26]), 35)
+        else:
+            hit(ms, random.choice([17, 18]), 60)
+        ms += random.randint(200, 1500)
+    hit(ms, 32, 600)
+    events.append((ms + 1200, 'c', 35))
+    ms += 3000
+
+events.sort(key=lambda e: e[0])
+
+def time_bytes(delta):
+    out = bytearray()
+    while delta >= 0x80:
+        out.append((delta & 0x7F) | 0x80)
+        delta >>= 7
+    out.append(delta)
+    return out
+
+out = bytearray(b"boot text\n")
+last = 0
+for ms, kind, switch in events:
+    if kind == 'state':
+        out += bytes([0xFC, len(switch)]) + bytes(switch)
+    elif kind == 'c':
+        out.append(0x80 | switch)
+    else:
+        out += bytes([0xFD, switch])
+    out += time_bytes(ms - last)
+    last = ms
+    if random.random() < 0.05:
+        out += b"some debug text\n"
+sys.stdout.buffer.write(out)
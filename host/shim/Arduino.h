@@ -0,0 +1,121 @@
+// Host build stand-in for the Arduino core (ATmega2560 / Mega)
+// Only what the RPU firmware uses is here. Registers and pins are
+// backed by the virtual board in HostPlatform.cpp.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+#include "HostPlatform.h"
+
+// The firmware checks this to pick the Mega register layout
+#ifndef __AVR_ATmega2560__
+#define __AVR_ATmega2560__
+#endif
+
+#define HIGH          0x1
+#define LOW           0x0
+
+#define INPUT         0x0
+#define OUTPUT        0x1
+#define INPUT_PULLUP  0x2
+
+#define CHANGE        1
+#define FALLING       2
+#define RISING        3
+
+#define NOT_AN_INTERRUPT  -1
+
+#define A0  54
+#define A1  55
+#define A2  56
+#define A3  57
+#define A4  58
+#define A5  59
+#define A6  60
+#define A7  61
+#define A8  62
+#define A9  63
+#define A10 64
+#define A11 65
+#define A12 66
+#define A13 67
+#define A14 68
+#define A15 69
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(addr)   (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)   (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)  (*(const uint32_t *)(addr))
+#define memcpy_P  memcpy
+#define strcpy_P  strcpy
+
+#ifndef min
+#define min(a,b) ((a)<(b)?(a):(b))
+#endif
+#ifndef max
+#define max(a,b) ((a)>(b)?(a):(b))
+#endif
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+// I/O ports
+extern HostPortRegister PORTA, PORTB, PORTC, PORTD, PORTE, PORTF, PORTG, PORTH, PORTJ, PORTK, PORTL;
+extern HostPortRegister DDRA, DDRB, DDRC, DDRD, DDRE, DDRF, DDRG, DDRH, DDRJ, DDRK, DDRL;
+extern HostPortRegister PINA, PINB, PINC, PIND, PINE, PINF, PING, PINH, PINJ, PINK, PINL;
+
+// Timers (only Timer1 CTC with OCIE1A is modeled; Timer2 is accepted and ignored)
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t TCNT1, OCR1A;
+extern volatile uint8_t TCCR2A, TCCR2B, TIMSK2, OCR2A;
+
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define WGM12   3
+#define OCIE1A  1
+#define CS20    0
+#define CS21    1
+#define CS22    2
+#define WGM21   1
+#define OCIE2A  1
+
+// ISR(TIMER1_COMPA_vect) turns into a C function the platform calls
+#define ISR(vector, ...) extern "C" void vector(void)
+#define TIMER1_COMPA_vect HostTimer1CompAVector
+#define TIMER2_COMPA_vect HostTimer2CompAVector
+
+void interrupts();
+void noInterrupts();
+void cli();
+void sei();
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+#include "HardwareSerial.h"
+
+#endif
@@ -0,0 +1,36 @@
+// Host build stand-in for the AVR EEPROM library
+// The 4K array lives in HostPlatform.cpp, is loaded from / written
+// through to a file when one is given, and makes the next access wait
+// out the 3.4 ms an AVR EEPROM write takes.
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <stdint.h>
+#include "HostPlatform.h"
+
+uint8_t HostEEPromRead(int address);
+void HostEEPromWrite(int address, uint8_t value);
+
+struct EEPROMClass {
+  uint8_t read(int idx) { return HostEEPromRead(idx); }
+  void write(int idx, uint8_t val) { HostEEPromWrite(idx, val); }
+  void update(int idx, uint8_t val) { if (HostEEPromRead(idx)!=val) HostEEPromWrite(idx, val); }
+  uint16_t length() { return HOST_EEPROM_SIZE; }
+
+  template<typename T> T &get(int idx, T &t) {
+    uint8_t *ptr = (uint8_t *)&t;
+    for (int count=sizeof(T); count; --count, ++idx) *ptr++ = read(idx);
+    return t;
+  }
+
+  template<typename T> const T &put(int idx, const T &t) {
+    const uint8_t *ptr = (const uint8_t *)&t;
+    for (int count=sizeof(T); count; --count, ++idx) update(idx, *ptr++);
+    return t;
+  }
+};
+
+static EEPROMClass EEPROM;
+
+#endif
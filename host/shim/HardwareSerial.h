@@ -0,0 +1,75 @@
+// Host build stand-in for the AVR HardwareSerial class
+// Each port has the Arduino's 64-byte transmit buffer, which empties at
+// the configured baud rate in virtual time. write() blocks (by letting
+// virtual time run) when the buffer is full, just like the real thing.
+// Transmitted bytes go to whatever HostSerialDevice is attached.
+
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "HostPlatform.h"
+
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 64
+#endif
+
+#define HOST_SERIAL_WRITE_CYCLES  40
+
+class HardwareSerial {
+public:
+  HardwareSerial(uint8_t s_serialNum);
+
+  void begin(unsigned long baud);
+  void end() {}
+  int available();
+  int peek();
+  int read();
+  int availableForWrite();
+  void flush();
+
+  size_t write(uint8_t data);
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str);
+  size_t print(const char *str) { return write(str); }
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t print(int value) { return print((long)value); }
+  size_t print(unsigned int value) { return print((unsigned long)value); }
+  size_t println() { return write("\r\n"); }
+  template<typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  operator bool() { return true; }
+
+  // Host side
+  void setDevice(HostSerialDevice *s_device) { device = s_device; }
+  void receive(uint8_t data);
+  uint64_t getBytesSent() { return bytesSent; }
+  uint64_t getTxStallCycles() { return txStallCycles; }
+
+private:
+  uint8_t serialNum;
+  uint64_t cyclesPerByte;
+  // Cycle at which the last byte handed to the UART finishes going out
+  uint64_t txIdleCycle;
+  uint64_t bytesSent;
+  // Time the firmware spent waiting on a full transmit buffer (or flush())
+  uint64_t txStallCycles;
+  HostSerialDevice *device;
+
+  uint8_t rxBuffer[SERIAL_RX_BUFFER_SIZE];
+  uint8_t rxHead;
+  uint8_t rxTail;
+
+  unsigned int bytesInTxBuffer();
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif
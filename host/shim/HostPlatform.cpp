@@ -0,0 +1,751 @@
+// Virtual Arduino Mega 2560 for the host build (see HostPlatform.h)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Arduino.h"
+#include "EEPROM.h"
+
+// The firmware's interrupt handlers (weak, so a build without them links)
+extern "C" void HostTimer1CompAVector(void) __attribute__((weak));
+extern "C" void HostTimer2CompAVector(void) __attribute__((weak));
+
+// Longest stretch of virtual time that passes without looking at the
+// interrupt sources (keeps delay() from stepping over an IRQ), unless the
+// driver sets another with HostSetMaxTimeStep()
+#define HOST_MAX_TIME_STEP        160
+// External interrupt pins are sampled at most this often
+#define HOST_EXTERNAL_POLL_CYCLES 64
+#define HOST_PIN_CALL_CYCLES      50
+
+static uint64_t CurrentCycle = 0;
+// When HostAdvanceCycles() next has to look at the interrupts
+static uint64_t NextServiceCycle = 0;
+static bool InterruptsEnabled = false;
+static HostStats Stats;
+
+static uint8_t PortValue[HOST_NUM_PORTS];
+static uint8_t DdrValue[HOST_NUM_PORTS];
+
+static HostBus DefaultBus;
+static HostBus *Bus = &DefaultBus;
+
+
+/*********************************************************************
+    Default bus
+*********************************************************************/
+uint8_t HostBus::readPins(uint8_t port, uint64_t cycle) {
+  if (port==HOST_PORT_G) {
+    // phi2 from the MPU board
+    return ((cycle * 2 * HOST_PHI2_HZ / HOST_CPU_HZ) & 1) ? 0x04 : 0x00;
+  }
+  // IRQ (pin 2) is pulled up
+  if (port==HOST_PORT_E) return 0x10;
+  return 0x00;
+}
+
+uint64_t HostBus::nextPinChange(uint8_t port, uint64_t cycle) {
+  if (port==HOST_PORT_G) {
+    // Start of the next half period of phi2
+    uint64_t halfPeriods = cycle * 2 * HOST_PHI2_HZ / HOST_CPU_HZ;
+    return ((halfPeriods + 1) * HOST_CPU_HZ + 2 * HOST_PHI2_HZ - 1) / (2 * HOST_PHI2_HZ);
+  }
+  return 0;
+}
+
+void HostBus::portChanged(uint8_t, uint8_t, uint8_t, uint64_t) {
+}
+
+void HostSetBus(HostBus *bus) {
+  Bus = bus ? bus : &DefaultBus;
+}
+
+HostBus *HostGetBus() {
+  return Bus;
+}
+
+
+/*********************************************************************
+    Pins
+*********************************************************************/
+struct HostPinMap {
+  uint8_t port;
+  uint8_t mask;
+};
+
+// Arduino Mega digital pin number -> port & bit
+static const HostPinMap PinMap[70] = {
+  {HOST_PORT_E, 0x01}, {HOST_PORT_E, 0x02}, {HOST_PORT_E, 0x10}, {HOST_PORT_E, 0x20},   // 0-3
+  {HOST_PORT_G, 0x20}, {HOST_PORT_E, 0x08}, {HOST_PORT_H, 0x08}, {HOST_PORT_H, 0x10},   // 4-7
+  {HOST_PORT_H, 0x20}, {HOST_PORT_H, 0x40}, {HOST_PORT_B, 0x10}, {HOST_PORT_B, 0x20},   // 8-11
+  {HOST_PORT_B, 0x40}, {HOST_PORT_B, 0x80}, {HOST_PORT_J, 0x02}, {HOST_PORT_J, 0x01},   // 12-15
+  {HOST_PORT_H, 0x02}, {HOST_PORT_H, 0x01}, {HOST_PORT_D, 0x08}, {HOST_PORT_D, 0x04},   // 16-19
+  {HOST_PORT_D, 0x02}, {HOST_PORT_D, 0x01},                                             // 20-21
+  {HOST_PORT_A, 0x01}, {HOST_PORT_A, 0x02}, {HOST_PORT_A, 0x04}, {HOST_PORT_A, 0x08},   // 22-25
+  {HOST_PORT_A, 0x10}, {HOST_PORT_A, 0x20}, {HOST_PORT_A, 0x40}, {HOST_PORT_A, 0x80},   // 26-29
+  {HOST_PORT_C, 0x80}, {HOST_PORT_C, 0x40}, {HOST_PORT_C, 0x20}, {HOST_PORT_C, 0x10},   // 30-33
+  {HOST_PORT_C, 0x08}, {HOST_PORT_C, 0x04}, {HOST_PORT_C, 0x02}, {HOST_PORT_C, 0x01},   // 34-37
+  {HOST_PORT_D, 0x80}, {HOST_PORT_G, 0x04}, {HOST_PORT_G, 0x02}, {HOST_PORT_G, 0x01},   // 38-41
+  {HOST_PORT_L, 0x80}, {HOST_PORT_L, 0x40}, {HOST_PORT_L, 0x20}, {HOST_PORT_L, 0x10},   // 42-45
+  {HOST_PORT_L, 0x08}, {HOST_PORT_L, 0x04}, {HOST_PORT_L, 0x02}, {HOST_PORT_L, 0x01},   // 46-49
+  {HOST_PORT_B, 0x08}, {HOST_PORT_B, 0x04}, {HOST_PORT_B, 0x02}, {HOST_PORT_B, 0x01},   // 50-53
+  {HOST_PORT_F, 0x01}, {HOST_PORT_F, 0x02}, {HOST_PORT_F, 0x04}, {HOST_PORT_F, 0x08},   // A0-A3
+  {HOST_PORT_F, 0x10}, {HOST_PORT_F, 0x20}, {HOST_PORT_F, 0x40}, {HOST_PORT_F, 0x80},   // A4-A7
+  {HOST_PORT_K, 0x01}, {HOST_PORT_K, 0x02}, {HOST_PORT_K, 0x04}, {HOST_PORT_K, 0x08},   // A8-A11
+  {HOST_PORT_K, 0x10}, {HOST_PORT_K, 0x20}, {HOST_PORT_K, 0x40}, {HOST_PORT_K, 0x80}    // A12-A15
+};
+
+static uint8_t ReadPortPins(uint8_t port) {
+  uint8_t ddr = DdrValue[port];
+  if (ddr==0xFF) return PortValue[port];
+  return (Bus->readPins(port, CurrentCycle) & ~ddr) | (PortValue[port] & ddr);
+}
+
+// The last PIN register read, for spotting a spin
+static bool FastSpin = false;
+static uint8_t SpinPort = HOST_NUM_PORTS;
+static uint8_t SpinValue = 0;
+static uint64_t SpinCycle = 0;
+
+// Called with the access already charged and read as value. When the
+// same register has read the same on the access just before, with nothing
+// else charged in between, the firmware is waiting for it to change: move
+// on to the first access (at the same spacing) that sees the change,
+// charging the accesses in between.
+static uint8_t SkipSpin(uint8_t port, uint8_t value) {
+  if (!FastSpin) return value;
+  bool repeated = (port==SpinPort && value==SpinValue && CurrentCycle==SpinCycle + HOST_PORT_ACCESS_CYCLES);
+  SpinPort = port;
+  SpinValue = value;
+  SpinCycle = CurrentCycle;
+  if (!repeated || DdrValue[port]==0xFF) return value;
+
+  uint8_t ddr = DdrValue[port];
+  uint64_t cycle = CurrentCycle;
+  while (true) {
+    uint64_t change = Bus->nextPinChange(port, cycle);
+    if (change<=cycle) return value;
+    uint64_t accesses = (change - CurrentCycle + HOST_PORT_ACCESS_CYCLES - 1) / HOST_PORT_ACCESS_CYCLES;
+    cycle = CurrentCycle + accesses * HOST_PORT_ACCESS_CYCLES;
+    // Every access in between has to have stayed clear of the interrupts
+    if (cycle>=NextServiceCycle) return value;
+    uint8_t newValue = (Bus->readPins(port, cycle) & ~ddr) | (PortValue[port] & ddr);
+    if (newValue!=value) {
+      Stats.portReads += accesses;
+      CurrentCycle = cycle;
+      SpinPort = HOST_NUM_PORTS;
+      return newValue;
+    }
+  }
+}
+
+void HostSetFastSpin(bool fastSpin) {
+  FastSpin = fastSpin;
+}
+
+static void SetPortValue(uint8_t port, uint8_t value) {
+  PortValue[port] = value;
+  Bus->portChanged(port, PortValue[port], DdrValue[port], CurrentCycle);
+}
+
+static void SetDdrValue(uint8_t port, uint8_t value) {
+  DdrValue[port] = value;
+  Bus->portChanged(port, PortValue[port], DdrValue[port], CurrentCycle);
+}
+
+uint8_t HostGetPortValue(uint8_t port) {
+  return PortValue[port];
+}
+
+uint8_t HostGetDdrValue(uint8_t port) {
+  return DdrValue[port];
+}
+
+bool HostReadPinLevel(uint8_t pin) {
+  if (pin>=70) return false;
+  return (ReadPortPins(PinMap[pin].port) & PinMap[pin].mask) ? true : false;
+}
+
+HostPortRegister::operator uint8_t() const {
+  HostAdvanceCycles(HOST_PORT_ACCESS_CYCLES);
+  Stats.portReads += 1;
+  if (kind==HOST_REGISTER_PORT) return PortValue[port];
+  if (kind==HOST_REGISTER_DDR) return DdrValue[port];
+  return SkipSpin(port, ReadPortPins(port));
+}
+
+HostPortRegister &HostPortRegister::operator=(uint8_t value) {
+  HostAdvanceCycles(HOST_PORT_ACCESS_CYCLES);
+  Stats.portWrites += 1;
+  if (kind==HOST_REGISTER_PORT) SetPortValue(port, value);
+  else if (kind==HOST_REGISTER_DDR) SetDdrValue(port, value);
+  else SetPortValue(port, PortValue[port] ^ value);  // writing PINx toggles PORTx
+  return *this;
+}
+
+#define HOST_DEFINE_PORT(letter, num) \
+  HostPortRegister PORT##letter(num, HOST_REGISTER_PORT); \
+  HostPortRegister DDR##letter(num, HOST_REGISTER_DDR); \
+  HostPortRegister PIN##letter(num, HOST_REGISTER_PIN);
+
+HOST_DEFINE_PORT(A, HOST_PORT_A)
+HOST_DEFINE_PORT(B, HOST_PORT_B)
+HOST_DEFINE_PORT(C, HOST_PORT_C)
+HOST_DEFINE_PORT(D, HOST_PORT_D)
+HOST_DEFINE_PORT(E, HOST_PORT_E)
+HOST_DEFINE_PORT(F, HOST_PORT_F)
+HOST_DEFINE_PORT(G, HOST_PORT_G)
+HOST_DEFINE_PORT(H, HOST_PORT_H)
+HOST_DEFINE_PORT(J, HOST_PORT_J)
+HOST_DEFINE_PORT(K, HOST_PORT_K)
+HOST_DEFINE_PORT(L, HOST_PORT_L)
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin>=70) return;
+  HostAdvanceCycles(HOST_PIN_CALL_CYCLES);
+  const HostPinMap &map = PinMap[pin];
+  if (mode==OUTPUT) {
+    SetDdrValue(map.port, DdrValue[map.port] | map.mask);
+  } else {
+    SetDdrValue(map.port, DdrValue[map.port] & ~map.mask);
+    if (mode==INPUT_PULLUP) SetPortValue(map.port, PortValue[map.port] | map.mask);
+    else SetPortValue(map.port, PortValue[map.port] & ~map.mask);
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin>=70) return;
+  HostAdvanceCycles(HOST_PIN_CALL_CYCLES);
+  const HostPinMap &map = PinMap[pin];
+  if (val==LOW) SetPortValue(map.port, PortValue[map.port] & ~map.mask);
+  else SetPortValue(map.port, PortValue[map.port] | map.mask);
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin>=70) return LOW;
+  HostAdvanceCycles(HOST_PIN_CALL_CYCLES);
+  return HostReadPinLevel(pin) ? HIGH : LOW;
+}
+
+
+/*********************************************************************
+    Timers & interrupts
+*********************************************************************/
+volatile uint8_t TCCR1A = 0, TCCR1B = 0, TIMSK1 = 0;
+volatile uint16_t TCNT1 = 0, OCR1A = 0;
+volatile uint8_t TCCR2A = 0, TCCR2B = 0, TIMSK2 = 0, OCR2A = 0;
+
+// Timer1 state as of the last time the registers were looked at
+static uint8_t Timer1Control = 0;
+static uint16_t Timer1Compare = 0;
+static uint64_t Timer1Period = 0;
+static uint64_t Timer1NextMatch = 0;
+static bool Timer1Pending = false;
+static uint64_t MaxTimeStep = HOST_MAX_TIME_STEP;
+
+// External interrupts INT0-INT5 (pins 2, 3, 21, 20, 19, 18)
+static const uint8_t ExternalInterruptPin[HOST_NUM_EXTERNAL_INTERRUPTS] = {2, 3, 21, 20, 19, 18};
+static void (*ExternalInterruptFunc[HOST_NUM_EXTERNAL_INTERRUPTS])(void);
+static int ExternalInterruptMode[HOST_NUM_EXTERNAL_INTERRUPTS];
+static bool ExternalInterruptLastLevel[HOST_NUM_EXTERNAL_INTERRUPTS];
+static bool ExternalInterruptPending[HOST_NUM_EXTERNAL_INTERRUPTS];
+static uint8_t NumExternalInterrupts = 0;
+static uint64_t LastExternalPoll = 0;
+
+static uint64_t Timer1Prescaler(uint8_t control) {
+  switch (control & 0x07) {
+    case 1: return 1;
+    case 2: return 8;
+    case 3: return 64;
+    case 4: return 256;
+    case 5: return 1024;
+  }
+  return 0;
+}
+
+static void UpdateTimer1() {
+  uint8_t control = TCCR1B;
+  uint16_t compare = OCR1A;
+  if (control!=Timer1Control || compare!=Timer1Compare) {
+    // Re-programmed: start counting from zero again
+    Timer1Control = control;
+    Timer1Compare = compare;
+    uint64_t prescaler = Timer1Prescaler(control);
+    Timer1Period = (prescaler && (control & (1<<WGM12))) ? ((uint64_t)compare + 1) * prescaler : 0;
+    Timer1NextMatch = CurrentCycle + Timer1Period;
+  }
+  if (Timer1Period==0) return;
+
+  if (CurrentCycle>=Timer1NextMatch) {
+    // The flag only holds one interrupt; anything more is lost
+    if (TIMSK1 & (1<<OCIE1A)) Timer1Pending = true;
+    uint64_t missed = (CurrentCycle - Timer1NextMatch) / Timer1Period;
+    Timer1NextMatch += (missed + 1) * Timer1Period;
+  }
+}
+
+static void PollExternalInterrupts() {
+  for (uint8_t count=0; count<HOST_NUM_EXTERNAL_INTERRUPTS; count++) {
+    if (ExternalInterruptFunc[count]==NULL) continue;
+    bool level = HostReadPinLevel(ExternalInterruptPin[count]);
+    bool lastLevel = ExternalInterruptLastLevel[count];
+    ExternalInterruptLastLevel[count] = level;
+    switch (ExternalInterruptMode[count]) {
+      case LOW: ExternalInterruptPending[count] = !level; break;
+      case CHANGE: if (level!=lastLevel) ExternalInterruptPending[count] = true; break;
+      case FALLING: if (!level && lastLevel) ExternalInterruptPending[count] = true; break;
+      case RISING: if (level && !lastLevel) ExternalInterruptPending[count] = true; break;
+    }
+  }
+}
+
+static void ServiceInterrupts();
+
+// Interrupts have been off since this cycle (if they are)
+static uint64_t InterruptsOffCycle = 0;
+
+static void SetInterruptsEnabled(bool enabled) {
+  if (enabled==InterruptsEnabled) return;
+  InterruptsEnabled = enabled;
+  if (!enabled) {
+    InterruptsOffCycle = CurrentCycle;
+  } else if (CurrentCycle - InterruptsOffCycle>Stats.maxInterruptsOffCycles) {
+    Stats.maxInterruptsOffCycles = CurrentCycle - InterruptsOffCycle;
+  }
+}
+
+// Handlers running now, innermost last
+struct HostHandlerFrame {
+  uint8_t vector;
+  uint64_t startCycle;
+  uint64_t nestedCycles;
+};
+static HostHandlerFrame HandlerStack[HOST_MAX_INTERRUPT_DEPTH];
+static uint8_t HandlerDepth = 0;
+
+// An ISR runs with interrupts off. If it turns them back on, other
+// sources (or a LOW level source that is still asserted) can nest.
+static void RunHandler(uint8_t vector, void (*handler)(void)) {
+  HostVectorStats &vectorStats = Stats.vectors[vector];
+  vectorStats.calls += 1;
+  if (HandlerDepth) vectorStats.nestedCalls += 1;
+
+  bool wasEnabled = InterruptsEnabled;
+  SetInterruptsEnabled(false);
+  HostHandlerFrame &frame = HandlerStack[HandlerDepth++];
+  frame.vector = vector;
+  frame.startCycle = CurrentCycle;
+  frame.nestedCycles = 0;
+  Bus->interruptEntered(vector, CurrentCycle);
+
+  HostAdvanceCycles(HOST_ISR_ENTRY_CYCLES);
+  handler();
+
+  Bus->interruptExited(vector, CurrentCycle);
+  HandlerDepth -= 1;
+  uint64_t inclusive = CurrentCycle - frame.startCycle;
+  uint64_t exclusive = inclusive - frame.nestedCycles;
+  if (HandlerDepth) HandlerStack[HandlerDepth-1].nestedCycles += inclusive;
+  vectorStats.totalCycles += exclusive;
+  if (exclusive>vectorStats.maxCycles) vectorStats.maxCycles = exclusive;
+  if (inclusive>vectorStats.maxInclusiveCycles) vectorStats.maxInclusiveCycles = inclusive;
+  SetInterruptsEnabled(wasEnabled);
+}
+
+uint8_t HostGetCurrentVector() {
+  return HandlerDepth ? HandlerStack[HandlerDepth-1].vector : HOST_VECTOR_NONE;
+}
+
+// Works out when HostAdvanceCycles next has to look at the interrupts
+static void ScheduleNextService() {
+  uint64_t next = CurrentCycle + MaxTimeStep;
+  // (a match with the interrupt masked only moves the next match along,
+  // which UpdateTimer1() catches up on whenever it next runs)
+  if (Timer1Period && (TIMSK1 & (1<<OCIE1A)) && Timer1NextMatch<next) next = Timer1NextMatch;
+  if (NumExternalInterrupts && LastExternalPoll + HOST_EXTERNAL_POLL_CYCLES<next) {
+    next = LastExternalPoll + HOST_EXTERNAL_POLL_CYCLES;
+  }
+  NextServiceCycle = next;
+}
+
+void HostSetMaxTimeStep(uint64_t cycles) {
+  MaxTimeStep = cycles ? cycles : HOST_MAX_TIME_STEP;
+  ScheduleNextService();
+}
+
+void HostSetTimer1NextMatch(uint64_t cycle) {
+  UpdateTimer1();
+  Timer1NextMatch = cycle;
+  ScheduleNextService();
+}
+
+void HostServiceInterrupts() {
+  ServiceInterrupts();
+  ScheduleNextService();
+}
+
+static void ServiceInterrupts() {
+  UpdateTimer1();
+  if (NumExternalInterrupts && (CurrentCycle - LastExternalPoll)>=HOST_EXTERNAL_POLL_CYCLES) {
+    LastExternalPoll = CurrentCycle;
+    PollExternalInterrupts();
+  }
+  if (!InterruptsEnabled || HandlerDepth>=HOST_MAX_INTERRUPT_DEPTH) return;
+
+  // Same priority order as the AVR vector table: INT0-5, then Timer1
+  for (uint8_t count=0; count<HOST_NUM_EXTERNAL_INTERRUPTS; count++) {
+    if (!ExternalInterruptPending[count]) continue;
+    // A level interrupt isn't latched, so it has to still be asserted
+    if (ExternalInterruptMode[count]==LOW && HostReadPinLevel(ExternalInterruptPin[count])) {
+      ExternalInterruptPending[count] = false;
+      continue;
+    }
+    ExternalInterruptPending[count] = false;
+    Stats.externalInterrupts += 1;
+    RunHandler(count, ExternalInterruptFunc[count]);
+    if (!InterruptsEnabled) return;
+  }
+  if (Timer1Pending) {
+    Timer1Pending = false;
+    if (HostTimer1CompAVector) {
+      Stats.timer1Interrupts += 1;
+      RunHandler(HOST_VECTOR_TIMER1, HostTimer1CompAVector);
+    }
+  }
+}
+
+uint64_t HostGetCycles() {
+  return CurrentCycle;
+}
+
+void HostAdvanceCycles(uint64_t cycles) {
+  // Most calls (port accesses) land between interrupt checks
+  if (CurrentCycle + cycles < NextServiceCycle) {
+    CurrentCycle += cycles;
+    return;
+  }
+  while (cycles) {
+    uint64_t step = (cycles>MaxTimeStep) ? MaxTimeStep : cycles;
+    if (NextServiceCycle>CurrentCycle && (NextServiceCycle-CurrentCycle)<step) {
+      step = NextServiceCycle - CurrentCycle;
+    }
+    CurrentCycle += step;
+    cycles -= step;
+    if (CurrentCycle>=NextServiceCycle) HostServiceInterrupts();
+  }
+}
+
+void interrupts() {
+  SetInterruptsEnabled(true);
+  HostServiceInterrupts();
+}
+
+void noInterrupts() {
+  SetInterruptsEnabled(false);
+}
+
+void sei() {
+  interrupts();
+}
+
+void cli() {
+  noInterrupts();
+}
+
+int digitalPinToInterrupt(uint8_t pin) {
+  for (uint8_t count=0; count<HOST_NUM_EXTERNAL_INTERRUPTS; count++) {
+    if (ExternalInterruptPin[count]==pin) return count;
+  }
+  return NOT_AN_INTERRUPT;
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode) {
+  if (interruptNum>=HOST_NUM_EXTERNAL_INTERRUPTS) return;
+  if (ExternalInterruptFunc[interruptNum]==NULL && userFunc) NumExternalInterrupts += 1;
+  ExternalInterruptFunc[interruptNum] = userFunc;
+  ExternalInterruptMode[interruptNum] = mode;
+  ExternalInterruptLastLevel[interruptNum] = HostReadPinLevel(ExternalInterruptPin[interruptNum]);
+  ExternalInterruptPending[interruptNum] = false;
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+  if (interruptNum>=HOST_NUM_EXTERNAL_INTERRUPTS || ExternalInterruptFunc[interruptNum]==NULL) return;
+  ExternalInterruptFunc[interruptNum] = NULL;
+  ExternalInterruptPending[interruptNum] = false;
+  NumExternalInterrupts -= 1;
+}
+
+
+/*********************************************************************
+    Time
+*********************************************************************/
+// These wrap at 32 bits, like they do on the AVR
+unsigned long millis() {
+  HostAdvanceCycles(HOST_MICROS_CALL_CYCLES);
+  return (uint32_t)(CurrentCycle / (HOST_CPU_HZ/1000));
+}
+
+unsigned long micros() {
+  HostAdvanceCycles(HOST_MICROS_CALL_CYCLES);
+  return (uint32_t)(CurrentCycle / HOST_CYCLES_PER_MICRO);
+}
+
+void delay(unsigned long ms) {
+  HostAdvanceCycles((uint64_t)ms * (HOST_CPU_HZ/1000));
+}
+
+void delayMicroseconds(unsigned int us) {
+  HostAdvanceCycles((uint64_t)us * HOST_CYCLES_PER_MICRO);
+}
+
+
+/*********************************************************************
+    Random numbers (same algorithm as avr-libc, so sequences match)
+*********************************************************************/
+static uint32_t RandomState = 1;
+
+static long NextRandom() {
+  // Park-Miller "minimal standard" as used by avr-libc random()
+  int32_t hi, lo, x;
+  x = (int32_t)RandomState;
+  if (x==0) x = 123459876;
+  hi = x / 127773;
+  lo = x % 127773;
+  x = 16807 * lo - 2836 * hi;
+  if (x<0) x += 0x7fffffff;
+  RandomState = (uint32_t)x;
+  return x % ((uint32_t)0x7fffffff + 1);
+}
+
+long random(long howbig) {
+  if (howbig==0) return 0;
+  return NextRandom() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall>=howbig) return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed!=0) RandomState = (uint32_t)seed;
+}
+
+
+/*********************************************************************
+    Serial ports
+*********************************************************************/
+// Serial (the USB port) goes to stdout unless the driver says otherwise
+class HostStdoutDevice : public HostSerialDevice {
+public:
+  void transmitted(uint8_t data, uint64_t) { fputc(data, stdout); }
+};
+static HostStdoutDevice StdoutDevice;
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+HardwareSerial Serial3(3);
+
+static HardwareSerial *SerialPorts[4] = {&Serial, &Serial1, &Serial2, &Serial3};
+
+HardwareSerial::HardwareSerial(uint8_t s_serialNum) {
+  serialNum = s_serialNum;
+  cyclesPerByte = 0;
+  txIdleCycle = 0;
+  bytesSent = 0;
+  txStallCycles = 0;
+  device = (s_serialNum==0) ? &StdoutDevice : NULL;
+  rxHead = 0;
+  rxTail = 0;
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  // 8N1 = 10 bits per byte
+  if (baud) cyclesPerByte = (10ULL * HOST_CPU_HZ) / baud;
+}
+
+unsigned int HardwareSerial::bytesInTxBuffer() {
+  if (cyclesPerByte==0 || txIdleCycle<=CurrentCycle) return 0;
+  // The byte in the shift register has already left the buffer
+  uint64_t inFlight = (txIdleCycle - CurrentCycle + cyclesPerByte - 1) / cyclesPerByte;
+  return (unsigned int)(inFlight - 1);
+}
+
+int HardwareSerial::availableForWrite() {
+  HostAdvanceCycles(HOST_PORT_ACCESS_CYCLES * 8);
+  return (SERIAL_TX_BUFFER_SIZE - 1) - (int)bytesInTxBuffer();
+}
+
+size_t HardwareSerial::write(uint8_t data) {
+  HostAdvanceCycles(HOST_SERIAL_WRITE_CYCLES);
+  if (cyclesPerByte) {
+    // Buffer full: spin until the UART frees a slot
+    uint64_t maxBacklog = (uint64_t)SERIAL_TX_BUFFER_SIZE * cyclesPerByte;
+    if (txIdleCycle>CurrentCycle + maxBacklog) {
+      txStallCycles += txIdleCycle - CurrentCycle - maxBacklog;
+      HostAdvanceCycles(txIdleCycle - CurrentCycle - maxBacklog);
+    }
+    if (txIdleCycle<CurrentCycle) txIdleCycle = CurrentCycle;
+    txIdleCycle += cyclesPerByte;
+  }
+  bytesSent += 1;
+  if (device) device->transmitted(data, cyclesPerByte ? txIdleCycle : CurrentCycle);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  for (size_t count=0; count<size; count++) write(buffer[count]);
+  return size;
+}
+
+size_t HardwareSerial::write(const char *str) {
+  if (str==NULL) return 0;
+  return write((const uint8_t *)str, strlen(str));
+}
+
+size_t HardwareSerial::print(long value) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%ld", value);
+  return write(buf);
+}
+
+size_t HardwareSerial::print(unsigned long value) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%lu", value);
+  return write(buf);
+}
+
+void HardwareSerial::flush() {
+  if (txIdleCycle>CurrentCycle) {
+    txStallCycles += txIdleCycle - CurrentCycle;
+    HostAdvanceCycles(txIdleCycle - CurrentCycle);
+  }
+}
+
+int HardwareSerial::available() {
+  HostAdvanceCycles(HOST_PORT_ACCESS_CYCLES * 8);
+  return (SERIAL_RX_BUFFER_SIZE + rxHead - rxTail) % SERIAL_RX_BUFFER_SIZE;
+}
+
+int HardwareSerial::peek() {
+  if (rxHead==rxTail) return -1;
+  return rxBuffer[rxTail];
+}
+
+int HardwareSerial::read() {
+  HostAdvanceCycles(HOST_PORT_ACCESS_CYCLES * 8);
+  if (rxHead==rxTail) return -1;
+  uint8_t data = rxBuffer[rxTail];
+  rxTail = (rxTail + 1) % SERIAL_RX_BUFFER_SIZE;
+  return data;
+}
+
+void HardwareSerial::receive(uint8_t data) {
+  uint8_t nextHead = (rxHead + 1) % SERIAL_RX_BUFFER_SIZE;
+  // Overrun drops the byte, as the AVR core does
+  if (nextHead==rxTail) return;
+  rxBuffer[rxHead] = data;
+  rxHead = nextHead;
+}
+
+void HostSetSerialDevice(uint8_t serialNum, HostSerialDevice *device) {
+  if (serialNum<4) SerialPorts[serialNum]->setDevice(device);
+}
+
+void HostSerialReceive(uint8_t serialNum, uint8_t data) {
+  if (serialNum<4) SerialPorts[serialNum]->receive(data);
+}
+
+void HostSerialFlushAll() {
+  fflush(stdout);
+}
+
+uint64_t HostGetSerialBytesSent(uint8_t serialNum) {
+  if (serialNum>=4) return 0;
+  return SerialPorts[serialNum]->getBytesSent();
+}
+
+uint64_t HostGetSerialTxStallCycles(uint8_t serialNum) {
+  if (serialNum>=4) return 0;
+  return SerialPorts[serialNum]->getTxStallCycles();
+}
+
+
+/*********************************************************************
+    EEPROM
+*********************************************************************/
+static uint8_t EEPromImage[HOST_EEPROM_SIZE];
+static uint32_t EEPromWriteCount[HOST_EEPROM_SIZE];
+static FILE *EEPromFile = NULL;
+static uint64_t EEPromBusyUntil = 0;
+static bool EEPromInitialized = false;
+
+static void InitEEProm() {
+  if (EEPromInitialized) return;
+  memset(EEPromImage, 0xFF, sizeof(EEPromImage));
+  EEPromInitialized = true;
+}
+
+bool HostOpenEEProm(const char *path) {
+  InitEEProm();
+  if (EEPromFile) fclose(EEPromFile);
+  EEPromFile = fopen(path, "r+b");
+  if (EEPromFile) {
+    size_t numRead = fread(EEPromImage, 1, HOST_EEPROM_SIZE, EEPromFile);
+    if (numRead<HOST_EEPROM_SIZE) memset(EEPromImage + numRead, 0xFF, HOST_EEPROM_SIZE - numRead);
+  } else {
+    EEPromFile = fopen(path, "w+b");
+    if (EEPromFile==NULL) return false;
+  }
+  // Make sure the file holds the whole image
+  fseek(EEPromFile, 0, SEEK_SET);
+  fwrite(EEPromImage, 1, HOST_EEPROM_SIZE, EEPromFile);
+  fflush(EEPromFile);
+  return true;
+}
+
+// Reads and writes wait for a write in progress, like EEPE on the AVR
+static void WaitForEEProm() {
+  if (EEPromBusyUntil>CurrentCycle) {
+    Stats.eepromWriteStallCycles += EEPromBusyUntil - CurrentCycle;
+    HostAdvanceCycles(EEPromBusyUntil - CurrentCycle);
+  }
+}
+
+uint8_t HostEEPromRead(int address) {
+  InitEEProm();
+  WaitForEEProm();
+  HostAdvanceCycles(HOST_PORT_ACCESS_CYCLES * 8);
+  return EEPromImage[address & (HOST_EEPROM_SIZE-1)];
+}
+
+void HostEEPromWrite(int address, uint8_t value) {
+  InitEEProm();
+  WaitForEEProm();
+  HostAdvanceCycles(HOST_PORT_ACCESS_CYCLES * 8);
+  address &= (HOST_EEPROM_SIZE-1);
+  EEPromImage[address] = value;
+  EEPromWriteCount[address] += 1;
+  Stats.eepromWrites += 1;
+  EEPromBusyUntil = CurrentCycle + HOST_EEPROM_WRITE_CYCLES;
+  if (EEPromFile) {
+    fseek(EEPromFile, address, SEEK_SET);
+    fputc(value, EEPromFile);
+    fflush(EEPromFile);
+  }
+}
+
+uint64_t HostGetEEPromWrites(unsigned short address) {
+  if (address>=HOST_EEPROM_SIZE) return 0;
+  return EEPromWriteCount[address];
+}
+
+const HostStats *HostGetStats() {
+  return &Stats;
+}
+
+void HostResetStats() {
+  memset(&Stats, 0, sizeof(Stats));
+  InterruptsOffCycle = CurrentCycle;
+}
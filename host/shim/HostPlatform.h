@@ -0,0 +1,172 @@
+// Host (Linux) stand-in for the parts of the Arduino Mega 2560 that the
+// firmware touches. Time is virtual and counted in CPU cycles (16 MHz):
+// it only moves when the code reads a port, asks for the time, delays,
+// waits on the EEPROM or a UART, or when the driver charges a pass
+// through loop(). Timer1 and the external interrupts are delivered
+// between those steps, the same places an AVR could take them.
+
+#ifndef HOST_PLATFORM_H
+#define HOST_PLATFORM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HOST_CPU_HZ               16000000UL
+#define HOST_CYCLES_PER_MICRO     16
+
+// What the shim charges for things the firmware does
+#define HOST_PORT_ACCESS_CYCLES   1
+#define HOST_MICROS_CALL_CYCLES   60
+#define HOST_EEPROM_WRITE_CYCLES  54400   // 3.4 ms
+#define HOST_ISR_ENTRY_CYCLES     40
+
+// 6800 clock seen on PG2 by the default bus
+#ifndef HOST_PHI2_HZ
+#define HOST_PHI2_HZ              1000000UL
+#endif
+
+#define HOST_PORT_A   0
+#define HOST_PORT_B   1
+#define HOST_PORT_C   2
+#define HOST_PORT_D   3
+#define HOST_PORT_E   4
+#define HOST_PORT_F   5
+#define HOST_PORT_G   6
+#define HOST_PORT_H   7
+#define HOST_PORT_J   8
+#define HOST_PORT_K   9
+#define HOST_PORT_L   10
+#define HOST_NUM_PORTS  11
+
+#define HOST_NUM_EXTERNAL_INTERRUPTS  6
+#define HOST_EEPROM_SIZE              4096
+
+// Interrupt vectors the shim delivers (INT0-5 share numbers with
+// attachInterrupt)
+#define HOST_VECTOR_TIMER1            6
+#define HOST_NUM_VECTORS              7
+#define HOST_VECTOR_NONE              0xFF
+// How deeply handlers may nest (a LOW level interrupt re-enters its
+// handler if the handler turns interrupts back on with the line still low)
+#define HOST_MAX_INTERRUPT_DEPTH      4
+
+
+// Whatever is wired to the Arduino's pins. The default bus models an
+// idle MPU board: the 6800 clock runs on PG2, the IRQ line (PE4) is
+// pulled high and every other input (including the data bus) reads 0,
+// so no switches are closed and no PIA interrupts are pending.
+class HostBus {
+public:
+  virtual ~HostBus() {}
+  // Levels on the port's pins (only bits set as inputs are used)
+  virtual uint8_t readPins(uint8_t port, uint64_t cycle);
+  // The first cycle after this one at which readPins() for the port can
+  // read differently, or 0 if that isn't known ahead (see
+  // HostSetFastSpin()). The default bus knows phi2 on port G; a bus that
+  // reads port G some other way has to override this too.
+  virtual uint64_t nextPinChange(uint8_t port, uint64_t cycle);
+  // Called after PORTx or DDRx is written
+  virtual void portChanged(uint8_t port, uint8_t portValue, uint8_t ddrValue, uint64_t cycle);
+  // Called around each interrupt handler (HOST_VECTOR_x)
+  virtual void interruptEntered(uint8_t vector, uint64_t cycle) {}
+  virtual void interruptExited(uint8_t vector, uint64_t cycle) {}
+};
+
+
+// Bytes written to a HardwareSerial arrive here as they finish leaving
+// the UART (at its baud rate)
+class HostSerialDevice {
+public:
+  virtual ~HostSerialDevice() {}
+  virtual void transmitted(uint8_t data, uint64_t cycle) = 0;
+};
+
+
+// A register that acts like an AVR I/O register but lets the shim see
+// every access
+#define HOST_REGISTER_PORT  0
+#define HOST_REGISTER_DDR   1
+#define HOST_REGISTER_PIN   2
+
+class HostPortRegister {
+public:
+  HostPortRegister(uint8_t s_port, uint8_t s_kind) : port(s_port), kind(s_kind) {}
+  operator uint8_t() const;
+  HostPortRegister &operator=(uint8_t value);
+  HostPortRegister &operator=(const HostPortRegister &other) { return (*this = (uint8_t)other); }
+  HostPortRegister &operator|=(uint8_t value) { return (*this = (uint8_t)(((uint8_t)*this) | value)); }
+  HostPortRegister &operator&=(uint8_t value) { return (*this = (uint8_t)(((uint8_t)*this) & value)); }
+  HostPortRegister &operator^=(uint8_t value) { return (*this = (uint8_t)(((uint8_t)*this) ^ value)); }
+
+private:
+  uint8_t port;
+  uint8_t kind;
+};
+
+
+struct HostVectorStats {
+  uint64_t calls;
+  uint64_t nestedCalls;
+  // Exclusive of any handler that nested inside this one
+  uint64_t totalCycles;
+  uint64_t maxCycles;
+  // Including nested handlers
+  uint64_t maxInclusiveCycles;
+};
+
+struct HostStats {
+  uint64_t timer1Interrupts;
+  uint64_t externalInterrupts;
+  uint64_t portReads;
+  uint64_t portWrites;
+  uint64_t eepromWrites;
+  uint64_t eepromWriteStallCycles;
+  // Longest stretch with interrupts off (in a handler or not)
+  uint64_t maxInterruptsOffCycles;
+  HostVectorStats vectors[HOST_NUM_VECTORS];
+};
+
+
+// Time
+uint64_t HostGetCycles();
+void HostAdvanceCycles(uint64_t cycles);
+// Runs any interrupts that are due (the driver calls this between passes
+// through loop(); the shim calls it whenever time moves)
+void HostServiceInterrupts();
+// The innermost handler running now, or HOST_VECTOR_NONE
+uint8_t HostGetCurrentVector();
+// How far time may move without a look at the interrupts (0 = the
+// default). Only safe to raise once nothing is polled: Timer1 matches
+// are scheduled exactly, external interrupt pins are not.
+void HostSetMaxTimeStep(uint64_t cycles);
+// Moves Timer1's next compare match to this cycle, as though TCNT1 had
+// been written (to line the display interrupt up with something else)
+void HostSetTimer1NextMatch(uint64_t cycle);
+
+// Hardware
+void HostSetBus(HostBus *bus);
+HostBus *HostGetBus();
+// With fast spin on, a PIN register that reads the same on back to back
+// accesses (the firmware spinning on phi2) jumps straight to the first
+// access that reads differently, as long as no interrupt check falls in
+// between. The cycles and port reads charged are the ones the spin
+// would have taken, so it only saves host time.
+void HostSetFastSpin(bool fastSpin);
+uint8_t HostGetPortValue(uint8_t port);
+uint8_t HostGetDdrValue(uint8_t port);
+bool HostReadPinLevel(uint8_t pin);
+void HostSetSerialDevice(uint8_t serialNum, HostSerialDevice *device);
+void HostSerialReceive(uint8_t serialNum, uint8_t data);
+void HostSerialFlushAll();
+uint64_t HostGetSerialBytesSent(uint8_t serialNum);
+// Cycles spent blocked in write() or flush() on this port
+uint64_t HostGetSerialTxStallCycles(uint8_t serialNum);
+
+// EEPROM (backed by a file, if one is given)
+bool HostOpenEEProm(const char *path);
+uint64_t HostGetEEPromWrites(unsigned short address);
+
+const HostStats *HostGetStats();
+void HostResetStats();
+
+#endif